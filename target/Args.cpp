@@ -36,6 +36,10 @@ Args::Args (int argc, char *argv[])
                           value<double> ()->default_value ("100"), "<speed>");
   options.add_options () ("d,duration-ns", "Simulation duration in nanoseconds",
                           value<uint64_t> ()->default_value ("0"), "<time>");
+  options.add_options () ("tck-ratio",
+                          "Core clock half periods per JTAG clock half period "
+                          "(0 holds the core clock while shifting)",
+                          value<unsigned int> ()->default_value ("2"), "<n>");
   options.add_options () ("seed", "Random number seed",
                           value<unsigned int> ()->default_value ("1"), "<n>");
   options.add_options () ("max-block", "Maximum size of memory block to test",
@@ -85,6 +89,7 @@ Args::Args (int argc, char *argv[])
   mClkPeriodNs = static_cast<uint64_t> (1000.0 / mhzVal);
 
   mDurationNs = res["duration-ns"].as<uint64_t> ();
+  mTckRatio = res["tck-ratio"].as<unsigned int> ();
   mSeed = res["seed"].as<unsigned int> ();
 
   mMaxBlock = res["max-block"].as<size_t> ();
@@ -135,6 +140,16 @@ Args::clkPeriodNs () const
   return mClkPeriodNs;
 }
 
+/// \brief Getter for the JTAG clock ratio.
+///
+/// \return The number of core clock half periods per JTAG clock half period,
+///         zero meaning the core clock is held while shifting.
+unsigned int
+Args::tckRatio () const
+{
+  return mTckRatio;
+}
+
 /// \brief Getter for the random number seed.
 ///
 /// \return The random number seed.
@@ -25,6 +25,7 @@ public:
   // API calls
   uint64_t clkPeriodNs () const;
   uint64_t durationNs () const;
+  unsigned int tckRatio () const;
   unsigned int seed () const;
   std::size_t maxBlock () const;
   std::string vcd () const;
@@ -44,6 +45,9 @@ private:
   /// \brief the duration of execution in nanoseconds
   uint64_t mDurationNs;
 
+  /// \brief Main clock half periods per JTAG clock half period (0 = TCK only)
+  unsigned int mTckRatio;
+
   /// \brief Random number seed specified as argument (default 1)
   unsigned int mSeed;
 
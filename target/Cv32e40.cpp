@@ -7,11 +7,19 @@
 // ----------------------------------------------------------------------------
 
 #include "Cv32e40.h"
+#include "DtmMock.h"
+#include "Utils.h"
 #include "embdebug/Compat.h"
 #include "embdebug/ITarget.h"
 
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <memory>
+#include <sstream>
 
 using namespace EmbDebug;
 
@@ -43,19 +51,79 @@ using namespace std;
 /* This bit mask corresponds to the field for the first hart in haltsum. */
 #define MASK_HALTSUM_FIRST_HART 1
 
+/* Number of clock cycles to free-run between checks for the end of
+ * simulation, when waiting for the core to enter debug mode. */
+#define HALT_BATCH_CYCLES 10000
+
+/* Default address for the memory benchmark, the start of L2 memory. */
+#define BENCH_MEM_ADDR 0x1c000000
+
+/* Address range of the MCU's memory mapped peripherals, which by default
+ * are not held in the memory cache. */
+#define MMIO_START 0x1a100000
+#define MMIO_END 0x1b000000
+
+/* Address range of the MCU's boot ROM, which by default is cached for the
+ * whole session. */
+#define ROM_START 0x1a000000
+#define ROM_END 0x1a100000
+
+/* Environment variable naming the directory for files cached between
+ * sessions.  If unset, $HOME/.cache is used. */
+#define CACHE_DIR_ENV "EMBDEBUG_CACHE_DIR"
+
+/* ELF32 constants needed to find loadable read-only segments. */
+#define ELF_EHDR_SIZE 52
+#define ELF_PHDR_SIZE 32
+#define ELF_PT_LOAD 1
+#define ELF_PF_W 2
+
 // Instantiate the model. TODO the argument will change to pass in the
-// residual argv.
-Cv32e40::Cv32e40 (const TraceFlags *traceFlags) : ITarget (traceFlags)
+// residual argv.  USEBACKDOOR selects the backdoor DTM, which drives the
+// debug module's DMI ports directly, rather than the JTAG DTM.  Either can be
+// selected later with the "dtm" monitor command.  TCKRATIO is the number of
+// core clock half periods per JTAG clock half period (see VSim::tckRatio).
+Cv32e40::Cv32e40 (const TraceFlags *traceFlags, const bool useBackdoor,
+                  const unsigned int tckRatio)
+    : ITarget (traceFlags)
 {
-  // We create the DTM here, because only at this level do we know what
-  // derived class we will instantiate.  But we then pass ownership to the
-  // DMI, because that is where it belongs.
-  unique_ptr<IDtm> mDtm (new DtmJtag (20, 1000000000, ""));
+  // We create the DTMs here, because only at this level do we know what
+  // derived classes we will instantiate.  Both share the one model.  We then
+  // pass ownership of the DTM in use to the DMI, because that is where it
+  // belongs, and keep the other for when we switch.
+  mSim.reset (new VSim (20, 1000000000, "", tckRatio));
+  mUsingBackdoor = useBackdoor && VSim::haveDmiBackdoor ();
+  if (useBackdoor && !mUsingBackdoor)
+    cerr << "Warning: DMI backdoor not available: using JTAG" << endl;
+
+  unique_ptr<IDtm> mDtm;
+  if (mUsingBackdoor)
+    {
+      mDtm.reset (new DtmBackdoor (mSim));
+      mAltDtm.reset (new DtmJtag (mSim));
+    }
+  else
+    {
+      mDtm.reset (new DtmJtag (mSim));
+      mAltDtm.reset (new DtmBackdoor (mSim));
+    }
+
   unique_ptr<Dmi> mDmi (new Dmi (std::move (mDtm)));
   // Only one core is present so we can select it at the start
   mDmi->dtmReset ();
   mDmi->selectHart (0);
   mDmi->haltHart (0);
+
+  // The debug module's fixed properties, from an earlier session with the
+  // same IDCODE if possible.
+  std::string capsFile = capsCacheFile (mDmi->dtm ()->idcode ());
+  if (capsFile.empty () || !mDmi->loadCaps (capsFile))
+    {
+      mDmi->discoverCaps ();
+      if (!capsFile.empty ())
+        static_cast<void> (mDmi->saveCaps (capsFile));
+    }
+
   mDmi->dmcontrol ()->read ();
   mDmi->dmcontrol ()->prettyPrint (1);
   mDmi->dmstatus ()->prettyPrint (1);
@@ -65,9 +133,27 @@ Cv32e40::Cv32e40 (const TraceFlags *traceFlags) : ITarget (traceFlags)
   // Get sim start time
   const uint64_t simStart = mDmi->simTimeNs ();
 
+  // Nothing cached yet
+  mRegCacheHits = 0;
+  mRegCacheMisses = 0;
+  mRegCacheWrites = 0;
+  mRegCacheDmiOps = 0;
+  mRegCacheStops = 0;
+  invalidateRegCache ();
+
+  mMemCacheEnabled = true;
+  mMemNoCache.push_back (std::make_pair (MMIO_START, MMIO_END));
+  mMemReadOnly.push_back (std::make_pair (ROM_START, ROM_END));
+  mRoCacheHits = 0;
+  mMemCacheHits = 0;
+  mMemCacheMisses = 0;
+  mMemCacheFills = 0;
+  mMemCacheBypasses = 0;
+
   // Move from method local storage to object attributes
   this->mDmi = std::move (mDmi);
   this->simStart = simStart;
+  checkRoCache ();
   return;
 }
 
@@ -75,6 +161,8 @@ Cv32e40::Cv32e40 (const TraceFlags *traceFlags) : ITarget (traceFlags)
 Cv32e40::~Cv32e40 ()
 {
   mDmi.reset (nullptr);
+  mAltDtm.reset (nullptr);
+  mSim.reset ();
   return;
 }
 
@@ -85,10 +173,27 @@ Cv32e40::terminate ()
   return ITarget::ResumeRes::NONE;
 }
 
-// Reset the model state
+// Reset the model state.  The hart and the rest of the MCU are reset through
+// the debug module, and the hart halted again, as at attach.  The read-only
+// cache is kept, but checked against the target, since the reset may have
+// changed memory such as RAM holding a loaded image.
 ITarget::ResumeRes Cv32e40::reset (ITarget::ResetType)
 {
-  mDmi.reset ();
+  invalidateRegCache ();
+  invalidateMemCache ();
+
+  // Toggle ndmreset, keeping the debug module active
+  for (bool flag : { true, false })
+    {
+      mDmi->dmcontrol ()->reset ();
+      mDmi->dmcontrol ()->hartsel (0);
+      mDmi->dmcontrol ()->ndmreset (flag);
+      mDmi->dmcontrol ()->dmactive (true);
+      mDmi->dmcontrol ()->write ();
+    }
+  mDmi->haltHart (0);
+
+  checkRoCache ();
   return ITarget::ResumeRes::SUCCESS;
 }
 
@@ -121,16 +226,71 @@ Cv32e40::getRegisterSize () const
 }
 
 // Read a register into the VALUE reference argument, returning the number of
-// bytes read
+// bytes read.  Nothing can change while the hart is halted, so we use the
+// register cache where we can.
 std::size_t
 Cv32e40::readRegister (const int reg, uint_reg_t &value)
 {
   std::size_t retval = getRegisterSize ();
 
-  uint32_t readvalue; // Need a temp store since we can't pass value.
+  if ((reg >= 0) && (reg < NUM_CACHED_REGS) && mRegValid[reg])
+    {
+      mRegCacheHits++;
+      value = mRegCache[reg];
+      return retval;
+    }
+
+  // GDB will almost always want all the GPRs, so on a miss we fetch them
+  // all in one bulk read, keeping any we have changed.
+  if ((reg >= 0) && (reg < NUM_GPRS))
+    {
+      uint32_t gprs[NUM_GPRS];
+      uint64_t opsStart = mDmi->dtm ()->dmiOpCount ();
+
+      mRegCacheMisses++;
+      if (mDmi->readGprs (0, NUM_GPRS, gprs)
+          == Dmi::Abstractcs::CmderrVal::CMDERR_NONE)
+        {
+          for (int r = 0; r < NUM_GPRS; r++)
+            if (!mRegDirty[r])
+              {
+                mRegCache[r] = gprs[r];
+                mRegValid[r] = true;
+              }
+
+          value = gprs[reg];
+        }
+      else
+        {
+          // The bulk read failed, so nothing was cached.  Read just this
+          // register, and only cache it if that worked.
+          uint32_t readvalue = 0;
+          if (mDmi->readGpr (reg, readvalue)
+              == Dmi::Abstractcs::CmderrVal::CMDERR_NONE)
+            {
+              mRegCache[reg] = readvalue;
+              mRegValid[reg] = true;
+            }
+          value = readvalue;
+        }
+
+      mRegCacheDmiOps += mDmi->dtm ()->dmiOpCount () - opsStart;
+      return retval;
+    }
+
+  uint32_t readvalue = 0; // Need a temp store since we can't pass value.
   if (reg == REG_PC_IDENTIFIER)
     {
-      mDmi->readCsr (Dmi::Csr::DPC, readvalue);
+      uint64_t opsStart = mDmi->dtm ()->dmiOpCount ();
+
+      mRegCacheMisses++;
+      if (mDmi->readCsr (Dmi::Csr::DPC, readvalue)
+          == Dmi::Abstractcs::CmderrVal::CMDERR_NONE)
+        {
+          mRegCache[reg] = readvalue;
+          mRegValid[reg] = true;
+        }
+      mRegCacheDmiOps += mDmi->dtm ()->dmiOpCount () - opsStart;
     }
   else
     {
@@ -169,11 +329,22 @@ Cv32e40::getSyscallArgLocs (SyscallArgLoc &syscallIDLoc,
 }
 
 // Write a register supplied in the VALUE argument and returning the number of
-// bytes written
+// bytes written.  Writes to cached registers are held in the cache until the
+// hart is resumed.
 std::size_t
 Cv32e40::writeRegister (const int reg, const uint_reg_t value)
 {
   std::size_t retval = getRegisterSize ();
+
+  if ((reg >= 0) && (reg < NUM_CACHED_REGS))
+    {
+      mRegCacheWrites++;
+      mRegCache[reg] = static_cast<uint32_t> (value);
+      mRegValid[reg] = true;
+      mRegDirty[reg] = true;
+      return retval;
+    }
+
   if (reg == REG_PC_IDENTIFIER)
     { // Special case for pc as it is a CSR not GPR
       mDmi->writeCsr (Dmi::Csr::DPC, value);
@@ -186,18 +357,71 @@ Cv32e40::writeRegister (const int reg, const uint_reg_t value)
 }
 
 // Read a block of memory into the supplied buffer, returning the number of
-// bytes read
+// bytes read.  Pages which may be cached are served from the memory cache
+// (or the read-only cache), with runs of consecutive missing pages filled by
+// a single read.
 std::size_t
 Cv32e40::read (const uint_addr_t addr, uint8_t *buffer, const std::size_t size)
 {
-  // We use an intermediary buffer 'buf' before loading into the given buffer.
-  std::size_t retval = size;
-  std::unique_ptr<unsigned char[]> buf (new unsigned char[size]);
-  mDmi->readMem (addr, size, buf);
-  for (size_t i = 0; i < size; i++)
-    buffer[i] = buf[i];
-  return retval;
-  ;
+  if (!mMemCacheEnabled)
+    {
+      mDmi->readMem (addr, size, buffer);
+      return size;
+    }
+
+  uint64_t a = addr;
+  uint8_t *p = buffer;
+  std::size_t n = size;
+
+  while (n > 0)
+    {
+      uint64_t page = a & ~(MEM_PAGE_SIZE - 1);
+      std::size_t off = static_cast<std::size_t> (a - page);
+      std::size_t len = min (n, static_cast<std::size_t> (MEM_PAGE_SIZE - off));
+
+      if (!memCacheable (page))
+        {
+          mMemCacheBypasses++;
+          mDmi->readMem (a, len, p);
+        }
+      else
+        {
+          PageMap &cache = cacheFor (page);
+          auto it = cache.find (page);
+          if (it == cache.end ())
+            {
+              // Fill this and any following missing pages of the request
+              // held in the same cache
+              uint64_t lastPage = (a + n - 1) & ~(MEM_PAGE_SIZE - 1);
+              std::size_t nPages = 1;
+              for (uint64_t pg = page + MEM_PAGE_SIZE;
+                   (pg <= lastPage) && memCacheable (pg)
+                   && (&cacheFor (pg) == &cache)
+                   && (cache.find (pg) == cache.end ());
+                   pg += MEM_PAGE_SIZE)
+                nPages++;
+
+              mMemCacheMisses++;
+              fillMemCache (page, nPages);
+              it = cache.find (page);
+            }
+          else if (&cache == &mRoCache)
+            mRoCacheHits++;
+          else
+            mMemCacheHits++;
+
+          if (it == cache.end ())
+            mDmi->readMem (a, len, p); // Fill failed
+          else
+            memcpy (p, it->second.data () + off, len);
+        }
+
+      a += len;
+      p += len;
+      n -= len;
+    }
+
+  return size;
 }
 
 // Write a block of memory from the supplied buffer, returning the number of
@@ -210,13 +434,31 @@ Cv32e40::write (const uint_addr_t addr, const uint8_t *buffer,
   if (size == 0)
     return size;
 
-  // We use an intermediary buffer 'buf' before loading into the given buffer.
-  std::size_t retval = size;
-  std::unique_ptr<unsigned char[]> buf (new unsigned char[size]);
-  for (size_t i = 0; i < size; i++)
-    buf[i] = buffer[i];
-  mDmi->writeMem (addr, size, buf);
-  return retval;
+  bool ok = mDmi->writeMem (addr, size, buffer) == Dmi::Sbcs::SBERR_NONE;
+
+  // Write through to any cached pages, or drop them if the write failed
+  uint64_t end = addr + size;
+  for (uint64_t page = addr & ~(MEM_PAGE_SIZE - 1); page < end;
+       page += MEM_PAGE_SIZE)
+    {
+      PageMap &cache = cacheFor (page);
+      auto it = cache.find (page);
+      if (it == cache.end ())
+        continue;
+
+      if (!ok)
+        {
+          cache.erase (it);
+          continue;
+        }
+
+      uint64_t from = max (page, static_cast<uint64_t> (addr));
+      uint64_t to = min (page + MEM_PAGE_SIZE, end);
+      memcpy (it->second.data () + (from - page), buffer + (from - addr),
+              static_cast<std::size_t> (to - from));
+    }
+
+  return size;
 }
 
 // Insert a matchpoint (breakpoint or watchpoint), returning whether or not
@@ -239,6 +481,261 @@ Cv32e40::removeMatchpoint (const uint_addr_t addr, const MatchType matchType)
 bool
 Cv32e40::command (const std::string cmd, std::ostream &stream)
 {
+  std::istringstream iss (cmd);
+  std::string verb;
+  std::string arg;
+
+  iss >> verb >> arg;
+
+  if (verb == "dtm")
+    {
+      if (arg.empty ())
+        {
+          stream << "DTM: " << (mUsingBackdoor ? "backdoor" : "jtag") << endl;
+          return true;
+        }
+      else if (arg == "jtag")
+        return selectDtm (false, stream);
+      else if (arg == "backdoor")
+        return selectDtm (true, stream);
+
+      stream << "Usage: dtm [jtag|backdoor]" << endl;
+      return false;
+    }
+  else if (verb == "poll")
+    {
+      uint64_t minCycles;
+      uint64_t maxCycles;
+      uint64_t timeoutNs;
+
+      if (!arg.empty ())
+        {
+          std::istringstream args (cmd.substr (cmd.find (arg)));
+          if (!(args >> minCycles >> maxCycles >> timeoutNs))
+            {
+              stream << "Usage: poll [<min-cycles> <max-cycles> <timeout-ns>]"
+                     << endl;
+              return false;
+            }
+          mDmi->pollConfig (minCycles, maxCycles, timeoutNs);
+        }
+
+      mDmi->printPollConfig (stream);
+      return true;
+    }
+  else if (verb == "cmd-retry")
+    {
+      unsigned retries;
+      uint32_t maxCycles;
+
+      if (!arg.empty ())
+        {
+          std::istringstream args (cmd.substr (cmd.find (arg)));
+          if (!(args >> retries >> maxCycles))
+            {
+              stream << "Usage: cmd-retry [<retries> <max-cycles>]" << endl;
+              return false;
+            }
+          mDmi->cmdRetryConfig (retries, maxCycles);
+        }
+
+      mDmi->printCmdRetry (stream);
+      return true;
+    }
+  else if (verb == "regcache")
+    {
+      if (arg == "clear")
+        {
+          mRegCacheHits = 0;
+          mRegCacheMisses = 0;
+          mRegCacheWrites = 0;
+          mRegCacheDmiOps = 0;
+          mRegCacheStops = 0;
+          return true;
+        }
+
+      // Compare the DMI ops measured with an abstract command for every
+      // access
+      uint64_t naive = (mRegCacheHits + mRegCacheMisses + mRegCacheWrites)
+                       * DMI_OPS_PER_REG;
+      uint64_t avoided
+          = (naive > mRegCacheDmiOps) ? naive - mRegCacheDmiOps : 0;
+      uint64_t stops = (mRegCacheStops == 0) ? 1 : mRegCacheStops;
+
+      stream << "Register cache: " << mRegCacheHits << " hits, "
+             << mRegCacheMisses << " misses, " << mRegCacheWrites
+             << " writes, " << mRegCacheStops << " stops" << endl;
+      stream << "  DMI ops avoided: " << avoided << " (" << fixed
+             << setprecision (1)
+             << (static_cast<double> (avoided) / static_cast<double> (stops))
+             << " per stop)" << endl;
+      return true;
+    }
+  else if (verb == "stats")
+    {
+      if (arg == "clear")
+        {
+          mDmi->dtm ()->clearStats ();
+          mDmi->clearShadowStats ();
+        }
+      else
+        {
+          mDmi->dtm ()->printStats (stream);
+          stream << "DMI writes elided: " << mDmi->writesElided () << endl;
+        }
+      return true;
+    }
+  else if (verb == "bench-dmi")
+    {
+      std::size_t nOps = 100;
+      if (!arg.empty ())
+        nOps = strtoul (arg.c_str (), nullptr, 0);
+      return benchDmi (nOps, stream);
+    }
+  else if (verb == "bench-dtm")
+    {
+      std::size_t nOps = 1000000;
+      if (!arg.empty ())
+        nOps = strtoul (arg.c_str (), nullptr, 0);
+      return benchDtm (nOps, stream);
+    }
+  else if (verb == "mem-path")
+    {
+      if (arg == "sysbus")
+        mDmi->memPath (Dmi::MEM_SYSBUS);
+      else if (arg == "progbuf")
+        mDmi->memPath (Dmi::MEM_PROGBUF);
+      else if (!arg.empty ())
+        {
+          stream << "Usage: mem-path [sysbus|progbuf]" << endl;
+          return false;
+        }
+
+      stream << "Memory path: "
+             << ((mDmi->memPath () == Dmi::MEM_PROGBUF) ? "progbuf" : "sysbus")
+             << endl;
+      return true;
+    }
+  else if (verb == "sbburst")
+    {
+      std::string idleArg;
+
+      iss >> idleArg;
+      if (arg == "on")
+        mDmi->sbBurst (true);
+      else if (arg == "off")
+        mDmi->sbBurst (false);
+      else if (!arg.empty ())
+        {
+          stream << "Usage: sbburst [on|off [<idle-cycles>]]" << endl;
+          return false;
+        }
+      if (!idleArg.empty ())
+        mDmi->sbBurstIdle (
+            static_cast<uint32_t> (strtoul (idleArg.c_str (), nullptr, 0)));
+
+      mDmi->printSbBurst (stream);
+      return true;
+    }
+  else if (verb == "posted")
+    {
+      if (arg == "on")
+        mDmi->dtm ()->postedWrites (true);
+      else if (arg == "off")
+        mDmi->dtm ()->postedWrites (false);
+      else if (!arg.empty ())
+        {
+          stream << "Usage: posted [on|off]" << endl;
+          return false;
+        }
+
+      stream << "Posted DMI writes: "
+             << (mDmi->dtm ()->postedWrites () ? "on" : "off") << endl;
+      return true;
+    }
+  else if (verb == "tck-ratio")
+    {
+      if (!arg.empty ())
+        {
+          char *end;
+          unsigned long ratio = strtoul (arg.c_str (), &end, 0);
+          if (*end != '\0')
+            {
+              stream << "Usage: tck-ratio [<ratio>]" << endl;
+              return false;
+            }
+          mSim->tckRatio (static_cast<unsigned int> (ratio));
+        }
+
+      stream << "JTAG clock ratio: " << mSim->tckRatio ();
+      if (mSim->tckRatio () == VSim::TCK_ONLY)
+        stream << " (core clock held while shifting)";
+      stream << endl;
+      return true;
+    }
+  else if (verb == "memcache")
+    return memCacheCommand (iss, arg, stream);
+  else if (verb == "csr")
+    {
+      uint16_t csrAddr;
+      uint32_t val;
+      char *end;
+
+      if (!mDmi->csrAddr (arg, csrAddr))
+        {
+          unsigned long n = strtoul (arg.c_str (), &end, 0);
+          if (arg.empty () || (*end != '\0') || (n >= 4096))
+            {
+              stream << "Usage: csr <name>|<address>" << endl;
+              return false;
+            }
+          csrAddr = static_cast<uint16_t> (n);
+        }
+
+      if (mDmi->readCsr (csrAddr, val) != Dmi::Abstractcs::CMDERR_NONE)
+        {
+          stream << "Cannot read CSR 0x" << Utils::hexStr (csrAddr, 3)
+                 << endl;
+          return false;
+        }
+
+      stream << mDmi->csrName (csrAddr) << " (0x"
+             << Utils::hexStr (csrAddr, 3) << ") = 0x" << Utils::hexStr (val)
+             << endl;
+      return true;
+    }
+  else if (verb == "caps")
+    {
+      if (arg == "discover")
+        {
+          std::string capsFile = capsCacheFile (mDmi->dtm ()->idcode ());
+          mDmi->discoverCaps ();
+          if (!capsFile.empty () && mDmi->saveCaps (capsFile))
+            stream << "Saved to " << capsFile << endl;
+        }
+      else if (!arg.empty ())
+        {
+          stream << "Usage: caps [discover]" << endl;
+          return false;
+        }
+
+      mDmi->printCaps (stream);
+      return true;
+    }
+  else if (verb == "bench-mem")
+    {
+      uint64_t addr = BENCH_MEM_ADDR;
+      std::size_t nBytes = 1024;
+      std::string bytesArg;
+
+      iss >> bytesArg;
+      if (!arg.empty ())
+        addr = strtoull (arg.c_str (), nullptr, 0);
+      if (!bytesArg.empty ())
+        nBytes = strtoul (bytesArg.c_str (), nullptr, 0);
+      return benchMem (addr, nBytes, stream);
+    }
+
   return false;
 }
 
@@ -310,6 +807,14 @@ Cv32e40::resume (void)
       != ITarget::ResumeType::NONE); // NONE is invalid on single core machine
   bool retval = true;
 
+  // Write back any registers changed while halted, which are then no longer
+  // valid once the hart runs.
+  retval &= flushRegCache ();
+  invalidateRegCache ();
+
+  // Memory may change once the hart runs
+  invalidateMemCache ();
+
   // Explicitly disable halt request and enable resume request.
   mDmi->dmcontrol ()->haltreq (false);
 
@@ -336,6 +841,9 @@ Cv32e40::resume (void)
   mDmi->dmcontrol ()->resumereq ();
   mDmi->dmcontrol ()->write ();
 
+  // The hart should be running before we start waiting for it
+  mDmi->sync ();
+
   return retval;
 }
 
@@ -368,6 +876,8 @@ Cv32e40::wait (std::vector<ResumeRes> &results)
       break;
     }
 
+  mRegCacheStops++;
+  invalidateMemCache (); // New halt epoch
   return retval;
 }
 
@@ -394,18 +904,11 @@ Cv32e40::stepInstr (ITarget::ResumeRes &resumeRes)
 {
   ITarget::WaitRes retval = ITarget::WaitRes::EVENT_OCCURRED;
   /* Keep going until we halt */
-  uint32_t haltsum_val;
-  while (1)
-    {
-      mDmi->haltsum ()->read (0);
-      haltsum_val = mDmi->haltsum ()->haltsum (0);
-      /* If hart 1 is halted, break */
-      if (haltsum_val & MASK_HALTSUM_FIRST_HART)
-        {
-          resumeRes = ITarget::ResumeRes::INTERRUPTED;
-          break;
-        }
-    }
+  if (waitForHalt ())
+    resumeRes = ITarget::ResumeRes::INTERRUPTED;
+  else
+    resumeRes = ITarget::ResumeRes::FAILURE;
+
   /* Unset the step field. */
   uint32_t dcsr_val;
   mDmi->readCsr (Dmi::Csr::DCSR, dcsr_val);
@@ -440,15 +943,9 @@ bool
 Cv32e40::stoppedAtEbreak ()
 {
   /* Keep going until we halt */
-  uint32_t haltsum_val = 0;
-  while (1)
-    {
-      mDmi->haltsum ()->read (0);
-      haltsum_val = mDmi->haltsum ()->haltsum (0);
-      /* If hart 1 is halted, break */
-      if (haltsum_val & MASK_HALTSUM_FIRST_HART)
-        break;
-    }
+  if (!waitForHalt ())
+    return false;
+
   /* Check if we stopped because of an ebreak */
   uint32_t dcsr_val;
   mDmi->readCsr (Dmi::Csr::DCSR, dcsr_val);
@@ -458,14 +955,579 @@ Cv32e40::stoppedAtEbreak ()
   return stoppedAtEbreak;
 }
 
+// Wait for the hart to halt, returning true if it did, false if the
+// simulation finished or polling timed out first.  If the model exposes the
+// core's debug mode signal, we free-run the clock until it is set and only
+// then confirm the halt with a single read of haltsum.  Otherwise we poll
+// over the DMI, backing off between polls.
+bool
+Cv32e40::waitForHalt ()
+{
+  if (VSim::haveDebugModeSignal ())
+    {
+      while (!mSim->runUntilDebugMode (HALT_BATCH_CYCLES))
+        if (mSim->allDone ())
+          return false;
+
+      mDmi->haltsum ()->read (0);
+      /* If hart 1 is halted, we are done */
+      if (mDmi->haltsum ()->haltsum (0) & MASK_HALTSUM_FIRST_HART)
+        return true;
+    }
+
+  return mDmi->waitForHalt () == Dmi::HALT_OK;
+}
+
+// Mark every cached register as invalid, discarding any changes
+void
+Cv32e40::invalidateRegCache ()
+{
+  for (int r = 0; r < NUM_CACHED_REGS; r++)
+    {
+      mRegValid[r] = false;
+      mRegDirty[r] = false;
+    }
+}
+
+// Write back any registers changed while the hart was halted, returning
+// whether this succeeded.  Runs of consecutive dirty GPRs are written in
+// bulk.
+bool
+Cv32e40::flushRegCache ()
+{
+  bool retval = true;
+  int r = 0;
+  uint64_t opsStart = mDmi->dtm ()->dmiOpCount ();
+
+  while (r < NUM_GPRS)
+    {
+      if (!mRegDirty[r])
+        {
+          r++;
+          continue;
+        }
+
+      int first = r;
+      while ((r < NUM_GPRS) && mRegDirty[r])
+        mRegDirty[r++] = false;
+
+      std::size_t count = r - first;
+      retval &= mDmi->writeGprs (first, count, &mRegCache[first])
+                == Dmi::Abstractcs::CmderrVal::CMDERR_NONE;
+    }
+
+  if (mRegDirty[REG_PC_IDENTIFIER])
+    {
+      retval &= mDmi->writeCsr (Dmi::Csr::DPC, mRegCache[REG_PC_IDENTIFIER])
+                == Dmi::Abstractcs::CmderrVal::CMDERR_NONE;
+      mRegDirty[REG_PC_IDENTIFIER] = false;
+    }
+
+  mRegCacheDmiOps += mDmi->dtm ()->dmiOpCount () - opsStart;
+  return retval;
+}
+
+// Switch the DMI to use the backdoor DTM if USEBACKDOOR is true, or the JTAG
+// DTM otherwise.  The DTMs share a model, so only the transport changes.
+// Return whether this succeeded.
+bool
+Cv32e40::selectDtm (const bool useBackdoor, std::ostream &stream)
+{
+  if (useBackdoor == mUsingBackdoor)
+    {
+      stream << "DTM already " << (useBackdoor ? "backdoor" : "jtag") << endl;
+      return true;
+    }
+
+  if (useBackdoor && !VSim::haveDmiBackdoor ())
+    {
+      stream << "DMI backdoor not available in this model" << endl;
+      return false;
+    }
+
+  mDmi->swapDtm (mAltDtm);
+  mDmi->dtmReset ();
+  mUsingBackdoor = useBackdoor;
+  stream << "DTM now " << (useBackdoor ? "backdoor" : "jtag") << endl;
+  return true;
+}
+
+// Return the file in which to cache the debug module's fixed properties
+// between sessions, which is specific to IDCODE.  Empty if there is no
+// IDCODE or no cache directory.
+std::string
+Cv32e40::capsCacheFile (const uint32_t idcode)
+{
+  const char *dir = getenv (CACHE_DIR_ENV);
+  std::string path;
+
+  if (idcode == 0)
+    return "";
+
+  if (dir != nullptr)
+    path = dir;
+  else if ((dir = getenv ("HOME")) != nullptr)
+    path = std::string (dir) + "/.cache";
+  else
+    return "";
+
+  return path + "/cv32e40-dm-" + Utils::hexStr (idcode) + ".caps";
+}
+
+// Benchmark DMI reads of dmstatus for each JTAG clock ratio, reporting the
+// DMI ops per wall-clock second and the simulated time per op.  The original
+// ratio is restored afterwards.  Return whether this succeeded.
+bool
+Cv32e40::benchDmi (const std::size_t nOps, std::ostream &stream)
+{
+  static const unsigned int ratios[] = { VSim::TCK_ONLY, 1, 2, 4, 8 };
+  const unsigned int origRatio = mSim->tckRatio ();
+
+  if (nOps == 0)
+    {
+      stream << "Usage: bench-dmi [<count>]" << endl;
+      return false;
+    }
+
+  stream << "DMI benchmark, " << nOps << " reads per ratio ("
+         << (mUsingBackdoor ? "backdoor" : "jtag") << ")" << endl;
+
+  for (auto r : ratios)
+    {
+      mSim->tckRatio (r);
+      uint64_t simStartNs = mDmi->simTimeNs ();
+      auto wallStart = chrono::steady_clock::now ();
+
+      for (std::size_t i = 0; i < nOps; i++)
+        mDmi->dmstatus ()->read ();
+
+      chrono::duration<double> wall = chrono::steady_clock::now () - wallStart;
+      uint64_t simNs = mDmi->simTimeNs () - simStartNs;
+
+      stream << "  ratio ";
+      if (r == VSim::TCK_ONLY)
+        stream << "tck-only";
+      else
+        stream << setw (8) << r;
+      stream << ": " << fixed << setprecision (0) << setw (10)
+             << (static_cast<double> (nOps) / wall.count ()) << " ops/s, "
+             << (simNs / nOps) << " sim ns/op" << endl;
+    }
+
+  mSim->tckRatio (origRatio);
+  return true;
+}
+
+// Benchmark the software path to the DTM, using a mock DTM so no simulation
+// time is included.  The same register read is made through a Dmi which
+// chooses its DTM at run time, as this target does, and through one built on
+// the concrete mock type, where the DMI access needs no virtual call and can
+// be inlined.  Report the ns per DMI op for each.  Return whether this
+// succeeded.
+bool
+Cv32e40::benchDtm (const std::size_t nOps, std::ostream &stream)
+{
+  if (nOps == 0)
+    {
+      stream << "Usage: bench-dtm [<count>]" << endl;
+      return false;
+    }
+
+  Dmi virtualDmi (std::unique_ptr<IDtm> (new DtmMock ()));
+  DmiT<DtmMock> directDmi (std::unique_ptr<DtmMock> (new DtmMock ()));
+
+  stream << "DTM benchmark, " << nOps << " reads per path" << endl;
+
+  auto wallStart = chrono::steady_clock::now ();
+  for (std::size_t i = 0; i < nOps; i++)
+    virtualDmi.dmstatus ()->read ();
+  chrono::duration<double, std::nano> wall
+      = chrono::steady_clock::now () - wallStart;
+  stream << "  Dmi over IDtm:    " << fixed << setprecision (2) << setw (8)
+         << (wall.count () / static_cast<double> (nOps)) << " ns/op" << endl;
+
+  wallStart = chrono::steady_clock::now ();
+  for (std::size_t i = 0; i < nOps; i++)
+    directDmi.dmstatus ()->read ();
+  wall = chrono::steady_clock::now () - wallStart;
+  stream << "  Dmi over DtmMock: " << fixed << setprecision (2) << setw (8)
+         << (wall.count () / static_cast<double> (nOps)) << " ns/op" << endl;
+
+  return (virtualDmi.dtm ()->dmiOpCount () == nOps)
+         && (directDmi.dtm ()->dmiOpCount () == nOps);
+}
+
+// Benchmark reading and then writing back a block of memory via each memory
+// path, reporting the bytes per simulated second and DMI ops per KiB.  The
+// system bus is measured both polling after each word and in burst mode.  The
+// hart should be halted, since otherwise the program buffer path falls back
+// to the system bus.  The original settings are restored afterwards.  Return
+// whether this succeeded.
+bool
+Cv32e40::benchMem (const uint64_t addr, const std::size_t nBytes,
+                   std::ostream &stream)
+{
+  static const struct
+  {
+    const char *name;
+    Dmi::MemPath path;
+    bool burst;
+  } runs[] = { { "sysbus polled", Dmi::MEM_SYSBUS, false },
+               { "sysbus burst", Dmi::MEM_SYSBUS, true },
+               { "progbuf", Dmi::MEM_PROGBUF, true } };
+  const Dmi::MemPath origPath = mDmi->memPath ();
+  const bool origBurst = mDmi->sbBurst ();
+  std::unique_ptr<uint8_t[]> buf (new uint8_t[nBytes]);
+  bool retval = true;
+
+  if (nBytes == 0)
+    {
+      stream << "Usage: bench-mem [<addr> [<bytes>]]" << endl;
+      return false;
+    }
+
+  mDmi->dmstatus ()->read ();
+  stream << "Memory benchmark, " << nBytes << " bytes at 0x" << hex << addr
+         << dec << " (" << (mUsingBackdoor ? "backdoor" : "jtag") << ")"
+         << endl;
+  if (!mDmi->dmstatus ()->halted ())
+    stream << "  hart not halted: progbuf will use the system bus" << endl;
+
+  for (auto &r : runs)
+    {
+      mDmi->memPath (r.path);
+      mDmi->sbBurst (r.burst);
+
+      std::unique_ptr<IDtm> &dtm = mDmi->dtm ();
+      double kib = static_cast<double> (nBytes) / 1024.0;
+
+      uint64_t simStartNs = mDmi->simTimeNs ();
+      uint64_t opsStart = dtm->dmiOpCount ();
+      retval &= mDmi->readMem (addr, nBytes, buf.get ())
+                == Dmi::Sbcs::SBERR_NONE;
+      uint64_t readNs = mDmi->simTimeNs () - simStartNs;
+      uint64_t readOps = dtm->dmiOpCount () - opsStart;
+
+      simStartNs = mDmi->simTimeNs ();
+      opsStart = dtm->dmiOpCount ();
+      retval &= mDmi->writeMem (addr, nBytes, buf.get ())
+                == Dmi::Sbcs::SBERR_NONE;
+      uint64_t writeNs = mDmi->simTimeNs () - simStartNs;
+      uint64_t writeOps = dtm->dmiOpCount () - opsStart;
+
+      readNs = (readNs == 0) ? 1 : readNs;
+      writeNs = (writeNs == 0) ? 1 : writeNs;
+      stream << "  " << setw (13) << r.name << ": " << fixed
+             << setprecision (0) << setw (10)
+             << (static_cast<double> (nBytes) * 1e9
+                 / static_cast<double> (readNs))
+             << " bytes/sim-s read (" << setw (6)
+             << (static_cast<double> (readOps) / kib) << " ops/KiB), "
+             << setw (10)
+             << (static_cast<double> (nBytes) * 1e9
+                 / static_cast<double> (writeNs))
+             << " bytes/sim-s write (" << setw (6)
+             << (static_cast<double> (writeOps) / kib) << " ops/KiB)" << endl;
+    }
+
+  mDmi->memPath (origPath);
+  mDmi->sbBurst (origBurst);
+  return retval;
+}
+
+// Return whether the memory page starting at PAGE may be cached, which it
+// may not if it overlaps any of the uncached ranges.
+bool
+Cv32e40::memCacheable (const uint64_t page) const
+{
+  for (auto &r : mMemNoCache)
+    if ((page < r.second) && ((page + MEM_PAGE_SIZE) > r.first))
+      return false;
+
+  return true;
+}
+
+// Return whether the memory page starting at PAGE is wholly within one of
+// the read-only ranges, so may be cached for the whole session.
+bool
+Cv32e40::memReadOnly (const uint64_t page) const
+{
+  for (auto &r : mMemReadOnly)
+    if ((page >= r.first) && ((page + MEM_PAGE_SIZE) <= r.second))
+      return true;
+
+  return false;
+}
+
+// Return the cache which holds the memory page starting at PAGE
+Cv32e40::PageMap &
+Cv32e40::cacheFor (const uint64_t page)
+{
+  return memReadOnly (page) ? mRoCache : mMemCache;
+}
+
+// Discard all memory pages cached for this halt epoch.  The read-only cache
+// is kept.
+void
+Cv32e40::invalidateMemCache ()
+{
+  mMemCache.clear ();
+}
+
+// Read NPAGES consecutive memory pages starting at FIRSTPAGE with a single
+// read, and add them to the memory cache.  If the read fails, nothing is
+// cached.
+void
+Cv32e40::fillMemCache (const uint64_t firstPage, const std::size_t nPages)
+{
+  std::size_t nBytes = nPages * MEM_PAGE_SIZE;
+
+  mMemFill.resize (nBytes);
+  if (mDmi->readMem (firstPage, nBytes, mMemFill.data ())
+      != Dmi::Sbcs::SBERR_NONE)
+    return;
+
+  mMemCacheFills++;
+  for (std::size_t i = 0; i < nPages; i++)
+    {
+      uint64_t page = firstPage + i * MEM_PAGE_SIZE;
+      auto first = mMemFill.begin () + i * MEM_PAGE_SIZE;
+      cacheFor (page)[page].assign (first, first + MEM_PAGE_SIZE);
+    }
+}
+
+// Declare the loadable read-only (i.e. not writable) segments of the ELF32
+// file FILENAME as read-only ranges, and seed the read-only cache with the
+// whole pages of their contents.  The seeded pages are then checked against
+// the target.  Return whether this succeeded, reporting on STREAM.
+bool
+Cv32e40::seedFromElf (const std::string &fileName, std::ostream &stream)
+{
+  ifstream f (fileName, ios::binary);
+  std::vector<uint8_t> elf ((istreambuf_iterator<char> (f)),
+                            istreambuf_iterator<char> ());
+
+  if (!f.good () && !f.eof ())
+    {
+      stream << "Cannot read " << fileName << endl;
+      return false;
+    }
+
+  // Little endian ELF32 only
+  if ((elf.size () < ELF_EHDR_SIZE) || (elf[0] != 0x7f) || (elf[1] != 'E')
+      || (elf[2] != 'L') || (elf[3] != 'F') || (elf[4] != 1) || (elf[5] != 1))
+    {
+      stream << fileName << " is not a little endian ELF32 file" << endl;
+      return false;
+    }
+
+  uint32_t phoff = Utils::loadLe (&elf[28]);
+  uint32_t phentsize = Utils::loadLe (&elf[42], 2);
+  uint32_t phnum = Utils::loadLe (&elf[44], 2);
+  std::size_t nSeeded = 0;
+
+  for (uint32_t i = 0; i < phnum; i++)
+    {
+      uint64_t ph = static_cast<uint64_t> (phoff) + i * phentsize;
+      if ((phentsize < ELF_PHDR_SIZE) || ((ph + ELF_PHDR_SIZE) > elf.size ()))
+        break;
+
+      uint32_t type = Utils::loadLe (&elf[ph]);
+      uint32_t offset = Utils::loadLe (&elf[ph + 4]);
+      uint64_t paddr = Utils::loadLe (&elf[ph + 12]);
+      uint32_t filesz = Utils::loadLe (&elf[ph + 16]);
+      uint32_t flags = Utils::loadLe (&elf[ph + 24]);
+
+      if ((type != ELF_PT_LOAD) || ((flags & ELF_PF_W) != 0) || (filesz == 0)
+          || ((static_cast<uint64_t> (offset) + filesz) > elf.size ()))
+        continue;
+
+      uint64_t end = paddr + filesz;
+      mMemReadOnly.push_back (std::make_pair (paddr, end));
+      stream << "  read-only: 0x" << hex << paddr << " - 0x" << end << dec
+             << endl;
+
+      for (uint64_t page = (paddr + MEM_PAGE_SIZE - 1) & ~(MEM_PAGE_SIZE - 1);
+           (page + MEM_PAGE_SIZE) <= end; page += MEM_PAGE_SIZE)
+        {
+          auto first = elf.begin () + (offset + (page - paddr));
+          mRoCache[page].assign (first, first + MEM_PAGE_SIZE);
+          nSeeded++;
+        }
+    }
+
+  stream << "Seeded " << nSeeded << " read-only pages from " << fileName
+         << endl;
+  return verifyRoCache (stream);
+}
+
+// Check the read-only cache against the target, by comparing a sample of up
+// to RO_VERIFY_PAGES pages spread across it.  This catches an image which
+// does not match what is loaded, at the cost of a few page reads.  On any
+// mismatch the read-only cache is discarded, to be refilled from the target
+// as needed.  Return whether the cache matched, reporting on STREAM.
+bool
+Cv32e40::verifyRoCache (std::ostream &stream)
+{
+  std::size_t nPages = mRoCache.size ();
+  std::size_t step = (nPages + RO_VERIFY_PAGES - 1) / RO_VERIFY_PAGES;
+  std::size_t i = 0;
+  std::size_t nChecked = 0;
+
+  mMemFill.resize (MEM_PAGE_SIZE);
+  for (auto &pg : mRoCache)
+    {
+      if ((i++ % step) != 0)
+        continue;
+
+      nChecked++;
+      if ((mDmi->readMem (pg.first, MEM_PAGE_SIZE, mMemFill.data ())
+           != Dmi::Sbcs::SBERR_NONE)
+          || (memcmp (mMemFill.data (), pg.second.data (), MEM_PAGE_SIZE)
+              != 0))
+        {
+          stream << "Read-only cache differs from target at 0x" << hex
+                 << pg.first << dec << ": discarded" << endl;
+          mRoCache.clear ();
+          return false;
+        }
+    }
+
+  stream << "Read-only cache verified: " << nChecked << " of " << nPages
+         << " pages checked" << endl;
+  return true;
+}
+
+// Check the read-only cache against the target, as done at attach and after
+// a reset, warning if any of it had to be discarded.
+void
+Cv32e40::checkRoCache ()
+{
+  std::ostringstream report;
+
+  if (!verifyRoCache (report))
+    cerr << "Warning: " << report.str ();
+}
+
+// Handle the "memcache" monitor command, whose first argument is ARG, with
+// any further arguments in ISS.  Return whether this succeeded.
+bool
+Cv32e40::memCacheCommand (std::istringstream &iss, const std::string &arg,
+                          std::ostream &stream)
+{
+  if (arg == "on")
+    mMemCacheEnabled = true;
+  else if (arg == "off")
+    {
+      mMemCacheEnabled = false;
+      invalidateMemCache ();
+    }
+  else if (arg == "clear")
+    {
+      invalidateMemCache ();
+      mMemCacheHits = 0;
+      mMemCacheMisses = 0;
+      mMemCacheFills = 0;
+      mMemCacheBypasses = 0;
+      return true;
+    }
+  else if (arg == "readonly")
+    {
+      std::string startArg;
+      std::string endArg;
+
+      iss >> startArg >> endArg;
+      if (endArg.empty ())
+        {
+          stream << "Usage: memcache readonly <start> <end>" << endl;
+          return false;
+        }
+
+      mMemReadOnly.push_back (
+          std::make_pair (strtoull (startArg.c_str (), nullptr, 0),
+                          strtoull (endArg.c_str (), nullptr, 0)));
+      invalidateMemCache ();
+    }
+  else if (arg == "elf")
+    {
+      std::string fileName;
+
+      iss >> fileName;
+      if (fileName.empty ())
+        {
+          stream << "Usage: memcache elf <file>" << endl;
+          return false;
+        }
+
+      invalidateMemCache ();
+      return seedFromElf (fileName, stream);
+    }
+  else if (arg == "verify")
+    return verifyRoCache (stream);
+  else if (arg == "nocache")
+    {
+      std::string startArg;
+      std::string endArg;
+
+      iss >> startArg >> endArg;
+      if (endArg.empty ())
+        {
+          stream << "Usage: memcache nocache <start> <end>" << endl;
+          return false;
+        }
+
+      mMemNoCache.push_back (
+          std::make_pair (strtoull (startArg.c_str (), nullptr, 0),
+                          strtoull (endArg.c_str (), nullptr, 0)));
+      invalidateMemCache ();
+    }
+  else if (!arg.empty ())
+    {
+      stream << "Usage: memcache [on|off|clear|verify|elf <file>|"
+             << "readonly <start> <end>|nocache <start> <end>]" << endl;
+      return false;
+    }
+
+  stream << "Memory cache: " << (mMemCacheEnabled ? "on" : "off") << ", "
+         << mMemCache.size () << " pages of " << MEM_PAGE_SIZE << " bytes, "
+         << mRoCache.size () << " read-only pages" << endl;
+  stream << "  " << mMemCacheHits << " hits, " << mRoCacheHits
+         << " read-only hits, " << mMemCacheMisses << " misses, "
+         << mMemCacheFills << " fills, " << mMemCacheBypasses << " uncached"
+         << endl;
+  for (auto &r : mMemNoCache)
+    stream << "  not cached: 0x" << hex << r.first << " - 0x" << r.second
+           << dec << endl;
+  for (auto &r : mMemReadOnly)
+    stream << "  read-only: 0x" << hex << r.first << " - 0x" << r.second
+           << dec << endl;
+
+  return true;
+}
+
 // Entry point for the shared library
 extern "C"
 {
-  // Create and return a new model
+  // Create and return a new model.  The server owns the command line, so
+  // the JTAG clock ratio may be given in the environment instead.
   EMBDEBUG_VISIBLE_API ITarget *
   create_target (TraceFlags *traceFlags)
   {
-    return new Cv32e40 (traceFlags);
+    unsigned int tckRatio = 2;
+    const char *ratioStr = getenv ("CV32E40_TCK_RATIO");
+
+    if ((ratioStr != nullptr) && (*ratioStr != '\0'))
+      {
+        char *end;
+        unsigned long ratio = strtoul (ratioStr, &end, 0);
+        if (*end == '\0')
+          tckRatio = static_cast<unsigned int> (ratio);
+        else
+          cerr << "Warning: bad CV32E40_TCK_RATIO \"" << ratioStr
+               << "\": using " << tckRatio << endl;
+      }
+
+    return new Cv32e40 (traceFlags, false, tckRatio);
   }
   // Used to ensure API compatibility
   EMBDEBUG_VISIBLE_API uint64_t
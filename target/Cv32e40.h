@@ -10,10 +10,14 @@
 #define CV32E40_H
 
 #include "Dmi.h"
+#include "DtmBackdoor.h"
 #include "DtmJtag.h"
 #include "embdebug/ITarget.h"
 
+#include <map>
 #include <memory>
+#include <utility>
+#include <vector>
 
 using namespace EmbDebug;
 
@@ -23,7 +27,9 @@ public:
   Cv32e40 () = delete;
   Cv32e40 (const Cv32e40 &) = delete;
 
-  explicit Cv32e40 (const TraceFlags *traceFlags);
+  explicit Cv32e40 (const TraceFlags *traceFlags,
+                    const bool useBackdoor = false,
+                    const unsigned int tckRatio = 2);
   ~Cv32e40 ();
 
   ITarget::ResumeRes terminate () override;
@@ -75,11 +81,36 @@ public:
   }
 
 private:
+  /// \brief Cached memory pages, keyed by page address
+  typedef std::map<uint64_t, std::vector<uint8_t>> PageMap;
+
   ITarget::WaitRes stepInstr (ITarget::ResumeRes &resumeRes);
   ITarget::WaitRes runToBreak (ITarget::ResumeRes &resumeRes);
   bool stoppedAtEbreak ();
-
+  bool waitForHalt ();
+  void invalidateRegCache ();
+  bool flushRegCache ();
+  bool selectDtm (const bool useBackdoor, std::ostream &stream);
+  bool benchDmi (const std::size_t nOps, std::ostream &stream);
+  bool benchDtm (const std::size_t nOps, std::ostream &stream);
+  bool benchMem (const uint64_t addr, const std::size_t nBytes,
+                 std::ostream &stream);
+  bool memCacheable (const uint64_t page) const;
+  bool memReadOnly (const uint64_t page) const;
+  PageMap &cacheFor (const uint64_t page);
+  void invalidateMemCache ();
+  void fillMemCache (const uint64_t firstPage, const std::size_t nPages);
+  bool seedFromElf (const std::string &fileName, std::ostream &stream);
+  bool verifyRoCache (std::ostream &stream);
+  void checkRoCache ();
+  bool memCacheCommand (std::istringstream &iss, const std::string &arg,
+                        std::ostream &stream);
+  static std::string capsCacheFile (const uint32_t idcode);
+
+  std::shared_ptr<VSim> mSim;
   std::unique_ptr<Dmi> mDmi;
+  std::unique_ptr<IDtm> mAltDtm;
+  bool mUsingBackdoor;
   uint64_t simStart;
   uint64_t clkPeriodNs;
   uint64_t mCpuTime;
@@ -87,6 +118,55 @@ private:
   uint64_t mCycleCnt;
   uint64_t mInstrCnt;
   std::unique_ptr<Dmi::Dmstatus> mDmstatus;
+
+  /// \brief Number of GPRs, which are read and written in bulk
+  static const int NUM_GPRS = 32;
+
+  /// \brief Number of registers cached, the GPRs and the PC
+  static const int NUM_CACHED_REGS = NUM_GPRS + 1;
+
+  /// \brief DMI ops for one uncached abstract register access (command,
+  ///        abstractcs and data0), the baseline for the cache statistics
+  static const uint64_t DMI_OPS_PER_REG = 3;
+
+  // Register cache, valid only while the hart is halted.  Dirty entries have
+  // been written by the debugger, but not yet to the hart.
+  uint32_t mRegCache[NUM_CACHED_REGS];
+  bool mRegValid[NUM_CACHED_REGS];
+  bool mRegDirty[NUM_CACHED_REGS];
+
+  // Register cache statistics
+  uint64_t mRegCacheHits;
+  uint64_t mRegCacheMisses;
+  uint64_t mRegCacheWrites;
+  uint64_t mRegCacheDmiOps; // Measured from the DTM's count of DMI ops
+  uint64_t mRegCacheStops;
+
+  /// \brief Size of a memory cache page in bytes (a power of 2)
+  static const uint64_t MEM_PAGE_SIZE = 64;
+
+  /// \brief Number of read-only pages sampled when verifying the cache
+  static const std::size_t RO_VERIFY_PAGES = 8;
+
+  // Memory cache of whole aligned pages, valid for one halt epoch, i.e. from
+  // when the hart halts until it is resumed.  Writes are written through.
+  // Address ranges (start, end) in mMemNoCache, such as MMIO, are never
+  // cached.  Pages wholly within a read-only range in mMemReadOnly are
+  // instead held in mRoCache, which lasts for the whole session, and is
+  // checked against the target at attach and after each reset.
+  bool mMemCacheEnabled;
+  PageMap mMemCache;
+  PageMap mRoCache;
+  std::vector<std::pair<uint64_t, uint64_t>> mMemNoCache;
+  std::vector<std::pair<uint64_t, uint64_t>> mMemReadOnly;
+  std::vector<uint8_t> mMemFill;
+
+  // Memory cache statistics
+  uint64_t mMemCacheHits;
+  uint64_t mMemCacheMisses;
+  uint64_t mMemCacheFills;
+  uint64_t mMemCacheBypasses;
+  uint64_t mRoCacheHits;
 };
 
 #endif
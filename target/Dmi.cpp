@@ -6,11 +6,16 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include <algorithm>
+#include <cstring>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
 
 #include "Dmi.h"
+#include "DtmBackdoor.h"
+#include "DtmJtag.h"
+#include "DtmMock.h"
 #include "Utils.h"
 
 using std::cerr;
@@ -18,14 +23,263 @@ using std::cout;
 using std::dec;
 using std::endl;
 using std::hex;
+using std::ifstream;
 using std::max;
 using std::min;
+using std::ofstream;
 using std::ostream;
 using std::setfill;
 using std::setw;
 using std::size_t;
 using std::unique_ptr;
 
+/// \brief Must define as well as declare our private table before using.
+///
+/// This is constant initialized, so costs nothing at run time until indexed.
+template <class DtmT>
+const typename DmiT<DtmT>::CsrInfo DmiT<DtmT>::CSR_INFO[] = {
+  // Standard user CSRs
+  { Csr::FFLAGS, "fflags", false, FP },
+  { Csr::FRM, "frm", false, FP },
+  { Csr::FCSR, "fcsr", false, FP },
+  { Csr::CYCLE, "cycle", true, ANY },
+  { Csr::INSTRET, "instret", true, ANY },
+  { Csr::HPMCOUNTER3, "hpmcounter3", true, ANY },
+  { Csr::HPMCOUNTER4, "hpmcounter4", true, ANY },
+  { Csr::HPMCOUNTER5, "hpmcounter5", true, ANY },
+  { Csr::HPMCOUNTER6, "hpmcounter6", true, ANY },
+  { Csr::HPMCOUNTER7, "hpmcounter7", true, ANY },
+  { Csr::HPMCOUNTER8, "hpmcounter8", true, ANY },
+  { Csr::HPMCOUNTER9, "hpmcounter9", true, ANY },
+  { Csr::HPMCOUNTER10, "hpmcounter10", true, ANY },
+  { Csr::HPMCOUNTER11, "hpmcounter11", true, ANY },
+  { Csr::HPMCOUNTER12, "hpmcounter12", true, ANY },
+  { Csr::HPMCOUNTER13, "hpmcounter13", true, ANY },
+  { Csr::HPMCOUNTER14, "hpmcounter14", true, ANY },
+  { Csr::HPMCOUNTER15, "hpmcounter15", true, ANY },
+  { Csr::HPMCOUNTER16, "hpmcounter16", true, ANY },
+  { Csr::HPMCOUNTER17, "hpmcounter17", true, ANY },
+  { Csr::HPMCOUNTER18, "hpmcounter18", true, ANY },
+  { Csr::HPMCOUNTER19, "hpmcounter19", true, ANY },
+  { Csr::HPMCOUNTER20, "hpmcounter20", true, ANY },
+  { Csr::HPMCOUNTER21, "hpmcounter21", true, ANY },
+  { Csr::HPMCOUNTER22, "hpmcounter22", true, ANY },
+  { Csr::HPMCOUNTER23, "hpmcounter23", true, ANY },
+  { Csr::HPMCOUNTER24, "hpmcounter24", true, ANY },
+  { Csr::HPMCOUNTER25, "hpmcounter25", true, ANY },
+  { Csr::HPMCOUNTER26, "hpmcounter26", true, ANY },
+  { Csr::HPMCOUNTER27, "hpmcounter27", true, ANY },
+  { Csr::HPMCOUNTER28, "hpmcounter28", true, ANY },
+  { Csr::HPMCOUNTER29, "hpmcounter29", true, ANY },
+  { Csr::HPMCOUNTER30, "hpmcounter30", true, ANY },
+  { Csr::HPMCOUNTER31, "hpmcounter31", true, ANY },
+  { Csr::CYCLEH, "cycleh", true, ANY },
+  { Csr::INSTRETH, "instreth", true, ANY },
+  { Csr::HPMCOUNTERH3, "hpmcounterh3", true, ANY },
+  { Csr::HPMCOUNTERH4, "hpmcounterh4", true, ANY },
+  { Csr::HPMCOUNTERH5, "hpmcounterh5", true, ANY },
+  { Csr::HPMCOUNTERH6, "hpmcounterh6", true, ANY },
+  { Csr::HPMCOUNTERH7, "hpmcounterh7", true, ANY },
+  { Csr::HPMCOUNTERH8, "hpmcounterh8", true, ANY },
+  { Csr::HPMCOUNTERH9, "hpmcounterh9", true, ANY },
+  { Csr::HPMCOUNTERH10, "hpmcounterh10", true, ANY },
+  { Csr::HPMCOUNTERH11, "hpmcounterh11", true, ANY },
+  { Csr::HPMCOUNTERH12, "hpmcounterh12", true, ANY },
+  { Csr::HPMCOUNTERH13, "hpmcounterh13", true, ANY },
+  { Csr::HPMCOUNTERH14, "hpmcounterh14", true, ANY },
+  { Csr::HPMCOUNTERH15, "hpmcounterh15", true, ANY },
+  { Csr::HPMCOUNTERH16, "hpmcounterh16", true, ANY },
+  { Csr::HPMCOUNTERH17, "hpmcounterh17", true, ANY },
+  { Csr::HPMCOUNTERH18, "hpmcounterh18", true, ANY },
+  { Csr::HPMCOUNTERH19, "hpmcounterh19", true, ANY },
+  { Csr::HPMCOUNTERH20, "hpmcounterh20", true, ANY },
+  { Csr::HPMCOUNTERH21, "hpmcounterh21", true, ANY },
+  { Csr::HPMCOUNTERH22, "hpmcounterh22", true, ANY },
+  { Csr::HPMCOUNTERH23, "hpmcounterh23", true, ANY },
+  { Csr::HPMCOUNTERH24, "hpmcounterh24", true, ANY },
+  { Csr::HPMCOUNTERH25, "hpmcounterh25", true, ANY },
+  { Csr::HPMCOUNTERH26, "hpmcounterh26", true, ANY },
+  { Csr::HPMCOUNTERH27, "hpmcounterh27", true, ANY },
+  { Csr::HPMCOUNTERH28, "hpmcounterh28", true, ANY },
+  { Csr::HPMCOUNTERH29, "hpmcounterh29", true, ANY },
+  { Csr::HPMCOUNTERH30, "hpmcounterh30", true, ANY },
+  { Csr::HPMCOUNTERH31, "hpmcounterh31", true, ANY },
+  // Custom user CSRs
+  { Csr::LPSTART0, "lpstart0", false, HWLP },
+  { Csr::LPEND0, "lpend0", false, HWLP },
+  { Csr::LPCOUNT0, "lpcount0", false, HWLP },
+  { Csr::LPSTART1, "lpstart1", false, HWLP },
+  { Csr::LPEND1, "lpend1", false, HWLP },
+  { Csr::LPCOUNT1, "lpcount1", false, HWLP },
+  { Csr::UHARTID, "uhartid", true, ANY },
+  { Csr::PRIVLV, "privlv", true, ANY },
+  // Standard machine CSRs
+  { Csr::MSTATUS, "mstatus", false, ANY },
+  { Csr::MISA, "misa", false, ANY },
+  { Csr::MIE, "mie", false, ANY },
+  { Csr::MTVEC, "mtvec", false, ANY },
+  { Csr::MCOUNTINHIBIT, "mcountinhibit", false, ANY },
+  { Csr::MHPMEVENT3, "mhpmevent3", false, ANY },
+  { Csr::MHPMEVENT4, "mhpmevent4", false, ANY },
+  { Csr::MHPMEVENT5, "mhpmevent5", false, ANY },
+  { Csr::MHPMEVENT6, "mhpmevent6", false, ANY },
+  { Csr::MHPMEVENT7, "mhpmevent7", false, ANY },
+  { Csr::MHPMEVENT8, "mhpmevent8", false, ANY },
+  { Csr::MHPMEVENT9, "mhpmevent9", false, ANY },
+  { Csr::MHPMEVENT10, "mhpmevent10", false, ANY },
+  { Csr::MHPMEVENT11, "mhpmevent11", false, ANY },
+  { Csr::MHPMEVENT12, "mhpmevent12", false, ANY },
+  { Csr::MHPMEVENT13, "mhpmevent13", false, ANY },
+  { Csr::MHPMEVENT14, "mhpmevent14", false, ANY },
+  { Csr::MHPMEVENT15, "mhpmevent15", false, ANY },
+  { Csr::MHPMEVENT16, "mhpmevent16", false, ANY },
+  { Csr::MHPMEVENT17, "mhpmevent17", false, ANY },
+  { Csr::MHPMEVENT18, "mhpmevent18", false, ANY },
+  { Csr::MHPMEVENT19, "mhpmevent19", false, ANY },
+  { Csr::MHPMEVENT20, "mhpmevent20", false, ANY },
+  { Csr::MHPMEVENT21, "mhpmevent21", false, ANY },
+  { Csr::MHPMEVENT22, "mhpmevent22", false, ANY },
+  { Csr::MHPMEVENT23, "mhpmevent23", false, ANY },
+  { Csr::MHPMEVENT24, "mhpmevent24", false, ANY },
+  { Csr::MHPMEVENT25, "mhpmevent25", false, ANY },
+  { Csr::MHPMEVENT26, "mhpmevent26", false, ANY },
+  { Csr::MHPMEVENT27, "mhpmevent27", false, ANY },
+  { Csr::MHPMEVENT28, "mhpmevent28", false, ANY },
+  { Csr::MHPMEVENT29, "mhpmevent29", false, ANY },
+  { Csr::MHPMEVENT30, "mhpmevent30", false, ANY },
+  { Csr::MHPMEVENT31, "mhpmevent31", false, ANY },
+  { Csr::MSCRATCH, "mscratch", false, ANY },
+  { Csr::MEPC, "mepc", false, ANY },
+  { Csr::MCAUSE, "mcause", false, ANY },
+  { Csr::MTVAL, "mtval", false, ANY },
+  { Csr::MIP, "mip", false, ANY },
+  { Csr::TSELECT, "tselect", false, ANY },
+  { Csr::TDATA1, "tdata1", false, ANY },
+  { Csr::TDATA2, "tdata2", false, ANY },
+  { Csr::TDATA3, "tdata3", false, ANY },
+  { Csr::TINFO, "tinfo", true, ANY },
+  { Csr::MCONTEXT, "mcontext", false, ANY },
+  { Csr::SCONTEXT, "scontext", false, ANY },
+  { Csr::DCSR, "dcsr", false, ANY },
+  { Csr::DPC, "dpc", false, ANY },
+  { Csr::DSCRATCH0, "dscratch0", false, ANY },
+  { Csr::DSCRATCH1, "dscratch1", false, ANY },
+  { Csr::MCYCLE, "mcycle", false, ANY },
+  { Csr::MINSTRET, "minstret", false, ANY },
+  { Csr::MHPMCOUNTER3, "mhpmcounter3", false, ANY },
+  { Csr::MHPMCOUNTER4, "mhpmcounter4", false, ANY },
+  { Csr::MHPMCOUNTER5, "mhpmcounter5", false, ANY },
+  { Csr::MHPMCOUNTER6, "mhpmcounter6", false, ANY },
+  { Csr::MHPMCOUNTER7, "mhpmcounter7", false, ANY },
+  { Csr::MHPMCOUNTER8, "mhpmcounter8", false, ANY },
+  { Csr::MHPMCOUNTER9, "mhpmcounter9", false, ANY },
+  { Csr::MHPMCOUNTER10, "mhpmcounter10", false, ANY },
+  { Csr::MHPMCOUNTER11, "mhpmcounter11", false, ANY },
+  { Csr::MHPMCOUNTER12, "mhpmcounter12", false, ANY },
+  { Csr::MHPMCOUNTER13, "mhpmcounter13", false, ANY },
+  { Csr::MHPMCOUNTER14, "mhpmcounter14", false, ANY },
+  { Csr::MHPMCOUNTER15, "mhpmcounter15", false, ANY },
+  { Csr::MHPMCOUNTER16, "mhpmcounter16", false, ANY },
+  { Csr::MHPMCOUNTER17, "mhpmcounter17", false, ANY },
+  { Csr::MHPMCOUNTER18, "mhpmcounter18", false, ANY },
+  { Csr::MHPMCOUNTER19, "mhpmcounter19", false, ANY },
+  { Csr::MHPMCOUNTER20, "mhpmcounter20", false, ANY },
+  { Csr::MHPMCOUNTER21, "mhpmcounter21", false, ANY },
+  { Csr::MHPMCOUNTER22, "mhpmcounter22", false, ANY },
+  { Csr::MHPMCOUNTER23, "mhpmcounter23", false, ANY },
+  { Csr::MHPMCOUNTER24, "mhpmcounter24", false, ANY },
+  { Csr::MHPMCOUNTER25, "mhpmcounter25", false, ANY },
+  { Csr::MHPMCOUNTER26, "mhpmcounter26", false, ANY },
+  { Csr::MHPMCOUNTER27, "mhpmcounter27", false, ANY },
+  { Csr::MHPMCOUNTER28, "mhpmcounter28", false, ANY },
+  { Csr::MHPMCOUNTER29, "mhpmcounter29", false, ANY },
+  { Csr::MHPMCOUNTER30, "mhpmcounter30", false, ANY },
+  { Csr::MHPMCOUNTER31, "mhpmcounter31", false, ANY },
+  { Csr::MCYCLEH, "mcycleh", false, ANY },
+  { Csr::MINSTRETH, "minstreth", false, ANY },
+  { Csr::MHPMCOUNTERH3, "mhpmcounterh3", false, ANY },
+  { Csr::MHPMCOUNTERH4, "mhpmcounterh4", false, ANY },
+  { Csr::MHPMCOUNTERH5, "mhpmcounterh5", false, ANY },
+  { Csr::MHPMCOUNTERH6, "mhpmcounterh6", false, ANY },
+  { Csr::MHPMCOUNTERH7, "mhpmcounterh7", false, ANY },
+  { Csr::MHPMCOUNTERH8, "mhpmcounterh8", false, ANY },
+  { Csr::MHPMCOUNTERH9, "mhpmcounterh9", false, ANY },
+  { Csr::MHPMCOUNTERH10, "mhpmcounterh10", false, ANY },
+  { Csr::MHPMCOUNTERH11, "mhpmcounterh11", false, ANY },
+  { Csr::MHPMCOUNTERH12, "mhpmcounterh12", false, ANY },
+  { Csr::MHPMCOUNTERH13, "mhpmcounterh13", false, ANY },
+  { Csr::MHPMCOUNTERH14, "mhpmcounterh14", false, ANY },
+  { Csr::MHPMCOUNTERH15, "mhpmcounterh15", false, ANY },
+  { Csr::MHPMCOUNTERH16, "mhpmcounterh16", false, ANY },
+  { Csr::MHPMCOUNTERH17, "mhpmcounterh17", false, ANY },
+  { Csr::MHPMCOUNTERH18, "mhpmcounterh18", false, ANY },
+  { Csr::MHPMCOUNTERH19, "mhpmcounterh19", false, ANY },
+  { Csr::MHPMCOUNTERH20, "mhpmcounterh20", false, ANY },
+  { Csr::MHPMCOUNTERH21, "mhpmcounterh21", false, ANY },
+  { Csr::MHPMCOUNTERH22, "mhpmcounterh22", false, ANY },
+  { Csr::MHPMCOUNTERH23, "mhpmcounterh23", false, ANY },
+  { Csr::MHPMCOUNTERH24, "mhpmcounterh24", false, ANY },
+  { Csr::MHPMCOUNTERH25, "mhpmcounterh25", false, ANY },
+  { Csr::MHPMCOUNTERH26, "mhpmcounterh26", false, ANY },
+  { Csr::MHPMCOUNTERH27, "mhpmcounterh27", false, ANY },
+  { Csr::MHPMCOUNTERH28, "mhpmcounterh28", false, ANY },
+  { Csr::MHPMCOUNTERH29, "mhpmcounterh29", false, ANY },
+  { Csr::MHPMCOUNTERH30, "mhpmcounterh30", false, ANY },
+  { Csr::MHPMCOUNTERH31, "mhpmcounterh31", false, ANY },
+  { Csr::MVENDORID, "mvendorid", true, ANY },
+  { Csr::MARCHID, "marchid", true, ANY },
+  { Csr::MIMPID, "mimpid", true, ANY },
+  { Csr::MHARTID, "mhartid", true, ANY }
+};
+
+/// \brief Must define as well as declare the table size before using.
+template <class DtmT>
+const size_t DmiT<DtmT>::NUM_CSRS
+    = sizeof (DmiT<DtmT>::CSR_INFO) / sizeof (DmiT<DtmT>::CSR_INFO[0]);
+
+/// \brief Encode a RISC-V load with zero offset
+///
+/// \param[in] funct3  The load width: 2 (lw), 4 (lbu) or 5 (lhu).
+/// \param[in] rd      Destination register.
+/// \param[in] rs1     Address register.
+/// \return The instruction.
+static uint32_t
+encodeLoad (const uint32_t funct3, const size_t rd, const size_t rs1)
+{
+  return (static_cast<uint32_t> (rs1) << 15) | (funct3 << 12)
+         | (static_cast<uint32_t> (rd) << 7) | 0x03;
+}
+
+/// \brief Encode a RISC-V store with zero offset
+///
+/// \param[in] funct3  The store width: 0 (sb), 1 (sh) or 2 (sw).
+/// \param[in] rs2     Data register.
+/// \param[in] rs1     Address register.
+/// \return The instruction.
+static uint32_t
+encodeStore (const uint32_t funct3, const size_t rs2, const size_t rs1)
+{
+  return (static_cast<uint32_t> (rs2) << 20)
+         | (static_cast<uint32_t> (rs1) << 15) | (funct3 << 12) | 0x23;
+}
+
+/// \brief Encode a RISC-V addi
+///
+/// \param[in] rd   Destination register.
+/// \param[in] rs1  Source register.
+/// \param[in] imm  Immediate (12-bit signed).
+/// \return The instruction.
+static uint32_t
+encodeAddi (const size_t rd, const size_t rs1, const int32_t imm)
+{
+  return ((static_cast<uint32_t> (imm) & 0xfff) << 20)
+         | (static_cast<uint32_t> (rs1) << 15)
+         | (static_cast<uint32_t> (rd) << 7) | 0x13;
+}
+
+/// \brief The RISC-V ebreak instruction
+static const uint32_t INSN_EBREAK = 0x00100073;
+
 /// \brief Constructor for the DMI
 ///
 /// The DTM has to be constructed locally, but is then passed to us, and we
@@ -35,32 +289,40 @@ using std::unique_ptr;
 /// We create local instances of all the interesting registers
 ///
 /// \param[in] dtm_  The Debug Transport Module we will use.
-Dmi::Dmi (unique_ptr<IDtm> dtm_) : mDtm (std::move (dtm_))
-{
-  mData.reset (new Data (mDtm));
-  mDmcontrol.reset (new Dmcontrol (mDtm));
-  mDmstatus.reset (new Dmstatus (mDtm));
-  mHartinfo.reset (new Hartinfo (mDtm));
-  mHaltsum.reset (new Haltsum (mDtm));
-  mHawindowsel.reset (new Hawindowsel (mDtm));
-  mHawindow.reset (new Hawindow (mDtm));
-  mAbstractcs.reset (new Abstractcs (mDtm));
-  mCommand.reset (new Command (mDtm));
-  mAbstractauto.reset (new Abstractauto (mDtm));
-  mConfstrptr.reset (new Confstrptr (mDtm));
-  mNextdm.reset (new Nextdm (mDtm));
-  mProgbuf.reset (new Progbuf (mDtm));
-  mAuthdata.reset (new Authdata (mDtm));
-  mSbaddress.reset (new Sbaddress (mDtm));
-  mSbcs.reset (new Sbcs (mDtm));
-  mSbdata.reset (new Sbdata (mDtm));
+template <class DtmT>
+DmiT<DtmT>::DmiT (unique_ptr<DtmT> dtm_)
+    : mDtm (std::move (dtm_)), mPollMinCycles (16), mPollMaxCycles (65536),
+      mPollTimeoutNs (0), mPollCount (0), mCmdRetries (CMD_RETRIES_DEFAULT),
+      mCmdMaxCycles (CMD_IDLE_MAX_DEFAULT), mCmdBusyRetries (0),
+      mCmdResets (0), mMemPath (MEM_SYSBUS),
+      mProgbufInsn (0), mSbBurst (true), mSbBurstIdle (SB_BURST_IDLE_DEFAULT),
+      mSbBursts (0), mSbBurstRetries (0), mCapsValid (false)
+{
+  mData.reset (new Data (mDtm.get ()));
+  mDmcontrol.reset (new Dmcontrol (mDtm.get ()));
+  mDmstatus.reset (new Dmstatus (mDtm.get ()));
+  mHartinfo.reset (new Hartinfo (mDtm.get ()));
+  mHaltsum.reset (new Haltsum (mDtm.get ()));
+  mHawindowsel.reset (new Hawindowsel (mDtm.get ()));
+  mHawindow.reset (new Hawindow (mDtm.get ()));
+  mAbstractcs.reset (new Abstractcs (mDtm.get ()));
+  mCommand.reset (new Command (mDtm.get ()));
+  mAbstractauto.reset (new Abstractauto (mDtm.get ()));
+  mConfstrptr.reset (new Confstrptr (mDtm.get ()));
+  mNextdm.reset (new Nextdm (mDtm.get ()));
+  mProgbuf.reset (new Progbuf (mDtm.get ()));
+  mAuthdata.reset (new Authdata (mDtm.get ()));
+  mSbaddress.reset (new Sbaddress (mDtm.get ()));
+  mSbcs.reset (new Sbcs (mDtm.get ()));
+  mSbdata.reset (new Sbdata (mDtm.get ()));
 }
 
 /// \brief Select a hart
 ///
 /// \param[in] h  Number of the hart to select
+template <class DtmT>
 void
-Dmi::selectHart (uint32_t h)
+DmiT<DtmT>::selectHart (uint32_t h)
 {
   mDmcontrol->reset ();
   mDmcontrol->hartsel (h);
@@ -74,8 +336,9 @@ Dmi::selectHart (uint32_t h)
 /// Spec v 0.13.2.
 ///
 /// \return The number of harts which exist
+template <class DtmT>
 uint32_t
-Dmi::hartsellen ()
+DmiT<DtmT>::hartsellen ()
 {
   selectHart (mDmcontrol->hartselMax ());
   mDmcontrol->reset ();
@@ -85,8 +348,9 @@ Dmi::hartsellen ()
 /// \brief Select and halt a hart
 ///
 /// \param[in] h  Number of the hart to select and halt
+template <class DtmT>
 void
-Dmi::haltHart (uint32_t h)
+DmiT<DtmT>::haltHart (uint32_t h)
 {
   mDmcontrol->reset ();
   mDmcontrol->haltreq (true);
@@ -95,21 +359,135 @@ Dmi::haltHart (uint32_t h)
   mDmcontrol->write ();
 }
 
+/// \brief Wait for the selected hart to halt
+///
+/// The status source is \c dmstatus, which covers the selected hart in a
+/// single DMI read.  Between polls the core runs with no DMI traffic for an
+/// exponentially growing number of clock cycles, from the minimum up to the
+/// cap set by Dmi::pollConfig.  This keeps the wall-clock time spent on JTAG
+/// low for long runs, while still responding quickly to short ones.
+///
+/// \return Whether the hart halted, or we timed out or the simulation
+///         finished first.
+template <class DtmT>
+typename DmiT<DtmT>::HaltWait
+DmiT<DtmT>::waitForHalt ()
+{
+  const uint64_t startNs = mDtm->simTimeNs ();
+  uint64_t cycles = mPollMinCycles;
+
+  while (true)
+    {
+      mDmstatus->read ();
+      mPollCount++;
+
+      if (mDmstatus->halted ())
+        return HALT_OK;
+
+      if ((mPollTimeoutNs != 0)
+          && ((mDtm->simTimeNs () - startNs) >= mPollTimeoutNs))
+        return HALT_TIMEOUT;
+
+      if (!mDtm->idle (cycles))
+        return HALT_SIM_DONE;
+
+      cycles = (cycles >= (mPollMaxCycles / 2)) ? mPollMaxCycles : cycles * 2;
+    }
+}
+
+/// \brief Configure polling of hart status
+///
+/// \param[in] minCycles  Initial clock cycles to run between polls.
+/// \param[in] maxCycles  Maximum clock cycles to run between polls.
+/// \param[in] timeoutNs  Simulated time after which to give up.  Zero means
+///                       never give up.
+template <class DtmT>
+void
+DmiT<DtmT>::pollConfig (uint64_t minCycles, uint64_t maxCycles,
+                        uint64_t timeoutNs)
+{
+  mPollMinCycles = (minCycles < 1) ? 1 : minCycles;
+  mPollMaxCycles = (maxCycles < mPollMinCycles) ? mPollMinCycles : maxCycles;
+  mPollTimeoutNs = timeoutNs;
+}
+
+/// \brief Report the polling configuration and count of polls
+///
+/// \param[in] stream  The stream on which to report.
+template <class DtmT>
+void
+DmiT<DtmT>::printPollConfig (std::ostream &stream) const
+{
+  stream << "Poll: " << mPollMinCycles << " to " << mPollMaxCycles
+         << " cycles between polls, timeout ";
+  if (mPollTimeoutNs == 0)
+    stream << "none";
+  else
+    stream << mPollTimeoutNs << " ns";
+  stream << ", " << mPollCount << " polls" << endl;
+}
+
+/// \brief Configure the retry of busy abstract commands
+///
+/// \param[in] retries    Times to reissue a command before resetting the
+///                       hart and debug module.  Zero means reset at once.
+/// \param[in] maxCycles  Maximum clock cycles to wait before reissuing.
+template <class DtmT>
+void
+DmiT<DtmT>::cmdRetryConfig (unsigned retries, uint32_t maxCycles)
+{
+  mCmdRetries = retries;
+  mCmdMaxCycles = maxCycles;
+  if (mCmdMaxCycles < CMD_IDLE_MIN)
+    mCmdMaxCycles = CMD_IDLE_MIN;
+}
+
+/// \brief Report the abstract command retry configuration and counts
+///
+/// \param[in] stream  The stream on which to report.
+template <class DtmT>
+void
+DmiT<DtmT>::printCmdRetry (std::ostream &stream) const
+{
+  stream << "Command retry: " << mCmdRetries << " retries, up to "
+         << mCmdMaxCycles << " cycles between, " << mCmdBusyRetries
+         << " retried, " << mCmdResets << " resets" << endl;
+}
+
+/// \brief Look up a CSR by address
+///
+/// The first call builds a direct index over the whole CSR address space, so
+/// every lookup is a single array access.
+///
+/// \param[in] csrAddr  The address of the CSR
+/// \return  The entry for the CSR, or \c nullptr if it does not exist
+template <class DtmT>
+const typename DmiT<DtmT>::CsrInfo *
+DmiT<DtmT>::csrInfo (const uint16_t csrAddr)
+{
+  static const std::vector<uint16_t> index = [] () {
+    std::vector<uint16_t> idx (CSR_SPACE, 0);
+    for (size_t i = 0; i < NUM_CSRS; i++)
+      idx[CSR_INFO[i].addr] = static_cast<uint16_t> (i + 1);
+    return idx;
+  }();
+
+  if ((csrAddr >= CSR_SPACE) || (index[csrAddr] == 0))
+    return nullptr;
+  else
+    return &CSR_INFO[index[csrAddr] - 1];
+}
+
 /// \brief Get a CSR's name from its address
 ///
 /// \param[in] csrAddr  The address of the CSR
 /// \return  The name of the CSR, or "UNKNOWN" if it does not exist
+template <class DtmT>
 const char *
-Dmi::csrName (const uint16_t csrAddr) const
+DmiT<DtmT>::csrName (const uint16_t csrAddr) const
 {
-  try
-    {
-      return mCsrMap.at (csrAddr).name;
-    }
-  catch (const std::out_of_range &oor)
-    {
-      return "UNKNOWN";
-    }
+  const CsrInfo *info = csrInfo (csrAddr);
+  return (info == nullptr) ? "UNKNOWN" : info->name;
 }
 
 /// \brief Get whether a CSR is readonly from its address
@@ -119,34 +497,57 @@ Dmi::csrName (const uint16_t csrAddr) const
 /// \param[in] csrAddr  The group the CSR belongs to
 /// \return  \c true if the CSR is read only, or if it does not exist, false
 ///          otherwise.
+template <class DtmT>
 bool
-Dmi::csrReadOnly (const uint16_t csrAddr) const
+DmiT<DtmT>::csrReadOnly (const uint16_t csrAddr) const
 {
-  try
-    {
-      return mCsrMap.at (csrAddr).readOnly;
-    }
-  catch (const std::out_of_range &oor)
-    {
-      return true;
-    }
+  const CsrInfo *info = csrInfo (csrAddr);
+  return (info == nullptr) ? true : info->readOnly;
 }
 
 /// \brief Get a CSR's type from its address
 ///
 /// \param[in] csrAddr  The group the CSR belongs to
 /// \return  The group of the CSR, or "NONE" if it does not exist
-Dmi::CsrType
-Dmi::csrType (const uint16_t csrAddr) const
+template <class DtmT>
+typename DmiT<DtmT>::CsrType
+DmiT<DtmT>::csrType (const uint16_t csrAddr) const
 {
-  try
-    {
-      return mCsrMap.at (csrAddr).type;
-    }
-  catch (const std::out_of_range &oor)
-    {
-      return NONE;
-    }
+  const CsrInfo *info = csrInfo (csrAddr);
+  return (info == nullptr) ? NONE : info->type;
+}
+
+/// \brief Get a CSR's address from its name
+///
+/// The first call builds an index of the CSRs sorted by name, which is then
+/// binary searched.
+///
+/// \param[in]  name     The name of the CSR
+/// \param[out] csrAddr  The address of the CSR, only valid if it exists
+/// \return  \c true if the CSR exists, \c false otherwise
+template <class DtmT>
+bool
+DmiT<DtmT>::csrAddr (const std::string &name, uint16_t &csrAddr) const
+{
+  auto nameLess = [] (const CsrInfo *a, const CsrInfo *b) {
+    return strcmp (a->name, b->name) < 0;
+  };
+  static const std::vector<const CsrInfo *> byName = [&nameLess] () {
+    std::vector<const CsrInfo *> v;
+    for (size_t i = 0; i < NUM_CSRS; i++)
+      v.push_back (&CSR_INFO[i]);
+    std::sort (v.begin (), v.end (), nameLess);
+    return v;
+  }();
+
+  CsrInfo key = { 0, name.c_str (), false, NONE };
+  auto it = std::lower_bound (byName.begin (), byName.end (), &key, nameLess);
+
+  if ((it == byName.end ()) || (name != (*it)->name))
+    return false;
+
+  csrAddr = (*it)->addr;
+  return true;
 }
 
 /// \brief Read a CSR.
@@ -154,61 +555,27 @@ Dmi::csrType (const uint16_t csrAddr) const
 /// \param[in]  addr  Address of the CSR to read.
 /// \param[out] res   The result of the read - only valid if there is no error.
 /// \return  The error code for the access.
-Dmi::Abstractcs::CmderrVal
-Dmi::readCsr (uint16_t addr, uint32_t &res)
-{
-  mCommand->reset ();
-  mCommand->cmdtype (Dmi::Command::ACCESS_REG);
-  mCommand->aarsize (Dmi::Command::ACCESS32);
-  mCommand->aatransfer (true);
-  mCommand->aawrite (false);
-  mCommand->aaregno (addr);
-  mCommand->write ();
-
-  // Check for any error
-  mAbstractcs->read ();
-  Abstractcs::CmderrVal err = mAbstractcs->cmderr ();
-
-  switch (err)
-    {
-    case Abstractcs::CMDERR_NONE:
-      // Good result, read the data into the result
-      mData->read (0);
-      res = mData->data (0);
-      return err;
-
-    case Abstractcs::CMDERR_BUSY:
-      // Debug unit is busy. This should not happen. Reset the hart, then the
-      // debug unit.
-      //
-      // TODO We should allow retry.
-
-      // Toggle ndmreset
-      for (bool flag : { true, false })
-        {
-          mDmcontrol->reset ();
-          mDmcontrol->ndmreset (flag);
-          mDmcontrol->write ();
-        }
+template <class DtmT>
+typename DmiT<DtmT>::Abstractcs::CmderrVal
+DmiT<DtmT>::readCsr (uint16_t addr, uint32_t &res)
+{
+  mCommand->command (Command::accessReg32 (addr, false));
 
-      // Toggle dmactive
-      for (bool flag : { false, true })
-        {
-          mDmcontrol->reset ();
-          mDmcontrol->dmactive (flag);
-          mDmcontrol->write ();
-        }
+  // Issue the command, check for any error and speculatively read the data
+  // as a single pipelined batch.  The data is only used if there was no
+  // error.
+  std::vector<IDtm::DmiOp> batch;
+  mCommand->queueWrite (batch);
+  std::size_t settlePos = batch.size ();
+  mAbstractcs->queueRead (batch);
+  mData->queueRead (0, batch);
 
-      return err;
+  typename Abstractcs::CmderrVal err = runCommand (batch, settlePos);
+  if (err == Abstractcs::CMDERR_NONE)
+    res = mData->data (0);
 
-    default:
-      // Otherwise bad result, clear the error. If the error is "busy", then
-      // we may have to reset the hart and then the debug unit.
-      mAbstractcs->cmderrClear ();
-      mAbstractcs->write ();
-      return err;
-    }
-};
+  return err;
+}
 
 /// \brief Write a CSR.
 ///
@@ -217,73 +584,212 @@ Dmi::readCsr (uint16_t addr, uint32_t &res)
 /// \param[in] addr  Address of the CSR to write.
 /// \param[in] val   The value to write to the CSR.
 /// \return  The error code for the access.
-Dmi::Abstractcs::CmderrVal
-Dmi::writeCsr (uint16_t addr, uint32_t val)
+template <class DtmT>
+typename DmiT<DtmT>::Abstractcs::CmderrVal
+DmiT<DtmT>::writeCsr (uint16_t addr, uint32_t val)
 {
   mData->reset (0);
   mData->data (0, val);
-  mData->write (0);
 
-  mCommand->reset ();
-  mCommand->cmdtype (Dmi::Command::ACCESS_REG);
-  mCommand->aarsize (Dmi::Command::ACCESS32);
-  mCommand->aatransfer (true);
-  mCommand->aawrite (true);
-  mCommand->aaregno (addr);
-  mCommand->write ();
+  mCommand->command (Command::accessReg32 (addr, true));
 
-  // Check for any error
-  mAbstractcs->read ();
-  Abstractcs::CmderrVal err = mAbstractcs->cmderr ();
+  // Write the data, issue the command and check for any error as a single
+  // pipelined batch.
+  std::vector<IDtm::DmiOp> batch;
+  mData->queueWrite (0, batch);
+  mCommand->queueWrite (batch);
+  std::size_t settlePos = batch.size ();
+  mAbstractcs->queueRead (batch);
 
-  switch (err)
+  return runCommand (batch, settlePos);
+}
+
+/// \brief Run a batch which issues a single abstract command
+///
+/// A busy error means the command, or an access to \c data0 after it, was
+/// made while an earlier command was still running.  We wait for
+/// \c abstractcs.busy to clear, clear \c cmderr and reissue the batch,
+/// with an idle after the command that doubles on each attempt.  Only once
+/// the retry budget set by Dmi::cmdRetryConfig is spent do we reset the
+/// hart and the debug module.  Any other error is just cleared.
+///
+/// If the command was accepted, but is still running when \c abstractcs is
+/// read, any results read after it are stale.  We wait for the command to
+/// finish and read them again.
+///
+/// \param[in,out] batch      The transactions to carry out.  Those from
+///                           \c settlePos on are a read of \c abstractcs,
+///                           then any reads of the command's results.
+/// \param[in]     settlePos  Where in \c batch to idle while the command
+///                           completes when reissuing, just after the write
+///                           of \c command.
+/// \return  The error code for the command.
+template <class DtmT>
+typename DmiT<DtmT>::Abstractcs::CmderrVal
+DmiT<DtmT>::runCommand (std::vector<IDtm::DmiOp> &batch,
+                        const std::size_t settlePos)
+{
+  uint32_t cycles = CMD_IDLE_MIN;
+
+  for (unsigned attempt = 0;; attempt++)
     {
-    case Abstractcs::CMDERR_NONE:
-      // Good result, nothing to do.
-      return err;
+      mDtm->dmiBatch (batch);
+      typename Abstractcs::CmderrVal err = mAbstractcs->cmderr ();
 
-    case Abstractcs::CMDERR_BUSY:
-      // Debug unit is busy. This should not happen. Reset the hart, then the
-      // debug unit.
-      //
-      // TODO We should allow retry.
+      if ((err == Abstractcs::CMDERR_NONE) && mAbstractcs->busy ())
+        err = rereadResults (batch, settlePos);
 
-      // Toggle ndmreset
-      for (bool flag : { true, false })
+      if (err == Abstractcs::CMDERR_NONE)
+        return err;
+      else if (err != Abstractcs::CMDERR_BUSY)
         {
-          mDmcontrol->reset ();
-          mDmcontrol->ndmreset (flag);
-          mDmcontrol->write ();
+          mAbstractcs->cmderrClear ();
+          mAbstractcs->write ();
+          return err;
         }
 
-      // Toggle dmactive
-      for (bool flag : { false, true })
+      if ((attempt >= mCmdRetries) || !waitCmdNotBusy ())
         {
-          mDmcontrol->reset ();
-          mDmcontrol->dmactive (flag);
-          mDmcontrol->write ();
+          cerr << "Warning: Abstract command still busy after " << attempt
+               << " retries: resetting hart and debug module" << endl;
+          mCmdResets++;
+          resetAfterBusy ();
+          return err;
         }
 
-      return err;
+      mAbstractcs->cmderrClear ();
+      mAbstractcs->write ();
+      mCmdBusyRetries++;
+
+      // Give the command time to complete before the rest of the batch.
+      if (attempt == 0)
+        batch.insert (batch.begin () + settlePos,
+                      { IDtm::DmiOp::IDLE, 0, cycles, nullptr });
+      else
+        batch[settlePos].wdata = cycles;
+      cycles = (cycles >= (mCmdMaxCycles / 2)) ? mCmdMaxCycles : cycles * 2;
+    }
+}
 
-    default:
-      // Otherwise bad result, clear the error. If the error is "busy", then
-      // we may have to reset the hart and then the debug unit.
+/// \brief Read the results of a command again once it has finished
+///
+/// Used when \c abstractcs showed the command still running.  Reading its
+/// results while it ran will have set \c cmderr to busy, so that is cleared
+/// first.
+///
+/// \param[in] batch      The transactions which issued the command, as for
+///                       Dmi::runCommand.
+/// \param[in] settlePos  Where the reads of \c abstractcs and of the results
+///                       start in \c batch, as for Dmi::runCommand.
+/// \return  The error code for the command, which is busy if it did not
+///          finish in time.
+template <class DtmT>
+typename DmiT<DtmT>::Abstractcs::CmderrVal
+DmiT<DtmT>::rereadResults (const std::vector<IDtm::DmiOp> &batch,
+                           const std::size_t settlePos)
+{
+  if (!waitCmdNotBusy ())
+    return Abstractcs::CMDERR_BUSY;
+
+  if (mAbstractcs->cmderr () != Abstractcs::CMDERR_NONE)
+    {
       mAbstractcs->cmderrClear ();
       mAbstractcs->write ();
-      return err;
     }
-};
+
+  // The results, then abstractcs again to check they were read cleanly
+  std::vector<IDtm::DmiOp> reads;
+  for (std::size_t i = settlePos; i < batch.size (); i++)
+    if (batch[i].type == IDtm::DmiOp::READ)
+      reads.push_back (batch[i]);
+  std::rotate (reads.begin (), reads.begin () + 1, reads.end ());
+  mDtm->dmiBatch (reads);
+
+  if (mAbstractcs->busy ())
+    return Abstractcs::CMDERR_BUSY;
+  return mAbstractcs->cmderr ();
+}
+
+/// \brief Wait for \c abstractcs.busy to clear
+///
+/// Polls back off as for Dmi::runCommand, within the same budget.
+///
+/// \return  \c true if the debug module is no longer busy, \c false if the
+///          budget ran out or the simulation finished first.
+template <class DtmT>
+bool
+DmiT<DtmT>::waitCmdNotBusy ()
+{
+  uint32_t cycles = CMD_IDLE_MIN;
+
+  for (unsigned poll = 0; poll <= mCmdRetries; poll++)
+    {
+      mAbstractcs->read ();
+      if (!mAbstractcs->busy ())
+        return true;
+      if (!mDtm->idle (cycles))
+        return false;
+      cycles = (cycles >= (mCmdMaxCycles / 2)) ? mCmdMaxCycles : cycles * 2;
+    }
+
+  return false;
+}
+
+/// \brief Reset the hart, then the debug module
+///
+/// The last resort for an abstract command which stays busy.  Resetting the
+/// debug module also clears the program buffer and \c cmderr.
+template <class DtmT>
+void
+DmiT<DtmT>::resetAfterBusy ()
+{
+  // Toggle ndmreset
+  for (bool flag : { true, false })
+    {
+      mDmcontrol->reset ();
+      mDmcontrol->ndmreset (flag);
+      mDmcontrol->write ();
+    }
+
+  // Toggle dmactive, which also clears the program buffer
+  for (bool flag : { false, true })
+    {
+      mDmcontrol->reset ();
+      mDmcontrol->dmactive (flag);
+      mDmcontrol->write ();
+    }
+  mProgbufInsn = 0;
+  invalidateShadows ();
+}
+
+/// \brief Recover from a failed sequence using auto-execution
+///
+/// A write to \c abstractauto while a command is running is ignored, so wait
+/// for the last command to finish before turning auto-execution off.
+/// Otherwise the next access to \c data0 would run the old command again.
+/// Then clear \c cmderr, so single commands can be used instead.
+template <class DtmT>
+void
+DmiT<DtmT>::stopAutoexec ()
+{
+  static_cast<void> (waitCmdNotBusy ());
+  mAbstractauto->reset ();
+  mAbstractauto->write ();
+  mAbstractcs->read ();
+  mAbstractcs->cmderrClear ();
+  mAbstractcs->write ();
+}
 
 /// \brief Read a general purpose register
 ///
 /// \param[in] regNum  Number of the register to read.
 /// \param[out] res   The result of the read - only valid if there is no error.
 /// \return  The error code for the access.
-Dmi::Abstractcs::CmderrVal
-Dmi::readGpr (size_t regNum, uint32_t &res)
+template <class DtmT>
+typename DmiT<DtmT>::Abstractcs::CmderrVal
+DmiT<DtmT>::readGpr (size_t regNum, uint32_t &res)
 {
-  Abstractcs::CmderrVal err
+  typename Abstractcs::CmderrVal err
       = readCsr (GPR_BASE + static_cast<uint16_t> (regNum), res);
   return err;
 }
@@ -293,22 +799,143 @@ Dmi::readGpr (size_t regNum, uint32_t &res)
 /// \param[in] regNum  Number of the register to write.
 /// \param[in] val     The value to write to the register.
 /// \return  The error code for the access.
-Dmi::Abstractcs::CmderrVal
-Dmi::writeGpr (size_t regNum, uint32_t val)
+template <class DtmT>
+typename DmiT<DtmT>::Abstractcs::CmderrVal
+DmiT<DtmT>::writeGpr (size_t regNum, uint32_t val)
 {
   return writeCsr (GPR_BASE + static_cast<uint16_t> (regNum), val);
 }
 
+/// \brief Read a contiguous set of general purpose registers
+///
+/// The register access command is issued once, with \c aapostincrement set
+/// so \c regno advances after each execution, and with \c autoexecdata set
+/// for \c data0, so each read of \c data0 executes the command again to
+/// fetch the next register.  Each register after the first thus costs a
+/// single DMI read, rather than three.  Auto-execution is turned off before
+/// the last read, so we never access a register beyond the last requested.
+///
+/// If the debug module reports an error (for example if it was still busy
+/// when \c data0 was read) we clear it and fall back to reading the
+/// registers individually.
+///
+/// \param[in]  first  Number of the first register to read.
+/// \param[in]  count  Number of registers to read.
+/// \param[out] res    The results - only valid if there is no error.
+/// \return  The error code for the access.
+template <class DtmT>
+typename DmiT<DtmT>::Abstractcs::CmderrVal
+DmiT<DtmT>::readGprs (size_t first, size_t count, uint32_t res[])
+{
+  if (count == 0)
+    return Abstractcs::CMDERR_NONE;
+  else if (count == 1)
+    return readGpr (first, res[0]);
+
+  mCommand->command (Command::accessReg32 (
+      GPR_BASE + static_cast<uint16_t> (first), false, false, true));
+
+  std::vector<IDtm::DmiOp> batch;
+  mCommand->queueWrite (batch);
+  mAbstractauto->reset ();
+  mAbstractauto->autoexecdata (1);
+  mAbstractauto->queueWrite (batch);
+
+  for (size_t i = 0; i < (count - 1); i++)
+    mData->queueRead (0, batch, &res[i]);
+
+  mAbstractauto->reset ();
+  mAbstractauto->queueWrite (batch);
+  mData->queueRead (0, batch, &res[count - 1]);
+  mAbstractcs->queueRead (batch);
+  mDtm->dmiBatch (batch);
+
+  if ((mAbstractcs->cmderr () == Abstractcs::CMDERR_NONE)
+      && !mAbstractcs->busy ())
+    return Abstractcs::CMDERR_NONE;
+
+  // Make sure auto-execution is off and try the slow way
+  stopAutoexec ();
+
+  for (size_t i = 0; i < count; i++)
+    {
+      typename Abstractcs::CmderrVal err = readGpr (first + i, res[i]);
+      if (err != Abstractcs::CMDERR_NONE)
+        return err;
+    }
+
+  return Abstractcs::CMDERR_NONE;
+}
+
+/// \brief Write a contiguous set of general purpose registers
+///
+/// The counterpart of Dmi::readGprs.  The command writes the first register
+/// from \c data0, and each subsequent write of \c data0 executes it again
+/// for the next register.
+///
+/// \param[in] first  Number of the first register to write.
+/// \param[in] count  Number of registers to write.
+/// \param[in] val    The values to write.
+/// \return  The error code for the access.
+template <class DtmT>
+typename DmiT<DtmT>::Abstractcs::CmderrVal
+DmiT<DtmT>::writeGprs (size_t first, size_t count, const uint32_t val[])
+{
+  if (count == 0)
+    return Abstractcs::CMDERR_NONE;
+  else if (count == 1)
+    return writeGpr (first, val[0]);
+
+  mCommand->command (Command::accessReg32 (
+      GPR_BASE + static_cast<uint16_t> (first), true, false, true));
+
+  std::vector<IDtm::DmiOp> batch;
+  mData->data (0, val[0]);
+  mData->queueWrite (0, batch);
+  mCommand->queueWrite (batch);
+  mAbstractauto->reset ();
+  mAbstractauto->autoexecdata (1);
+  mAbstractauto->queueWrite (batch);
+
+  for (size_t i = 1; i < count; i++)
+    {
+      mData->data (0, val[i]);
+      mData->queueWrite (0, batch);
+    }
+
+  mAbstractauto->reset ();
+  mAbstractauto->queueWrite (batch);
+  mAbstractcs->queueRead (batch);
+  mDtm->dmiBatch (batch);
+
+  if ((mAbstractcs->cmderr () == Abstractcs::CMDERR_NONE)
+      && !mAbstractcs->busy ())
+    return Abstractcs::CMDERR_NONE;
+
+  // Make sure auto-execution is off and try the slow way
+  stopAutoexec ();
+
+  for (size_t i = 0; i < count; i++)
+    {
+      typename Abstractcs::CmderrVal err = writeGpr (first + i, val[i]);
+      if (err != Abstractcs::CMDERR_NONE)
+        return err;
+    }
+
+  return Abstractcs::CMDERR_NONE;
+}
+
 /// \brief Read a floating point register
 ///
 /// \param[in] regNum  Number of the register to read.
 /// \param[out] res   The result of the read - only valid if there is no error.
 /// \return  The error code for the access.
-Dmi::Abstractcs::CmderrVal
-Dmi::readFpr (size_t regNum, uint32_t &res)
+template <class DtmT>
+typename DmiT<DtmT>::Abstractcs::CmderrVal
+DmiT<DtmT>::readFpr (size_t regNum, uint32_t &res)
 {
   uint16_t csrNum = FPR_BASE + static_cast<uint16_t> (regNum);
-  Abstractcs::CmderrVal err = readCsr (csrNum, res);
+  typename Abstractcs::CmderrVal err = readCsr (csrNum, res);
   return err;
 }
 
@@ -317,8 +944,9 @@ Dmi::readFpr (size_t regNum, uint32_t &res)
 /// \param[in] regNum  Number of the register to write.
 /// \param[in] val     The value to write to the register.
 /// \return  The error code for the access.
-Dmi::Abstractcs::CmderrVal
-Dmi::writeFpr (size_t regNum, uint32_t val)
+template <class DtmT>
+typename DmiT<DtmT>::Abstractcs::CmderrVal
+DmiT<DtmT>::writeFpr (size_t regNum, uint32_t val)
 {
   uint16_t csrNum = FPR_BASE + static_cast<uint16_t> (regNum);
   return writeCsr (csrNum, val);
@@ -327,167 +955,627 @@ Dmi::writeFpr (size_t regNum, uint32_t val)
 /// \brief Read from memory
 ///
 /// We can't use the abstract command approach, since the MemoryAccess command
-/// is not implemented. For now we use the System Bus.
+/// is not implemented.  By default we use the System Bus, but if the program
+/// buffer path is selected we use that instead while the hart is halted.
 ///
-/// \note This is problematic, since the system bus only permits 32-bit reads,
-///       potentially troublesome for volatile memory locations.
+/// \see Dmi::memPath
 ///
-/// \todo There is a known hardware design issue, where system bus accesses
-///       always succeed, even if there is no memory at the location. Reads
-///       will return 0xbadcab1e.
+/// The bytes are transferred directly to the caller's buffer, with no
+/// intermediate copy.
 ///
 /// \param[in]  addr    Address to read from
 /// \param[in]  nBytes  Number of bytes to read
-/// \param[out] buf     Buffer for storing the bytes read
+/// \param[out] buf     Buffer of at least \p nBytes for storing the bytes read
 /// \return  The error code for the access.
-Dmi::Sbcs::SberrorVal
-Dmi::readMem (uint64_t addr, size_t nBytes, unique_ptr<uint8_t[]> &buf)
+template <class DtmT>
+typename DmiT<DtmT>::Sbcs::SberrorVal
+DmiT<DtmT>::readMem (uint64_t addr, size_t nBytes, uint8_t *buf)
 {
-  uint32_t startAddr = addr & 0xfffffffc;
-  uint32_t endAddr = (addr + nBytes + 3) & 0xfffffffc;
-  size_t nWords = (endAddr - startAddr) / 4;
-  size_t bufIndex = 0;
-  uint32_t w;
-
-  // Set up systembus to read on setting the address or reading the data and
-  // autoincrement if we need to read more than one word
-  mSbcs->reset ();
-  mSbcs->sbreadonaddr (true);
-  mSbcs->sbaccess (Sbcs::SBACCESS_32);
-  mSbcs->sbautoincrement (nWords > 1);
-  mSbcs->sbreadondata (true);
-  mSbcs->sberrorClear ();
-  mSbcs->write ();
+  if (mMemPath == MEM_PROGBUF)
+    {
+      typename Abstractcs::CmderrVal err
+          = progbufMem (addr, nBytes, buf, nullptr);
+      if (err == Abstractcs::CMDERR_NONE)
+        return Sbcs::SBERR_NONE;
+      else if (err == Abstractcs::CMDERR_EXCEPT)
+        return Sbcs::SBERR_BAD_ADDR;
+
+      // Otherwise the hart is running or there is no usable program buffer,
+      // so fall through to the System Bus.
+    }
 
-  // Initial word, which may be different from the actual start address if the
-  // start is misaligned. Setting the address will cause the first read.
-  mSbaddress->reset (0);
-  mSbaddress->sbaddress (0, startAddr);
-  mSbaddress->write (0);
+  return readMemSysbus (addr, nBytes, buf);
+}
 
-  do
-    mSbcs->read ();
-  while (mSbcs->sbbusy ());
+/// \brief Write to memory
+///
+/// The counterpart of Dmi::readMem.
+///
+/// \param[in] addr    Address to write to
+/// \param[in] nBytes  Number of bytes to write
+/// \param[in] buf     Buffer of at least \p nBytes with the bytes to write
+/// \return  The error code for the access.
+template <class DtmT>
+typename DmiT<DtmT>::Sbcs::SberrorVal
+DmiT<DtmT>::writeMem (uint64_t addr, size_t nBytes, const uint8_t *buf)
+{
+  if (mMemPath == MEM_PROGBUF)
+    {
+      typename Abstractcs::CmderrVal err
+          = progbufMem (addr, nBytes, nullptr, buf);
+      if (err == Abstractcs::CMDERR_NONE)
+        return Sbcs::SBERR_NONE;
+      else if (err == Abstractcs::CMDERR_EXCEPT)
+        return Sbcs::SBERR_BAD_ADDR;
+    }
 
-  Sbcs::SberrorVal err = mSbcs->sberror ();
-  if (err != Sbcs::SBERR_NONE)
-    return err;
+  return writeMemSysbus (addr, nBytes, buf);
+}
 
-  // Get the read data, which will trigger the next read if we have
-  // autoincrement set.
-  mSbdata->read (0);
-  w = mSbdata->sbdata (0);
+/// \brief Select the route taken by memory accesses
+///
+/// \param[in] path  The route to use.
+template <class DtmT>
+void
+DmiT<DtmT>::memPath (const MemPath path)
+{
+  mMemPath = path;
+}
 
-  size_t offset = (addr - startAddr);
-  for (size_t i = offset; i < min (offset + nBytes, static_cast<size_t> (4)); i++)
-    {
-      uint8_t ch = static_cast<uint8_t> ((w >> (8 * i)) & 0xff);
-      buf[bufIndex++] = ch;
-    }
+/// \brief Get the route taken by memory accesses
+///
+/// \return The route in use.
+template <class DtmT>
+typename DmiT<DtmT>::MemPath
+DmiT<DtmT>::memPath () const
+{
+  return mMemPath;
+}
 
-  startAddr += 4;
-  if (startAddr == endAddr) // Read was just a single word or less
-    return Sbcs::SBERR_NONE;
+/// \brief Read from memory using the System Bus
+///
+/// The block is split into chunks, each using the widest access size the bus
+/// supports for its alignment and length.  So an aligned interior is read
+/// with the widest access, while the edges fall back to narrower accesses.
+/// If the bus cannot make an access narrow enough for an edge, the edge is
+/// read as part of its enclosing word.
+///
+/// Each chunk is first tried in burst mode, and only if that reports an error
+/// is it repeated polling the bus after each word.
+///
+/// \param[in]  addr    Address to read from
+/// \param[in]  nBytes  Number of bytes to read
+/// \param[out] buf     Buffer for storing the bytes read
+/// \return  The error code for the access.
+template <class DtmT>
+typename DmiT<DtmT>::Sbcs::SberrorVal
+DmiT<DtmT>::readMemSysbus (uint64_t addr, size_t nBytes, uint8_t *buf)
+{
+  if (!mSbBurst)
+    return readMemPolled (addr, nBytes, buf);
 
-  // Bulk of the words
-  for (; startAddr < (endAddr - 4); startAddr += 4)
+  uint8_t *p = buf;
+  while (nBytes > 0)
     {
-      do
-        mSbcs->read ();
-      while (mSbcs->sbbusy ());
+      size_t size = sbChunkSize (addr, nBytes);
+      size_t len;
+      typename Sbcs::SberrorVal err = Sbcs::SBERR_NONE;
+
+      if (size == 0)
+        {
+          // Edge the bus cannot access exactly
+          len = min (nBytes, static_cast<size_t> (4 - (addr & 0x3)));
+          err = readMemPolled (addr, len, p);
+        }
+      else
+        {
+          len = (size == sbWidest ()) ? (nBytes / size) * size : size;
+          if (!readMemBurst (addr, size, len / size, p))
+            {
+              mSbBurstRetries++;
+              err = readMemPolled (addr, len, p);
+            }
+        }
 
-      err = mSbcs->sberror ();
       if (err != Sbcs::SBERR_NONE)
         return err;
 
-      mSbdata->read (0);
-      w = mSbdata->sbdata (0);
-
-      for (size_t i = 0; i < 4; i++)
-        {
-	  uint8_t ch = static_cast<uint8_t> (w & 0xff);
-          buf[bufIndex++] = ch;
-          w = w >> 8;
-        }
+      addr += len;
+      p += len;
+      nBytes -= len;
     }
 
-  // Final word, which may be different the actual end address if the
-  // end is misaligned
-  do
-    mSbcs->read ();
-  while (mSbcs->sbbusy ());
+  return Sbcs::SBERR_NONE;
+}
 
-  err = mSbcs->sberror ();
-  if (err != Sbcs::SBERR_NONE)
-    return err;
+/// \brief Write to memory using the System Bus
+///
+/// The block is split into chunks in the same way as for Dmi::readMemSysbus,
+/// and each chunk first tried in burst mode.  In particular, bytes and
+/// halfwords at a misaligned start or end are written with exact 8- or 16-bit
+/// accesses when the bus supports them, so a small misaligned write is a
+/// single transaction and does not disturb its neighbours.  Only if the bus
+/// cannot make an access narrow enough do we fall back to a read-modify-write
+/// of the enclosing word.
+///
+/// With burst mode disabled, whole words are written polling the bus after
+/// each one, but the edges are still written exactly where possible.
+///
+/// \param[in] addr    Address to write to
+/// \param[in] nBytes  Number of bytes to write
+/// \param[in] buf     Buffer with the bytes to write
+/// \return  The error code for the access.
+template <class DtmT>
+typename DmiT<DtmT>::Sbcs::SberrorVal
+DmiT<DtmT>::writeMemSysbus (uint64_t addr, size_t nBytes, const uint8_t *buf)
+{
+  const uint8_t *p = buf;
+  while (nBytes > 0)
+    {
+      size_t size = sbChunkSize (addr, nBytes);
+      size_t len;
+      typename Sbcs::SberrorVal err = Sbcs::SBERR_NONE;
 
-  mSbdata->read (0);
-  w = mSbdata->sbdata (0);
+      if (size == 0)
+        {
+          // Edge the bus cannot access exactly
+          len = min (nBytes, static_cast<size_t> (4 - (addr & 0x3)));
+          err = writeMemPolled (addr, len, p);
+        }
+      else if (!mSbBurst && (size >= 4))
+        {
+          // All the whole words
+          len = static_cast<size_t> (((addr + nBytes) & ~0x3ULL) - addr);
+          err = writeMemPolled (addr, len, p);
+        }
+      else
+        {
+          len = (size == sbWidest ()) ? (nBytes / size) * size : size;
+          if (!writeMemBurst (addr, size, len / size, p))
+            {
+              mSbBurstRetries++;
+              err = writeMemPolled (addr, len, p);
+            }
+        }
 
-  offset = endAddr - (addr + nBytes);
-  for (size_t i = 0; i < 4 - offset; i++)
-    {
-      uint8_t ch = static_cast<uint8_t> (w & 0xff);
-      buf[bufIndex++] = ch;
-      w = w >> 8;
+      if (err != Sbcs::SBERR_NONE)
+        return err;
+
+      addr += len;
+      p += len;
+      nBytes -= len;
     }
 
   return Sbcs::SBERR_NONE;
 }
 
-/// \brief Write to memory
+/// \brief Read a chunk of memory using the System Bus in burst mode
+///
+/// The bus is set to read on setting the address and on reading the data,
+/// with auto-increment, so each access costs one DMI read per 32 bits.  For
+/// accesses wider than 32 bits, the upper \c sbdata registers are read
+/// before \c sbdata0, since it is reading \c sbdata0 which starts the next
+/// access.  Rather than polling \c sbbusy, we let the MCU run for a
+/// calibrated number of clock cycles before each access is collected, and
+/// check \c sbbusyerror and \c sberror once at the end.  Read on data is
+/// turned off before the last access is collected, so we never read beyond
+/// the chunk.
+///
+/// If \c sbbusyerror is set, the idle time was too short, so it is doubled
+/// for next time.
+///
+/// \param[in]  addr   Address to read from, aligned to \p size.
+/// \param[in]  size   Size of each access in bytes (1, 2, 4, 8 or 16).
+/// \param[in]  count  Number of accesses.
+/// \param[out] buf    Buffer for storing the bytes read.
+/// \return \c true if the chunk was read without error, \c false if it must
+///         be read again in polled mode.
+template <class DtmT>
+bool
+DmiT<DtmT>::readMemBurst (uint64_t addr, size_t size, size_t count,
+                          uint8_t *buf)
+{
+  size_t nRegs = (size + 3) / 4;
+  uint8_t access = sbAccessCode (size);
+  std::vector<uint32_t> &vals = mMemWords;
+  std::vector<IDtm::DmiOp> &batch = mMemBatch;
+
+  vals.resize (count * nRegs);
+  batch.clear ();
+  mSbBursts++;
+
+  mSbcs->sbcs (Sbcs::config (access, true, count > 1, count > 1));
+  mSbcs->sberrorClear ();
+  mSbcs->sbbusyerrorClear ();
+  mSbaddress->reset (0);
+  mSbaddress->sbaddress (0, static_cast<uint32_t> (addr));
+
+  mSbcs->queueWrite (batch);
+  mSbaddress->queueWrite (0, batch);
+
+  for (size_t i = 0; i < count; i++)
+    {
+      batch.push_back ({ IDtm::DmiOp::IDLE, 0, mSbBurstIdle, nullptr });
+
+      // Don't trigger a read beyond the end
+      if ((count > 1) && (i == (count - 1)))
+        {
+          mSbcs->sbcs (Sbcs::config (access, false, false, false));
+          mSbcs->queueWrite (batch);
+        }
+
+      for (size_t r = nRegs - 1; r > 0; r--)
+        mSbdata->queueRead (r, batch, &vals[i * nRegs + r]);
+      mSbdata->queueRead (0, batch, &vals[i * nRegs]);
+    }
+
+  mSbcs->queueRead (batch);
+  mDtm->dmiBatch (batch);
+
+  if (!sbBurstOk ())
+    return false;
+
+  for (size_t i = 0; i < count; i++)
+    for (size_t r = 0; r < nRegs; r++)
+      Utils::storeLe (buf + i * size + r * 4, vals[i * nRegs + r],
+                      min (size, static_cast<size_t> (4)));
+
+  return true;
+}
+
+/// \brief Write a chunk of memory using the System Bus in burst mode
 ///
-/// We can't use the abstract command approach, since the MemoryAccess command
-/// is not implemented. For now we use the System Bus.
+/// The counterpart of Dmi::readMemBurst.  Each access costs one DMI write
+/// per 32 bits, followed by the calibrated idle time.  The upper \c sbdata
+/// registers are written before \c sbdata0, since it is writing \c sbdata0
+/// which starts the access.
+///
+/// \param[in] addr   Address to write to, aligned to \p size.
+/// \param[in] size   Size of each access in bytes (1, 2, 4, 8 or 16).
+/// \param[in] count  Number of accesses.
+/// \param[in] buf    Buffer with the bytes to write.
+/// \return \c true if the chunk was written without error, \c false if it
+///         must be written again in polled mode.
+template <class DtmT>
+bool
+DmiT<DtmT>::writeMemBurst (uint64_t addr, size_t size, size_t count,
+                           const uint8_t *buf)
+{
+  size_t nRegs = (size + 3) / 4;
+  std::vector<IDtm::DmiOp> &batch = mMemBatch;
+
+  batch.clear ();
+  mSbBursts++;
+
+  mSbcs->sbcs (Sbcs::config (sbAccessCode (size), false, count > 1, false));
+  mSbcs->sberrorClear ();
+  mSbcs->sbbusyerrorClear ();
+  mSbaddress->reset (0);
+  mSbaddress->sbaddress (0, static_cast<uint32_t> (addr));
+
+  mSbcs->queueWrite (batch);
+  mSbaddress->queueWrite (0, batch);
+
+  for (size_t i = 0; i < count; i++)
+    {
+      for (size_t r = nRegs; r > 0; r--)
+        {
+          mSbdata->sbdata (
+              r - 1, Utils::loadLe (buf + i * size + (r - 1) * 4,
+                                    min (size, static_cast<size_t> (4))));
+          mSbdata->queueWrite (r - 1, batch);
+        }
+
+      batch.push_back ({ IDtm::DmiOp::IDLE, 0, mSbBurstIdle, nullptr });
+    }
+
+  mSbcs->queueRead (batch);
+  mDtm->dmiBatch (batch);
+
+  return sbBurstOk ();
+}
+
+/// \brief Find the access sizes the System Bus supports
+///
+/// \return A mask of supported sizes in bytes: bit \c n set means accesses
+///         of \c 2^n bytes are supported.
+template <class DtmT>
+uint8_t
+DmiT<DtmT>::sbSizes ()
+{
+  return caps ().sbSizes;
+}
+
+/// \brief The widest access the System Bus supports
+///
+/// \return The size of the widest access in bytes.
+template <class DtmT>
+size_t
+DmiT<DtmT>::sbWidest ()
+{
+  uint8_t sizes = sbSizes ();
+  size_t widest = 1;
+
+  for (uint8_t code = 0; code <= Sbcs::SBACCESS_128; code++)
+    if ((sizes & (1 << code)) != 0)
+      widest = static_cast<size_t> (1) << code;
+
+  return widest;
+}
+
+/// \brief Choose the access size for the next chunk of a block
+///
+/// \param[in] addr    Address of the start of the chunk.
+/// \param[in] nBytes  Bytes remaining in the block.
+/// \return The largest supported access size in bytes to which \p addr is
+///         aligned and which does not exceed \p nBytes, or zero if there is
+///         none.
+template <class DtmT>
+size_t
+DmiT<DtmT>::sbChunkSize (uint64_t addr, size_t nBytes)
+{
+  uint8_t sizes = sbSizes ();
+
+  for (int code = Sbcs::SBACCESS_128; code >= Sbcs::SBACCESS_8; code--)
+    {
+      size_t size = static_cast<size_t> (1) << code;
+      if (((sizes & (1 << code)) != 0) && ((addr & (size - 1)) == 0)
+          && (size <= nBytes))
+        return size;
+    }
+
+  return 0;
+}
+
+/// \brief The \c sbaccess code for an access size
+///
+/// \param[in] size  Size of access in bytes (1, 2, 4, 8 or 16).
+/// \return The \c sbaccess code.
+template <class DtmT>
+uint8_t
+DmiT<DtmT>::sbAccessCode (size_t size)
+{
+  uint8_t code = 0;
+
+  while ((static_cast<size_t> (1) << code) < size)
+    code++;
+
+  return code;
+}
+
+/// \brief Check the outcome of a System Bus burst
+///
+/// Relies on \c sbcs having been read at the end of the burst.  The last
+/// access may still be running, so we wait for \c sbbusy to clear before
+/// looking at the error bits.  Any error is cleared.  If \c sbbusyerror is
+/// set, the idle time between accesses is doubled, up to a limit.
+///
+/// \return \c true if the burst completed without error.
+template <class DtmT>
+bool
+DmiT<DtmT>::sbBurstOk ()
+{
+  while (mSbcs->sbbusy () && !mDtm->simDone ())
+    mSbcs->read ();
+
+  bool busyErr = mSbcs->sbbusyerror ();
+
+  if (!busyErr && (mSbcs->sberror () == Sbcs::SBERR_NONE))
+    return true;
+
+  mSbcs->reset ();
+  mSbcs->sberrorClear ();
+  mSbcs->sbbusyerrorClear ();
+  mSbcs->write ();
+
+  if (busyErr)
+    {
+      mSbBurstIdle = (mSbBurstIdle == 0) ? 1 : mSbBurstIdle * 2;
+      if (mSbBurstIdle > SB_BURST_IDLE_MAX)
+        mSbBurstIdle = SB_BURST_IDLE_MAX;
+    }
+
+  return false;
+}
+
+/// \brief Check the outcome of a polled System Bus access
+///
+/// Relies on \c sbcs having been read once \c sbbusy is clear.  If
+/// \c sbbusyerror is set, an access was started or its data collected while
+/// the bus was still busy, so the data cannot be trusted even though
+/// \c sberror is clear.
+///
+/// \return The value of \c sberror, or Sbcs::SBERR_OTHER if only
+///         \c sbbusyerror is set.
+template <class DtmT>
+typename DmiT<DtmT>::Sbcs::SberrorVal
+DmiT<DtmT>::sbPolledError ()
+{
+  typename Sbcs::SberrorVal err = mSbcs->sberror ();
+
+  if ((err == Sbcs::SBERR_NONE) && mSbcs->sbbusyerror ())
+    err = Sbcs::SBERR_OTHER;
+
+  return err;
+}
+
+/// \brief Enable or disable System Bus burst mode
+///
+/// \param[in] enable  \c true to use burst mode for blocks of memory.
+template <class DtmT>
+void
+DmiT<DtmT>::sbBurst (const bool enable)
+{
+  mSbBurst = enable;
+}
+
+/// \brief Is System Bus burst mode enabled?
+///
+/// \return \c true if burst mode is used for blocks of memory.
+template <class DtmT>
+bool
+DmiT<DtmT>::sbBurst () const
+{
+  return mSbBurst;
+}
+
+/// \brief Set the idle time between System Bus burst accesses
+///
+/// The value is increased automatically if it proves too small.
+///
+/// \param[in] idleCycles  Clock cycles to idle between accesses.
+template <class DtmT>
+void
+DmiT<DtmT>::sbBurstIdle (const uint32_t idleCycles)
+{
+  mSbBurstIdle
+      = (idleCycles > SB_BURST_IDLE_MAX) ? SB_BURST_IDLE_MAX : idleCycles;
+}
+
+/// \brief Report the System Bus burst mode configuration and statistics
 ///
-/// \note This is problematic, since the system bus only permits 32-bit writes,
+/// \param[in] stream  The stream on which to report.
+template <class DtmT>
+void
+DmiT<DtmT>::printSbBurst (std::ostream &stream) const
+{
+  stream << "System bus burst: " << (mSbBurst ? "on" : "off") << ", idle "
+         << mSbBurstIdle << " cycles, " << mSbBursts << " bursts, "
+         << mSbBurstRetries << " retried" << endl;
+}
+
+/// \brief Read from memory using the System Bus, polling after each word
+///
+/// \note This is problematic, since the system bus only permits 32-bit reads,
 ///       potentially troublesome for volatile memory locations.
 ///
 /// \todo There is a known hardware design issue, where system bus accesses
+///       always succeed, even if there is no memory at the location. Reads
+///       will return 0xbadcab1e.
+///
+/// \param[in]  addr    Address to read from
+/// \param[in]  nBytes  Number of bytes to read
+/// \param[out] buf     Buffer for storing the bytes read
+/// \return  The error code for the access.
+template <class DtmT>
+typename DmiT<DtmT>::Sbcs::SberrorVal
+DmiT<DtmT>::readMemPolled (uint64_t addr, size_t nBytes, uint8_t *buf)
+{
+  uint32_t startAddr = addr & 0xfffffffc;
+  uint32_t endAddr = (addr + nBytes + 3) & 0xfffffffc;
+  size_t nWords = (endAddr - startAddr) / 4;
+  std::vector<IDtm::DmiOp> batch;
+
+  // Set up systembus to read on setting the address or reading the data and
+  // autoincrement if we need to read more than one word
+  mSbcs->sbcs (Sbcs::config (Sbcs::SBACCESS_32, true, nWords > 1, true));
+  mSbcs->sberrorClear ();
+  mSbcs->sbbusyerrorClear ();
+
+  // Initial word, which may be different from the actual start address if the
+  // start is misaligned. Setting the address will cause the first read, whose
+  // status we check in the same batch.
+  mSbaddress->reset (0);
+  mSbaddress->sbaddress (0, startAddr);
+
+  mSbcs->queueWrite (batch);
+  mSbaddress->queueWrite (0, batch);
+  mSbcs->queueRead (batch);
+  mDtm->dmiBatch (batch);
+
+  for (uint32_t wordAddr = startAddr; wordAddr < endAddr; wordAddr += 4)
+    {
+      while (mSbcs->sbbusy ())
+        mSbcs->read ();
+
+      typename Sbcs::SberrorVal err = sbPolledError ();
+      if (err != Sbcs::SBERR_NONE)
+        return err;
+
+      // Get the read data, which will trigger the next read if we have
+      // autoincrement set.  Unless this is the last word, check the status
+      // of that next read in the same batch.
+      batch.clear ();
+      mSbdata->queueRead (0, batch);
+      if ((wordAddr + 4) < endAddr)
+        mSbcs->queueRead (batch);
+      mDtm->dmiBatch (batch);
+
+      // Save the bytes we want, which may not be all of them if the first or
+      // last word is misaligned.
+      uint32_t w = mSbdata->sbdata (0);
+      if ((wordAddr >= addr) && ((wordAddr + 4) <= (addr + nBytes)))
+        Utils::storeLe (buf + (wordAddr - addr), w);
+      else
+        for (size_t i = 0; i < 4; i++)
+          {
+            uint64_t byteAddr = wordAddr + i;
+            if ((byteAddr >= addr) && (byteAddr < (addr + nBytes)))
+              buf[byteAddr - addr]
+                  = static_cast<uint8_t> ((w >> (8 * i)) & 0xff);
+          }
+    }
+
+  return Sbcs::SBERR_NONE;
+}
+
+/// \brief Write to memory using the System Bus, polling after each word
+///
+/// \note Only 32-bit writes are used, with a read-modify-write of any partial
+///       word, potentially troublesome for volatile memory locations.  So
+///       Dmi::writeMemSysbus only uses this for partial words when the bus
+///       does not support narrower accesses.
+///
+/// \todo There is a known hardware design issue, where system bus accesses
 ///       always succeed, even if there is no memory at the location.
 ///
 /// \param[in  addr    Address to write to
 /// \param[in] nBytes  Number of bytes to write
 /// \param[in] buf     Buffer with the bytes to write
 /// \return  The error code for the access.
-Dmi::Sbcs::SberrorVal
-Dmi::writeMem (uint64_t addr, size_t nBytes, unique_ptr<uint8_t[]> &buf)
+template <class DtmT>
+typename DmiT<DtmT>::Sbcs::SberrorVal
+DmiT<DtmT>::writeMemPolled (uint64_t addr, size_t nBytes, const uint8_t *buf)
 {
   uint32_t startAddr = addr & 0xfffffffc;
   uint32_t endAddr = (addr + nBytes + 3) & 0xfffffffc;
   bool startAligned = startAddr == addr;
   bool endAligned = endAddr == (addr + nBytes);
+  bool firstPartial = !startAligned || ((addr + nBytes) < (startAddr + 4));
   size_t nWords = (endAddr - startAddr) / 4;
   size_t bufIndex = 0;
   uint32_t w;
+  std::vector<IDtm::DmiOp> batch;
 
   // Set up systembus
-  // - we read on setting the address if the initial word is misaligned
+  // - we read on setting the address if the initial word is partial
   // - we don't read on reading the data
   // - we will set autoincrement if we need to write more than one word, but
   //   not until we have done the initial word read if necessary.
-  mSbcs->reset ();
-  mSbcs->sbreadonaddr (!startAligned);
-  mSbcs->sbaccess (Sbcs::SBACCESS_32);
-  mSbcs->sbautoincrement (nWords > 1);
-  mSbcs->sbreadondata (false);
+  mSbcs->sbcs (Sbcs::config (Sbcs::SBACCESS_32, firstPartial, nWords > 1,
+                             false));
   mSbcs->sberrorClear ();
-  mSbcs->write ();
+  mSbcs->sbbusyerrorClear ();
 
   // Initial word, which may be different from the actual start address if the
-  // start is misaligned. If we are misaligned this will read the first word.
+  // start is misaligned. If the word is partial this will read it, so we
+  // check its status in the same batch.
   mSbaddress->reset (0);
   mSbaddress->sbaddress (0, startAddr);
-  mSbaddress->write (0);
 
-  // If we are misaligned read data at the first word into w.
-  if (!startAligned)
+  mSbcs->queueWrite (batch);
+  mSbaddress->queueWrite (0, batch);
+  if (firstPartial)
+    mSbcs->queueRead (batch);
+  mDtm->dmiBatch (batch);
+
+  // If the first word is partial, read its data into w.
+  if (firstPartial)
     {
-      do
+      while (mSbcs->sbbusy ())
         mSbcs->read ();
-      while (mSbcs->sbbusy ());
 
-      Sbcs::SberrorVal err = mSbcs->sberror ();
+      typename Sbcs::SberrorVal err = sbPolledError ();
       if (err != Sbcs::SBERR_NONE)
         return err;
 
@@ -496,140 +1584,680 @@ Dmi::writeMem (uint64_t addr, size_t nBytes, unique_ptr<uint8_t[]> &buf)
       w = mSbdata->sbdata (0);
 
       // Clear the read on address flag if set and reset the start address
-      mSbcs->reset ();
-      mSbcs->sbreadonaddr (false);
-      mSbcs->sbaccess (Sbcs::SBACCESS_32);
-      mSbcs->sbautoincrement (nWords > 1);
-      mSbcs->sbreadondata (false);
+      mSbcs->sbcs (Sbcs::config (Sbcs::SBACCESS_32, false, nWords > 1, false));
+      mSbcs->sberrorClear ();
+
+      mSbaddress->reset (0);
+      mSbaddress->sbaddress (0, startAddr);
+
+      batch.clear ();
+      mSbcs->queueWrite (batch);
+      mSbaddress->queueWrite (0, batch);
+      mDtm->dmiBatch (batch);
+    }
+
+  // Create the first word to write
+  size_t offset = (addr - startAddr);
+  for (size_t i = offset; i < min (offset + nBytes, static_cast<std::size_t> (4)); i++)
+    {
+      w &= ~((0x000000ff) << (8 * i));
+      w |= static_cast<uint32_t> (buf[bufIndex++]) << (8 * i);
+    }
+
+  // Write the value into sbdata, which will trigger the write and wait for it
+  // to complete.
+  mSbdata->sbdata (0, w);
+  batch.clear ();
+  mSbdata->queueWrite (0, batch);
+  mSbcs->queueRead (batch);
+  mDtm->dmiBatch (batch);
+
+  while (mSbcs->sbbusy ())
+    mSbcs->read ();
+
+  typename Sbcs::SberrorVal err = sbPolledError ();
+  if (err != Sbcs::SBERR_NONE)
+    return err;
+
+  startAddr += 4;
+  if (startAddr == endAddr) // Write was just a single word or less
+    return Sbcs::SBERR_NONE;
+
+  // Write the bulk of the words
+  for (; startAddr < (endAddr - 4); startAddr += 4)
+    {
+      // Create the word
+      w = Utils::loadLe (buf + bufIndex);
+      bufIndex += 4;
+
+      // Write the value into sbdata, which will trigger the write and wait
+      // for it to complete.
+      mSbdata->sbdata (0, w);
+      batch.clear ();
+      mSbdata->queueWrite (0, batch);
+      mSbcs->queueRead (batch);
+      mDtm->dmiBatch (batch);
+
+      while (mSbcs->sbbusy ())
+        mSbcs->read ();
+
+      err = sbPolledError ();
+      if (err != Sbcs::SBERR_NONE)
+        return err;
+    }
+
+  // Final word, which may be different to the actual end address if the
+  // end is misaligned
+
+  // Set the read on address flag if the end is misaligned
+  if (!endAligned)
+    {
+      mSbcs->sbcs (Sbcs::config (Sbcs::SBACCESS_32, true, false, false));
+      mSbcs->sberrorClear ();
+
+      // Trigger a read by writing the current address
+      mSbaddress->reset (0);
+      mSbaddress->sbaddress (0, startAddr);
+
+      batch.clear ();
+      mSbcs->queueWrite (batch);
+      mSbaddress->queueWrite (0, batch);
+      mSbcs->queueRead (batch);
+      mDtm->dmiBatch (batch);
+
+      while (mSbcs->sbbusy ())
+        mSbcs->read ();
+
+      err = sbPolledError ();
+      if (err != Sbcs::SBERR_NONE)
+        return err;
+
+      // Get the read data
+      mSbdata->read (0);
+      w = mSbdata->sbdata (0);
+
+      // Clear the read on address flag if set
+      mSbcs->sbcs (Sbcs::config (Sbcs::SBACCESS_32, false, nWords > 1, false));
       mSbcs->sberrorClear ();
       mSbcs->write ();
+    }
+
+  // Create the word to write and then write it.
+  offset = endAddr - (addr + nBytes);
+  for (size_t i = 0; i < 4 - offset; i++)
+    {
+      w &= ~(0x000000ff << (8 * i));
+      w |= static_cast<uint32_t> (buf[bufIndex++]) << (8 * i);
+    }
+
+  // Write the value into sbdata, which will trigger the write and wait for it
+  // to complete.
+  mSbdata->sbdata (0, w);
+  batch.clear ();
+  mSbdata->queueWrite (0, batch);
+  mSbcs->queueRead (batch);
+  mDtm->dmiBatch (batch);
+
+  while (mSbcs->sbbusy ())
+    mSbcs->read ();
+
+  err = sbPolledError ();
+  return err;
+}
+
+/// \brief Access memory using the program buffer
+///
+/// The hart must be halted.  s0 and s1 are used to hold the address and
+/// data, so are saved first and restored afterwards.  Each access uses the
+/// natural width for its alignment, so the bulk is transferred as words, but
+/// a byte or halfword at an unaligned start or end, or a request for just one
+/// byte or halfword, is accessed exactly, which matters for volatile
+/// locations.
+///
+/// \param[in]  addr    Address of the first byte.
+/// \param[in]  nBytes  Number of bytes to transfer.
+/// \param[out] rbuf    Buffer for the bytes read, or \c nullptr to write.
+/// \param[in]  wbuf    Buffer of bytes to write, or \c nullptr to read.
+/// \return  The error code for the access.
+template <class DtmT>
+typename DmiT<DtmT>::Abstractcs::CmderrVal
+DmiT<DtmT>::progbufMem (uint64_t addr, size_t nBytes, uint8_t *rbuf,
+                        const uint8_t *wbuf)
+{
+  if (nBytes == 0)
+    return Abstractcs::CMDERR_NONE;
+
+  uint32_t saved[2];
+  typename Abstractcs::CmderrVal err = readGprs (PROGBUF_ADDR_REG, 2, saved);
+  if (err != Abstractcs::CMDERR_NONE)
+    return err;
+
+  uint32_t a = static_cast<uint32_t> (addr);
+  while ((nBytes > 0) && (err == Abstractcs::CMDERR_NONE))
+    {
+      size_t width;
+      size_t count;
+
+      if (((a & 0x3) == 0) && (nBytes >= 4))
+        {
+          width = 4;
+          count = nBytes / 4;
+        }
+      else if (((a & 0x1) == 0) && (nBytes >= 2))
+        {
+          width = 2;
+          count = 1;
+        }
+      else
+        {
+          width = 1;
+          count = 1;
+        }
+
+      err = progbufStream (a, count, width, rbuf, wbuf);
+      a += static_cast<uint32_t> (count * width);
+      rbuf = (rbuf == nullptr) ? nullptr : rbuf + count * width;
+      wbuf = (wbuf == nullptr) ? nullptr : wbuf + count * width;
+      nBytes -= count * width;
+    }
+
+  typename Abstractcs::CmderrVal restoreErr
+      = writeGprs (PROGBUF_ADDR_REG, 2, saved);
+  return (err == Abstractcs::CMDERR_NONE) ? restoreErr : err;
+}
+
+/// \brief Stream memory accesses of one width through the program buffer
+///
+/// The program buffer holds a load (or store) between s0 and s1, followed by
+/// an increment of s0.  Writing s0 with \c postexec set starts the sequence,
+/// then \c autoexecdata reissues the transfer of s1 to or from \c data0,
+/// and with it the program, for each further \c data0 access.  Each word
+/// after the first thus costs a single DMI access.
+///
+/// For reads the load runs one ahead of \c data0.  Auto-execution is turned
+/// off so that the last value is collected by a transfer with no \c postexec,
+/// so we never read beyond the last location requested.
+///
+/// All the DMI accesses are issued as a single batch, and \c abstractcs
+/// checked once at the end.
+///
+/// \param[in]  addr   Address of the first access.
+/// \param[in]  count  Number of accesses.
+/// \param[in]  width  Width of each access in bytes (1, 2 or 4).
+/// \param[out] rbuf   Buffer for the bytes read, or \c nullptr to write.
+/// \param[in]  wbuf   Buffer of bytes to write, or \c nullptr to read.
+/// \return  The error code for the access.
+template <class DtmT>
+typename DmiT<DtmT>::Abstractcs::CmderrVal
+DmiT<DtmT>::progbufStream (uint32_t addr, size_t count, const size_t width,
+                           uint8_t *rbuf, const uint8_t *wbuf)
+{
+  const bool isWrite = wbuf != nullptr;
+
+  // Loads of bytes and halfwords are unsigned (lbu/lhu)
+  uint32_t insn;
+  if (isWrite)
+    insn = encodeStore ((width == 4) ? 2 : (width == 2) ? 1 : 0,
+                        PROGBUF_DATA_REG, PROGBUF_ADDR_REG);
+  else
+    insn = encodeLoad ((width == 4) ? 2 : (width == 2) ? 5 : 4,
+                       PROGBUF_DATA_REG, PROGBUF_ADDR_REG);
+
+  if (!progbufLoad (insn, width))
+    return Abstractcs::CMDERR_UNSUPPORTED;
+
+  std::vector<uint32_t> &vals = mMemWords;
+  std::vector<IDtm::DmiOp> &batch = mMemBatch;
+
+  vals.resize (count);
+  batch.clear ();
+
+  // Queue a transfer between data0 and a register
+  auto queueTransfer = [this, &batch] (size_t regNum, bool write,
+                                       bool postexec) {
+    mCommand->command (Command::accessReg32 (
+        GPR_BASE + static_cast<uint16_t> (regNum), write, postexec));
+    mCommand->queueWrite (batch);
+  };
+
+  // Queue setting autoexecdata for data0
+  auto queueAutoexec = [this, &batch] (bool flag) {
+    mAbstractauto->reset ();
+    mAbstractauto->autoexecdata (flag ? 1 : 0);
+    mAbstractauto->queueWrite (batch);
+  };
+
+  if (isWrite)
+    {
+      for (size_t i = 0; i < count; i++)
+        vals[i] = Utils::loadLe (wbuf + i * width, width);
+
+      mData->data (0, addr);
+      mData->queueWrite (0, batch);
+      queueTransfer (PROGBUF_ADDR_REG, true, false);
+      mData->data (0, vals[0]);
+      mData->queueWrite (0, batch);
+      queueTransfer (PROGBUF_DATA_REG, true, true);
+
+      if (count > 1)
+        {
+          queueAutoexec (true);
+          for (size_t i = 1; i < count; i++)
+            {
+              mData->data (0, vals[i]);
+              mData->queueWrite (0, batch);
+            }
+          queueAutoexec (false);
+        }
+    }
+  else
+    {
+      // Setting s0 loads the first value into s1
+      mData->data (0, addr);
+      mData->queueWrite (0, batch);
+      queueTransfer (PROGBUF_ADDR_REG, true, true);
+
+      if (count > 1)
+        {
+          // Each transfer of s1 to data0 loads the next value
+          queueTransfer (PROGBUF_DATA_REG, false, true);
+          if (count > 2)
+            {
+              queueAutoexec (true);
+              for (size_t i = 0; i < (count - 2); i++)
+                mData->queueRead (0, batch, &vals[i]);
+              queueAutoexec (false);
+            }
+          mData->queueRead (0, batch, &vals[count - 2]);
+        }
 
-      mSbaddress->reset (0);
-      mSbaddress->sbaddress (0, startAddr);
-      mSbaddress->write (0);
+      // The last value is already in s1
+      queueTransfer (PROGBUF_DATA_REG, false, false);
+      mData->queueRead (0, batch, &vals[count - 1]);
     }
 
-  // Create the first word to write
-  size_t offset = (addr - startAddr);
-  for (size_t i = offset; i < min (offset + nBytes, static_cast<std::size_t> (4)); i++)
+  mAbstractcs->queueRead (batch);
+  mDtm->dmiBatch (batch);
+
+  typename Abstractcs::CmderrVal err = mAbstractcs->cmderr ();
+  if ((err == Abstractcs::CMDERR_NONE) && mAbstractcs->busy ())
+    err = Abstractcs::CMDERR_BUSY;
+  if (err != Abstractcs::CMDERR_NONE)
     {
-      w &= ~((0x000000ff) << (8 * i));
-      w |= static_cast<uint32_t> (buf[bufIndex++]) << (8 * i);
+      stopAutoexec ();
+      return err;
     }
 
-  // Write the value into sbdata, which will trigger the write and wait for it
-  // to complete.
-  mSbdata->sbdata (0, w);
-  mSbdata->write (0);
+  if (!isWrite)
+    for (size_t i = 0; i < count; i++)
+      Utils::storeLe (rbuf + i * width, vals[i], width);
 
-  do
-    mSbcs->read ();
-  while (mSbcs->sbbusy ());
+  return Abstractcs::CMDERR_NONE;
+}
 
-  Sbcs::SberrorVal err = mSbcs->sberror ();
-  if (err != Sbcs::SBERR_NONE)
-    return err;
+/// \brief Load a memory access sequence into the program buffer
+///
+/// The sequence is the load or store, an increment of the address in s0 by
+/// the access width, and an ebreak.  Nothing is written if the program buffer
+/// already holds the sequence.
+///
+/// \param[in] insn   The load or store instruction.
+/// \param[in] width  The access width in bytes.
+/// \return \c true if the sequence is loaded, \c false if the program buffer
+///         is too small to hold it.
+template <class DtmT>
+bool
+DmiT<DtmT>::progbufLoad (const uint32_t insn, const size_t width)
+{
+  if (insn == mProgbufInsn)
+    return true;
 
-  startAddr += 4;
-  if (startAddr == endAddr) // Write was just a single word or less
-    return Sbcs::SBERR_NONE;
+  std::vector<IDtm::DmiOp> batch;
+  mProgbuf->progbuf (0, insn);
+  mProgbuf->progbuf (
+      1, encodeAddi (PROGBUF_ADDR_REG, PROGBUF_ADDR_REG,
+                     static_cast<int32_t> (width)));
+  mProgbuf->progbuf (2, INSN_EBREAK);
 
-  // Write the bulk of the words
-  for (; startAddr < (endAddr - 4); startAddr += 4)
+  if (caps ().progbufsize < PROGBUF_MEM_LEN)
     {
-      // Create the word
-      w = 0;
-      for (size_t i = 0; i < 4; i++)
-        w |= static_cast<uint32_t> (buf[bufIndex++]) << (i * 8);
+      mProgbufInsn = 0;
+      return false;
+    }
 
-      // Write the value into sbdata, which will trigger the write and wait
-      // for it to complete.
-      mSbdata->sbdata (0, w);
-      mSbdata->write (0);
+  for (size_t i = 0; i < PROGBUF_MEM_LEN; i++)
+    mProgbuf->queueWrite (i, batch);
+  mDtm->dmiBatch (batch);
 
-      do
-        mSbcs->read ();
-      while (mSbcs->sbbusy ());
+  mProgbufInsn = insn;
+  return true;
+}
 
-      err = mSbcs->sberror ();
-      if (err != Sbcs::SBERR_NONE)
-        return err;
-    }
+/// \brief Discover the fixed properties of the debug module.
+///
+/// Reads all the registers describing the debug module, which need never be
+/// read again.  The DTM properties are those it found when last reset.
+template <class DtmT>
+void
+DmiT<DtmT>::discoverCaps ()
+{
+  uint32_t dtmcs = mDtm->dtmcs ();
 
-  // Final word, which may be different to the actual end address if the
-  // end is misaligned
+  mCaps.idcode = mDtm->idcode ();
+  mCaps.abits = static_cast<uint8_t> ((dtmcs >> 4) & 0x3f);
+  mCaps.idle = static_cast<uint8_t> ((dtmcs >> 12) & 0x7);
 
-  // Set the read on address flag if the end is misaligned
-  if (!endAligned)
+  mHartinfo->read ();
+  mCaps.nscratch = mHartinfo->nscratch ();
+  mCaps.dataaccess = mHartinfo->dataaccess ();
+  mCaps.datasize = mHartinfo->datasize ();
+  mCaps.dataaddr = mHartinfo->dataaddr ();
+
+  mAbstractcs->read ();
+  mCaps.progbufsize = mAbstractcs->progbufsize ();
+  mCaps.datacount = mAbstractcs->datacount ();
+
+  // We always assume 32-bit System Bus access, which all the polled code
+  // relies on.
+  mSbcs->read ();
+  mCaps.sbversion = mSbcs->sbversion ();
+  mCaps.sbasize = mSbcs->sbasize ();
+  mCaps.sbSizes = (mSbcs->sbaccess8 () ? 0x01 : 0)
+                  | (mSbcs->sbaccess16 () ? 0x02 : 0) | 0x04
+                  | (mSbcs->sbaccess64 () ? 0x08 : 0)
+                  | (mSbcs->sbaccess128 () ? 0x10 : 0);
+
+  for (size_t i = 0; i < Confstrptr::NUM_REGS; i++)
     {
-      mSbcs->reset ();
-      mSbcs->sbreadonaddr (true);
-      mSbcs->sbaccess (Sbcs::SBACCESS_32);
-      mSbcs->sbautoincrement (false);
-      mSbcs->sbreadondata (false);
-      mSbcs->sberrorClear ();
-      mSbcs->write ();
+      mConfstrptr->read (i);
+      mCaps.confstrptr[i] = mConfstrptr->confstrptr (i);
+    }
 
-      // Trigger a read by writing the current address
-      mSbaddress->reset (0);
-      mSbaddress->sbaddress (0, startAddr);
-      mSbaddress->write (0);
+  mNextdm->read ();
+  mCaps.nextdm = mNextdm->nextdm ();
+  mCapsValid = true;
+}
 
-      do
-        mSbcs->read ();
-      while (mSbcs->sbbusy ());
+/// \brief Get the fixed properties of the debug module.
+///
+/// These are discovered the first time they are needed, unless already
+/// loaded.
+///
+/// \return The properties of the debug module.
+template <class DtmT>
+const typename DmiT<DtmT>::Caps &
+DmiT<DtmT>::caps ()
+{
+  if (!mCapsValid)
+    discoverCaps ();
 
-      err = mSbcs->sberror ();
-      if (err != Sbcs::SBERR_NONE)
-        return err;
+  return mCaps;
+}
 
-      // Get the read data
-      mSbdata->read (0);
-      w = mSbdata->sbdata (0);
+/// \brief Load the fixed properties of the debug module from a file.
+///
+/// The file must be for this IDCODE, and its \c dtmcs properties must match
+/// those the DTM found, or it is ignored.  Without an IDCODE there is no way
+/// to know the file applies, so nothing is loaded.
+///
+/// \param[in] fileName  The file written by Dmi::saveCaps.
+/// \return \c true if the properties were loaded, \c false otherwise.
+template <class DtmT>
+bool
+DmiT<DtmT>::loadCaps (const std::string &fileName)
+{
+  uint32_t dtmcs = mDtm->dtmcs ();
+  Caps c = {};
+  ifstream f (fileName);
+  std::string line;
+  std::size_t nFields = 0;
 
-      // Clear the read on address flag if set
-      mSbcs->reset ();
-      mSbcs->sbreadonaddr (false);
-      mSbcs->sbaccess (Sbcs::SBACCESS_32);
-      mSbcs->sbautoincrement (nWords > 1);
-      mSbcs->sbreadondata (false);
-      mSbcs->sberrorClear ();
-      mSbcs->write ();
-    }
+  if (mDtm->idcode () == 0)
+    return false;
 
-  // Create the word to write and then write it.
-  offset = endAddr - (addr + nBytes);
-  for (size_t i = 0; i < 4 - offset; i++)
+  while (std::getline (f, line))
     {
-      w &= ~(0x000000ff << (8 * i));
-      w |= static_cast<uint32_t> (buf[bufIndex++]) << (8 * i);
+      std::istringstream iss (line);
+      std::string key;
+      uint32_t val;
+
+      if (!(iss >> key >> hex >> val))
+        continue;
+
+      nFields++;
+      if (key == "idcode")
+        c.idcode = val;
+      else if (key == "abits")
+        c.abits = static_cast<uint8_t> (val);
+      else if (key == "idle")
+        c.idle = static_cast<uint8_t> (val);
+      else if (key == "nscratch")
+        c.nscratch = static_cast<uint8_t> (val);
+      else if (key == "dataaccess")
+        c.dataaccess = val != 0;
+      else if (key == "datasize")
+        c.datasize = static_cast<uint8_t> (val);
+      else if (key == "dataaddr")
+        c.dataaddr = static_cast<uint16_t> (val);
+      else if (key == "progbufsize")
+        c.progbufsize = static_cast<uint8_t> (val);
+      else if (key == "datacount")
+        c.datacount = static_cast<uint8_t> (val);
+      else if (key == "sbversion")
+        c.sbversion = static_cast<uint8_t> (val);
+      else if (key == "sbasize")
+        c.sbasize = static_cast<uint8_t> (val);
+      else if (key == "sbsizes")
+        c.sbSizes = static_cast<uint8_t> (val);
+      else if (key == "confstrptr")
+        {
+          c.confstrptr[0] = val;
+          for (size_t i = 1; i < Confstrptr::NUM_REGS; i++)
+            iss >> c.confstrptr[i];
+        }
+      else if (key == "nextdm")
+        c.nextdm = val;
+      else
+        nFields--;
     }
 
-  // Write the value into sbdata, which will trigger the write and wait for it
-  // to complete.
-  mSbdata->sbdata (0, w);
-  mSbdata->write (0);
+  if ((nFields != CAPS_FIELDS) || (c.idcode != mDtm->idcode ())
+      || (c.abits != ((dtmcs >> 4) & 0x3f)) || (c.idle != ((dtmcs >> 12) & 0x7)))
+    return false;
 
-  do
-    mSbcs->read ();
-  while (mSbcs->sbbusy ());
+  mCaps = c;
+  mCapsValid = true;
+  return true;
+}
 
-  err = mSbcs->sberror ();
-  return err;
+/// \brief Save the fixed properties of the debug module to a file.
+///
+/// Nothing is saved without an IDCODE, since there would be no way to know
+/// which target the file describes.
+///
+/// \param[in] fileName  The file to write.
+/// \return \c true if the properties were saved, \c false otherwise.
+template <class DtmT>
+bool
+DmiT<DtmT>::saveCaps (const std::string &fileName)
+{
+  const Caps &c = caps ();
+
+  if (c.idcode == 0)
+    return false;
+
+  ofstream f (fileName);
+  f << hex;
+  f << "idcode " << c.idcode << endl;
+  f << "abits " << static_cast<uint32_t> (c.abits) << endl;
+  f << "idle " << static_cast<uint32_t> (c.idle) << endl;
+  f << "nscratch " << static_cast<uint32_t> (c.nscratch) << endl;
+  f << "dataaccess " << (c.dataaccess ? 1 : 0) << endl;
+  f << "datasize " << static_cast<uint32_t> (c.datasize) << endl;
+  f << "dataaddr " << c.dataaddr << endl;
+  f << "progbufsize " << static_cast<uint32_t> (c.progbufsize) << endl;
+  f << "datacount " << static_cast<uint32_t> (c.datacount) << endl;
+  f << "sbversion " << static_cast<uint32_t> (c.sbversion) << endl;
+  f << "sbasize " << static_cast<uint32_t> (c.sbasize) << endl;
+  f << "sbsizes " << static_cast<uint32_t> (c.sbSizes) << endl;
+  f << "confstrptr";
+  for (size_t i = 0; i < Confstrptr::NUM_REGS; i++)
+    f << " " << c.confstrptr[i];
+  f << endl;
+  f << "nextdm " << c.nextdm << endl;
+
+  return f.good ();
+}
+
+/// \brief Report the fixed properties of the debug module.
+///
+/// \param[in] stream  The stream on which to report.
+template <class DtmT>
+void
+DmiT<DtmT>::printCaps (std::ostream &stream)
+{
+  const Caps &c = caps ();
+
+  stream << "IDCODE = 0x" << Utils::hexStr (c.idcode) << ", abits = "
+         << static_cast<uint32_t> (c.abits)
+         << ", idle = " << static_cast<uint32_t> (c.idle) << endl;
+  stream << "hartinfo: nscratch = " << static_cast<uint32_t> (c.nscratch)
+         << ", dataaccess = " << Utils::boolStr (c.dataaccess)
+         << ", datasize = " << static_cast<uint32_t> (c.datasize)
+         << ", dataaddr = 0x" << hex << c.dataaddr << dec << endl;
+  stream << "abstractcs: progbufsize = "
+         << static_cast<uint32_t> (c.progbufsize)
+         << ", datacount = " << static_cast<uint32_t> (c.datacount) << endl;
+  stream << "sbcs: sbversion = " << static_cast<uint32_t> (c.sbversion)
+         << ", sbasize = " << static_cast<uint32_t> (c.sbasize)
+         << ", sizes mask = 0x" << hex << static_cast<uint32_t> (c.sbSizes)
+         << dec << endl;
+  stream << "confstrptr:";
+  for (size_t i = 0; i < Confstrptr::NUM_REGS; i++)
+    stream << " 0x" << Utils::hexStr (c.confstrptr[i]);
+  stream << ", nextdm = 0x" << Utils::hexStr (c.nextdm) << endl;
+}
+
+/// \brief Forget the state last written to all the DMI registers.
+///
+/// Needed whenever the debug module may have been reset, so the next write
+/// of each register is always carried out.
+template <class DtmT>
+void
+DmiT<DtmT>::invalidateShadows ()
+{
+  mDmcontrol->shadow ().invalidate ();
+  mSbcs->shadow ().invalidate ();
+  for (size_t i = 0; i < Sbaddress::NUM_REGS; i++)
+    mSbaddress->shadow (i).invalidate ();
+}
+
+/// \brief Get the number of DMI register writes skipped.
+///
+/// \return The number of writes skipped because they would change nothing.
+template <class DtmT>
+uint64_t
+DmiT<DtmT>::writesElided () const
+{
+  uint64_t n = mDmcontrol->shadow ().writesElided ()
+               + mSbcs->shadow ().writesElided ();
+  for (size_t i = 0; i < Sbaddress::NUM_REGS; i++)
+    n += mSbaddress->shadow (i).writesElided ();
+
+  return n;
+}
+
+/// \brief Clear the count of DMI register writes skipped.
+template <class DtmT>
+void
+DmiT<DtmT>::clearShadowStats ()
+{
+  mDmcontrol->shadow ().clearStats ();
+  mSbcs->shadow ().clearStats ();
+  for (size_t i = 0; i < Sbaddress::NUM_REGS; i++)
+    mSbaddress->shadow (i).clearStats ();
 }
 
 /// \brief Reset the underlying DTM.
+template <class DtmT>
 void
-Dmi::dtmReset ()
+DmiT<DtmT>::dtmReset ()
 {
   mDtm->reset ();
+  mProgbufInsn = 0;
+  invalidateShadows ();
+}
+
+/// \brief Exchange the underlying DTM for another.
+///
+/// All the registers are pointed at the new DTM, so they all follow the
+/// change.  The caller gets back the previous DTM, so it can be swapped
+/// back later.
+///
+/// \param[in,out] dtm  The DTM to use.  On return holds the previous DTM.
+template <class DtmT>
+void
+DmiT<DtmT>::swapDtm (std::unique_ptr<DtmT> &dtm)
+{
+  mDtm->sync ();
+  mDtm.swap (dtm);
+  bindDtm ();
+  invalidateShadows ();
+}
+
+/// \brief Point all the registers at our current DTM.
+template <class DtmT>
+void
+DmiT<DtmT>::bindDtm ()
+{
+  DtmT *dtm = mDtm.get ();
+
+  mData->mDtm = dtm;
+  mDmcontrol->mDtm = dtm;
+  mDmstatus->mDtm = dtm;
+  mHartinfo->mDtm = dtm;
+  mHaltsum->mDtm = dtm;
+  mHawindowsel->mDtm = dtm;
+  mHawindow->mDtm = dtm;
+  mAbstractcs->mDtm = dtm;
+  mCommand->mDtm = dtm;
+  mAbstractauto->mDtm = dtm;
+  mConfstrptr->mDtm = dtm;
+  mNextdm->mDtm = dtm;
+  mProgbuf->mDtm = dtm;
+  mAuthdata->mDtm = dtm;
+  mSbaddress->mDtm = dtm;
+  mSbcs->mDtm = dtm;
+  mSbdata->mDtm = dtm;
+}
+
+/// \brief Confirm any DMI writes the DTM has posted.
+///
+/// Writes which failed are reissued.  Needed before relying on a sequence of
+/// writes having taken effect, when there is no read to follow them.
+template <class DtmT>
+void
+DmiT<DtmT>::sync ()
+{
+  mDtm->sync ();
+}
+
+/// \brief Get the underlying DTM.
+///
+/// \return The DTM in use.
+template <class DtmT>
+std::unique_ptr<DtmT> &
+DmiT<DtmT>::dtm ()
+{
+  return mDtm;
 }
 
 /// \brief Provide access to simulation time
 ///
 /// \return The current simulation time in nanoseconds.
+template <class DtmT>
 uint64_t
-Dmi::simTimeNs () const
+DmiT<DtmT>::simTimeNs () const
 {
   return mDtm->simTimeNs ();
 }
@@ -638,8 +2266,9 @@ Dmi::simTimeNs () const
 ///
 /// \return  An instance of class Data:: representing the set of \c data
 ///          registers.
-std::unique_ptr<Dmi::Data> &
-Dmi::data ()
+template <class DtmT>
+std::unique_ptr<typename DmiT<DtmT>::Data> &
+DmiT<DtmT>::data ()
 {
   return mData;
 }
@@ -648,8 +2277,9 @@ Dmi::data ()
 ///
 /// \return  An instance of class Dmcontrol:: representing the \c dmcontrol
 ///          register.
-std::unique_ptr<Dmi::Dmcontrol> &
-Dmi::dmcontrol ()
+template <class DtmT>
+std::unique_ptr<typename DmiT<DtmT>::Dmcontrol> &
+DmiT<DtmT>::dmcontrol ()
 {
   return mDmcontrol;
 }
@@ -658,8 +2288,9 @@ Dmi::dmcontrol ()
 ///
 /// \return  An instance of class Dmstatus:: representing the \c dmstatus
 ///          register.
-std::unique_ptr<Dmi::Dmstatus> &
-Dmi::dmstatus ()
+template <class DtmT>
+std::unique_ptr<typename DmiT<DtmT>::Dmstatus> &
+DmiT<DtmT>::dmstatus ()
 {
   return mDmstatus;
 }
@@ -668,8 +2299,9 @@ Dmi::dmstatus ()
 ///
 /// \return  An instance of class Hartinfo:: representing the \c hartinfo
 ///          register.
-std::unique_ptr<Dmi::Hartinfo> &
-Dmi::hartinfo ()
+template <class DtmT>
+std::unique_ptr<typename DmiT<DtmT>::Hartinfo> &
+DmiT<DtmT>::hartinfo ()
 {
   return mHartinfo;
 }
@@ -678,8 +2310,9 @@ Dmi::hartinfo ()
 ///
 /// \return  An instance of class Haltsum:: representing the set of \c haltsum
 ///          registers.
-std::unique_ptr<Dmi::Haltsum> &
-Dmi::haltsum ()
+template <class DtmT>
+std::unique_ptr<typename DmiT<DtmT>::Haltsum> &
+DmiT<DtmT>::haltsum ()
 {
   return mHaltsum;
 }
@@ -688,8 +2321,9 @@ Dmi::haltsum ()
 ///
 /// \return  An instance of class Hawindowsel:: representing the \c hawindowsel
 ///          register.
-std::unique_ptr<Dmi::Hawindowsel> &
-Dmi::hawindowsel ()
+template <class DtmT>
+std::unique_ptr<typename DmiT<DtmT>::Hawindowsel> &
+DmiT<DtmT>::hawindowsel ()
 {
   return mHawindowsel;
 }
@@ -698,8 +2332,9 @@ Dmi::hawindowsel ()
 ///
 /// \return  An instance of class Hawindow:: representing the \c hawindow
 ///          register.
-std::unique_ptr<Dmi::Hawindow> &
-Dmi::hawindow ()
+template <class DtmT>
+std::unique_ptr<typename DmiT<DtmT>::Hawindow> &
+DmiT<DtmT>::hawindow ()
 {
   return mHawindow;
 }
@@ -708,8 +2343,9 @@ Dmi::hawindow ()
 ///
 /// \return  An instance of class Abstractcs:: representing the \c abstractcs
 ///          register.
-std::unique_ptr<Dmi::Abstractcs> &
-Dmi::abstractcs ()
+template <class DtmT>
+std::unique_ptr<typename DmiT<DtmT>::Abstractcs> &
+DmiT<DtmT>::abstractcs ()
 {
   return mAbstractcs;
 }
@@ -718,8 +2354,9 @@ Dmi::abstractcs ()
 ///
 /// \return  An instance of class Command:: representing the \c command
 ///          register.
-std::unique_ptr<Dmi::Command> &
-Dmi::command ()
+template <class DtmT>
+std::unique_ptr<typename DmiT<DtmT>::Command> &
+DmiT<DtmT>::command ()
 {
   return mCommand;
 }
@@ -728,8 +2365,9 @@ Dmi::command ()
 ///
 /// \return  An instance of class Abstractauto:: representing the
 ///          \c abstractauto register.
-std::unique_ptr<Dmi::Abstractauto> &
-Dmi::abstractauto ()
+template <class DtmT>
+std::unique_ptr<typename DmiT<DtmT>::Abstractauto> &
+DmiT<DtmT>::abstractauto ()
 {
   return mAbstractauto;
 }
@@ -738,8 +2376,9 @@ Dmi::abstractauto ()
 ///
 /// \return  An instance of class Constrptr:: representing the set of \c
 ///          confstrptr registers.
-std::unique_ptr<Dmi::Confstrptr> &
-Dmi::confstrptr ()
+template <class DtmT>
+std::unique_ptr<typename DmiT<DtmT>::Confstrptr> &
+DmiT<DtmT>::confstrptr ()
 {
   return mConfstrptr;
 }
@@ -748,8 +2387,9 @@ Dmi::confstrptr ()
 ///
 /// \return  An instance of class Nextdm:: representing the \c nextdm
 ///          register.
-std::unique_ptr<Dmi::Nextdm> &
-Dmi::nextdm ()
+template <class DtmT>
+std::unique_ptr<typename DmiT<DtmT>::Nextdm> &
+DmiT<DtmT>::nextdm ()
 {
   return mNextdm;
 }
@@ -758,8 +2398,9 @@ Dmi::nextdm ()
 ///
 /// \return  An instance of class Progbuf:: representing the set of \c progbuf
 ///          registers.
-std::unique_ptr<Dmi::Progbuf> &
-Dmi::progbuf ()
+template <class DtmT>
+std::unique_ptr<typename DmiT<DtmT>::Progbuf> &
+DmiT<DtmT>::progbuf ()
 {
   return mProgbuf;
 }
@@ -768,8 +2409,9 @@ Dmi::progbuf ()
 ///
 /// \return  An instance of class Authdata:: representing the \c authdata
 ///          register.
-std::unique_ptr<Dmi::Authdata> &
-Dmi::authdata ()
+template <class DtmT>
+std::unique_ptr<typename DmiT<DtmT>::Authdata> &
+DmiT<DtmT>::authdata ()
 {
   return mAuthdata;
 }
@@ -778,8 +2420,9 @@ Dmi::authdata ()
 ///
 /// \return  An instance of class Sbaddress:: representing the set of
 ///          \c sbaddress registers.
-std::unique_ptr<Dmi::Sbaddress> &
-Dmi::sbaddress ()
+template <class DtmT>
+std::unique_ptr<typename DmiT<DtmT>::Sbaddress> &
+DmiT<DtmT>::sbaddress ()
 {
   return mSbaddress;
 }
@@ -788,8 +2431,9 @@ Dmi::sbaddress ()
 ///
 /// \return  An instance of class Sbcs:: representing the \c sbcs
 ///          register.
-std::unique_ptr<Dmi::Sbcs> &
-Dmi::sbcs ()
+template <class DtmT>
+std::unique_ptr<typename DmiT<DtmT>::Sbcs> &
+DmiT<DtmT>::sbcs ()
 {
   return mSbcs;
 }
@@ -798,12 +2442,86 @@ Dmi::sbcs ()
 ///
 /// \return  An instance of class Sbdata:: representing the set of
 ///          \c sbdata registers.
-std::unique_ptr<Dmi::Sbdata> &
-Dmi::sbdata ()
+template <class DtmT>
+std::unique_ptr<typename DmiT<DtmT>::Sbdata> &
+DmiT<DtmT>::sbdata ()
 {
   return mSbdata;
 }
 
+/*******************************************************************************
+ *                                                                             *
+ * The Dmi::Shadow class                                                       *
+ *                                                                             *
+ ******************************************************************************/
+
+/// \brief constructor for the Dmi::Shadow class.
+///
+/// Nothing is known about the debug module until the first write.
+template <class DtmT>
+DmiT<DtmT>::Shadow::Shadow ()
+    : mValid (false), mShadowReg (0), mWritesElided (0)
+{
+}
+
+/// \brief Determine whether a write would leave the state unchanged.
+///
+/// \param[in] val  The recorded fields of the value to be written.
+/// \return \c true if the debug module already holds \p val, in which case
+///         the write is counted as skipped, \c false otherwise.
+template <class DtmT>
+bool
+DmiT<DtmT>::Shadow::unchanged (const uint32_t val)
+{
+  if (mValid && (val == mShadowReg))
+    {
+      mWritesElided++;
+      return true;
+    }
+  else
+    return false;
+}
+
+/// \brief Record a value written.
+///
+/// \param[in] val  The recorded fields of the value written.
+template <class DtmT>
+void
+DmiT<DtmT>::Shadow::update (const uint32_t val)
+{
+  mShadowReg = val;
+  mValid = true;
+}
+
+/// \brief Forget the recorded state.
+///
+/// Needed whenever the debug module may have changed the register itself,
+/// for example when it is reset.
+template <class DtmT>
+void
+DmiT<DtmT>::Shadow::invalidate ()
+{
+  mValid = false;
+}
+
+/// \brief Get the number of writes skipped.
+///
+/// \return The number of writes skipped since the statistics were cleared.
+template <class DtmT>
+uint64_t
+DmiT<DtmT>::Shadow::writesElided () const
+{
+  return mWritesElided;
+}
+
+/// \brief Clear the count of writes skipped.
+template <class DtmT>
+void
+DmiT<DtmT>::Shadow::clearStats ()
+{
+  mWritesElided = 0;
+}
+
 /*******************************************************************************
  *                                                                             *
  * The Dmi::Data class                                                         *
@@ -812,9 +2530,10 @@ Dmi::sbdata ()
 
 /// \brief constructor for the Dmi::Data class
 ///
-/// \param[in] dtm_  The DTM we shall use.  This is a unique_ptr owned by the
-///                  Dmi, so passed and stored by reference.
-Dmi::Data::Data (unique_ptr<IDtm> &dtm_) : mDtm (dtm_)
+/// \param[in] dtm_  The DTM we shall use.  This is owned by the Dmi, which
+///                  rebinds it if the DTM is swapped.
+template <class DtmT>
+DmiT<DtmT>::Data::Data (DtmT *dtm_) : mDtm (dtm_)
 {
   for (size_t i = 0; i < NUM_REGS; i++)
     mDataReg[i] = 0x0;
@@ -825,8 +2544,9 @@ Dmi::Data::Data (unique_ptr<IDtm> &dtm_) : mDtm (dtm_)
 /// The register is refreshed via the DTM.
 ///
 /// \param[in] n  Index of the \c data register to read.
+template <class DtmT>
 void
-Dmi::Data::read (const size_t n)
+DmiT<DtmT>::Data::read (const size_t n)
 {
   if (n < NUM_REGS)
     mDataReg[n] = mDtm->dmiRead (DMI_ADDR[n]);
@@ -834,9 +2554,47 @@ Dmi::Data::read (const size_t n)
     cerr << "Warning: reading data[" << n << "] invalid: ignored." << endl;
 }
 
+/// \brief Queue a read of the specified abstract \c data register.
+///
+/// The register is refreshed when the batch is carried out by the DTM.
+///
+/// \param[in]     n      Index of the \c data register to read.
+/// \param[in,out] batch  The batch of DMI transactions to append to.
+template <class DtmT>
+void
+DmiT<DtmT>::Data::queueRead (const size_t n, std::vector<IDtm::DmiOp> &batch)
+{
+  if (n < NUM_REGS)
+    batch.push_back ({ IDtm::DmiOp::READ, DMI_ADDR[n], 0, &mDataReg[n] });
+  else
+    cerr << "Warning: queueing read of data[" << n << "] invalid: ignored."
+         << endl;
+}
+
+/// \brief Queue a read of the specified abstract \c data register elsewhere.
+///
+/// The value read is stored in \p res rather than the register, so the same
+/// register may be read several times in one batch.
+///
+/// \param[in]     n      Index of the \c data register to read.
+/// \param[in,out] batch  The batch of DMI transactions to append to.
+/// \param[out]    res    Where to store the value read.
+template <class DtmT>
+void
+DmiT<DtmT>::Data::queueRead (const size_t n, std::vector<IDtm::DmiOp> &batch,
+                             uint32_t *res)
+{
+  if (n < NUM_REGS)
+    batch.push_back ({ IDtm::DmiOp::READ, DMI_ADDR[n], 0, res });
+  else
+    cerr << "Warning: queueing read of data[" << n << "] invalid: ignored."
+         << endl;
+}
+
 /// \brief Set the specified abstract \c data register to its reset value.
+template <class DtmT>
 void
-Dmi::Data::reset (const size_t n)
+DmiT<DtmT>::Data::reset (const size_t n)
 {
   if (n < NUM_REGS)
     mDataReg[n] = RESET_VALUE;
@@ -847,8 +2605,9 @@ Dmi::Data::reset (const size_t n)
 /// \brief Write the value of the specified abstract \c data register.
 ///
 /// The register is refreshed via the DTM, and we save the value read back.
+template <class DtmT>
 void
-Dmi::Data::write (const size_t n)
+DmiT<DtmT>::Data::write (const size_t n)
 {
   if (n < NUM_REGS)
     mDtm->dmiWrite (DMI_ADDR[n], mDataReg[n]);
@@ -856,15 +2615,32 @@ Dmi::Data::write (const size_t n)
     cerr << "Warning: writing data[" << n << "] invalid: ignored." << endl;
 }
 
+/// \brief Queue a write of the specified abstract \c data register.
+///
+/// \param[in]     n      Index of the \c data register to write.
+/// \param[in,out] batch  The batch of DMI transactions to append to.
+template <class DtmT>
+void
+DmiT<DtmT>::Data::queueWrite (const size_t n, std::vector<IDtm::DmiOp> &batch)
+{
+  if (n < NUM_REGS)
+    batch.push_back ({ IDtm::DmiOp::WRITE, DMI_ADDR[n], mDataReg[n], nullptr });
+  else
+    cerr << "Warning: queueing write of data[" << n << "] invalid: ignored."
+         << endl;
+}
+
 /// \brief Must define as well as declare our private constexpr before using.
-constexpr uint64_t Dmi::Data::DMI_ADDR[Dmi::Data::NUM_REGS];
+template <class DtmT>
+constexpr uint64_t DmiT<DtmT>::Data::DMI_ADDR[];
 
 /// Get the value the specified \c data register.
 ///
 /// \param[in] n  Index of the \c data register to get.
 /// \return  The value in the specified \c data register.
+template <class DtmT>
 uint32_t
-Dmi::Data::data (const size_t n) const
+DmiT<DtmT>::Data::data (const size_t n) const
 {
   if (n < NUM_REGS)
     return mDataReg[n];
@@ -880,8 +2656,9 @@ Dmi::Data::data (const size_t n) const
 ///
 /// \param[in] n        Index of the \c data register to get.
 /// \param[in] dataVal  The value to be set in the specified \c data register.
+template <class DtmT>
 void
-Dmi::Data::data (const size_t n, const uint32_t dataVal)
+DmiT<DtmT>::Data::data (const size_t n, const uint32_t dataVal)
 {
   if (n < NUM_REGS)
     mDataReg[n] = dataVal;
@@ -889,19 +2666,19 @@ Dmi::Data::data (const size_t n, const uint32_t dataVal)
     cerr << "Warning: setting data[" << n << "] invalid: ignored." << endl;
 }
 
-/// \brief Output operator for the Dmi::Data class
+/// \brief Write the Dmi::Data class to a stream
 ///
 /// \param[in] s  The stream to which output is written
-/// \param[in] p  A unique_ptr to the instance to output
 /// \return  The stream with the instance appended
+template <class DtmT>
 std::ostream &
-operator<< (ostream &s, const unique_ptr<Dmi::Data> &p)
+DmiT<DtmT>::Data::print (ostream &s) const
 {
   std::ostringstream oss ("[");
 
-  for (size_t i = 0; i < p->NUM_REGS; i++)
-    oss << Utils::hexStr (p->mDataReg[i], 8)
-        << ((i == (p->NUM_REGS - 1)) ? "]" : ", ");
+  for (size_t i = 0; i < NUM_REGS; i++)
+    oss << Utils::hexStr (mDataReg[i], 8)
+        << ((i == (NUM_REGS - 1)) ? "]" : ", ");
 
   return s << oss.str ();
 }
@@ -914,19 +2691,21 @@ operator<< (ostream &s, const unique_ptr<Dmi::Data> &p)
 
 /// \brief constructor for the Dmi::Dmcontrol class.
 ///
-/// \param[in] dtm_  The DTM we shall use.  This is a unique_ptr owned by the
-///                  Dmi, so passed and stored by reference.
-Dmi::Dmcontrol::Dmcontrol (unique_ptr<IDtm> &dtm_)
+/// \param[in] dtm_  The DTM we shall use.  This is owned by the Dmi, which
+///                  rebinds it if the DTM is swapped.
+template <class DtmT>
+DmiT<DtmT>::Dmcontrol::Dmcontrol (DtmT *dtm_)
     : mCurrentHartsel (0), mPrettyPrint (false), mDtm (dtm_),
-      mDmcontrolReg (Dmi::Dmcontrol::RESET_VALUE)
+      mDmcontrolReg (DmiT::Dmcontrol::RESET_VALUE)
 {
 }
 
 /// \brief Read the value of the \c dmcontrol register.
 ///
 /// The register is refreshed via the DTM.
+template <class DtmT>
 void
-Dmi::Dmcontrol::read ()
+DmiT<DtmT>::Dmcontrol::read ()
 {
   mDmcontrolReg = mDtm->dmiRead (DMI_ADDR);
 }
@@ -935,8 +2714,9 @@ Dmi::Dmcontrol::read ()
 ///
 /// \note This includes setting the \c hartsel field to its most recently
 ///       selected value.
+template <class DtmT>
 void
-Dmi::Dmcontrol::reset ()
+DmiT<DtmT>::Dmcontrol::reset ()
 {
   mDmcontrolReg = RESET_VALUE;
   hartsel (mCurrentHartsel);
@@ -944,19 +2724,38 @@ Dmi::Dmcontrol::reset ()
 
 /// \brief Write the value of the \c dmcontrol register.
 ///
-/// The register is refreshed via the DTM, and we save the value read back.
+/// The write is skipped if it sets no trigger bits and the other fields
+/// match those last written.
+template <class DtmT>
 void
-Dmi::Dmcontrol::write ()
+DmiT<DtmT>::Dmcontrol::write ()
 {
+  uint32_t held = mDmcontrolReg & ~TRIGGER_MASK;
+
+  if (((mDmcontrolReg & TRIGGER_MASK) == 0) && mShadow.unchanged (held))
+    return;
+
   mDtm->dmiWrite (DMI_ADDR, mDmcontrolReg);
+  mShadow.update (held);
+}
+
+/// \brief Get the record of the fields last written to \c dmcontrol.
+///
+/// \return The shadow of the register.
+template <class DtmT>
+typename DmiT<DtmT>::Shadow &
+DmiT<DtmT>::Dmcontrol::shadow ()
+{
+  return mShadow;
 }
 
 /// \brief Control whether to pretty print the \c dmcontrol register.
 ///
 /// @param[in] flag  If \c true, subsequent stream output will generate a list
 ///                  of field values, if false a simple hex value.
+template <class DtmT>
 void
-Dmi::Dmcontrol::prettyPrint (const bool flag)
+DmiT<DtmT>::Dmcontrol::prettyPrint (const bool flag)
 {
   mPrettyPrint = flag;
 }
@@ -969,8 +2768,9 @@ Dmi::Dmcontrol::prettyPrint (const bool flag)
 ///                  selected harts, so that running hards will halt whenever
 ///                  their halt request bit is set.\c false clears the halt
 ///                  request bit,
+template <class DtmT>
 void
-Dmi::Dmcontrol::haltreq (const bool flag)
+DmiT<DtmT>::Dmcontrol::haltreq (const bool flag)
 {
   if (flag)
     mDmcontrolReg |= HALTREQ_MASK;
@@ -979,8 +2779,9 @@ Dmi::Dmcontrol::haltreq (const bool flag)
 }
 
 /// \brief Set the \c resumereq bit in \c dmcontrol to 1.
+template <class DtmT>
 void
-Dmi::Dmcontrol::resumereq ()
+DmiT<DtmT>::Dmcontrol::resumereq ()
 {
   mDmcontrolReg |= RESUMEREQ_MASK;
 }
@@ -991,8 +2792,9 @@ Dmi::Dmcontrol::resumereq ()
 ///          \c false.
 ///
 /// \returns Always returns \c false.
+template <class DtmT>
 bool
-Dmi::Dmcontrol::hartreset () const
+DmiT<DtmT>::Dmcontrol::hartreset () const
 {
   return false;
 }
@@ -1003,16 +2805,18 @@ Dmi::Dmcontrol::hartreset () const
 ///          warning.
 ///
 /// \param[in] flag  Value ignored.
+template <class DtmT>
 void
-Dmi::Dmcontrol::hartreset (const bool flag __attribute ((unused)))
+DmiT<DtmT>::Dmcontrol::hartreset (const bool flag __attribute ((unused)))
 {
   cerr << "Warning: Setting dmcontrol:hartreset not supported: ignored."
        << endl;
 }
 
 /// \brief Set the \c ackhavereset bit in \c dmcontrol to 1.
+template <class DtmT>
 void
-Dmi::Dmcontrol::ackhavereset ()
+DmiT<DtmT>::Dmcontrol::ackhavereset ()
 {
   mDmcontrolReg |= ACKHAVERESET_MASK;
 }
@@ -1023,8 +2827,9 @@ Dmi::Dmcontrol::ackhavereset ()
 ///          \c false (only ever one selected hart).
 ///
 /// \return Always returns \c false.
+template <class DtmT>
 bool
-Dmi::Dmcontrol::hasel () const
+DmiT<DtmT>::Dmcontrol::hasel () const
 {
   return false;
 }
@@ -1035,8 +2840,9 @@ Dmi::Dmcontrol::hasel () const
 ///          warning.
 ///
 /// \param[in] flag  Value ignored.
+template <class DtmT>
 void
-Dmi::Dmcontrol::hasel (const bool flag __attribute ((unused)))
+DmiT<DtmT>::Dmcontrol::hasel (const bool flag __attribute ((unused)))
 {
   cerr << "Warning: Setting dmcontrol:hasel not supported: ignored." << endl;
 }
@@ -1046,8 +2852,9 @@ Dmi::Dmcontrol::hasel (const bool flag __attribute ((unused)))
 /// Computes \c hartsel as \c hartselhi << 10 | \c hartsello.
 ///
 /// \return The value of \c hartsel
+template <class DtmT>
 uint32_t
-Dmi::Dmcontrol::hartsel () const
+DmiT<DtmT>::Dmcontrol::hartsel () const
 {
   uint32_t hartsello = (mDmcontrolReg & (HARTSELLO_MASK)) >> HARTSELLO_OFFSET;
   uint32_t hartselhi = (mDmcontrolReg & (HARTSELHI_MASK)) >> HARTSELHI_OFFSET;
@@ -1062,8 +2869,9 @@ Dmi::Dmcontrol::hartsel () const
 /// Also remembers this is the currently selected hart for use when reseting.
 ///
 /// \param[in] hartselVal  The value of \c hartsel to set.
+template <class DtmT>
 void
-Dmi::Dmcontrol::hartsel (const uint32_t hartselVal)
+DmiT<DtmT>::Dmcontrol::hartsel (const uint32_t hartselVal)
 {
   if (hartselVal >= (1 << (HARTSELLO_SIZE + HARTSELHI_SIZE)))
     cerr << "Warning: requested value of hartsel, " << hartselVal
@@ -1082,8 +2890,9 @@ Dmi::Dmcontrol::hartsel (const uint32_t hartselVal)
 /// \brief Return the maximum possible value of Hartsel
 ///
 /// \return The maximum value for Hartsel
+template <class DtmT>
 uint32_t
-Dmi::Dmcontrol::hartselMax ()
+DmiT<DtmT>::Dmcontrol::hartselMax ()
 {
   return ((HARTSELHI_MASK >> HARTSELHI_OFFSET) << HARTSELLO_SIZE)
          | (HARTSELLO_MASK >> HARTSELLO_OFFSET);
@@ -1093,8 +2902,9 @@ Dmi::Dmcontrol::hartselMax ()
 ///
 /// \warning Not implemented for the CORE-V MCU debug unit. Ignored with a
 ///          warning.
+template <class DtmT>
 void
-Dmi::Dmcontrol::setresethaltreq ()
+DmiT<DtmT>::Dmcontrol::setresethaltreq ()
 {
   cerr << "Warning: Setting dmcontrol:setresethaltreq not supported: ignored."
        << endl;
@@ -1105,8 +2915,9 @@ Dmi::Dmcontrol::setresethaltreq ()
 ///
 /// \warning Not implemented for the CORE-V MCU debug unit. Ignored with a
 ///          warning.
+template <class DtmT>
 void
-Dmi::Dmcontrol::clrresethaltreq ()
+DmiT<DtmT>::Dmcontrol::clrresethaltreq ()
 {
   cerr << "Warning: Setting dmcontrol:clrresethaltreq not supported: ignored."
        << endl;
@@ -1115,8 +2926,9 @@ Dmi::Dmcontrol::clrresethaltreq ()
 /// \brief Get the \c ndmreset bit in \c dmcontrol
 ///
 /// return \c true if the \c ndmreset bit is set and \c false otherwise.
+template <class DtmT>
 bool
-Dmi::Dmcontrol::ndmreset () const
+DmiT<DtmT>::Dmcontrol::ndmreset () const
 {
   return (mDmcontrolReg & NDMRESET_MASK) != 0;
 }
@@ -1125,8 +2937,9 @@ Dmi::Dmcontrol::ndmreset () const
 ///
 /// \param[in] flag  If \c true sets the \c ndmreset bit, otherwise clears the
 ///                  \c ndmreset bit.
+template <class DtmT>
 void
-Dmi::Dmcontrol::ndmreset (const bool flag)
+DmiT<DtmT>::Dmcontrol::ndmreset (const bool flag)
 {
   if (flag)
     mDmcontrolReg |= NDMRESET_MASK;
@@ -1137,8 +2950,9 @@ Dmi::Dmcontrol::ndmreset (const bool flag)
 /// \brief Get the \c dmactive bit in \c dmcontrol
 ///
 /// return \c true if the \c dmactive bit is set and \c false otherwise.
+template <class DtmT>
 bool
-Dmi::Dmcontrol::dmactive () const
+DmiT<DtmT>::Dmcontrol::dmactive () const
 {
   return (mDmcontrolReg & DMACTIVE_MASK) != 0;
 }
@@ -1147,8 +2961,9 @@ Dmi::Dmcontrol::dmactive () const
 ///
 /// \param[in] flag  If \c true sets the \c dmactive bit, otherwise clears the
 ///                  \c dmactive bit.
+template <class DtmT>
 void
-Dmi::Dmcontrol::dmactive (const bool flag)
+DmiT<DtmT>::Dmcontrol::dmactive (const bool flag)
 {
   if (flag)
     mDmcontrolReg |= DMACTIVE_MASK;
@@ -1156,32 +2971,32 @@ Dmi::Dmcontrol::dmactive (const bool flag)
     mDmcontrolReg &= ~DMACTIVE_MASK;
 }
 
-/// \brief Output operator for the Dmi::Dmcontrol class
+/// \brief Write the Dmi::Dmcontrol class to a stream
 ///
 /// \param[in] s  The stream to which output is written
-/// \param[in] p  A unique_ptr to the instance to output
 /// \return  The stream with the instance appended
+template <class DtmT>
 std::ostream &
-operator<< (ostream &s, const unique_ptr<Dmi::Dmcontrol> &p)
+DmiT<DtmT>::Dmcontrol::print (ostream &s) const
 {
   std::ostringstream oss;
 
-  if (p->mPrettyPrint)
-    oss << "[ haltreq = " << Utils::nonZero (p->mDmcontrolReg & p->HALTREQ_MASK)
+  if (mPrettyPrint)
+    oss << "[ haltreq = " << Utils::nonZero (mDmcontrolReg & HALTREQ_MASK)
         << ", resumereq = "
-        << Utils::nonZero (p->mDmcontrolReg & p->RESUMEREQ_MASK)
-        << ", hartreset = " << Utils::boolStr (p->hartreset ())
+        << Utils::nonZero (mDmcontrolReg & RESUMEREQ_MASK)
+        << ", hartreset = " << Utils::boolStr (hartreset ())
         << ", ackhavereset = "
-        << Utils::nonZero (p->mDmcontrolReg & p->ACKHAVERESET_MASK)
-        << ", hasel = " << Utils::boolStr (p->hasel ()) << ", hartsel = 0x"
-        << Utils::hexStr (p->hartsel (), 5) << ", setresethaltreq = "
-        << Utils::nonZero (p->mDmcontrolReg & p->SETRESETHALTREQ_MASK)
+        << Utils::nonZero (mDmcontrolReg & ACKHAVERESET_MASK)
+        << ", hasel = " << Utils::boolStr (hasel ()) << ", hartsel = 0x"
+        << Utils::hexStr (hartsel (), 5) << ", setresethaltreq = "
+        << Utils::nonZero (mDmcontrolReg & SETRESETHALTREQ_MASK)
         << ", clrresethaltreq = "
-        << Utils::nonZero (p->mDmcontrolReg & p->CLRRESETHALTREQ_MASK)
-        << ", ndmreset = " << Utils::boolStr (p->ndmreset ())
-        << ", dmactive = " << Utils::boolStr (p->dmactive ()) << " ]";
+        << Utils::nonZero (mDmcontrolReg & CLRRESETHALTREQ_MASK)
+        << ", ndmreset = " << Utils::boolStr (ndmreset ())
+        << ", dmactive = " << Utils::boolStr (dmactive ()) << " ]";
   else
-    oss << Utils::hexStr (p->mDmcontrolReg, 8);
+    oss << Utils::hexStr (mDmcontrolReg, 8);
 
   return s << oss.str ();
 }
@@ -1194,9 +3009,10 @@ operator<< (ostream &s, const unique_ptr<Dmi::Dmcontrol> &p)
 
 /// \brief constructor for the Dmi::Dmstatus class
 ///
-/// \param[in] dtm_  The DTM we shall use.  This is a unique_ptr owned by the
-///                  Dmi, so passed and stored by reference.
-Dmi::Dmstatus::Dmstatus (unique_ptr<IDtm> &dtm_)
+/// \param[in] dtm_  The DTM we shall use.  This is owned by the Dmi, which
+///                  rebinds it if the DTM is swapped.
+template <class DtmT>
+DmiT<DtmT>::Dmstatus::Dmstatus (DtmT *dtm_)
     : mPrettyPrint (false), mDtm (dtm_), mDmstatusReg (0)
 {
 }
@@ -1204,178 +3020,49 @@ Dmi::Dmstatus::Dmstatus (unique_ptr<IDtm> &dtm_)
 /// \brief Read the value of the \c dmstatus register.
 ///
 /// The register is refreshed via the DTM.
+template <class DtmT>
 void
-Dmi::Dmstatus::read ()
-{
-  mDmstatusReg = mDtm->dmiRead (DMI_ADDR);
-}
-
-/// \brief Control whether to pretty print the \c dmstatus register.
-///
-/// @param[in] flag  If \c true, subsequent stream output will generate a list
-///                  of field values, if false a simple hex value.
-void
-Dmi::Dmstatus::prettyPrint (const bool flag)
-{
-  mPrettyPrint = flag;
-}
-
-/// Get the \c impebreak field of the \c dmstatus register.
-///
-/// \return \c true if the \c impebreak field of \c dmstatus is set, \c false
-///         otherwise.
-bool
-Dmi::Dmstatus::impebreak () const
-{
-  return (mDmstatusReg & IMPEBREAK_MASK) != 0;
-}
-
-/// Get the \c havereset fields of the \c dmstatus register.
-///
-/// \note we do not distinguish between "all" or "any" versions of the flag.
-///
-/// \return \c true if either of the \c allhavereset of \c anyhavereset
-///         fields of \c dmstatus is set, \c false otherwise.
-bool
-Dmi::Dmstatus::havereset () const
-{
-  return (mDmstatusReg & (ALLHAVERESET_MASK | ANYHAVERESET_MASK)) != 0;
-}
-
-/// Get the \c resumeack fields of the \c dmstatus register.
-///
-/// \note we do not distinguish between "all" or "any" versions of the flag.
-///
-/// \return \c true if either of the \c allresumeack of \c anyresumeack
-///         fields of \c dmstatus is set, \c false otherwise.
-bool
-Dmi::Dmstatus::resumeack () const
-{
-  return (mDmstatusReg & (ALLRESUMEACK_MASK | ANYRESUMEACK_MASK)) != 0;
-}
-
-/// Get the \c nonexistent fields of the \c dmstatus register.
-///
-/// \note we do not distinguish between "all" or "any" versions of the flag.
-///
-/// \return \c true if either of the \c allnonexistent of \c anynonexistent
-///         fields of \c dmstatus is set, \c false otherwise.
-bool
-Dmi::Dmstatus::nonexistent () const
-{
-  return (mDmstatusReg & (ALLNONEXISTENT_MASK | ANYNONEXISTENT_MASK)) != 0;
-}
-
-/// Get the \c unavail fields of the \c dmstatus register.
-///
-/// \note we do not distinguish between "all" or "any" versions of the flag.
-///
-/// \return \c true if either of the \c allunavail of \c anyunavail
-///         fields of \c dmstatus is set, \c false otherwise.
-bool
-Dmi::Dmstatus::unavail () const
-{
-  return (mDmstatusReg & (ALLUNAVAIL_MASK | ANYUNAVAIL_MASK)) != 0;
-}
-
-/// Get the \c running fields of the \c dmstatus register.
-///
-/// \note we do not distinguish between "all" or "any" versions of the flag.
-///
-/// \return \c true if either of the \c allrunning of \c anyrunning
-///         fields of \c dmstatus is set, \c false otherwise.
-bool
-Dmi::Dmstatus::running () const
-{
-  return (mDmstatusReg & (ALLRUNNING_MASK | ANYRUNNING_MASK)) != 0;
-}
-
-/// Get the \c halted fields of the \c dmstatus register.
-///
-/// \note we do not distinguish between "all" or "any" versions of the flag.
-///
-/// \return \c true if either of the \c allhalted of \c anyhalted
-///         fields of \c dmstatus is set, \c false otherwise.
-bool
-Dmi::Dmstatus::halted () const
-{
-  return (mDmstatusReg & (ALLHALTED_MASK | ANYHALTED_MASK)) != 0;
-}
-
-/// Get the \c authenticated field of the \c dmstatus register.
-///
-/// \return \c true if the \c authenticated field of \c dmstatus is set,
-///         \c false otherwise.
-bool
-Dmi::Dmstatus::authenticated () const
-{
-  return (mDmstatusReg & AUTHENTICATED_MASK) != 0;
-}
-
-/// Get the \c authbusy field of the \c dmstatus register.
-///
-/// \return \c true if the \c authbusy field of \c dmstatus is set, \c false
-///         otherwise.
-bool
-Dmi::Dmstatus::authbusy () const
-{
-  return (mDmstatusReg & AUTHBUSY_MASK) != 0;
-}
-
-/// Get the \c hasresethaltreq field of the \c dmstatus register.
-///
-/// \return \c true if the \c hasresethaltreq field of \c dmstatus is set,
-///         \c false otherwise.
-bool
-Dmi::Dmstatus::hasresethaltreq () const
-{
-  return (mDmstatusReg & HASRESETHALTREQ_MASK) != 0;
-}
-
-/// Get the \c confstrptrvalid field of the \c dmstatus register.
-///
-/// \return \c true if the \c confstrptrvalid field of \c dmstatus is set,
-///         \c false otherwise.
-bool
-Dmi::Dmstatus::confstrptrvalid () const
+DmiT<DtmT>::Dmstatus::read ()
 {
-  return (mDmstatusReg & CONFSTRPTRVALID_MASK) != 0;
+  mDmstatusReg = mDtm->dmiRead (DMI_ADDR);
 }
 
-/// Get the \c version field of the \c dmstatus register.
+/// \brief Control whether to pretty print the \c dmstatus register.
 ///
-/// \return the value in the \c version field of \c dmstatus.
-uint8_t
-Dmi::Dmstatus::version () const
+/// @param[in] flag  If \c true, subsequent stream output will generate a list
+///                  of field values, if false a simple hex value.
+template <class DtmT>
+void
+DmiT<DtmT>::Dmstatus::prettyPrint (const bool flag)
 {
-  return (mDmstatusReg & VERSION_MASK) >> VERSION_OFFSET;
+  mPrettyPrint = flag;
 }
 
-/// \brief Output operator for the Dmi::Dmstatus class
+/// \brief Write the Dmi::Dmstatus class to a stream
 ///
 /// \param[in] s  The stream to which output is written
-/// \param[in] p  A unique_ptr to the instance to output
 /// \return  The stream with the instance appended
+template <class DtmT>
 std::ostream &
-operator<< (ostream &s, const unique_ptr<Dmi::Dmstatus> &p)
+DmiT<DtmT>::Dmstatus::print (ostream &s) const
 {
   std::ostringstream oss;
 
-  if (p->mPrettyPrint)
-    oss << "[ impebreak = " << Utils::boolStr (p->impebreak ())
-        << ", havereset = " << Utils::boolStr (p->havereset ())
-        << ", resumeack = " << Utils::boolStr (p->resumeack ())
-        << ", nonexistent = " << Utils::boolStr (p->nonexistent ())
-        << ", unavail = " << Utils::boolStr (p->unavail ())
-        << ", running = " << Utils::boolStr (p->running ())
-        << ", halted = " << Utils::boolStr (p->halted ())
-        << ", authenticated = " << Utils::boolStr (p->authenticated ())
-        << ", authbusy = " << Utils::boolStr (p->authbusy ())
-        << ", hasresethaltreq = " << Utils::boolStr (p->hasresethaltreq ())
-        << ", confstrptrvalid = " << Utils::boolStr (p->confstrptrvalid ())
-        << ", version = " << static_cast<uint16_t> (p->version ()) << " ]";
+  if (mPrettyPrint)
+    oss << "[ impebreak = " << Utils::boolStr (impebreak ())
+        << ", havereset = " << Utils::boolStr (havereset ())
+        << ", resumeack = " << Utils::boolStr (resumeack ())
+        << ", nonexistent = " << Utils::boolStr (nonexistent ())
+        << ", unavail = " << Utils::boolStr (unavail ())
+        << ", running = " << Utils::boolStr (running ())
+        << ", halted = " << Utils::boolStr (halted ())
+        << ", authenticated = " << Utils::boolStr (authenticated ())
+        << ", authbusy = " << Utils::boolStr (authbusy ())
+        << ", hasresethaltreq = " << Utils::boolStr (hasresethaltreq ())
+        << ", confstrptrvalid = " << Utils::boolStr (confstrptrvalid ())
+        << ", version = " << static_cast<uint16_t> (version ()) << " ]";
   else
-    oss << Utils::hexStr (p->mDmstatusReg, 8);
+    oss << Utils::hexStr (mDmstatusReg, 8);
 
   return s << oss.str ();
 }
@@ -1388,9 +3075,10 @@ operator<< (ostream &s, const unique_ptr<Dmi::Dmstatus> &p)
 
 /// \brief constructor for the Dmi::Hartinfo class
 ///
-/// \param[in] dtm_  The DTM we shall use.  This is a unique_ptr owned by the
-///                  Dmi, so passed and stored by reference.
-Dmi::Hartinfo::Hartinfo (unique_ptr<IDtm> &dtm_)
+/// \param[in] dtm_  The DTM we shall use.  This is owned by the Dmi, which
+///                  rebinds it if the DTM is swapped.
+template <class DtmT>
+DmiT<DtmT>::Hartinfo::Hartinfo (DtmT *dtm_)
     : mPrettyPrint (false), mDtm (dtm_), mHartinfoReg (0)
 {
 }
@@ -1398,8 +3086,9 @@ Dmi::Hartinfo::Hartinfo (unique_ptr<IDtm> &dtm_)
 /// \brief Read the value of the \c hartinfo register.
 ///
 /// The register is refreshed via the DTM.
+template <class DtmT>
 void
-Dmi::Hartinfo::read ()
+DmiT<DtmT>::Hartinfo::read ()
 {
   mHartinfoReg = mDtm->dmiRead (DMI_ADDR);
 }
@@ -1408,8 +3097,9 @@ Dmi::Hartinfo::read ()
 ///
 /// @param[in] flag  If \c true, subsequent stream output will generate a list
 ///                  of field values, if false a simple hex value.
+template <class DtmT>
 void
-Dmi::Hartinfo::prettyPrint (const bool flag)
+DmiT<DtmT>::Hartinfo::prettyPrint (const bool flag)
 {
   mPrettyPrint = flag;
 }
@@ -1417,8 +3107,9 @@ Dmi::Hartinfo::prettyPrint (const bool flag)
 /// Get the \c nscratch field of the \c hartinfo register.
 ///
 /// \return  The value in the \c nscratch field of the \c hartinfo register
+template <class DtmT>
 uint8_t
-Dmi::Hartinfo::nscratch () const
+DmiT<DtmT>::Hartinfo::nscratch () const
 {
   return (mHartinfoReg & NSCRATCH_MASK) >> NSCRATCH_OFFSET;
 }
@@ -1427,8 +3118,9 @@ Dmi::Hartinfo::nscratch () const
 ///
 /// \return  \c true if \c dataaccess field of \c hartinfo is set, \c false
 ///          otherwise.
+template <class DtmT>
 bool
-Dmi::Hartinfo::dataaccess () const
+DmiT<DtmT>::Hartinfo::dataaccess () const
 {
   return (mHartinfoReg & DATAACCESS_MASK) != 0;
 }
@@ -1436,8 +3128,9 @@ Dmi::Hartinfo::dataaccess () const
 /// Get the \c datasize field of the \c hartinfo register.
 ///
 /// \return  The value in the \c datasize field of the \c hartinfo register
+template <class DtmT>
 uint8_t
-Dmi::Hartinfo::datasize () const
+DmiT<DtmT>::Hartinfo::datasize () const
 {
   return (mHartinfoReg & DATASIZE_MASK) >> DATASIZE_OFFSET;
 }
@@ -1445,29 +3138,30 @@ Dmi::Hartinfo::datasize () const
 /// Get the \c dataaddr field of the \c hartinfo register.
 ///
 /// \return  The value in the \c dataaddr field of the \c hartinfo register
+template <class DtmT>
 uint16_t
-Dmi::Hartinfo::dataaddr () const
+DmiT<DtmT>::Hartinfo::dataaddr () const
 {
   return (mHartinfoReg & DATAADDR_MASK) >> DATAADDR_OFFSET;
 }
 
-/// \brief Output operator for the Dmi::Hartinfo class
+/// \brief Write the Dmi::Hartinfo class to a stream
 ///
 /// \param[in] s  The stream to which output is written
-/// \param[in] p  A unique_ptr to the instance to output
 /// \return  The stream with the instance appended
+template <class DtmT>
 std::ostream &
-operator<< (ostream &s, const unique_ptr<Dmi::Hartinfo> &p)
+DmiT<DtmT>::Hartinfo::print (ostream &s) const
 {
   std::ostringstream oss;
 
-  if (p->mPrettyPrint)
-    oss << "[ nscratch = " << static_cast<uint16_t> (p->nscratch ())
-        << ", dataaccess = " << Utils::boolStr (p->dataaccess ())
-        << ", datasize = " << static_cast<uint16_t> (p->datasize ())
-        << ", dataaddr = 0x" << Utils::hexStr (p->dataaddr (), 3) << " ]";
+  if (mPrettyPrint)
+    oss << "[ nscratch = " << static_cast<uint16_t> (nscratch ())
+        << ", dataaccess = " << Utils::boolStr (dataaccess ())
+        << ", datasize = " << static_cast<uint16_t> (datasize ())
+        << ", dataaddr = 0x" << Utils::hexStr (dataaddr (), 3) << " ]";
   else
-    oss << Utils::hexStr (p->mHartinfoReg, 8);
+    oss << Utils::hexStr (mHartinfoReg, 8);
 
   return s << oss.str ();
 }
@@ -1480,9 +3174,10 @@ operator<< (ostream &s, const unique_ptr<Dmi::Hartinfo> &p)
 
 /// \brief constructor for the Dmi::Haltsum class
 ///
-/// \param[in] dtm_  The DTM we shall use.  This is a unique_ptr owned by the
-///                  Dmi, so passed and stored by reference.
-Dmi::Haltsum::Haltsum (unique_ptr<IDtm> &dtm_) : mDtm (dtm_)
+/// \param[in] dtm_  The DTM we shall use.  This is owned by the Dmi, which
+///                  rebinds it if the DTM is swapped.
+template <class DtmT>
+DmiT<DtmT>::Haltsum::Haltsum (DtmT *dtm_) : mDtm (dtm_)
 {
   for (size_t i = 0; i < NUM_REGS; i++)
     mHaltsumReg[i] = 0x0;
@@ -1493,8 +3188,9 @@ Dmi::Haltsum::Haltsum (unique_ptr<IDtm> &dtm_) : mDtm (dtm_)
 /// The register is refreshed via the DTM.
 ///
 /// \param[in] n  Index of the \c haltsum register to read.
+template <class DtmT>
 void
-Dmi::Haltsum::read (const size_t n)
+DmiT<DtmT>::Haltsum::read (const size_t n)
 {
   if (n < NUM_REGS)
     mHaltsumReg[n] = mDtm->dmiRead (DMI_ADDR[n]);
@@ -1503,14 +3199,16 @@ Dmi::Haltsum::read (const size_t n)
 }
 
 /// \brief Must define as well as declare our private constexpr before using.
-constexpr uint64_t Dmi::Haltsum::DMI_ADDR[Dmi::Haltsum::NUM_REGS];
+template <class DtmT>
+constexpr uint64_t DmiT<DtmT>::Haltsum::DMI_ADDR[];
 
 /// Get the value the specified \c haltsum register.
 ///
 /// \param[in] n  Index of the \c haltsum register to get.
 /// \return  The value in the specified \c haltsum register.
+template <class DtmT>
 uint32_t
-Dmi::Haltsum::haltsum (const size_t n) const
+DmiT<DtmT>::Haltsum::haltsum (const size_t n) const
 {
   if (n < NUM_REGS)
     return mHaltsumReg[n];
@@ -1522,21 +3220,21 @@ Dmi::Haltsum::haltsum (const size_t n) const
     }
 }
 
-/// \brief Output operator for the Dmi::Haltsum class
+/// \brief Write the Dmi::Haltsum class to a stream
 ///
 /// \param[in] s  The stream to which output is written
-/// \param[in] p  A unique_ptr to the instance to output
 /// \return  The stream with the instance appended
+template <class DtmT>
 std::ostream &
-operator<< (ostream &s, const unique_ptr<Dmi::Haltsum> &p)
+DmiT<DtmT>::Haltsum::print (ostream &s) const
 {
   std::ostringstream oss;
   oss << "[" << hex << setw (8) << setfill ('0');
 
-  for (size_t i = 0; i < p->NUM_REGS; i++)
+  for (size_t i = 0; i < NUM_REGS; i++)
     {
-      oss << p->mHaltsumReg[i];
-      if (i != (p->NUM_REGS - 1))
+      oss << mHaltsumReg[i];
+      if (i != (NUM_REGS - 1))
         oss << ", ";
     }
 
@@ -1552,25 +3250,28 @@ operator<< (ostream &s, const unique_ptr<Dmi::Haltsum> &p)
 
 /// \brief constructor for the Dmi::Hawindowsel class.
 ///
-/// \param[in] dtm_  The DTM we shall use.  This is a unique_ptr owned by the
-///                  Dmi, so passed and stored by reference.
-Dmi::Hawindowsel::Hawindowsel (unique_ptr<IDtm> &dtm_)
-    : mDtm (dtm_), mHawindowselReg (Dmi::Hawindowsel::RESET_VALUE)
+/// \param[in] dtm_  The DTM we shall use.  This is owned by the Dmi, which
+///                  rebinds it if the DTM is swapped.
+template <class DtmT>
+DmiT<DtmT>::Hawindowsel::Hawindowsel (DtmT *dtm_)
+    : mDtm (dtm_), mHawindowselReg (DmiT::Hawindowsel::RESET_VALUE)
 {
 }
 
 /// \brief Read the value of the \c hawindowsel register.
 ///
 /// The register is refreshed via the DTM.
+template <class DtmT>
 void
-Dmi::Hawindowsel::read ()
+DmiT<DtmT>::Hawindowsel::read ()
 {
   mHawindowselReg = mDtm->dmiRead (DMI_ADDR);
 }
 
 /// \brief Set the \c hawindowsel register to its reset value.
+template <class DtmT>
 void
-Dmi::Hawindowsel::reset ()
+DmiT<DtmT>::Hawindowsel::reset ()
 {
   mHawindowselReg = RESET_VALUE;
 }
@@ -1578,8 +3279,9 @@ Dmi::Hawindowsel::reset ()
 /// \brief Write the value of the \c hawindowsel register.
 ///
 /// The register is refreshed via the DTM, and we save the value read back.
+template <class DtmT>
 void
-Dmi::Hawindowsel::write ()
+DmiT<DtmT>::Hawindowsel::write ()
 {
   mDtm->dmiWrite (DMI_ADDR, mHawindowselReg);
 }
@@ -1587,8 +3289,9 @@ Dmi::Hawindowsel::write ()
 /// \brief Get the \c hawindowsel bits of \c hawindowsel
 ///
 /// \return The value of \c hawindowsel
+template <class DtmT>
 uint16_t
-Dmi::Hawindowsel::hawindowsel () const
+DmiT<DtmT>::Hawindowsel::hawindowsel () const
 {
   return static_cast<uint16_t> ((mHawindowselReg & HAWINDOWSEL_MASK)
                                 >> HAWINDOWSEL_OFFSET);
@@ -1597,8 +3300,9 @@ Dmi::Hawindowsel::hawindowsel () const
 /// \brief Set the \c hawindowsel bits of \c hawindowsel
 ///
 /// \param[in] hawindowselVal  The value of \c hawindowsel to set.
+template <class DtmT>
 void
-Dmi::Hawindowsel::hawindowsel (const uint16_t hawindowselVal)
+DmiT<DtmT>::Hawindowsel::hawindowsel (const uint16_t hawindowselVal)
 {
   if (hawindowselVal >= (1 << HAWINDOWSEL_SIZE))
     cerr << "Warning: requested value of hawindowsel, " << hawindowselVal
@@ -1609,16 +3313,16 @@ Dmi::Hawindowsel::hawindowsel (const uint16_t hawindowselVal)
   mHawindowselReg |= (hawindowselVal << HAWINDOWSEL_OFFSET) & HAWINDOWSEL_MASK;
 }
 
-/// \brief Output operator for the Dmi::Hawindowsel class
+/// \brief Write the Dmi::Hawindowsel class to a stream
 ///
 /// \param[in] s  The stream to which output is written
-/// \param[in] p  A unique_ptr to the instance to output
 /// \return  The stream with the instance appended
+template <class DtmT>
 std::ostream &
-operator<< (ostream &s, const unique_ptr<Dmi::Hawindowsel> &p)
+DmiT<DtmT>::Hawindowsel::print (ostream &s) const
 {
   std::ostringstream oss;
-  oss << Utils::hexStr (p->mHawindowselReg, 8);
+  oss << Utils::hexStr (mHawindowselReg, 8);
   return s << oss.str ();
 }
 
@@ -1630,25 +3334,28 @@ operator<< (ostream &s, const unique_ptr<Dmi::Hawindowsel> &p)
 
 /// \brief constructor for the Dmi::Hawindow class.
 ///
-/// \param[in] dtm_  The DTM we shall use.  This is a unique_ptr owned by the
-///                  Dmi, so passed and stored by reference.
-Dmi::Hawindow::Hawindow (unique_ptr<IDtm> &dtm_)
-    : mDtm (dtm_), mHawindowReg (Dmi::Hawindow::RESET_VALUE)
+/// \param[in] dtm_  The DTM we shall use.  This is owned by the Dmi, which
+///                  rebinds it if the DTM is swapped.
+template <class DtmT>
+DmiT<DtmT>::Hawindow::Hawindow (DtmT *dtm_)
+    : mDtm (dtm_), mHawindowReg (DmiT::Hawindow::RESET_VALUE)
 {
 }
 
 /// \brief Read the value of the \c hawindow register.
 ///
 /// The register is refreshed via the DTM.
+template <class DtmT>
 void
-Dmi::Hawindow::read ()
+DmiT<DtmT>::Hawindow::read ()
 {
   mHawindowReg = mDtm->dmiRead (DMI_ADDR);
 }
 
 /// \brief Set the \c hawindow register to its reset value.
+template <class DtmT>
 void
-Dmi::Hawindow::reset ()
+DmiT<DtmT>::Hawindow::reset ()
 {
   mHawindowReg = RESET_VALUE;
 }
@@ -1656,8 +3363,9 @@ Dmi::Hawindow::reset ()
 /// \brief Write the value of the \c hawindow register.
 ///
 /// The register is refreshed via the DTM, and we save the value read back.
+template <class DtmT>
 void
-Dmi::Hawindow::write ()
+DmiT<DtmT>::Hawindow::write ()
 {
   mDtm->dmiWrite (DMI_ADDR, mHawindowReg);
 }
@@ -1665,8 +3373,9 @@ Dmi::Hawindow::write ()
 /// \brief Get the value of \c hawindow
 ///
 /// \return The value of \c hawindow
+template <class DtmT>
 uint32_t
-Dmi::Hawindow::hawindow () const
+DmiT<DtmT>::Hawindow::hawindow () const
 {
   return mHawindowReg;
 }
@@ -1674,22 +3383,23 @@ Dmi::Hawindow::hawindow () const
 /// \brief Set the value of \c hawindow
 ///
 /// \param[in] hawindowVal  The value of \c hawindow to set.
+template <class DtmT>
 void
-Dmi::Hawindow::hawindow (const uint32_t hawindowVal)
+DmiT<DtmT>::Hawindow::hawindow (const uint32_t hawindowVal)
 {
   mHawindowReg = hawindowVal;
 }
 
-/// \brief Output operator for the Dmi::Hawindow class
+/// \brief Write the Dmi::Hawindow class to a stream
 ///
 /// \param[in] s  The stream to which output is written
-/// \param[in] p  A unique_ptr to the instance to output
 /// \return  The stream with the instance appended
+template <class DtmT>
 std::ostream &
-operator<< (ostream &s, const unique_ptr<Dmi::Hawindow> &p)
+DmiT<DtmT>::Hawindow::print (ostream &s) const
 {
   std::ostringstream oss;
-  oss << Utils::hexStr (p->mHawindowReg, 8);
+  oss << Utils::hexStr (mHawindowReg, 8);
   return s << oss.str ();
 }
 
@@ -1701,117 +3411,90 @@ operator<< (ostream &s, const unique_ptr<Dmi::Hawindow> &p)
 
 /// \brief constructor for the Dmi::Abstractcs class.
 ///
-/// \param[in] dtm_  The DTM we shall use.  This is a unique_ptr owned by the
-///                  Dmi, so passed and stored by reference.
-Dmi::Abstractcs::Abstractcs (unique_ptr<IDtm> &dtm_)
+/// \param[in] dtm_  The DTM we shall use.  This is owned by the Dmi, which
+///                  rebinds it if the DTM is swapped.
+template <class DtmT>
+DmiT<DtmT>::Abstractcs::Abstractcs (DtmT *dtm_)
     : mPrettyPrint (false), mDtm (dtm_),
-      mAbstractcsReg (Dmi::Abstractcs::RESET_VALUE)
+      mAbstractcsReg (DmiT::Abstractcs::RESET_VALUE)
 {
 }
 
 /// \brief Read the value of the \c abstractcs register.
 ///
 /// The register is refreshed via the DTM.
+template <class DtmT>
 void
-Dmi::Abstractcs::read ()
+DmiT<DtmT>::Abstractcs::read ()
 {
   mAbstractcsReg = mDtm->dmiRead (DMI_ADDR);
 }
 
+/// \brief Queue a read of the \c abstractcs register.
+///
+/// The register is refreshed when the batch is carried out by the DTM.
+///
+/// \param[in,out] batch  The batch of DMI transactions to append to.
+template <class DtmT>
+void
+DmiT<DtmT>::Abstractcs::queueRead (std::vector<IDtm::DmiOp> &batch)
+{
+  batch.push_back ({ IDtm::DmiOp::READ, DMI_ADDR, 0, &mAbstractcsReg });
+}
+
 /// \brief Set the \c abstractcs register to its reset value.
+template <class DtmT>
 void
-Dmi::Abstractcs::reset ()
+DmiT<DtmT>::Abstractcs::reset ()
 {
   mAbstractcsReg = RESET_VALUE;
 }
 
 /// \brief Write the value of the \c abstractcs register.
 ///
-/// The register is refreshed via the DTM, and we save the value read back.
+/// The only writable field is the write-1-to-clear \c cmderr, so the write
+/// is skipped if it would clear no bits.
+template <class DtmT>
 void
-Dmi::Abstractcs::write ()
+DmiT<DtmT>::Abstractcs::write ()
 {
-  mDtm->dmiWrite (DMI_ADDR, mAbstractcsReg);
+  if ((mAbstractcsReg & Cmderr::MASK) != 0)
+    mDtm->dmiWrite (DMI_ADDR, mAbstractcsReg);
 }
 
 /// \brief Control whether to pretty print the \c abstractcs register.
 ///
 /// @param[in] flag  If \c true, subsequent stream output will generate a list
 ///                  of field values, if false a simple hex value.
+template <class DtmT>
 void
-Dmi::Abstractcs::prettyPrint (const bool flag)
+DmiT<DtmT>::Abstractcs::prettyPrint (const bool flag)
 {
   mPrettyPrint = flag;
 }
 
-/// \brief Get the \c progbufsize bits of \c abstractcs
-///
-/// \return The value of \c progbufsize
-uint8_t
-Dmi::Abstractcs::progbufsize () const
-{
-  return static_cast<uint8_t> ((mAbstractcsReg & PROGBUFSIZE_MASK)
-                               >> PROGBUFSIZE_OFFSET);
-}
-
-/// \brief Get the \c busy bit of \c abstractcs
-///
-/// \return \c true if the \c busy bit is set, \c false otherwise.
-bool
-Dmi::Abstractcs::busy () const
-{
-  return (mAbstractcsReg & BUSY_MASK) != 0;
-}
-
-/// \brief Get the \c cmderr bits of \c abstractcs
-///
-/// \return The value of \c cmderr
-Dmi::Abstractcs::CmderrVal
-Dmi::Abstractcs::cmderr () const
-{
-  switch (static_cast<int> ((mAbstractcsReg & CMDERR_MASK) >> CMDERR_OFFSET))
-    {
-    case CMDERR_NONE:
-      return CMDERR_NONE;
-    case CMDERR_BUSY:
-      return CMDERR_BUSY;
-    case CMDERR_UNSUPPORTED:
-      return CMDERR_UNSUPPORTED;
-    case CMDERR_EXCEPT:
-      return CMDERR_EXCEPT;
-    case CMDERR_HALT_RESUME:
-      return CMDERR_HALT_RESUME;
-    case CMDERR_BUS:
-      return CMDERR_BUS;
-    case CMDERR_OTHER:
-      return CMDERR_OTHER;
-
-    default:
-      return CMDERR_UNKNOWN;
-    }
-}
-
 /// \brief Get the value of cmderr as a string.
 ///
 /// \return  The constant string corresponding to the cmderr
+template <class DtmT>
 const char *
-Dmi::Abstractcs::cmderrName (Dmi::Abstractcs::CmderrVal err)
+DmiT<DtmT>::Abstractcs::cmderrName (DmiT::Abstractcs::CmderrVal err)
 {
   switch (err)
     {
-    case Dmi::Abstractcs::CMDERR_NONE:
+    case DmiT::Abstractcs::CMDERR_NONE:
       return "None";
-    case Dmi::Abstractcs::CMDERR_BUSY:
+    case DmiT::Abstractcs::CMDERR_BUSY:
       return "Busy";
-    case Dmi::Abstractcs::CMDERR_UNSUPPORTED:
+    case DmiT::Abstractcs::CMDERR_UNSUPPORTED:
       return "Unsupported";
-    case Dmi::Abstractcs::CMDERR_EXCEPT:
+    case DmiT::Abstractcs::CMDERR_EXCEPT:
       return "Exception";
-    case Dmi::Abstractcs::CMDERR_HALT_RESUME:
+    case DmiT::Abstractcs::CMDERR_HALT_RESUME:
       return "Halt/resume";
-    case Dmi::Abstractcs::CMDERR_BUS:
+    case DmiT::Abstractcs::CMDERR_BUS:
       return "Bus error";
-    case Dmi::Abstractcs::CMDERR_OTHER:
+    case DmiT::Abstractcs::CMDERR_OTHER:
       return "Other";
 
     default:
@@ -1819,47 +3502,28 @@ Dmi::Abstractcs::cmderrName (Dmi::Abstractcs::CmderrVal err)
     }
 }
 
-/// \brief Clear the \c cmderr bits of \c abstractcs
-///
-/// This means setting all the bits to 1, prior to a write.
-void
-Dmi::Abstractcs::cmderrClear ()
-{
-  mAbstractcsReg |= CMDERR_MASK;
-}
-
-/// \brief Get the \c datacount bits of \c abstractcs
-///
-/// \return The value of \c datacount
-uint8_t
-Dmi::Abstractcs::datacount () const
-{
-  return static_cast<uint8_t> ((mAbstractcsReg & DATACOUNT_MASK)
-                               >> DATACOUNT_OFFSET);
-}
-
-/// \brief Output operator for the Dmi::Abstractcs class
+/// \brief Write the Dmi::Abstractcs class to a stream
 ///
 /// \param[in] s  The stream to which output is written
-/// \param[in] p  A unique_ptr to the instance to output
 /// \return  The stream with the instance appended
+template <class DtmT>
 std::ostream &
-operator<< (ostream &s, const unique_ptr<Dmi::Abstractcs> &p)
+DmiT<DtmT>::Abstractcs::print (ostream &s) const
 {
   std::ostringstream oss;
 
-  if (p->mPrettyPrint)
+  if (mPrettyPrint)
     {
-      Dmi::Abstractcs::CmderrVal err = p->cmderr ();
-      oss << "[ progbufsize = " << static_cast<uint16_t> (p->progbufsize ())
-          << ", busy = " << Utils::boolStr (p->busy ())
+      DmiT::Abstractcs::CmderrVal err = cmderr ();
+      oss << "[ progbufsize = " << static_cast<uint16_t> (progbufsize ())
+          << ", busy = " << Utils::boolStr (busy ())
           << ", cmderr = " << static_cast<uint16_t> (err) << " ("
-          << Dmi::Abstractcs::cmderrName (err) << ")"
-          << ", datacount = 0x" << static_cast<uint16_t> (p->datacount ())
+          << DmiT::Abstractcs::cmderrName (err) << ")"
+          << ", datacount = 0x" << static_cast<uint16_t> (datacount ())
           << " ]";
     }
   else
-    oss << Utils::hexStr (p->mAbstractcsReg, 8);
+    oss << Utils::hexStr (mAbstractcsReg, 8);
 
   return s << oss.str ();
 }
@@ -1872,16 +3536,19 @@ operator<< (ostream &s, const unique_ptr<Dmi::Abstractcs> &p)
 
 /// \brief constructor for the Dmi::Command class.
 ///
-/// \param[in] dtm_  The DTM we shall use.  This is a unique_ptr owned by the
-///                  Dmi, so passed and stored by reference.
-Dmi::Command::Command (unique_ptr<IDtm> &dtm_)
-    : mPrettyPrint (false), mDtm (dtm_), mCommandReg (Dmi::Command::RESET_VALUE)
+/// \param[in] dtm_  The DTM we shall use.  This is owned by the Dmi, which
+///                  rebinds it if the DTM is swapped.
+template <class DtmT>
+DmiT<DtmT>::Command::Command (DtmT *dtm_)
+    : mPrettyPrint (false), mDtm (dtm_),
+      mCommandReg (DmiT::Command::RESET_VALUE)
 {
 }
 
 /// \brief Set the \c command register to its reset value.
+template <class DtmT>
 void
-Dmi::Command::reset ()
+DmiT<DtmT>::Command::reset ()
 {
   mCommandReg = RESET_VALUE;
 }
@@ -1889,18 +3556,30 @@ Dmi::Command::reset ()
 /// \brief Write the value of the \c command register.
 ///
 /// The register is refreshed via the DTM, and we save the value read back.
+template <class DtmT>
 void
-Dmi::Command::write ()
+DmiT<DtmT>::Command::write ()
 {
   mDtm->dmiWrite (DMI_ADDR, mCommandReg);
 }
 
+/// \brief Queue a write of the \c command register.
+///
+/// \param[in,out] batch  The batch of DMI transactions to append to.
+template <class DtmT>
+void
+DmiT<DtmT>::Command::queueWrite (std::vector<IDtm::DmiOp> &batch)
+{
+  batch.push_back ({ IDtm::DmiOp::WRITE, DMI_ADDR, mCommandReg, nullptr });
+}
+
 /// \brief Control whether to pretty print the \c command register.
 ///
 /// @param[in] flag  If \c true, subsequent stream output will generate a list
 ///                  of field values, if false a simple hex value.
+template <class DtmT>
 void
-Dmi::Command::prettyPrint (const bool flag)
+DmiT<DtmT>::Command::prettyPrint (const bool flag)
 {
   mPrettyPrint = flag;
 }
@@ -1911,17 +3590,16 @@ Dmi::Command::prettyPrint (const bool flag)
 ///                        are \c ACCESS_REG (0), \c QUICK_ACCESS (1) or
 ///                        \c ACCESS_MEM (2). Any other value is ignored with
 ///                        a warning.
+template <class DtmT>
 void
-Dmi::Command::cmdtype (const Dmi::Command::CmdtypeEnum cmdtypeVal)
+DmiT<DtmT>::Command::cmdtype (const DmiT::Command::CmdtypeEnum cmdtypeVal)
 {
   switch (cmdtypeVal)
     {
     case ACCESS_REG:
     case QUICK_ACCESS:
     case ACCESS_MEM:
-      mCommandReg &= ~CMDTYPE_MASK;
-      mCommandReg |= (static_cast<uint32_t> (cmdtypeVal) << CMDTYPE_OFFSET)
-                     & CMDTYPE_MASK;
+      mCommandReg = Cmdtype::set (mCommandReg, cmdtypeVal);
       return;
 
     default:
@@ -1934,29 +3612,16 @@ Dmi::Command::cmdtype (const Dmi::Command::CmdtypeEnum cmdtypeVal)
 /// \brief Set the \c control bits of \c command
 ///
 /// \param[in] controlVal  The value of \c control to set.
+template <class DtmT>
 void
-Dmi::Command::control (const uint32_t controlVal)
+DmiT<DtmT>::Command::control (const uint32_t controlVal)
 {
-  if (controlVal >= (1 << CONTROL_SIZE))
+  if (controlVal > Control::MAX)
     cerr << "Warning: requested value of control, " << controlVal
          << ", exceeds the maximum permitted value: higher bits ignored."
          << endl;
 
-  mCommandReg &= ~CONTROL_MASK;
-  mCommandReg
-      |= (static_cast<uint32_t> (controlVal) << CONTROL_OFFSET) & CONTROL_MASK;
-}
-
-/// \brief Set the \c aamvirtual bit for the \c command \c control field.
-///
-/// \param[in] flag  \c true if the bit is to be set, false otherwise.
-void
-Dmi::Command::aamvirtual (bool flag)
-{
-  if (flag)
-    mCommandReg |= AAMVIRTUAL_MASK;
-  else
-    mCommandReg &= ~AAMVIRTUAL_MASK;
+  mCommandReg = Control::set (mCommandReg, controlVal);
 }
 
 /// \brief Set the \c aarsize bits for the \c command \c control field.
@@ -1964,16 +3629,16 @@ Dmi::Command::aamvirtual (bool flag)
 /// \param[in] aarsizeval  The value to be set, permitted values are
 ///                       \c ACCESS32 (2), \c ACCESS32 (3) or \c ACCESS32 (4).
 ///                       Any other value is ignored with a warning.
+template <class DtmT>
 void
-Dmi::Command::aarsize (const Dmi::Command::AasizeEnum aarsizeVal)
+DmiT<DtmT>::Command::aarsize (const DmiT::Command::AasizeEnum aarsizeVal)
 {
   switch (aarsizeVal)
     {
     case ACCESS32:
     case ACCESS64:
     case ACCESS128:
-      mCommandReg &= ~AARSIZE_MASK;
-      mCommandReg |= static_cast<uint32_t> (aarsizeVal) << AARSIZE_OFFSET;
+      mCommandReg = Aarsize::set (mCommandReg, aarsizeVal);
       return;
 
     default:
@@ -1989,8 +3654,9 @@ Dmi::Command::aarsize (const Dmi::Command::AasizeEnum aarsizeVal)
 ///                       \c ACCESS8 (0), \c ACCESS16 (1), \c ACCESS32 (2),
 ///                       \c ACCESS32 (3) or \c ACCESS32 (4).  Any other value
 ///                       is ignored with a warning.
+template <class DtmT>
 void
-Dmi::Command::aamsize (const Dmi::Command::AasizeEnum aamsizeVal)
+DmiT<DtmT>::Command::aamsize (const DmiT::Command::AasizeEnum aamsizeVal)
 {
   switch (aamsizeVal)
     {
@@ -1999,8 +3665,7 @@ Dmi::Command::aamsize (const Dmi::Command::AasizeEnum aamsizeVal)
     case ACCESS32:
     case ACCESS64:
     case ACCESS128:
-      mCommandReg &= ~AAMSIZE_MASK;
-      mCommandReg |= static_cast<uint32_t> (aamsizeVal) << AAMSIZE_OFFSET;
+      mCommandReg = Aamsize::set (mCommandReg, aamsizeVal);
       return;
 
     default:
@@ -2010,62 +3675,15 @@ Dmi::Command::aamsize (const Dmi::Command::AasizeEnum aamsizeVal)
     }
 }
 
-/// \brief Set the \c postincrement bit for the \c command \c control field.
-///
-/// \param[in] flag  \c true if the bit is to be set, false otherwise.
-void
-Dmi::Command::aapostincrement (const bool flag)
-{
-  if (flag)
-    mCommandReg |= AAPOSTINCREMENT_MASK;
-  else
-    mCommandReg &= ~AAPOSTINCREMENT_MASK;
-}
-
-/// \brief Set the \c postexec bit for the \c command \c control field.
-///
-/// \param[in] flag  \c true if the bit is to be set, false otherwise.
-void
-Dmi::Command::aapostexec (const bool flag)
-{
-  if (flag)
-    mCommandReg |= POSTEXEC_MASK;
-  else
-    mCommandReg &= ~POSTEXEC_MASK;
-}
-
-/// \brief Set the \c transfer bit for the \c command \c control field.
-///
-/// \param[in] flag  \c true if the bit is to be set, false otherwise.
-void
-Dmi::Command::aatransfer (const bool flag)
-{
-  if (flag)
-    mCommandReg |= TRANSFER_MASK;
-  else
-    mCommandReg &= ~TRANSFER_MASK;
-}
-
-/// \brief Set the \c write bit for the \c command \c control field.
-///
-/// \param[in] flag  \c true if the bit is to be set, false otherwise.
-void
-Dmi::Command::aawrite (const bool flag)
-{
-  if (flag)
-    mCommandReg |= WRITE_MASK;
-  else
-    mCommandReg &= ~WRITE_MASK;
-}
-
 /// \brief Set the \c target-specific bits for the \c command \c control
 ///        field.
 ///
 /// \param[in] value  The value to be set. Must be in the range 0-3.
+template <class DtmT>
 void
-Dmi::Command::aatargetSpecific (uint8_t val)
+DmiT<DtmT>::Command::aatargetSpecific (uint8_t val)
 {
-  if (val > 3)
+  if (val > AatargetSpecific::MAX)
     {
       cerr << "Warning: " << val
            << " too large for target-specific field: ignored" << endl;
@@ -2073,38 +3691,27 @@ Dmi::Command::aatargetSpecific (uint8_t val)
     }
   else
     {
-      mCommandReg &= ~TARGET_SPECIFIC_MASK;
-      mCommandReg |= static_cast<uint32_t> (val) << TARGET_SPECIFIC_OFFSET;
+      mCommandReg = AatargetSpecific::set (mCommandReg, val);
     }
 }
 
-/// \brief Set the \c regno bits for the \c command \c control field.
-///
-/// \param[in] value  The value to be set.
-void
-Dmi::Command::aaregno (uint16_t val)
-{
-  mCommandReg &= ~REGNO_MASK;
-  mCommandReg |= static_cast<uint32_t> (val) << REGNO_OFFSET;
-}
-
-/// \brief Output operator for the Dmi::Command class
+/// \brief Write the Dmi::Command class to a stream
 ///
 /// \param[in] s  The stream to which output is written
-/// \param[in] p  A unique_ptr to the instance to output
 /// \return  The stream with the instance appended
+template <class DtmT>
 std::ostream &
-operator<< (ostream &s, const unique_ptr<Dmi::Command> &p)
+DmiT<DtmT>::Command::print (ostream &s) const
 {
   std::ostringstream oss;
 
-  if (p->mPrettyPrint)
+  if (mPrettyPrint)
     oss << "[ cmdtype = "
-        << ((p->mCommandReg & p->CMDTYPE_MASK) >> p->CMDTYPE_OFFSET)
-        << ", control = 0x" << hex << setw (6) << setfill ('0')
-        << ((p->mCommandReg & p->CONTROL_MASK) >> p->CONTROL_OFFSET) << " ]";
+        << DmiT::Command::Cmdtype::get (mCommandReg) << ", control = 0x"
+        << hex << setw (6) << setfill ('0')
+        << DmiT::Command::Control::get (mCommandReg) << " ]";
   else
-    oss << Utils::hexStr (p->mCommandReg, 8);
+    oss << Utils::hexStr (mCommandReg, 8);
 
   return s << oss.str ();
 }
@@ -2117,26 +3724,29 @@ operator<< (ostream &s, const unique_ptr<Dmi::Command> &p)
 
 /// \brief constructor for the Dmi::Abstractauto class.
 ///
-/// \param[in] dtm_  The DTM we shall use.  This is a unique_ptr owned by the
-///                  Dmi, so passed and stored by reference.
-Dmi::Abstractauto::Abstractauto (unique_ptr<IDtm> &dtm_)
+/// \param[in] dtm_  The DTM we shall use.  This is owned by the Dmi, which
+///                  rebinds it if the DTM is swapped.
+template <class DtmT>
+DmiT<DtmT>::Abstractauto::Abstractauto (DtmT *dtm_)
     : mPrettyPrint (false), mDtm (dtm_),
-      mAbstractautoReg (Dmi::Abstractauto::RESET_VALUE)
+      mAbstractautoReg (DmiT::Abstractauto::RESET_VALUE)
 {
 }
 
 /// \brief Read the value of the \c abstractauto register.
 ///
 /// The register is refreshed via the DTM.
+template <class DtmT>
 void
-Dmi::Abstractauto::read ()
+DmiT<DtmT>::Abstractauto::read ()
 {
   mAbstractautoReg = mDtm->dmiRead (DMI_ADDR);
 }
 
 /// \brief Set the \c abstractauto register to its reset value.
+template <class DtmT>
 void
-Dmi::Abstractauto::reset ()
+DmiT<DtmT>::Abstractauto::reset ()
 {
   mAbstractautoReg = RESET_VALUE;
 }
@@ -2144,18 +3754,31 @@ Dmi::Abstractauto::reset ()
 /// \brief Write the value of the \c abstractauto register.
 ///
 /// The register is refreshed via the DTM, and we save the value read back.
+template <class DtmT>
 void
-Dmi::Abstractauto::write ()
+DmiT<DtmT>::Abstractauto::write ()
 {
   mDtm->dmiWrite (DMI_ADDR, mAbstractautoReg);
 }
 
+/// \brief Queue a write of the \c abstractauto register.
+///
+/// \param[in,out] batch  The batch of DMI transactions to append to.
+template <class DtmT>
+void
+DmiT<DtmT>::Abstractauto::queueWrite (std::vector<IDtm::DmiOp> &batch)
+{
+  batch.push_back (
+      { IDtm::DmiOp::WRITE, DMI_ADDR, mAbstractautoReg, nullptr });
+}
+
 /// \brief Control whether to pretty print the \c abstractauto register.
 ///
 /// @param[in] flag  If \c true, subsequent stream output will generate a list
 ///                  of field values, if false a simple hex value.
+template <class DtmT>
 void
-Dmi::Abstractauto::prettyPrint (const bool flag)
+DmiT<DtmT>::Abstractauto::prettyPrint (const bool flag)
 {
   mPrettyPrint = flag;
 }
@@ -2163,8 +3786,9 @@ Dmi::Abstractauto::prettyPrint (const bool flag)
 /// \brief Get the \c autoexecprogbuf bits of \c abstractauto.
 ///
 /// \return  The value of the \c autoexecprogbuf bits of \c abstractauto
+template <class DtmT>
 uint16_t
-Dmi::Abstractauto::autoexecprogbuf () const
+DmiT<DtmT>::Abstractauto::autoexecprogbuf () const
 {
   return static_cast<uint16_t> ((mAbstractautoReg & AUTOEXECPROGBUF_MASK)
                                 << AUTOEXECPROGBUF_OFFSET);
@@ -2174,8 +3798,9 @@ Dmi::Abstractauto::autoexecprogbuf () const
 ///
 /// \param[in] autoexecprogbufVal  The value of the \c autoexecprogbuf bits to
 ///                                set in \c abstractauto.
+template <class DtmT>
 void
-Dmi::Abstractauto::autoexecprogbuf (const uint16_t autoexecprogbufVal)
+DmiT<DtmT>::Abstractauto::autoexecprogbuf (const uint16_t autoexecprogbufVal)
 {
   mAbstractautoReg &= ~AUTOEXECPROGBUF_MASK;
   mAbstractautoReg
@@ -2186,8 +3811,9 @@ Dmi::Abstractauto::autoexecprogbuf (const uint16_t autoexecprogbufVal)
 /// \brief Get the \c autoexecdata bits of \c abstractauto.
 ///
 /// \return  The value of the \c autoexecdata bits of \c abstractauto
+template <class DtmT>
 uint16_t
-Dmi::Abstractauto::autoexecdata () const
+DmiT<DtmT>::Abstractauto::autoexecdata () const
 {
   return static_cast<uint16_t> ((mAbstractautoReg & AUTOEXECDATA_MASK)
                                 << AUTOEXECDATA_OFFSET);
@@ -2197,8 +3823,9 @@ Dmi::Abstractauto::autoexecdata () const
 ///
 /// \param[in] autoexecdataVal  The value of the \c autoexecdata bits to set in
 ///                        \c abstractauto.
+template <class DtmT>
 void
-Dmi::Abstractauto::autoexecdata (const uint16_t autoexecdataVal)
+DmiT<DtmT>::Abstractauto::autoexecdata (const uint16_t autoexecdataVal)
 {
   if (autoexecdataVal >= (1 << AUTOEXECDATA_SIZE))
     cerr << "Warning: requested value of autoexecdata, " << autoexecdataVal
@@ -2211,22 +3838,22 @@ Dmi::Abstractauto::autoexecdata (const uint16_t autoexecdataVal)
          & AUTOEXECDATA_MASK;
 }
 
-/// \brief Output operator for the Dmi::Abstractauto class
+/// \brief Write the Dmi::Abstractauto class to a stream
 ///
 /// \param[in] s  The stream to which output is written
-/// \param[in] p  A unique_ptr to the instance to output
 /// \return  The stream with the instance appended
+template <class DtmT>
 std::ostream &
-operator<< (ostream &s, const unique_ptr<Dmi::Abstractauto> &p)
+DmiT<DtmT>::Abstractauto::print (ostream &s) const
 {
   std::ostringstream oss;
 
-  if (p->mPrettyPrint)
+  if (mPrettyPrint)
     oss << "[ autoexecprogbuf = 0x" << hex << setw (4) << setfill ('0')
-        << p->autoexecprogbuf () << ", autoexecdata = 0x" << setw (3)
-        << p->autoexecdata () << " ]";
+        << autoexecprogbuf () << ", autoexecdata = 0x" << setw (3)
+        << autoexecdata () << " ]";
   else
-    oss << Utils::hexStr (p->mAbstractautoReg, 8);
+    oss << Utils::hexStr (mAbstractautoReg, 8);
 
   return s << oss.str ();
 }
@@ -2239,9 +3866,10 @@ operator<< (ostream &s, const unique_ptr<Dmi::Abstractauto> &p)
 
 /// \brief constructor for the Dmi::Confstrptr class
 ///
-/// \param[in] dtm_  The DTM we shall use.  This is a unique_ptr owned by the
-///                  Dmi, so passed and stored by reference.
-Dmi::Confstrptr::Confstrptr (unique_ptr<IDtm> &dtm_) : mDtm (dtm_)
+/// \param[in] dtm_  The DTM we shall use.  This is owned by the Dmi, which
+///                  rebinds it if the DTM is swapped.
+template <class DtmT>
+DmiT<DtmT>::Confstrptr::Confstrptr (DtmT *dtm_) : mDtm (dtm_)
 {
   for (size_t i = 0; i < NUM_REGS; i++)
     mConfstrptrReg[i] = 0x0;
@@ -2252,8 +3880,9 @@ Dmi::Confstrptr::Confstrptr (unique_ptr<IDtm> &dtm_) : mDtm (dtm_)
 /// The register is refreshed via the DTM.
 ///
 /// \param[in] n  Index of the \c confstrptr register to read.
+template <class DtmT>
 void
-Dmi::Confstrptr::read (const size_t n)
+DmiT<DtmT>::Confstrptr::read (const size_t n)
 {
   if (n < NUM_REGS)
     mConfstrptrReg[n] = mDtm->dmiRead (DMI_ADDR[n]);
@@ -2263,14 +3892,16 @@ Dmi::Confstrptr::read (const size_t n)
 }
 
 /// \brief Must define as well as declare our private constexpr before using.
-constexpr uint64_t Dmi::Confstrptr::DMI_ADDR[Dmi::Confstrptr::NUM_REGS];
+template <class DtmT>
+constexpr uint64_t DmiT<DtmT>::Confstrptr::DMI_ADDR[];
 
 /// Get the value the specified \c confstrptr register.
 ///
 /// \param[in] n  Index of the \c confstrptr register to get.
 /// \return  The value in the specified \c confstrptr register.
+template <class DtmT>
 uint32_t
-Dmi::Confstrptr::confstrptr (const size_t n) const
+DmiT<DtmT>::Confstrptr::confstrptr (const size_t n) const
 {
   if (n < NUM_REGS)
     return mConfstrptrReg[n];
@@ -2282,21 +3913,21 @@ Dmi::Confstrptr::confstrptr (const size_t n) const
     }
 }
 
-/// \brief Output operator for the Dmi::Confstrptr class
+/// \brief Write the Dmi::Confstrptr class to a stream
 ///
 /// \param[in] s  The stream to which output is written
-/// \param[in] p  A unique_ptr to the instance to output
 /// \return  The stream with the instance appended
+template <class DtmT>
 std::ostream &
-operator<< (ostream &s, const unique_ptr<Dmi::Confstrptr> &p)
+DmiT<DtmT>::Confstrptr::print (ostream &s) const
 {
   std::ostringstream oss;
   oss << "[" << hex << setw (8) << setfill ('0');
 
-  for (size_t i = 0; i < p->NUM_REGS; i++)
+  for (size_t i = 0; i < NUM_REGS; i++)
     {
-      oss << p->mConfstrptrReg[i];
-      if (i != (p->NUM_REGS - 1))
+      oss << mConfstrptrReg[i];
+      if (i != (NUM_REGS - 1))
         oss << ", ";
     }
 
@@ -2312,18 +3943,20 @@ operator<< (ostream &s, const unique_ptr<Dmi::Confstrptr> &p)
 
 /// \brief constructor for the Dmi::Nextdm class.
 ///
-/// \param[in] dtm_  The DTM we shall use.  This is a unique_ptr owned by the
-///                  Dmi, so passed and stored by reference.
-Dmi::Nextdm::Nextdm (unique_ptr<IDtm> &dtm_)
-    : mDtm (dtm_), mNextdmReg (Dmi::Nextdm::RESET_VALUE)
+/// \param[in] dtm_  The DTM we shall use.  This is owned by the Dmi, which
+///                  rebinds it if the DTM is swapped.
+template <class DtmT>
+DmiT<DtmT>::Nextdm::Nextdm (DtmT *dtm_)
+    : mDtm (dtm_), mNextdmReg (DmiT::Nextdm::RESET_VALUE)
 {
 }
 
 /// \brief Read the value of the \c nextdm register.
 ///
 /// The register is refreshed via the DTM.
+template <class DtmT>
 void
-Dmi::Nextdm::read ()
+DmiT<DtmT>::Nextdm::read ()
 {
   mNextdmReg = mDtm->dmiRead (DMI_ADDR);
 }
@@ -2331,22 +3964,23 @@ Dmi::Nextdm::read ()
 /// \brief Get the value of \c nextdm
 ///
 /// \return The value of \c nextdm
+template <class DtmT>
 uint32_t
-Dmi::Nextdm::nextdm () const
+DmiT<DtmT>::Nextdm::nextdm () const
 {
   return mNextdmReg;
 }
 
-/// \brief Output operator for the Dmi::Nextdm class
+/// \brief Write the Dmi::Nextdm class to a stream
 ///
 /// \param[in] s  The stream to which output is written
-/// \param[in] p  A unique_ptr to the instance to output
 /// \return  The stream with the instance appended
+template <class DtmT>
 std::ostream &
-operator<< (ostream &s, const unique_ptr<Dmi::Nextdm> &p)
+DmiT<DtmT>::Nextdm::print (ostream &s) const
 {
   std::ostringstream oss;
-  oss << Utils::hexStr (p->mNextdmReg, 8);
+  oss << Utils::hexStr (mNextdmReg, 8);
   return s << oss.str ();
 }
 
@@ -2358,9 +3992,10 @@ operator<< (ostream &s, const unique_ptr<Dmi::Nextdm> &p)
 
 /// \brief constructor for the Dmi::Progbuf class
 ///
-/// \param[in] dtm_  The DTM we shall use.  This is a unique_ptr owned by the
-///                  Dmi, so passed and stored by reference.
-Dmi::Progbuf::Progbuf (unique_ptr<IDtm> &dtm_) : mDtm (dtm_)
+/// \param[in] dtm_  The DTM we shall use.  This is owned by the Dmi, which
+///                  rebinds it if the DTM is swapped.
+template <class DtmT>
+DmiT<DtmT>::Progbuf::Progbuf (DtmT *dtm_) : mDtm (dtm_)
 {
   for (size_t i = 0; i < NUM_REGS; i++)
     mProgbufReg[i] = 0x0;
@@ -2371,8 +4006,9 @@ Dmi::Progbuf::Progbuf (unique_ptr<IDtm> &dtm_) : mDtm (dtm_)
 /// The register is refreshed via the DTM.
 ///
 /// \param[in] n  Index of the \c progbuf register to read.
+template <class DtmT>
 void
-Dmi::Progbuf::read (const size_t n)
+DmiT<DtmT>::Progbuf::read (const size_t n)
 {
   if (n < NUM_REGS)
     mProgbufReg[n] = mDtm->dmiRead (DMI_ADDR[n]);
@@ -2381,8 +4017,9 @@ Dmi::Progbuf::read (const size_t n)
 }
 
 /// \brief Set the specified abstract \c progbuf register to its reset value.
+template <class DtmT>
 void
-Dmi::Progbuf::reset (const size_t n)
+DmiT<DtmT>::Progbuf::reset (const size_t n)
 {
   if (n < NUM_REGS)
     mProgbufReg[n] = RESET_VALUE;
@@ -2393,8 +4030,9 @@ Dmi::Progbuf::reset (const size_t n)
 /// \brief Write the value of the specified abstract \c progbuf register.
 ///
 /// The register is refreshed via the DTM, and we save the value read back.
+template <class DtmT>
 void
-Dmi::Progbuf::write (const size_t n)
+DmiT<DtmT>::Progbuf::write (const size_t n)
 {
   if (n < NUM_REGS)
     mDtm->dmiWrite (DMI_ADDR[n], mProgbufReg[n]);
@@ -2402,15 +4040,34 @@ Dmi::Progbuf::write (const size_t n)
     cerr << "Warning: writing progbuf[" << n << "] invalid: ignored." << endl;
 }
 
+/// \brief Queue a write of the specified \c progbuf register.
+///
+/// \param[in]     n      Index of the \c progbuf register to write.
+/// \param[in,out] batch  The batch of DMI transactions to append to.
+template <class DtmT>
+void
+DmiT<DtmT>::Progbuf::queueWrite (const size_t n,
+                                 std::vector<IDtm::DmiOp> &batch)
+{
+  if (n < NUM_REGS)
+    batch.push_back (
+        { IDtm::DmiOp::WRITE, DMI_ADDR[n], mProgbufReg[n], nullptr });
+  else
+    cerr << "Warning: queueing write of progbuf[" << n << "] invalid: ignored."
+         << endl;
+}
+
 /// \brief Must define as well as declare our private constexpr before using.
-constexpr uint64_t Dmi::Progbuf::DMI_ADDR[Dmi::Progbuf::NUM_REGS];
+template <class DtmT>
+constexpr uint64_t DmiT<DtmT>::Progbuf::DMI_ADDR[];
 
 /// Get the value the specified \c progbuf register.
 ///
 /// \param[in] n  Index of the \c progbuf register to get.
 /// \return  The value in the specified \c progbuf register.
+template <class DtmT>
 uint32_t
-Dmi::Progbuf::progbuf (const size_t n) const
+DmiT<DtmT>::Progbuf::progbuf (const size_t n) const
 {
   if (n < NUM_REGS)
     return mProgbufReg[n];
@@ -2427,8 +4084,9 @@ Dmi::Progbuf::progbuf (const size_t n) const
 /// \param[in] n         Index of the \c progbuf register to get.
 /// \param[in] progbufValy  The value to be set in the specified \c progbuf
 /// register.
+template <class DtmT>
 void
-Dmi::Progbuf::progbuf (const size_t n, const uint32_t progbufVal)
+DmiT<DtmT>::Progbuf::progbuf (const size_t n, const uint32_t progbufVal)
 {
   if (n < NUM_REGS)
     mProgbufReg[n] = progbufVal;
@@ -2436,18 +4094,18 @@ Dmi::Progbuf::progbuf (const size_t n, const uint32_t progbufVal)
     cerr << "Warning: setting progbuf[" << n << "] invalid: ignored." << endl;
 }
 
-/// \brief Output operator for the Dmi::Progbuf class
+/// \brief Write the Dmi::Progbuf class to a stream
 ///
 /// \param[in] s  The stream to which output is written
-/// \param[in] p  A unique_ptr to the instance to output
 /// \return  The stream with the instance appended
+template <class DtmT>
 std::ostream &
-operator<< (ostream &s, const unique_ptr<Dmi::Progbuf> &p)
+DmiT<DtmT>::Progbuf::print (ostream &s) const
 {
   std::ostringstream oss ("[");
 
-  for (size_t i = 0; i < p->NUM_REGS; i++)
-    oss << p->mProgbufReg[i] << ((i == (p->NUM_REGS - 1)) ? "]" : ", ");
+  for (size_t i = 0; i < NUM_REGS; i++)
+    oss << mProgbufReg[i] << ((i == (NUM_REGS - 1)) ? "]" : ", ");
 
   return s << oss.str ();
 }
@@ -2460,18 +4118,20 @@ operator<< (ostream &s, const unique_ptr<Dmi::Progbuf> &p)
 
 /// \brief constructor for the Dmi::Authdata class.
 ///
-/// \param[in] dtm_  The DTM we shall use.  This is a unique_ptr owned by the
-///                  Dmi, so passed and stored by reference.
-Dmi::Authdata::Authdata (unique_ptr<IDtm> &dtm_)
-    : mDtm (dtm_), mAuthdataReg (Dmi::Authdata::RESET_VALUE)
+/// \param[in] dtm_  The DTM we shall use.  This is owned by the Dmi, which
+///                  rebinds it if the DTM is swapped.
+template <class DtmT>
+DmiT<DtmT>::Authdata::Authdata (DtmT *dtm_)
+    : mDtm (dtm_), mAuthdataReg (DmiT::Authdata::RESET_VALUE)
 {
 }
 
 /// \brief Read the value of the \c authdata register.
 ///
 /// The register is refreshed via the DTM.
+template <class DtmT>
 void
-Dmi::Authdata::read ()
+DmiT<DtmT>::Authdata::read ()
 {
   cerr << "Warning: authentication not supported while reading authdata"
        << endl;
@@ -2479,8 +4139,9 @@ Dmi::Authdata::read ()
 }
 
 /// \brief Set the \c authdata register to its reset value.
+template <class DtmT>
 void
-Dmi::Authdata::reset ()
+DmiT<DtmT>::Authdata::reset ()
 {
   cerr << "Warning: authentication not supported while reseting authdata"
        << endl;
@@ -2490,8 +4151,9 @@ Dmi::Authdata::reset ()
 /// \brief Write the value of the \c authdata register.
 ///
 /// The register is refreshed via the DTM, and we save the value read back.
+template <class DtmT>
 void
-Dmi::Authdata::write ()
+DmiT<DtmT>::Authdata::write ()
 {
   cerr << "Warning: authentication not supported while writing authdata"
        << endl;
@@ -2501,8 +4163,9 @@ Dmi::Authdata::write ()
 /// \brief Get the value of \c authdata
 ///
 /// \return The value of \c authdata
+template <class DtmT>
 uint32_t
-Dmi::Authdata::authdata () const
+DmiT<DtmT>::Authdata::authdata () const
 {
   cerr << "Warning: authentication not supported while getting authdata"
        << endl;
@@ -2512,23 +4175,25 @@ Dmi::Authdata::authdata () const
 /// \brief Set the value of \c authdata
 ///
 /// \param[in] authdataVal  The value of \c authdata to set.
+template <class DtmT>
 void
-Dmi::Authdata::authdata (const uint32_t authdataVal __attribute__ ((unused)))
+DmiT<DtmT>::Authdata::authdata (
+    const uint32_t authdataVal __attribute__ ((unused)))
 {
   cerr << "Warning: authentication not supported while setting authdata: "
        << "value ignored" << endl;
 }
 
-/// \brief Output operator for the Dmi::Authdata class
+/// \brief Write the Dmi::Authdata class to a stream
 ///
 /// \param[in] s  The stream to which output is written
-/// \param[in] p  A unique_ptr to the instance to output
 /// \return  The stream with the instance appended
+template <class DtmT>
 std::ostream &
-operator<< (ostream &s, const unique_ptr<Dmi::Authdata> &p)
+DmiT<DtmT>::Authdata::print (ostream &s) const
 {
   std::ostringstream oss;
-  oss << Utils::hexStr (p->mAuthdataReg, 8);
+  oss << Utils::hexStr (mAuthdataReg, 8);
   return s << oss.str ();
 }
 
@@ -2540,9 +4205,10 @@ operator<< (ostream &s, const unique_ptr<Dmi::Authdata> &p)
 
 /// \brief constructor for the Dmi::Sbaddress class
 ///
-/// \param[in] dtm_  The DTM we shall use.  This is a unique_ptr owned by the
-///                  Dmi, so passed and stored by reference.
-Dmi::Sbaddress::Sbaddress (unique_ptr<IDtm> &dtm_) : mDtm (dtm_)
+/// \param[in] dtm_  The DTM we shall use.  This is owned by the Dmi, which
+///                  rebinds it if the DTM is swapped.
+template <class DtmT>
+DmiT<DtmT>::Sbaddress::Sbaddress (DtmT *dtm_) : mDtm (dtm_)
 {
   for (size_t i = 0; i < NUM_REGS; i++)
     mSbaddressReg[i] = 0x0;
@@ -2553,8 +4219,9 @@ Dmi::Sbaddress::Sbaddress (unique_ptr<IDtm> &dtm_) : mDtm (dtm_)
 /// The register is refreshed via the DTM.
 ///
 /// \param[in] n  Index of the \c sbaddress register to read.
+template <class DtmT>
 void
-Dmi::Sbaddress::read (const size_t n)
+DmiT<DtmT>::Sbaddress::read (const size_t n)
 {
   if (n < NUM_REGS)
     mSbaddressReg[n] = mDtm->dmiRead (DMI_ADDR[n]);
@@ -2563,8 +4230,9 @@ Dmi::Sbaddress::read (const size_t n)
 }
 
 /// \brief Set the specified abstract \c sbaddress register to its reset value.
+template <class DtmT>
 void
-Dmi::Sbaddress::reset (const size_t n)
+DmiT<DtmT>::Sbaddress::reset (const size_t n)
 {
   if (n < NUM_REGS)
     mSbaddressReg[n] = RESET_VALUE;
@@ -2575,25 +4243,68 @@ Dmi::Sbaddress::reset (const size_t n)
 
 /// \brief Write the value of the specified abstract \c sbaddress register.
 ///
-/// The register is refreshed via the DTM, and we save the value read back.
+/// Writes of the upper address words are skipped if they match the value
+/// last written.
+template <class DtmT>
 void
-Dmi::Sbaddress::write (const size_t n)
+DmiT<DtmT>::Sbaddress::write (const size_t n)
 {
-  if (n < NUM_REGS)
-    mDtm->dmiWrite (DMI_ADDR[n], mSbaddressReg[n]);
-  else
+  if (n >= NUM_REGS)
     cerr << "Warning: writing sbaddress[" << n << "] invalid: ignored." << endl;
+  else if ((n == 0) || !mShadow[n].unchanged (mSbaddressReg[n]))
+    {
+      mDtm->dmiWrite (DMI_ADDR[n], mSbaddressReg[n]);
+      mShadow[n].update (mSbaddressReg[n]);
+    }
+}
+
+/// \brief Queue a write of the specified \c sbaddress register.
+///
+/// As Dmi::Sbaddress::write, writes of upper address words matching the
+/// value last written are not queued.
+///
+/// \param[in]     n      Index of the \c sbaddress register to write.
+/// \param[in,out] batch  The batch of DMI transactions to append to.
+template <class DtmT>
+void
+DmiT<DtmT>::Sbaddress::queueWrite (const size_t n,
+                                   std::vector<IDtm::DmiOp> &batch)
+{
+  if (n >= NUM_REGS)
+    cerr << "Warning: queueing write of sbaddress[" << n
+         << "] invalid: ignored." << endl;
+  else if ((n == 0) || !mShadow[n].unchanged (mSbaddressReg[n]))
+    {
+      batch.push_back (
+          { IDtm::DmiOp::WRITE, DMI_ADDR[n], mSbaddressReg[n], nullptr });
+      mShadow[n].update (mSbaddressReg[n]);
+    }
+}
+
+/// \brief Get the record of the value last written to an \c sbaddress
+///        register.
+///
+/// \param[in] n  Index of the \c sbaddress register.
+/// \return The shadow of the register.  The shadow of \c sbaddress0 for an
+///         invalid index.
+template <class DtmT>
+typename DmiT<DtmT>::Shadow &
+DmiT<DtmT>::Sbaddress::shadow (const size_t n)
+{
+  return mShadow[(n < NUM_REGS) ? n : 0];
 }
 
 /// \brief Must define as well as declare our private constexpr before using.
-constexpr uint64_t Dmi::Sbaddress::DMI_ADDR[Dmi::Sbaddress::NUM_REGS];
+template <class DtmT>
+constexpr uint64_t DmiT<DtmT>::Sbaddress::DMI_ADDR[];
 
 /// Get the value the specified \c sbaddress register.
 ///
 /// \param[in] n  Index of the \c sbaddress register to get.
 /// \return  The value in the specified \c sbaddress register.
+template <class DtmT>
 uint32_t
-Dmi::Sbaddress::sbaddress (const size_t n) const
+DmiT<DtmT>::Sbaddress::sbaddress (const size_t n) const
 {
   if (n < NUM_REGS)
     return mSbaddressReg[n];
@@ -2610,8 +4321,9 @@ Dmi::Sbaddress::sbaddress (const size_t n) const
 /// \param[in] n         Index of the \c sbaddress register to get.
 /// \param[in] sbaddressValy  The value to be set in the specified \c sbaddress
 /// register.
+template <class DtmT>
 void
-Dmi::Sbaddress::sbaddress (const size_t n, const uint32_t sbaddressVal)
+DmiT<DtmT>::Sbaddress::sbaddress (const size_t n, const uint32_t sbaddressVal)
 {
   if (n < NUM_REGS)
     mSbaddressReg[n] = sbaddressVal;
@@ -2619,18 +4331,18 @@ Dmi::Sbaddress::sbaddress (const size_t n, const uint32_t sbaddressVal)
     cerr << "Warning: setting sbaddress[" << n << "] invalid: ignored." << endl;
 }
 
-/// \brief Output operator for the Dmi::Sbaddress class
+/// \brief Write the Dmi::Sbaddress class to a stream
 ///
 /// \param[in] s  The stream to which output is written
-/// \param[in] p  A unique_ptr to the instance to output
 /// \return  The stream with the instance appended
+template <class DtmT>
 std::ostream &
-operator<< (ostream &s, const unique_ptr<Dmi::Sbaddress> &p)
+DmiT<DtmT>::Sbaddress::print (ostream &s) const
 {
   std::ostringstream oss ("[");
 
-  for (size_t i = 0; i < p->NUM_REGS; i++)
-    oss << p->mSbaddressReg[i] << ((i == (p->NUM_REGS - 1)) ? "]" : ", ");
+  for (size_t i = 0; i < NUM_REGS; i++)
+    oss << mSbaddressReg[i] << ((i == (NUM_REGS - 1)) ? "]" : ", ");
 
   return s << oss.str ();
 }
@@ -2643,117 +4355,108 @@ operator<< (ostream &s, const unique_ptr<Dmi::Sbaddress> &p)
 
 /// \brief constructor for the Dmi::Sbcs class.
 ///
-/// \param[in] dtm_  The DTM we shall use.  This is a unique_ptr owned by the
-///                  Dmi, so passed and stored by reference.
-Dmi::Sbcs::Sbcs (unique_ptr<IDtm> &dtm_)
-    : mPrettyPrint (false), mDtm (dtm_), mSbcsReg (Dmi::Sbcs::RESET_VALUE)
+/// \param[in] dtm_  The DTM we shall use.  This is owned by the Dmi, which
+///                  rebinds it if the DTM is swapped.
+template <class DtmT>
+DmiT<DtmT>::Sbcs::Sbcs (DtmT *dtm_)
+    : mPrettyPrint (false), mDtm (dtm_), mSbcsReg (DmiT::Sbcs::RESET_VALUE)
 {
 }
 
 /// \brief Read the value of the \c sbcs register.
 ///
 /// The register is refreshed via the DTM.
+template <class DtmT>
 void
-Dmi::Sbcs::read ()
+DmiT<DtmT>::Sbcs::read ()
 {
   mSbcsReg = mDtm->dmiRead (DMI_ADDR);
 }
 
-/// \brief Set the \c sbcs register to its reset value.
+/// \brief Queue a read of the \c sbcs register.
+///
+/// The register is refreshed when the batch is carried out by the DTM.
+///
+/// \param[in,out] batch  The batch of DMI transactions to append to.
+template <class DtmT>
 void
-Dmi::Sbcs::reset ()
+DmiT<DtmT>::Sbcs::queueRead (std::vector<IDtm::DmiOp> &batch)
 {
-  mSbcsReg = RESET_VALUE;
+  batch.push_back ({ IDtm::DmiOp::READ, DMI_ADDR, 0, &mSbcsReg });
 }
 
-/// \brief Write the value of the \c sbcs register.
-///
-/// The register is refreshed via the DTM, and we save the value read back.
+/// \brief Set the \c sbcs register to its reset value.
+template <class DtmT>
 void
-Dmi::Sbcs::write ()
+DmiT<DtmT>::Sbcs::reset ()
 {
-  mDtm->dmiWrite (DMI_ADDR, mSbcsReg);
+  mSbcsReg = RESET_VALUE;
 }
 
-/// \brief Control whether to pretty print the \c sbcs register.
+/// \brief Write the value of the \c sbcs register.
 ///
-/// @param[in] flag  If \c true, subsequent stream output will generate a list
-///                  of field values, if false a simple hex value.
+/// The write is skipped if it clears no error bits and the configuration
+/// fields match those last written.
+template <class DtmT>
 void
-Dmi::Sbcs::prettyPrint (const bool flag)
+DmiT<DtmT>::Sbcs::write ()
 {
-  mPrettyPrint = flag;
-}
+  uint32_t config = mSbcsReg & CONFIG_MASK;
 
-/// \brief Get the \c sbversion bits in \c sbcs.
-///
-/// \return  The value in the \c sbversion bits of \c sbcs.
-uint8_t
-Dmi::Sbcs::sbversion () const
-{
-  return static_cast<uint8_t> ((mSbcsReg & SBVERSION_MASK) >> SBVERSION_OFFSET);
-}
+  if (((mSbcsReg & W1C_MASK) == 0) && mShadow.unchanged (config))
+    return;
 
-/// \brief Get the \c sbbusyerror bit in \c sbcs.
-///
-/// \return  \c true if the \c sbbusyerror bit of \c sbcs is set, \c false
-///          otherwise.
-bool
-Dmi::Sbcs::sbbusyerror () const
-{
-  return (mSbcsReg & SBBUSYERROR_MASK) != 0;
+  mDtm->dmiWrite (DMI_ADDR, mSbcsReg);
+  mShadow.update (config);
 }
 
-/// \brief Clear the \c sbbusyerror bit in \c sbcs.
+/// \brief Queue a write of the \c sbcs register.
+///
+/// As Dmi::Sbcs::write, a write which would change nothing is not queued.
 ///
-/// Writing 1 to this bit clears it.
+/// \param[in,out] batch  The batch of DMI transactions to append to.
+template <class DtmT>
 void
-Dmi::Sbcs::sbbusyerrorClear ()
+DmiT<DtmT>::Sbcs::queueWrite (std::vector<IDtm::DmiOp> &batch)
 {
-  mSbcsReg |= SBBUSYERROR_MASK;
-}
+  uint32_t config = mSbcsReg & CONFIG_MASK;
 
-/// \brief Get the \c sbbusy bit in \c sbcs.
-///
-/// \return  \c true if the \c sbbusy bit of \c sbcs is set, \c false
-///          otherwise.
-bool
-Dmi::Sbcs::sbbusy () const
-{
-  return (mSbcsReg & SBBUSY_MASK) != 0;
+  if (((mSbcsReg & W1C_MASK) == 0) && mShadow.unchanged (config))
+    return;
+
+  batch.push_back ({ IDtm::DmiOp::WRITE, DMI_ADDR, mSbcsReg, nullptr });
+  mShadow.update (config);
 }
 
-/// \brief Get the \c sbreadonaddr bit in \c sbcs.
+/// \brief Get the record of the configuration last written to \c sbcs.
 ///
-/// \return  \c true if the \c sbreadonaddr bit of \c sbcs is set, \c false
-///          otherwise.
-bool
-Dmi::Sbcs::sbreadonaddr () const
+/// \return The shadow of the register.
+template <class DtmT>
+typename DmiT<DtmT>::Shadow &
+DmiT<DtmT>::Sbcs::shadow ()
 {
-  return (mSbcsReg & SBREADONADDR_MASK) != 0;
+  return mShadow;
 }
 
-/// \brief Set the \c sbreadonaddr bit in \c sbcs.
+/// \brief Control whether to pretty print the \c sbcs register.
 ///
-/// \param[in] flag  If \c true sets \c sbreadonaddr bit in \c sbcs, otherwise
-///                  clears it.
+/// @param[in] flag  If \c true, subsequent stream output will generate a list
+///                  of field values, if false a simple hex value.
+template <class DtmT>
 void
-Dmi::Sbcs::sbreadonaddr (const bool flag)
+DmiT<DtmT>::Sbcs::prettyPrint (const bool flag)
 {
-  if (flag)
-    mSbcsReg |= SBREADONADDR_MASK;
-  else
-    mSbcsReg &= ~SBREADONADDR_MASK;
+  mPrettyPrint = flag;
 }
 
 /// \brief Get the \c sbaccess bits of \c sbcs.
 ///
 /// \return  The value of the \c sbaccess bits of \c sbcs.
-Dmi::Sbcs::SbaccessVal
-Dmi::Sbcs::sbaccess () const
+template <class DtmT>
+typename DmiT<DtmT>::Sbcs::SbaccessVal
+DmiT<DtmT>::Sbcs::sbaccess () const
 {
-  SbaccessVal val = static_cast<SbaccessVal> ((mSbcsReg & SBACCESS_MASK)
-                                              >> SBACCESS_OFFSET);
+  SbaccessVal val = static_cast<SbaccessVal> (Sbaccess::get (mSbcsReg));
 
   switch (val)
     {
@@ -2772,70 +4475,24 @@ Dmi::Sbcs::sbaccess () const
 /// \brief Set the \c sbaccess bits in \c sbcs.
 ///
 /// \param[in] val  Value to set for the \c sb bits in \c sbcs.
+template <class DtmT>
 void
-Dmi::Sbcs::sbaccess (const uint8_t val)
+DmiT<DtmT>::Sbcs::sbaccess (const uint8_t val)
 {
-  if (val >= (1 << SBACCESS_SIZE))
+  if (val > Sbaccess::MAX)
     cerr << "Warning: " << val << " too large for sbaccess field of sbcs: "
          << "truncated" << endl;
-  mSbcsReg &= ~SBACCESS_MASK;
-  mSbcsReg |= (static_cast<uint32_t> (val) << SBACCESS_OFFSET) & SBACCESS_MASK;
-}
-
-/// \brief Get the \c sbautoincrement bit in \c sbcs.
-///
-/// \return  \c true if the \c sbautoincrement bit of \c sbcs is set, \c false
-///          otherwise.
-bool
-Dmi::Sbcs::sbautoincrement () const
-{
-  return (mSbcsReg & SBAUTOINCREMENT_MASK) != 0;
-}
-
-/// \brief Set the \c sbautoincrement bit in \c sbcs.
-///
-/// \param[in] flag  If \c true sets \c sbautoincrement bit in \c sbcs,
-///                  otherwise clears it.
-void
-Dmi::Sbcs::sbautoincrement (const bool flag)
-{
-  if (flag)
-    mSbcsReg |= SBAUTOINCREMENT_MASK;
-  else
-    mSbcsReg &= ~SBAUTOINCREMENT_MASK;
-}
-
-/// \brief Get the \c sbreadondata bit in \c sbcs.
-///
-/// \return  \c true if the \c sbreadondata bit of \c sbcs is set, \c false
-///          otherwise.
-bool
-Dmi::Sbcs::sbreadondata () const
-{
-  return (mSbcsReg & SBREADONDATA_MASK) != 0;
-}
-
-/// \brief Set the \c sbreadondata bit in \c sbcs.
-///
-/// \param[in] flag  If \c true sets \c sbreadondata bit in \c sbcs, otherwise
-///                  clears it.
-void
-Dmi::Sbcs::sbreadondata (const bool flag)
-{
-  if (flag)
-    mSbcsReg |= SBREADONDATA_MASK;
-  else
-    mSbcsReg &= ~SBREADONDATA_MASK;
+  mSbcsReg = Sbaccess::set (mSbcsReg, val);
 }
 
 /// \brief Get the \c sberror bits in \c sbcs.
 ///
 /// \return  The value of the \c sberror bits in \c sbcs.
-Dmi::Sbcs::SberrorVal
-Dmi::Sbcs::sberror () const
+template <class DtmT>
+typename DmiT<DtmT>::Sbcs::SberrorVal
+DmiT<DtmT>::Sbcs::sberror () const
 {
-  SberrorVal err
-      = static_cast<SberrorVal> ((mSbcsReg & SBERROR_MASK) >> SBERROR_OFFSET);
+  SberrorVal err = static_cast<SberrorVal> (Sberror::get (mSbcsReg));
 
   switch (err)
     {
@@ -2852,80 +4509,13 @@ Dmi::Sbcs::sberror () const
     }
 }
 
-/// \brief Clear the \c sberror bits in \c sbcs.
-///
-/// Writing 1 to these bits clears the error.
-void
-Dmi::Sbcs::sberrorClear ()
-{
-  mSbcsReg |= SBERROR_MASK;
-}
-
-/// \brief Get the \c sbasize bits in \c sbcs.
-///
-/// \return  The value of the \c sbasize bits in \c sbcs.
-uint8_t
-Dmi::Sbcs::sbasize () const
-{
-  return static_cast<uint8_t> ((mSbcsReg & SBASIZE_MASK) >> SBASIZE_OFFSET);
-}
-
-/// \brief Get the \c sbaccess128 bit in \c sbcs.
-///
-/// \return  \c true if the \c sbaccess128 bit of \c sbcs is set, \c false
-///          otherwise.
-bool
-Dmi::Sbcs::sbaccess128 () const
-{
-  return (mSbcsReg & SBACCESS128_MASK) != 0;
-}
-
-/// \brief Get the \c sbaccess64 bit in \c sbcs.
-///
-/// \return  \c true if the \c sbaccess64 bit of \c sbcs is set, \c false
-///          otherwise.
-bool
-Dmi::Sbcs::sbaccess64 () const
-{
-  return (mSbcsReg & SBACCESS64_MASK) != 0;
-}
-
-/// \brief Get the \c sbaccess32 bit in \c sbcs.
-///
-/// \return  \c true if the \c sbaccess32 bit of \c sbcs is set, \c false
-///          otherwise.
-bool
-Dmi::Sbcs::sbaccess32 () const
-{
-  return (mSbcsReg & SBACCESS32_MASK) != 0;
-}
-
-/// \brief Get the \c sbaccess16 bit in \c sbcs.
-///
-/// \return  \c true if the \c sbaccess16 bit of \c sbcs is set, \c false
-///          otherwise.
-bool
-Dmi::Sbcs::sbaccess16 () const
-{
-  return (mSbcsReg & SBACCESS16_MASK) != 0;
-}
-
-/// \brief Get the \c sbaccess8 bit in \c sbcs.
-///
-/// \return  \c true if the \c sbaccess8 bit of \c sbcs is set, \c false
-///          otherwise.
-bool
-Dmi::Sbcs::sbaccess8 () const
-{
-  return (mSbcsReg & SBACCESS8_MASK) != 0;
-}
-
 /// \brief Give the name of a \c sbversion field.
 ///
 /// \param[in] val  The value of the \c sbversion field
 /// \return The name of the field.
+template <class DtmT>
 const char *
-Dmi::Sbcs::sbversionName (uint8_t val)
+DmiT<DtmT>::Sbcs::sbversionName (uint8_t val)
 {
   switch (val)
     {
@@ -2943,8 +4533,9 @@ Dmi::Sbcs::sbversionName (uint8_t val)
 ///
 /// \param[in] val  The value of the \c sbaccess field
 /// \return The name of the field.
+template <class DtmT>
 const char *
-Dmi::Sbcs::sbaccessName (Dmi::Sbcs::SbaccessVal val)
+DmiT<DtmT>::Sbcs::sbaccessName (DmiT::Sbcs::SbaccessVal val)
 {
   switch (val)
     {
@@ -2968,8 +4559,9 @@ Dmi::Sbcs::sbaccessName (Dmi::Sbcs::SbaccessVal val)
 ///
 /// \param[in] val  The value of the \c sberror field
 /// \return The name of the field.
+template <class DtmT>
 const char *
-Dmi::Sbcs::sberrorName (Dmi::Sbcs::SberrorVal val)
+DmiT<DtmT>::Sbcs::sberrorName (DmiT::Sbcs::SberrorVal val)
 {
   switch (val)
     {
@@ -2991,41 +4583,41 @@ Dmi::Sbcs::sberrorName (Dmi::Sbcs::SberrorVal val)
     }
 }
 
-/// \brief Output operator for the Dmi::Sbcs class
+/// \brief Write the Dmi::Sbcs class to a stream
 ///
 /// \param[in] s  The stream to which output is written
-/// \param[in] p  A unique_ptr to the instance to output
 /// \return  The stream with the instance appended
+template <class DtmT>
 std::ostream &
-operator<< (ostream &s, const unique_ptr<Dmi::Sbcs> &p)
+DmiT<DtmT>::Sbcs::print (ostream &s) const
 {
   std::ostringstream oss;
 
-  if (p->mPrettyPrint)
+  if (mPrettyPrint)
     {
-      uint8_t version = p->sbversion ();
-      Dmi::Sbcs::SbaccessVal aval = p->sbaccess ();
-      Dmi::Sbcs::SberrorVal err = p->sberror ();
+      uint8_t version = sbversion ();
+      DmiT::Sbcs::SbaccessVal aval = sbaccess ();
+      DmiT::Sbcs::SberrorVal err = sberror ();
       oss << "[ sbversion = " << static_cast<uint16_t> (version) << " ("
-          << Dmi::Sbcs::sbversionName (version) << ")"
-          << ", sbbusyerror = " << Utils::boolStr (p->sbbusyerror ())
-          << ", sbbusy = " << Utils::boolStr (p->sbbusy ())
-          << ", sbreadonaddr = " << Utils::boolStr (p->sbreadonaddr ())
+          << DmiT::Sbcs::sbversionName (version) << ")"
+          << ", sbbusyerror = " << Utils::boolStr (sbbusyerror ())
+          << ", sbbusy = " << Utils::boolStr (sbbusy ())
+          << ", sbreadonaddr = " << Utils::boolStr (sbreadonaddr ())
           << ", sbaccess = " << static_cast<uint16_t> (aval) << " ("
-          << Dmi::Sbcs::sbaccessName (aval) << ")"
-          << ", sbautoincrement = " << Utils::boolStr (p->sbautoincrement ())
-          << ", sbreadondata = " << Utils::boolStr (p->sbreadondata ())
+          << DmiT::Sbcs::sbaccessName (aval) << ")"
+          << ", sbautoincrement = " << Utils::boolStr (sbautoincrement ())
+          << ", sbreadondata = " << Utils::boolStr (sbreadondata ())
           << ", sberror = " << static_cast<uint16_t> (err) << " ("
-          << Dmi::Sbcs::sberrorName (err) << ")"
-          << ", sbasize = " << static_cast<uint16_t> (p->sbasize ())
-          << ", sbaccess128 = " << Utils::boolStr (p->sbaccess128 ())
-          << ", sbaccess64 = " << Utils::boolStr (p->sbaccess64 ())
-          << ", sbaccess32 = " << Utils::boolStr (p->sbaccess32 ())
-          << ", sbaccess16 = " << Utils::boolStr (p->sbaccess16 ())
-          << ", sbaccess8 = " << Utils::boolStr (p->sbaccess8 ()) << " ]";
+          << DmiT::Sbcs::sberrorName (err) << ")"
+          << ", sbasize = " << static_cast<uint16_t> (sbasize ())
+          << ", sbaccess128 = " << Utils::boolStr (sbaccess128 ())
+          << ", sbaccess64 = " << Utils::boolStr (sbaccess64 ())
+          << ", sbaccess32 = " << Utils::boolStr (sbaccess32 ())
+          << ", sbaccess16 = " << Utils::boolStr (sbaccess16 ())
+          << ", sbaccess8 = " << Utils::boolStr (sbaccess8 ()) << " ]";
     }
   else
-    oss << Utils::hexStr (p->mSbcsReg, 8);
+    oss << Utils::hexStr (mSbcsReg, 8);
 
   return s << oss.str ();
 }
@@ -3038,9 +4630,10 @@ operator<< (ostream &s, const unique_ptr<Dmi::Sbcs> &p)
 
 /// \brief constructor for the Dmi::Sbdata class
 ///
-/// \param[in] dtm_  The DTM we shall use.  This is a unique_ptr owned by the
-///                  Dmi, so passed and stored by reference.
-Dmi::Sbdata::Sbdata (unique_ptr<IDtm> &dtm_) : mDtm (dtm_)
+/// \param[in] dtm_  The DTM we shall use.  This is owned by the Dmi, which
+///                  rebinds it if the DTM is swapped.
+template <class DtmT>
+DmiT<DtmT>::Sbdata::Sbdata (DtmT *dtm_) : mDtm (dtm_)
 {
   for (size_t i = 0; i < NUM_REGS; i++)
     mSbdataReg[i] = 0x0;
@@ -3051,8 +4644,9 @@ Dmi::Sbdata::Sbdata (unique_ptr<IDtm> &dtm_) : mDtm (dtm_)
 /// The register is refreshed via the DTM.
 ///
 /// \param[in] n  Index of the \c sbdata register to read.
+template <class DtmT>
 void
-Dmi::Sbdata::read (const size_t n)
+DmiT<DtmT>::Sbdata::read (const size_t n)
 {
   if (n < NUM_REGS)
     mSbdataReg[n] = mDtm->dmiRead (DMI_ADDR[n]);
@@ -3060,9 +4654,47 @@ Dmi::Sbdata::read (const size_t n)
     cerr << "Warning: reading sbdata[" << n << "] invalid: ignored." << endl;
 }
 
+/// \brief Queue a read of the specified \c sbdata register.
+///
+/// The register is refreshed when the batch is carried out by the DTM.
+///
+/// \param[in]     n      Index of the \c sbdata register to read.
+/// \param[in,out] batch  The batch of DMI transactions to append to.
+template <class DtmT>
+void
+DmiT<DtmT>::Sbdata::queueRead (const size_t n, std::vector<IDtm::DmiOp> &batch)
+{
+  if (n < NUM_REGS)
+    batch.push_back ({ IDtm::DmiOp::READ, DMI_ADDR[n], 0, &mSbdataReg[n] });
+  else
+    cerr << "Warning: queueing read of sbdata[" << n << "] invalid: ignored."
+         << endl;
+}
+
+/// \brief Queue a read of the specified \c sbdata register elsewhere.
+///
+/// The value read is stored in \p res rather than the register, so the same
+/// register may be read several times in one batch.
+///
+/// \param[in]     n      Index of the \c sbdata register to read.
+/// \param[in,out] batch  The batch of DMI transactions to append to.
+/// \param[out]    res    Where to store the value read.
+template <class DtmT>
+void
+DmiT<DtmT>::Sbdata::queueRead (const size_t n, std::vector<IDtm::DmiOp> &batch,
+                               uint32_t *res)
+{
+  if (n < NUM_REGS)
+    batch.push_back ({ IDtm::DmiOp::READ, DMI_ADDR[n], 0, res });
+  else
+    cerr << "Warning: queueing read of sbdata[" << n << "] invalid: ignored."
+         << endl;
+}
+
 /// \brief Set the specified abstract \c sbdata register to its reset value.
+template <class DtmT>
 void
-Dmi::Sbdata::reset (const size_t n)
+DmiT<DtmT>::Sbdata::reset (const size_t n)
 {
   if (n < NUM_REGS)
     mSbdataReg[n] = RESET_VALUE;
@@ -3073,8 +4705,9 @@ Dmi::Sbdata::reset (const size_t n)
 /// \brief Write the value of the specified abstract \c sbdata register.
 ///
 /// The register is refreshed via the DTM, and we save the value read back.
+template <class DtmT>
 void
-Dmi::Sbdata::write (const size_t n)
+DmiT<DtmT>::Sbdata::write (const size_t n)
 {
   if (n < NUM_REGS)
     mDtm->dmiWrite (DMI_ADDR[n], mSbdataReg[n]);
@@ -3082,15 +4715,33 @@ Dmi::Sbdata::write (const size_t n)
     cerr << "Warning: writing sbdata[" << n << "] invalid: ignored." << endl;
 }
 
+/// \brief Queue a write of the specified \c sbdata register.
+///
+/// \param[in]     n      Index of the \c sbdata register to write.
+/// \param[in,out] batch  The batch of DMI transactions to append to.
+template <class DtmT>
+void
+DmiT<DtmT>::Sbdata::queueWrite (const size_t n, std::vector<IDtm::DmiOp> &batch)
+{
+  if (n < NUM_REGS)
+    batch.push_back (
+        { IDtm::DmiOp::WRITE, DMI_ADDR[n], mSbdataReg[n], nullptr });
+  else
+    cerr << "Warning: queueing write of sbdata[" << n << "] invalid: ignored."
+         << endl;
+}
+
 /// \brief Must define as well as declare our private constexpr before using.
-constexpr uint64_t Dmi::Sbdata::DMI_ADDR[Dmi::Sbdata::NUM_REGS];
+template <class DtmT>
+constexpr uint64_t DmiT<DtmT>::Sbdata::DMI_ADDR[];
 
 /// Get the value the specified \c sbdata register.
 ///
 /// \param[in] n  Index of the \c sbdata register to get.
 /// \return  The value in the specified \c sbdata register.
+template <class DtmT>
 uint32_t
-Dmi::Sbdata::sbdata (const size_t n) const
+DmiT<DtmT>::Sbdata::sbdata (const size_t n) const
 {
   if (n < NUM_REGS)
     return mSbdataReg[n];
@@ -3107,8 +4758,9 @@ Dmi::Sbdata::sbdata (const size_t n) const
 /// \param[in] n         Index of the \c sbdata register to get.
 /// \param[in] sbdataValy  The value to be set in the specified \c sbdata
 /// register.
+template <class DtmT>
 void
-Dmi::Sbdata::sbdata (const size_t n, const uint32_t sbdataVal)
+DmiT<DtmT>::Sbdata::sbdata (const size_t n, const uint32_t sbdataVal)
 {
   if (n < NUM_REGS)
     mSbdataReg[n] = sbdataVal;
@@ -3116,20 +4768,27 @@ Dmi::Sbdata::sbdata (const size_t n, const uint32_t sbdataVal)
     cerr << "Warning: setting sbdata[" << n << "] invalid: ignored." << endl;
 }
 
-/// \brief Output operator for the Dmi::Sbdata class
+/// \brief Write the Dmi::Sbdata class to a stream
 ///
 /// \param[in] s  The stream to which output is written
-/// \param[in] p  A unique_ptr to the instance to output
 /// \return  The stream with the instance appended
+template <class DtmT>
 std::ostream &
-operator<< (ostream &s, const unique_ptr<Dmi::Sbdata> &p)
+DmiT<DtmT>::Sbdata::print (ostream &s) const
 {
   std::ostringstream oss;
 
   oss << "[";
-  for (size_t i = 0; i < p->NUM_REGS; i++)
-    oss << "0x" << Utils::hexStr (p->mSbdataReg[i], 8)
-        << ((i == (p->NUM_REGS - 1)) ? "]" : ", ");
+  for (size_t i = 0; i < NUM_REGS; i++)
+    oss << "0x" << Utils::hexStr (mSbdataReg[i], 8)
+        << ((i == (NUM_REGS - 1)) ? "]" : ", ");
 
   return s << oss.str ();
 }
+
+// The DTMs a Dmi may be built on.  IDtm chooses the DTM at run time, the
+// others are fixed at compile time, so DMI accesses need no virtual call.
+template class DmiT<IDtm>;
+template class DmiT<DtmJtag>;
+template class DmiT<DtmBackdoor>;
+template class DmiT<DtmMock>;
@@ -9,19 +9,57 @@
 #define DMI_H
 
 #include <cstdint>
-#include <map>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "IDtm.h"
+#include "RegField.h"
 
 /// \brief The class modeling the Debug Module Interface
 ///
 /// This sits on top of the Debug Transport Module
 ///
 /// Within this class we provide classes to represent each of the registers.
-class Dmi
+///
+/// \tparam DtmT  The type of the Debug Transport Module.  With a concrete
+///               final DTM every DMI access is a direct call, which can be
+///               inlined.  Use \c IDtm to choose the DTM at run time.
+template <class DtmT> class DmiT
 {
 public:
+  /// \brief A record of the state last written to a DMI register.
+  ///
+  /// Register classes use this to skip writes which would not change the
+  /// state held by the debug module.  Only fields which the debug module
+  /// holds, and which only change when written, are recorded.  Trigger and
+  /// write-1-to-clear bits are never recorded, and writes setting them are
+  /// always carried out.
+  class Shadow
+  {
+  public:
+    // Constructors & destructor
+    Shadow ();
+    ~Shadow () = default;
+
+    // API
+    bool unchanged (const uint32_t val);
+    void update (const uint32_t val);
+    void invalidate ();
+    uint64_t writesElided () const;
+    void clearStats ();
+
+  private:
+    /// \brief Whether \c mShadowReg matches the debug module
+    bool mValid;
+
+    /// \brief The state last written
+    uint32_t mShadowReg;
+
+    /// \brief The number of writes skipped
+    uint64_t mWritesElided;
+  };
+
   /// \brief The class modeling the abstract \c data registers.
   class Data
   {
@@ -31,7 +69,7 @@ public:
 
     // Constructors & destructor
     Data () = delete;
-    Data (std::unique_ptr<IDtm> &dtm_);
+    Data (DtmT *dtm_);
     ~Data () = default;
 
     // Delete copy operator
@@ -39,14 +77,25 @@ public:
 
     // API
     void read (const std::size_t n);
+    void queueRead (const std::size_t n, std::vector<IDtm::DmiOp> &batch);
+    void queueRead (const std::size_t n, std::vector<IDtm::DmiOp> &batch,
+                    uint32_t *res);
     void reset (const std::size_t n);
     void write (const std::size_t n);
+    void queueWrite (const std::size_t n, std::vector<IDtm::DmiOp> &batch);
     uint32_t data (const std::size_t n) const;
     void data (const std::size_t n, const uint32_t dataVal);
+    std::ostream &print (std::ostream &s) const;
 
     // Output operator is a friend
-    friend std::ostream &operator<< (std::ostream &s,
-                                     const std::unique_ptr<Data> &p);
+    friend std::ostream &
+    operator<< (std::ostream &s, const std::unique_ptr<Data> &p)
+    {
+      return p->print (s);
+    }
+
+    // The owning Dmi rebinds the DTM when it is swapped
+    friend class DmiT;
 
   private:
     /// \brief The address of the \c data registers in the DMI
@@ -56,8 +105,8 @@ public:
     /// \brief The reset value of the \c data registers in the DMI.
     static const uint32_t RESET_VALUE = 0x0;
 
-    /// \brief A reference to the DTM we are using
-    std::unique_ptr<IDtm> &mDtm;
+    /// \brief The DTM we are using, owned by the Dmi
+    DtmT *mDtm;
 
     /// \brief The value of the Data registers
     uint32_t mDataReg[NUM_REGS];
@@ -69,7 +118,7 @@ public:
   public:
     // Constructors & destructor
     Dmcontrol () = delete;
-    Dmcontrol (std::unique_ptr<IDtm> &dtm_);
+    Dmcontrol (DtmT *dtm_);
     ~Dmcontrol () = default;
 
     // Delete copy operator
@@ -79,6 +128,7 @@ public:
     void read ();
     void reset ();
     void write ();
+    Shadow &shadow ();
     void prettyPrint (const bool flag);
     void haltreq (const bool flag);
     void resumereq ();
@@ -96,10 +146,17 @@ public:
     void ndmreset (const bool flag);
     bool dmactive () const;
     void dmactive (const bool flag);
+    std::ostream &print (std::ostream &s) const;
 
     // Output operator is a friend
-    friend std::ostream &operator<< (std::ostream &s,
-                                     const std::unique_ptr<Dmcontrol> &p);
+    friend std::ostream &
+    operator<< (std::ostream &s, const std::unique_ptr<Dmcontrol> &p)
+    {
+      return p->print (s);
+    }
+
+    // The owning Dmi rebinds the DTM when it is swapped
+    friend class DmiT;
 
   private:
     /// \brief Masks for flag bits in \c dmcontrol
@@ -116,6 +173,8 @@ public:
       CLRRESETHALTREQ_MASK = 0x00000004,
       NDMRESET_MASK = 0x00000002,
       DMACTIVE_MASK = 0x00000001,
+      TRIGGER_MASK = RESUMEREQ_MASK | ACKHAVERESET_MASK | SETRESETHALTREQ_MASK
+                     | CLRRESETHALTREQ_MASK,
     };
 
     /// \brief Offsets for flag bits in \c dmcontrol
@@ -167,20 +226,45 @@ public:
     /// register.
     bool mPrettyPrint;
 
-    /// \brief A reference to the DTM we are using.
-    std::unique_ptr<IDtm> &mDtm;
+    /// \brief The DTM we are using, owned by the Dmi.
+    DtmT *mDtm;
 
     /// \brief the value of the Dmcontrol register.
     uint32_t mDmcontrolReg;
+
+    /// \brief The fields last written to the \c dmcontrol register.
+    ///
+    /// \c haltreq is held by the debug module until cleared, so is recorded.
+    Shadow mShadow;
   };
 
   /// \brief The class modeling the \c dmstatus register.
   class Dmstatus
   {
   public:
+    /// \brief Fields of \c dmstatus
+    typedef RegField<22, 1> Impebreak;
+    typedef RegField<19, 1> Allhavereset;
+    typedef RegField<18, 1> Anyhavereset;
+    typedef RegField<17, 1> Allresumeack;
+    typedef RegField<16, 1> Anyresumeack;
+    typedef RegField<15, 1> Allnonexistent;
+    typedef RegField<14, 1> Anynonexistent;
+    typedef RegField<13, 1> Allunavail;
+    typedef RegField<12, 1> Anyunavail;
+    typedef RegField<11, 1> Allrunning;
+    typedef RegField<10, 1> Anyrunning;
+    typedef RegField<9, 1> Allhalted;
+    typedef RegField<8, 1> Anyhalted;
+    typedef RegField<7, 1> Authenticated;
+    typedef RegField<6, 1> Authbusy;
+    typedef RegField<5, 1> Hasresethaltreq;
+    typedef RegField<4, 1> Confstrptrvalid;
+    typedef RegField<0, 4> Version;
+
     // Constructors & destructor
     Dmstatus () = delete;
-    Dmstatus (std::unique_ptr<IDtm> &dtm_);
+    Dmstatus (DtmT *dtm_);
     ~Dmstatus () = default;
 
     // Delete copy operator
@@ -201,85 +285,19 @@ public:
     bool hasresethaltreq () const;
     bool confstrptrvalid () const;
     uint8_t version () const;
+    std::ostream &print (std::ostream &s) const;
 
     // Output operator is a friend
-    friend std::ostream &operator<< (std::ostream &s,
-                                     const std::unique_ptr<Dmstatus> &p);
-
-  private:
-    /// \brief Masks for flag bits in \c dmstatus
-    enum Masks
+    friend std::ostream &
+    operator<< (std::ostream &s, const std::unique_ptr<Dmstatus> &p)
     {
-      IMPEBREAK_MASK = 0x00400000,
-      ALLHAVERESET_MASK = 0x00080000,
-      ANYHAVERESET_MASK = 0x00040000,
-      ALLRESUMEACK_MASK = 0x00020000,
-      ANYRESUMEACK_MASK = 0x00010000,
-      ALLNONEXISTENT_MASK = 0x00008000,
-      ANYNONEXISTENT_MASK = 0x00004000,
-      ALLUNAVAIL_MASK = 0x00002000,
-      ANYUNAVAIL_MASK = 0x00001000,
-      ALLRUNNING_MASK = 0x00000800,
-      ANYRUNNING_MASK = 0x00000400,
-      ALLHALTED_MASK = 0x00000200,
-      ANYHALTED_MASK = 0x00000100,
-      AUTHENTICATED_MASK = 0x00000080,
-      AUTHBUSY_MASK = 0x00000040,
-      HASRESETHALTREQ_MASK = 0x00000020,
-      CONFSTRPTRVALID_MASK = 0x00000010,
-      VERSION_MASK = 0x0000000f,
-    };
+      return p->print (s);
+    }
 
-    /// \brief Offsets for flag bits in \c dmstatus
-    ///
-    /// How much to shift right to get the mask into the LS bits of the word.
-    enum Offsets
-    {
-      IMPEBREAK_OFFSET = 22,
-      ALLHAVERESET_OFFSET = 19,
-      ANYHAVERESET_OFFSET = 18,
-      ALLRESUMEACK_OFFSET = 17,
-      ANYRESUMEACK_OFFSET = 16,
-      ALLNONEXISTENT_OFFSET = 15,
-      ANYNONEXISTENT_OFFSET = 14,
-      ALLUNAVAIL_OFFSET = 13,
-      ANYUNAVAIL_OFFSET = 12,
-      ALLRUNNING_OFFSET = 11,
-      ANYRUNNING_OFFSET = 10,
-      ALLHALTED_OFFSET = 9,
-      ANYHALTED_OFFSET = 8,
-      AUTHENTICATED_OFFSET = 7,
-      AUTHBUSY_OFFSET = 6,
-      HASRESETHALTREQ_OFFSET = 5,
-      CONFSTRPTRVALID_OFFSET = 4,
-      VERSION_OFFSET = 0,
-    };
-
-    /// \brief Sizes of flag bits in \c dmstatus
-    ///
-    /// How many bits are set in the flag.
-    enum Sizes
-    {
-      IMPEBREAK_SIZE = 1,
-      ALLHAVERESET_SIZE = 1,
-      ANYHAVERESET_SIZE = 1,
-      ALLRESUMEACK_SIZE = 1,
-      ANYRESUMEACK_SIZE = 1,
-      ALLNONEXISTENT_SIZE = 1,
-      ANYNONEXISTENT_SIZE = 1,
-      ALLUNAVAIL_SIZE = 1,
-      ANYUNAVAIL_SIZE = 1,
-      ALLRUNNING_SIZE = 1,
-      ANYRUNNING_SIZE = 1,
-      ALLHALTED_SIZE = 1,
-      ANYHALTED_SIZE = 1,
-      AUTHENTICATED_SIZE = 1,
-      AUTHBUSY_SIZE = 1,
-      HASRESETHALTREQ_SIZE = 1,
-      CONFSTRPTRVALID_SIZE = 1,
-      VERSION_SIZE = 4,
-    };
+    // The owning Dmi rebinds the DTM when it is swapped
+    friend class DmiT;
 
+  private:
     /// \brief The address of the \c dmstatus register in the DMI
     static const uint64_t DMI_ADDR = 0x11;
 
@@ -287,8 +305,8 @@ public:
     /// register.
     bool mPrettyPrint;
 
-    /// \brief A reference to the DTM we are using
-    std::unique_ptr<IDtm> &mDtm;
+    /// \brief The DTM we are using, owned by the Dmi
+    DtmT *mDtm;
 
     /// \brief The value of the Dmstatus register
     uint32_t mDmstatusReg;
@@ -300,7 +318,7 @@ public:
   public:
     // Constructors & destructor
     Hartinfo () = delete;
-    Hartinfo (std::unique_ptr<IDtm> &dtm_);
+    Hartinfo (DtmT *dtm_);
     ~Hartinfo () = default;
 
     // Delete copy operator
@@ -313,10 +331,17 @@ public:
     bool dataaccess () const;
     uint8_t datasize () const;
     uint16_t dataaddr () const;
+    std::ostream &print (std::ostream &s) const;
 
     // Output operator is a friend
-    friend std::ostream &operator<< (std::ostream &s,
-                                     const std::unique_ptr<Hartinfo> &p);
+    friend std::ostream &
+    operator<< (std::ostream &s, const std::unique_ptr<Hartinfo> &p)
+    {
+      return p->print (s);
+    }
+
+    // The owning Dmi rebinds the DTM when it is swapped
+    friend class DmiT;
 
   private:
     /// \brief Masks for flag bits in \c hartinfo
@@ -357,8 +382,8 @@ public:
     /// register.
     bool mPrettyPrint;
 
-    /// \brief A reference to the DTM we are using
-    std::unique_ptr<IDtm> &mDtm;
+    /// \brief The DTM we are using, owned by the Dmi
+    DtmT *mDtm;
 
     /// \brief The value of the Hartinfo register
     uint32_t mHartinfoReg;
@@ -373,7 +398,7 @@ public:
 
     // Constructors & destructor
     Haltsum () = delete;
-    Haltsum (std::unique_ptr<IDtm> &dtm_);
+    Haltsum (DtmT *dtm_);
     ~Haltsum () = default;
 
     // Delete copy operator
@@ -382,17 +407,24 @@ public:
     // API
     void read (const std::size_t n);
     uint32_t haltsum (const std::size_t n) const;
+    std::ostream &print (std::ostream &s) const;
 
     // Output operator is a friend
-    friend std::ostream &operator<< (std::ostream &s,
-                                     const std::unique_ptr<Haltsum> &p);
+    friend std::ostream &
+    operator<< (std::ostream &s, const std::unique_ptr<Haltsum> &p)
+    {
+      return p->print (s);
+    }
+
+    // The owning Dmi rebinds the DTM when it is swapped
+    friend class DmiT;
 
   private:
     /// \brief The address of the \c haltsum registers in the DMI
     static constexpr uint64_t DMI_ADDR[NUM_REGS] = { 0x40, 0x13, 0x34, 0x35 };
 
-    /// \brief A reference to the DTM we are using
-    std::unique_ptr<IDtm> &mDtm;
+    /// \brief The DTM we are using, owned by the Dmi
+    DtmT *mDtm;
 
     /// \brief The value of the Haltsum registers
     uint32_t mHaltsumReg[NUM_REGS];
@@ -404,7 +436,7 @@ public:
   public:
     // Constructors & destructor
     Hawindowsel () = delete;
-    Hawindowsel (std::unique_ptr<IDtm> &dtm_);
+    Hawindowsel (DtmT *dtm_);
     ~Hawindowsel () = default;
 
     // Delete copy operator
@@ -416,10 +448,17 @@ public:
     void write ();
     uint16_t hawindowsel () const;
     void hawindowsel (const uint16_t hawindowselVal);
+    std::ostream &print (std::ostream &s) const;
 
     // Output operator is a friend
-    friend std::ostream &operator<< (std::ostream &s,
-                                     const std::unique_ptr<Hawindowsel> &p);
+    friend std::ostream &
+    operator<< (std::ostream &s, const std::unique_ptr<Hawindowsel> &p)
+    {
+      return p->print (s);
+    }
+
+    // The owning Dmi rebinds the DTM when it is swapped
+    friend class DmiT;
 
   private:
     /// \brief Masks for flag bits in \c hawindowsel
@@ -450,8 +489,8 @@ public:
     /// \brief The reset value of the \c hawindowsel register in the DMI.
     static const uint32_t RESET_VALUE = 0x0;
 
-    /// \brief A reference to the DTM we are using
-    std::unique_ptr<IDtm> &mDtm;
+    /// \brief The DTM we are using, owned by the Dmi
+    DtmT *mDtm;
 
     /// \brief The value of the Hawindowsel register
     uint32_t mHawindowselReg;
@@ -463,7 +502,7 @@ public:
   public:
     // Constructors & destructor
     Hawindow () = delete;
-    Hawindow (std::unique_ptr<IDtm> &dtm_);
+    Hawindow (DtmT *dtm_);
     ~Hawindow () = default;
 
     // Delete copy operator
@@ -475,10 +514,17 @@ public:
     void write ();
     uint32_t hawindow () const;
     void hawindow (const uint32_t hawindowVal);
+    std::ostream &print (std::ostream &s) const;
 
     // Output operator is a friend
-    friend std::ostream &operator<< (std::ostream &s,
-                                     const std::unique_ptr<Hawindow> &p);
+    friend std::ostream &
+    operator<< (std::ostream &s, const std::unique_ptr<Hawindow> &p)
+    {
+      return p->print (s);
+    }
+
+    // The owning Dmi rebinds the DTM when it is swapped
+    friend class DmiT;
 
   private:
     /// \brief The address of the \c hawindow register in the DMI
@@ -487,8 +533,8 @@ public:
     /// \brief The reset value of the \c hawindow register in the DMI.
     static const uint32_t RESET_VALUE = 0x0;
 
-    /// \brief A reference to the DTM we are using
-    std::unique_ptr<IDtm> &mDtm;
+    /// \brief The DTM we are using, owned by the Dmi
+    DtmT *mDtm;
 
     /// \brief The value of the Hawindow register
     uint32_t mHawindowReg;
@@ -511,9 +557,15 @@ public:
       CMDERR_UNKNOWN = -1,
     };
 
+    /// \brief Fields of \c abstractcs
+    typedef RegField<24, 5> Progbufsize;
+    typedef RegField<12, 1> Busy;
+    typedef RegField<8, 3> Cmderr;
+    typedef RegField<0, 4> Datacount;
+
     // Constructors & destructor
     Abstractcs () = delete;
-    Abstractcs (std::unique_ptr<IDtm> &dtm_);
+    Abstractcs (DtmT *dtm_);
     ~Abstractcs () = default;
 
     // Delete copy operator
@@ -521,6 +573,7 @@ public:
 
     // API
     void read ();
+    void queueRead (std::vector<IDtm::DmiOp> &batch);
     void reset ();
     void write ();
     void prettyPrint (const bool flag);
@@ -530,57 +583,33 @@ public:
     void cmderrClear ();
     uint8_t datacount () const;
     static const char *cmderrName (CmderrVal err);
+    std::ostream &print (std::ostream &s) const;
 
     // Output operator is a friend
-    friend std::ostream &operator<< (std::ostream &s,
-                                     const std::unique_ptr<Abstractcs> &p);
-
-  private:
-    /// \brief Masks for flag bits in \c abstractcs
-    enum Masks
+    friend std::ostream &
+    operator<< (std::ostream &s, const std::unique_ptr<Abstractcs> &p)
     {
-      PROGBUFSIZE_MASK = 0x1f000000,
-      BUSY_MASK = 0x00001000,
-      CMDERR_MASK = 0x00000700,
-      DATACOUNT_MASK = 0x0000000f,
-    };
+      return p->print (s);
+    }
 
-    /// \brief Offsets for flag bits in \c abstractcs
-    ///
-    /// How much to shift right to get the mask into the LS bits of the word.
-    enum Offsets
-    {
-      PROGBUFSIZE_OFFSET = 24,
-      BUSY_OFFSET = 12,
-      CMDERR_OFFSET = 8,
-      DATACOUNT_OFFSET = 0,
-    };
-
-    /// \brief Sizes of flag bits in \c abstractcs
-    ///
-    /// How many bits are set in the flag.
-    enum Sizes
-    {
-      PROGBUFSIZE_SIZE = 5,
-      BUSY_SIZE = 1,
-      CMDERR_SIZE = 3,
-      DATACOUNT_SIZE = 4,
-    };
+    // The owning Dmi rebinds the DTM when it is swapped
+    friend class DmiT;
 
+  private:
     /// \brief The address of the \c abstractcs register in the DMI.
     static const uint64_t DMI_ADDR = 0x16;
 
     /// \brief The reset value of the \c abstractcs register in the DMI.
     ///
     /// Set all the \c cmderr bits to 1 t clear.
-    static const uint32_t RESET_VALUE = CMDERR_MASK;
+    static const uint32_t RESET_VALUE = Cmderr::MASK;
 
     /// \brief Whether pretty printing is enabled for the \c abstractcs
     /// register.
     bool mPrettyPrint;
 
-    /// \brief A reference to the DTM we are using.
-    std::unique_ptr<IDtm> &mDtm;
+    /// \brief The DTM we are using, owned by the Dmi.
+    DtmT *mDtm;
 
     /// \brief the value of the Abstractcs register.
     uint32_t mAbstractcsReg;
@@ -610,9 +639,42 @@ public:
       ACCESS128 = 4,
     };
 
+    /// \brief Fields of \c command
+    typedef RegField<24, 8> Cmdtype;
+    typedef RegField<0, 24> Control;
+    typedef RegField<23, 1> Aamvirtual;
+    typedef RegField<20, 3> Aarsize;
+    typedef RegField<20, 3> Aamsize;
+    typedef RegField<19, 1> Aapostincrement;
+    typedef RegField<18, 1> Aapostexec;
+    typedef RegField<17, 1> Aatransfer;
+    typedef RegField<16, 1> Aawrite;
+    typedef RegField<14, 2> AatargetSpecific;
+    typedef RegField<0, 16> Aaregno;
+
+    /// \brief The \c command word to transfer a 32-bit register.
+    ///
+    /// Computed at compile time for constant arguments.
+    ///
+    /// \param[in] regno          The register number.
+    /// \param[in] write          \c true to write the register, \c false to
+    ///                           read it.
+    /// \param[in] postexec       \c true to run the program buffer after.
+    /// \param[in] postincrement  \c true to increment \c regno after.
+    /// \return The \c command word.
+    static constexpr uint32_t
+    accessReg32 (const uint16_t regno, const bool write,
+                 const bool postexec = false, const bool postincrement = false)
+    {
+      return Cmdtype::encode (ACCESS_REG) | Aarsize::encode (ACCESS32)
+             | Aapostincrement::encode (postincrement ? 1 : 0)
+             | Aapostexec::encode (postexec ? 1 : 0) | Aatransfer::encode (1)
+             | Aawrite::encode (write ? 1 : 0) | Aaregno::encode (regno);
+    }
+
     // Constructors & destructor
     Command () = delete;
-    Command (std::unique_ptr<IDtm> &dtm_);
+    Command (DtmT *dtm_);
     ~Command () = default;
 
     // Delete copy operator
@@ -621,7 +683,9 @@ public:
     // API
     void reset ();
     void write ();
+    void queueWrite (std::vector<IDtm::DmiOp> &batch);
     void prettyPrint (const bool flag);
+    void command (const uint32_t commandVal);
     void cmdtype (const CmdtypeEnum cmdtypeVal);
     void control (const uint32_t controlVal);
     void aamvirtual (bool flag);
@@ -633,64 +697,19 @@ public:
     void aawrite (const bool flag);
     void aatargetSpecific (uint8_t val);
     void aaregno (uint16_t val);
+    std::ostream &print (std::ostream &s) const;
 
     // Output operator is a friend
-    friend std::ostream &operator<< (std::ostream &s,
-                                     const std::unique_ptr<Command> &p);
-
-  private:
-    /// \brief Masks for flag bits in \c command
-    enum Masks
+    friend std::ostream &
+    operator<< (std::ostream &s, const std::unique_ptr<Command> &p)
     {
-      CMDTYPE_MASK = 0xff000000,
-      CONTROL_MASK = 0x00ffffff,
-      AAMVIRTUAL_MASK = 0x00800000,
-      AARSIZE_MASK = 0x00700000,
-      AAMSIZE_MASK = 0x00700000,
-      AAPOSTINCREMENT_MASK = 0x00080000,
-      POSTEXEC_MASK = 0x00040000,
-      TRANSFER_MASK = 0x00020000,
-      WRITE_MASK = 0x00010000,
-      TARGET_SPECIFIC_MASK = 0x0000c000,
-      REGNO_MASK = 0x0000ffff,
-    };
+      return p->print (s);
+    }
 
-    /// \brief Offsets for flag bits in \c command
-    ///
-    /// How much to shift right to get the mask into the LS bits of the word.
-    enum Offsets
-    {
-      CMDTYPE_OFFSET = 24,
-      CONTROL_OFFSET = 0,
-      AAMVIRTUAL_OFFSET = 23,
-      AARSIZE_OFFSET = 20,
-      AAMSIZE_OFFSET = 20,
-      AAPOSTINCREMENT_OFFSET = 19,
-      POSTEXEC_OFFSET = 18,
-      TRANSFER_OFFSET = 17,
-      WRITE_OFFSET = 16,
-      TARGET_SPECIFIC_OFFSET = 14,
-      REGNO_OFFSET = 0,
-    };
-
-    /// \brief Sizes of flag bits in \c command
-    ///
-    /// How many bits are set in the flag.
-    enum Sizes
-    {
-      CMDTYPE_SIZE = 8,
-      CONTROL_SIZE = 24,
-      AAMVIRTUAL_SIZE = 1,
-      AARSIZE_SIZE = 3,
-      AAMSIZE_SIZE = 1,
-      AAPOSTINCREMENT_SIZE = 1,
-      POSTEXEC_SIZE = 1,
-      TRANSFER_SIZE = 1,
-      WRITE_SIZE = 1,
-      TARGET_SPECIFIC_SIZE = 2,
-      REGNO_SIZE = 16,
-    };
+    // The owning Dmi rebinds the DTM when it is swapped
+    friend class DmiT;
 
+  private:
     /// \brief The address of the \c command register in the DMI.
     static const uint64_t DMI_ADDR = 0x17;
 
@@ -704,8 +723,8 @@ public:
     /// register.
     bool mPrettyPrint;
 
-    /// \brief A reference to the DTM we are using.
-    std::unique_ptr<IDtm> &mDtm;
+    /// \brief The DTM we are using, owned by the Dmi.
+    DtmT *mDtm;
 
     /// \brief the value of the Command register.
     uint32_t mCommandReg;
@@ -719,7 +738,7 @@ public:
   public:
     // Constructors & destructor
     Abstractauto () = delete;
-    Abstractauto (std::unique_ptr<IDtm> &dtm_);
+    Abstractauto (DtmT *dtm_);
     ~Abstractauto () = default;
 
     // Delete copy operator
@@ -729,15 +748,23 @@ public:
     void read ();
     void reset ();
     void write ();
+    void queueWrite (std::vector<IDtm::DmiOp> &batch);
     void prettyPrint (const bool flag);
     uint16_t autoexecprogbuf () const;
     void autoexecprogbuf (const uint16_t autoexecprogbufVal);
     uint16_t autoexecdata () const;
     void autoexecdata (const uint16_t autoexecdataVal);
+    std::ostream &print (std::ostream &s) const;
 
     // Output operator is a friend
-    friend std::ostream &operator<< (std::ostream &s,
-                                     const std::unique_ptr<Abstractauto> &p);
+    friend std::ostream &
+    operator<< (std::ostream &s, const std::unique_ptr<Abstractauto> &p)
+    {
+      return p->print (s);
+    }
+
+    // The owning Dmi rebinds the DTM when it is swapped
+    friend class DmiT;
 
   private:
     /// \brief Masks for flag bits in \c abstractauto
@@ -775,8 +802,8 @@ public:
     /// register.
     bool mPrettyPrint;
 
-    /// \brief A reference to the DTM we are using.
-    std::unique_ptr<IDtm> &mDtm;
+    /// \brief The DTM we are using, owned by the Dmi.
+    DtmT *mDtm;
 
     /// \brief the value of the Abstractauto register.
     uint32_t mAbstractautoReg;
@@ -791,7 +818,7 @@ public:
 
     // Constructors & destructor
     Confstrptr () = delete;
-    Confstrptr (std::unique_ptr<IDtm> &dtm_);
+    Confstrptr (DtmT *dtm_);
     ~Confstrptr () = default;
 
     // Delete copy operator
@@ -800,17 +827,24 @@ public:
     // API
     void read (const std::size_t n);
     uint32_t confstrptr (const std::size_t n) const;
+    std::ostream &print (std::ostream &s) const;
 
     // Output operator is a friend
-    friend std::ostream &operator<< (std::ostream &s,
-                                     const std::unique_ptr<Confstrptr> &p);
+    friend std::ostream &
+    operator<< (std::ostream &s, const std::unique_ptr<Confstrptr> &p)
+    {
+      return p->print (s);
+    }
+
+    // The owning Dmi rebinds the DTM when it is swapped
+    friend class DmiT;
 
   private:
     /// \brief The address of the \c confstrptr registers in the DMI
     static constexpr uint64_t DMI_ADDR[NUM_REGS] = { 0x19, 0x1a, 0x1b, 0x1c };
 
-    /// \brief A reference to the DTM we are using
-    std::unique_ptr<IDtm> &mDtm;
+    /// \brief The DTM we are using, owned by the Dmi
+    DtmT *mDtm;
 
     /// \brief The value of the Confstrptr registers
     uint32_t mConfstrptrReg[NUM_REGS];
@@ -822,7 +856,7 @@ public:
   public:
     // Constructors & destructor
     Nextdm () = delete;
-    Nextdm (std::unique_ptr<IDtm> &dtm_);
+    Nextdm (DtmT *dtm_);
     ~Nextdm () = default;
 
     // Delete copy operator
@@ -832,10 +866,17 @@ public:
     void read ();
     uint32_t nextdm () const;
     void nextdm (const uint32_t nextdmVal);
+    std::ostream &print (std::ostream &s) const;
 
     // Output operator is a friend
-    friend std::ostream &operator<< (std::ostream &s,
-                                     const std::unique_ptr<Nextdm> &p);
+    friend std::ostream &
+    operator<< (std::ostream &s, const std::unique_ptr<Nextdm> &p)
+    {
+      return p->print (s);
+    }
+
+    // The owning Dmi rebinds the DTM when it is swapped
+    friend class DmiT;
 
   private:
     /// \brief The address of the \c nextdm register in the DMI
@@ -844,8 +885,8 @@ public:
     /// \brief The reset value of the \c nextdm register in the DMI.
     static const uint32_t RESET_VALUE = 0x0;
 
-    /// \brief A reference to the DTM we are using
-    std::unique_ptr<IDtm> &mDtm;
+    /// \brief The DTM we are using, owned by the Dmi
+    DtmT *mDtm;
 
     /// \brief The value of the Nextdm register
     uint32_t mNextdmReg;
@@ -860,7 +901,7 @@ public:
 
     // Constructors & destructor
     Progbuf () = delete;
-    Progbuf (std::unique_ptr<IDtm> &dtm_);
+    Progbuf (DtmT *dtm_);
     ~Progbuf () = default;
 
     // Delete copy operator
@@ -870,12 +911,20 @@ public:
     void read (const std::size_t n);
     void reset (const std::size_t n);
     void write (const std::size_t n);
+    void queueWrite (const std::size_t n, std::vector<IDtm::DmiOp> &batch);
     uint32_t progbuf (const std::size_t n) const;
     void progbuf (const std::size_t n, const uint32_t progbufVal);
+    std::ostream &print (std::ostream &s) const;
 
     // Output operator is a friend
-    friend std::ostream &operator<< (std::ostream &s,
-                                     const std::unique_ptr<Progbuf> &p);
+    friend std::ostream &
+    operator<< (std::ostream &s, const std::unique_ptr<Progbuf> &p)
+    {
+      return p->print (s);
+    }
+
+    // The owning Dmi rebinds the DTM when it is swapped
+    friend class DmiT;
 
   private:
     /// \brief The address of the \c progbuf registers in the DMI
@@ -886,8 +935,8 @@ public:
     /// \brief The reset value of the \c progbuf registers in the DMI.
     static const uint32_t RESET_VALUE = 0x0;
 
-    /// \brief A reference to the DTM we are using
-    std::unique_ptr<IDtm> &mDtm;
+    /// \brief The DTM we are using, owned by the Dmi
+    DtmT *mDtm;
 
     /// \brief The value of the Progbuf registers
     uint32_t mProgbufReg[NUM_REGS];
@@ -902,7 +951,7 @@ public:
   public:
     // Constructors & destructor
     Authdata () = delete;
-    Authdata (std::unique_ptr<IDtm> &dtm_);
+    Authdata (DtmT *dtm_);
     ~Authdata () = default;
 
     // Delete copy operator
@@ -914,10 +963,17 @@ public:
     void write ();
     uint32_t authdata () const;
     void authdata (const uint32_t authdataVal);
+    std::ostream &print (std::ostream &s) const;
 
     // Output operator is a friend
-    friend std::ostream &operator<< (std::ostream &s,
-                                     const std::unique_ptr<Authdata> &p);
+    friend std::ostream &
+    operator<< (std::ostream &s, const std::unique_ptr<Authdata> &p)
+    {
+      return p->print (s);
+    }
+
+    // The owning Dmi rebinds the DTM when it is swapped
+    friend class DmiT;
 
   private:
     /// \brief The address of the \c authdata register in the DMI
@@ -926,8 +982,8 @@ public:
     /// \brief The reset value of the \c authdata register in the DMI.
     static const uint32_t RESET_VALUE = 0x0;
 
-    /// \brief A reference to the DTM we are using
-    std::unique_ptr<IDtm> &mDtm;
+    /// \brief The DTM we are using, owned by the Dmi
+    DtmT *mDtm;
 
     /// \brief The value of the Authdata register
     uint32_t mAuthdataReg;
@@ -942,7 +998,7 @@ public:
 
     // Constructors & destructor
     Sbaddress () = delete;
-    Sbaddress (std::unique_ptr<IDtm> &dtm_);
+    Sbaddress (DtmT *dtm_);
     ~Sbaddress () = default;
 
     // Delete copy operator
@@ -952,12 +1008,21 @@ public:
     void read (const std::size_t n);
     void reset (const std::size_t n);
     void write (const std::size_t n);
+    void queueWrite (const std::size_t n, std::vector<IDtm::DmiOp> &batch);
+    Shadow &shadow (const std::size_t n);
     uint32_t sbaddress (const std::size_t n) const;
     void sbaddress (const std::size_t n, const uint32_t sbaddressVal);
+    std::ostream &print (std::ostream &s) const;
 
     // Output operator is a friend
-    friend std::ostream &operator<< (std::ostream &s,
-                                     const std::unique_ptr<Sbaddress> &p);
+    friend std::ostream &
+    operator<< (std::ostream &s, const std::unique_ptr<Sbaddress> &p)
+    {
+      return p->print (s);
+    }
+
+    // The owning Dmi rebinds the DTM when it is swapped
+    friend class DmiT;
 
   private:
     /// \brief The address of the \c sbaddress registers in the DMI
@@ -966,11 +1031,17 @@ public:
     /// \brief The reset value of the \c sbaddress registers in the DMI.
     static const uint32_t RESET_VALUE = 0x0;
 
-    /// \brief A reference to the DTM we are using
-    std::unique_ptr<IDtm> &mDtm;
+    /// \brief The DTM we are using, owned by the Dmi
+    DtmT *mDtm;
 
     /// \brief The value of the Sbaddress registers
     uint32_t mSbaddressReg[NUM_REGS];
+
+    /// \brief The values last written to the \c sbaddress registers.
+    ///
+    /// Writing \c sbaddress0 may start a bus read, and the debug module
+    /// increments it after accesses, so its shadow is never used.
+    Shadow mShadow[NUM_REGS];
   };
 
   /// \brief The class modeling the \c sbcs register.
@@ -1000,9 +1071,46 @@ public:
       SBERR_UNKNOWN = 8
     };
 
+    /// \brief Fields of \c sbcs
+    typedef RegField<29, 3> Sbversion;
+    typedef RegField<22, 1> Sbbusyerror;
+    typedef RegField<21, 1> Sbbusy;
+    typedef RegField<20, 1> Sbreadonaddr;
+    typedef RegField<17, 3> Sbaccess;
+    typedef RegField<16, 1> Sbautoincrement;
+    typedef RegField<15, 1> Sbreadondata;
+    typedef RegField<12, 3> Sberror;
+    typedef RegField<5, 7> Sbasize;
+    typedef RegField<4, 1> Sbaccess128;
+    typedef RegField<3, 1> Sbaccess64;
+    typedef RegField<2, 1> Sbaccess32;
+    typedef RegField<1, 1> Sbaccess16;
+    typedef RegField<0, 1> Sbaccess8;
+
+    /// \brief An \c sbcs word to configure System Bus access.
+    ///
+    /// Computed at compile time for constant arguments.  Any errors are
+    /// left alone.
+    ///
+    /// \param[in] access         The \c sbaccess size code.
+    /// \param[in] readonaddr     Whether writing \c sbaddress0 reads.
+    /// \param[in] autoincrement  Whether the address increments.
+    /// \param[in] readondata     Whether reading \c sbdata0 reads again.
+    /// \return The \c sbcs word.
+    static constexpr uint32_t
+    config (const uint32_t access, const bool readonaddr,
+            const bool autoincrement, const bool readondata)
+    {
+      return Sbversion::encode (Sbversion::get (RESET_VALUE))
+             | Sbreadonaddr::encode (readonaddr ? 1 : 0)
+             | Sbaccess::encode (access)
+             | Sbautoincrement::encode (autoincrement ? 1 : 0)
+             | Sbreadondata::encode (readondata ? 1 : 0);
+    }
+
     // Constructors & destructor
     Sbcs () = delete;
-    Sbcs (std::unique_ptr<IDtm> &dtm_);
+    Sbcs (DtmT *dtm_);
     ~Sbcs () = default;
 
     // Delete copy operator
@@ -1010,9 +1118,13 @@ public:
 
     // API
     void read ();
+    void queueRead (std::vector<IDtm::DmiOp> &batch);
     void reset ();
     void write ();
+    void queueWrite (std::vector<IDtm::DmiOp> &batch);
+    Shadow &shadow ();
     void prettyPrint (const bool flag);
+    void sbcs (const uint32_t sbcsVal);
     uint8_t sbversion () const;
     bool sbbusyerror () const;
     void sbbusyerrorClear ();
@@ -1036,72 +1148,26 @@ public:
     static const char *sbversionName (uint8_t val);
     static const char *sbaccessName (SbaccessVal val);
     static const char *sberrorName (SberrorVal val);
+    std::ostream &print (std::ostream &s) const;
 
     // Output operator is a friend
-    friend std::ostream &operator<< (std::ostream &s,
-                                     const std::unique_ptr<Sbcs> &p);
-
-  private:
-    /// \brief Masks for flag bits in \c sbcs
-    enum Masks
+    friend std::ostream &
+    operator<< (std::ostream &s, const std::unique_ptr<Sbcs> &p)
     {
-      SBVERSION_MASK = 0xe0000000,
-      SBBUSYERROR_MASK = 0x00400000,
-      SBBUSY_MASK = 0x00200000,
-      SBREADONADDR_MASK = 0x00100000,
-      SBACCESS_MASK = 0x000e0000,
-      SBAUTOINCREMENT_MASK = 0x00010000,
-      SBREADONDATA_MASK = 0x00008000,
-      SBERROR_MASK = 0x00007000,
-      SBASIZE_MASK = 0x00000fe0,
-      SBACCESS128_MASK = 0x00000010,
-      SBACCESS64_MASK = 0x00000008,
-      SBACCESS32_MASK = 0x00000004,
-      SBACCESS16_MASK = 0x00000002,
-      SBACCESS8_MASK = 0x00000001,
-    };
+      return p->print (s);
+    }
 
-    /// \brief Offsets for flag bits in \c sbcs
-    ///
-    /// How much to shift right to get the mask into the LS bits of the word.
-    enum Offsets
-    {
-      SBVERSION_OFFSET = 29,
-      SBBUSYERROR_OFFSET = 22,
-      SBBUSY_OFFSET = 21,
-      SBREADONADDR_OFFSET = 20,
-      SBACCESS_OFFSET = 17,
-      SBAUTOINCREMENT_OFFSET = 16,
-      SBREADONDATA_OFFSET = 15,
-      SBERROR_OFFSET = 12,
-      SBASIZE_OFFSET = 5,
-      SBACCESS128_OFFSET = 4,
-      SBACCESS64_OFFSET = 3,
-      SBACCESS32_OFFSET = 2,
-      SBACCESS16_OFFSET = 1,
-      SBACCESS8_OFFSET = 0,
-    };
+    // The owning Dmi rebinds the DTM when it is swapped
+    friend class DmiT;
 
-    /// \brief Sizes of flag bits in \c sbcs
-    ///
-    /// How many bits are set in the flag.
-    enum Sizes
-    {
-      SBVERSION_SIZE = 3,
-      SBBUSYERROR_SIZE = 1,
-      SBBUSY_SIZE = 1,
-      SBREADONADDR_SIZE = 1,
-      SBACCESS_SIZE = 3,
-      SBAUTOINCREMENT_SIZE = 1,
-      SBREADONDATA_SIZE = 1,
-      SBERROR_SIZE = 3,
-      SBASIZE_SIZE = 7,
-      SBACCESS128_SIZE = 1,
-      SBACCESS64_SIZE = 1,
-      SBACCESS32_SIZE = 1,
-      SBACCESS16_SIZE = 1,
-      SBACCESS8_SIZE = 1,
-    };
+  private:
+    /// \brief Write-1-to-clear bits of \c sbcs
+    static constexpr uint32_t W1C_MASK = Sbbusyerror::MASK | Sberror::MASK;
+
+    /// \brief Configuration fields of \c sbcs, held until next written
+    static constexpr uint32_t CONFIG_MASK
+        = Sbreadonaddr::MASK | Sbaccess::MASK | Sbautoincrement::MASK
+          | Sbreadondata::MASK;
 
     /// \brief The address of the \c sbcs register in the DMI.
     static const uint64_t DMI_ADDR = 0x38;
@@ -1115,11 +1181,15 @@ public:
     /// register.
     bool mPrettyPrint;
 
-    /// \brief A reference to the DTM we are using.
-    std::unique_ptr<IDtm> &mDtm;
+    /// \brief The DTM we are using, owned by the Dmi.
+    DtmT *mDtm;
 
     /// \brief the value of the Sbcs register.
     uint32_t mSbcsReg;
+
+    /// \brief The configuration fields last written to the \c sbcs
+    /// register.
+    Shadow mShadow;
   };
 
   /// \brief The class modeling the \c sbdata registers.
@@ -1131,7 +1201,7 @@ public:
 
     // Constructors & destructor
     Sbdata () = delete;
-    Sbdata (std::unique_ptr<IDtm> &dtm_);
+    Sbdata (DtmT *dtm_);
     ~Sbdata () = default;
 
     // Delete copy operator
@@ -1139,14 +1209,25 @@ public:
 
     // API
     void read (const std::size_t n);
+    void queueRead (const std::size_t n, std::vector<IDtm::DmiOp> &batch);
+    void queueRead (const std::size_t n, std::vector<IDtm::DmiOp> &batch,
+                    uint32_t *res);
     void reset (const std::size_t n);
     void write (const std::size_t n);
+    void queueWrite (const std::size_t n, std::vector<IDtm::DmiOp> &batch);
     uint32_t sbdata (const std::size_t n) const;
     void sbdata (const std::size_t n, const uint32_t sbdataVal);
+    std::ostream &print (std::ostream &s) const;
 
     // Output operator is a friend
-    friend std::ostream &operator<< (std::ostream &s,
-                                     const std::unique_ptr<Sbdata> &p);
+    friend std::ostream &
+    operator<< (std::ostream &s, const std::unique_ptr<Sbdata> &p)
+    {
+      return p->print (s);
+    }
+
+    // The owning Dmi rebinds the DTM when it is swapped
+    friend class DmiT;
 
   private:
     /// \brief The address of the \c sbdata registers in the DMI
@@ -1155,8 +1236,8 @@ public:
     /// \brief The reset value of the \c sbdata registers in the DMI.
     static const uint32_t RESET_VALUE = 0x0;
 
-    /// \brief A reference to the DTM we are using
-    std::unique_ptr<IDtm> &mDtm;
+    /// \brief The DTM we are using, owned by the Dmi
+    DtmT *mDtm;
 
     /// \brief The value of the Sbdata registers
     uint32_t mSbdataReg[NUM_REGS];
@@ -1371,40 +1452,111 @@ public:
     HWLP, ///< Only if hardware loop is present
   };
 
+  /// \brief Outcome of waiting for the hart to halt
+  enum HaltWait
+  {
+    HALT_OK,       ///< The hart halted
+    HALT_TIMEOUT,  ///< The timeout expired first
+    HALT_SIM_DONE, ///< The simulation finished first
+  };
+
+  /// \brief Route taken by memory accesses
+  enum MemPath
+  {
+    MEM_SYSBUS,  ///< Via the System Bus
+    MEM_PROGBUF, ///< Via loads and stores in the program buffer
+  };
+
+  /// \brief Fixed properties of the debug module and its transport
+  ///
+  /// Found once when we attach, and then used by all access paths.
+  struct Caps
+  {
+    uint32_t idcode;      ///< JTAG IDCODE, zero if the DTM has none
+    uint8_t abits;        ///< \c dtmcs.abits, zero if the DTM has none
+    uint8_t idle;         ///< \c dtmcs.idle, zero if the DTM has none
+    uint8_t nscratch;     ///< \c hartinfo.nscratch
+    bool dataaccess;      ///< \c hartinfo.dataaccess
+    uint8_t datasize;     ///< \c hartinfo.datasize
+    uint16_t dataaddr;    ///< \c hartinfo.dataaddr
+    uint8_t progbufsize;  ///< \c abstractcs.progbufsize
+    uint8_t datacount;    ///< \c abstractcs.datacount
+    uint8_t sbversion;    ///< \c sbcs.sbversion
+    uint8_t sbasize;      ///< \c sbcs.sbasize
+    uint8_t sbSizes;      ///< System Bus sizes: bit \c n for \c 2^n bytes
+    uint32_t confstrptr[Confstrptr::NUM_REGS]; ///< \c confstrptr0-3
+    uint32_t nextdm;                           ///< \c nextdm
+  };
+
   // Constructor and destructor
-  Dmi (std::unique_ptr<IDtm> dtm);
-  Dmi () = delete;
-  ~Dmi () = default;
+  DmiT (std::unique_ptr<DtmT> dtm);
+  DmiT () = delete;
+  ~DmiT () = default;
 
   // Delete the copy assignment operator
-  Dmi &operator= (const Dmi &) = delete;
+  DmiT &operator= (const DmiT &) = delete;
 
   // Hart control API
   void selectHart (uint32_t h);
   uint32_t hartsellen ();
   void haltHart (uint32_t h);
 
+  // Hart status polling API
+  HaltWait waitForHalt ();
+  void pollConfig (uint64_t minCycles, uint64_t maxCycles, uint64_t timeoutNs);
+  void printPollConfig (std::ostream &stream) const;
+
+  // Abstract command retry API
+  void cmdRetryConfig (unsigned retries, uint32_t maxCycles);
+  void printCmdRetry (std::ostream &stream) const;
+
   // Accessors for CSR fields
   const char *csrName (const uint16_t csrAddr) const;
   bool csrReadOnly (const uint16_t csrAddr) const;
   CsrType csrType (const uint16_t csrAddr) const;
+  bool csrAddr (const std::string &name, uint16_t &csrAddr) const;
 
   // Register access API
-  Abstractcs::CmderrVal readCsr (uint16_t addr, uint32_t &res);
-  Abstractcs::CmderrVal writeCsr (uint16_t addr, uint32_t val);
-  Abstractcs::CmderrVal readGpr (std::size_t regNum, uint32_t &res);
-  Abstractcs::CmderrVal writeGpr (std::size_t regNum, uint32_t val);
-  Abstractcs::CmderrVal readFpr (std::size_t regNum, uint32_t &res);
-  Abstractcs::CmderrVal writeFpr (std::size_t regNum, uint32_t val);
+  typename Abstractcs::CmderrVal readCsr (uint16_t addr, uint32_t &res);
+  typename Abstractcs::CmderrVal writeCsr (uint16_t addr, uint32_t val);
+  typename Abstractcs::CmderrVal readGpr (std::size_t regNum, uint32_t &res);
+  typename Abstractcs::CmderrVal writeGpr (std::size_t regNum, uint32_t val);
+  typename Abstractcs::CmderrVal
+  readGprs (std::size_t first, std::size_t count, uint32_t res[]);
+  typename Abstractcs::CmderrVal
+  writeGprs (std::size_t first, std::size_t count, const uint32_t val[]);
+  typename Abstractcs::CmderrVal readFpr (std::size_t regNum, uint32_t &res);
+  typename Abstractcs::CmderrVal writeFpr (std::size_t regNum, uint32_t val);
 
   // Memory access API
-  Sbcs::SberrorVal readMem (uint64_t addr, std::size_t nBytes,
-                            std::unique_ptr<uint8_t[]> &buf);
-  Sbcs::SberrorVal writeMem (uint64_t addr, std::size_t nBytes,
-                             std::unique_ptr<uint8_t[]> &buf);
+  typename Sbcs::SberrorVal readMem (uint64_t addr, std::size_t nBytes,
+                                     uint8_t *buf);
+  typename Sbcs::SberrorVal writeMem (uint64_t addr, std::size_t nBytes,
+                                      const uint8_t *buf);
+  void memPath (const MemPath path);
+  MemPath memPath () const;
+  void sbBurst (const bool enable);
+  bool sbBurst () const;
+  void sbBurstIdle (const uint32_t idleCycles);
+  void printSbBurst (std::ostream &stream) const;
+
+  // Capability API
+  void discoverCaps ();
+  const Caps &caps ();
+  bool loadCaps (const std::string &fileName);
+  bool saveCaps (const std::string &fileName);
+  void printCaps (std::ostream &stream);
+
+  // Write elision API
+  void invalidateShadows ();
+  uint64_t writesElided () const;
+  void clearShadowStats ();
 
   // API for the underlying DTM
   void dtmReset ();
+  void swapDtm (std::unique_ptr<DtmT> &dtm);
+  void sync ();
+  std::unique_ptr<DtmT> &dtm ();
   uint64_t simTimeNs () const;
 
   // Accessors for registers
@@ -1427,221 +1579,161 @@ public:
   std::unique_ptr<Sbdata> &sbdata ();
 
 private:
+  // Memory access helpers
+  typename Sbcs::SberrorVal readMemSysbus (uint64_t addr, std::size_t nBytes,
+                                           uint8_t *buf);
+  typename Sbcs::SberrorVal writeMemSysbus (uint64_t addr, std::size_t nBytes,
+                                            const uint8_t *buf);
+  bool readMemBurst (uint64_t addr, std::size_t size, std::size_t count,
+                     uint8_t *buf);
+  bool writeMemBurst (uint64_t addr, std::size_t size, std::size_t count,
+                      const uint8_t *buf);
+  bool sbBurstOk ();
+  typename Sbcs::SberrorVal sbPolledError ();
+  uint8_t sbSizes ();
+  std::size_t sbWidest ();
+  std::size_t sbChunkSize (uint64_t addr, std::size_t nBytes);
+  static uint8_t sbAccessCode (std::size_t size);
+  typename Sbcs::SberrorVal readMemPolled (uint64_t addr, std::size_t nBytes,
+                                           uint8_t *buf);
+  typename Sbcs::SberrorVal writeMemPolled (uint64_t addr, std::size_t nBytes,
+                                            const uint8_t *buf);
+  typename Abstractcs::CmderrVal progbufMem (uint64_t addr, std::size_t nBytes,
+                                             uint8_t *rbuf,
+                                             const uint8_t *wbuf);
+  typename Abstractcs::CmderrVal
+  progbufStream (uint32_t addr, std::size_t count, const std::size_t width,
+                 uint8_t *rbuf, const uint8_t *wbuf);
+  bool progbufLoad (const uint32_t insn, const std::size_t width);
+
+  // DTM helper
+  void bindDtm ();
+
+  // Abstract command helpers
+  typename Abstractcs::CmderrVal runCommand (std::vector<IDtm::DmiOp> &batch,
+                                             const std::size_t settlePos);
+  typename Abstractcs::CmderrVal
+  rereadResults (const std::vector<IDtm::DmiOp> &batch,
+                 const std::size_t settlePos);
+  bool waitCmdNotBusy ();
+  void resetAfterBusy ();
+  void stopAutoexec ();
+
   /// \brief A structure representing a CSR
   ///
-  /// CSRs will be placed into a std::map with this data keyed by the CSR
-  /// address.
+  /// CSRs are held in a constant table of these, indexed by address and by
+  /// name when first needed.
   struct CsrInfo
   {
-    const char *name;    ///< The printable name of the CSR
-    const bool readOnly; ///< True if the CSR is read only
-    const CsrType type;  ///< Which CSR group
+    uint16_t addr;    ///< The address of the CSR
+    const char *name; ///< The printable name of the CSR
+    bool readOnly;    ///< True if the CSR is read only
+    CsrType type;     ///< Which CSR group
   };
 
+  // CSR lookup helper
+  static const CsrInfo *csrInfo (const uint16_t csrAddr);
+
+  /// \brief Size of the CSR address space
+  static const std::size_t CSR_SPACE = 4096;
+
   /// \brief Base address of the GPRs when reading/writing
   static const uint16_t GPR_BASE = 0x1000;
 
   /// \brief Base address of the FPRs when reading/writing
   static const uint16_t FPR_BASE = 0x1020;
 
-  /// \brief A map of CSR address to name, readability and instruction gorup
-  std::map<const uint16_t, CsrInfo> mCsrMap{
-    // Standard user CSRs
-    { Csr::FFLAGS, { "fflags", false, FP } },
-    { Csr::FRM, { "frm", false, FP } },
-    { Csr::FCSR, { "fcsr", false, FP } },
-    { Csr::CYCLE, { "cycle", true, ANY } },
-    { Csr::INSTRET, { "instret", true, ANY } },
-    { Csr::HPMCOUNTER3, { "hpmcounter3", true, ANY } },
-    { Csr::HPMCOUNTER4, { "hpmcounter4", true, ANY } },
-    { Csr::HPMCOUNTER5, { "hpmcounter5", true, ANY } },
-    { Csr::HPMCOUNTER6, { "hpmcounter6", true, ANY } },
-    { Csr::HPMCOUNTER7, { "hpmcounter7", true, ANY } },
-    { Csr::HPMCOUNTER8, { "hpmcounter8", true, ANY } },
-    { Csr::HPMCOUNTER9, { "hpmcounter9", true, ANY } },
-    { Csr::HPMCOUNTER10, { "hpmcounter10", true, ANY } },
-    { Csr::HPMCOUNTER11, { "hpmcounter11", true, ANY } },
-    { Csr::HPMCOUNTER12, { "hpmcounter12", true, ANY } },
-    { Csr::HPMCOUNTER13, { "hpmcounter13", true, ANY } },
-    { Csr::HPMCOUNTER14, { "hpmcounter14", true, ANY } },
-    { Csr::HPMCOUNTER15, { "hpmcounter15", true, ANY } },
-    { Csr::HPMCOUNTER16, { "hpmcounter16", true, ANY } },
-    { Csr::HPMCOUNTER17, { "hpmcounter17", true, ANY } },
-    { Csr::HPMCOUNTER18, { "hpmcounter18", true, ANY } },
-    { Csr::HPMCOUNTER19, { "hpmcounter19", true, ANY } },
-    { Csr::HPMCOUNTER20, { "hpmcounter20", true, ANY } },
-    { Csr::HPMCOUNTER21, { "hpmcounter21", true, ANY } },
-    { Csr::HPMCOUNTER22, { "hpmcounter22", true, ANY } },
-    { Csr::HPMCOUNTER23, { "hpmcounter23", true, ANY } },
-    { Csr::HPMCOUNTER24, { "hpmcounter24", true, ANY } },
-    { Csr::HPMCOUNTER25, { "hpmcounter25", true, ANY } },
-    { Csr::HPMCOUNTER26, { "hpmcounter26", true, ANY } },
-    { Csr::HPMCOUNTER27, { "hpmcounter27", true, ANY } },
-    { Csr::HPMCOUNTER28, { "hpmcounter28", true, ANY } },
-    { Csr::HPMCOUNTER29, { "hpmcounter29", true, ANY } },
-    { Csr::HPMCOUNTER30, { "hpmcounter30", true, ANY } },
-    { Csr::HPMCOUNTER31, { "hpmcounter31", true, ANY } },
-    { Csr::CYCLEH, { "cycleh", true, ANY } },
-    { Csr::INSTRETH, { "instreth", true, ANY } },
-    { Csr::HPMCOUNTERH3, { "hpmcounterh3", true, ANY } },
-    { Csr::HPMCOUNTERH4, { "hpmcounterh4", true, ANY } },
-    { Csr::HPMCOUNTERH5, { "hpmcounterh5", true, ANY } },
-    { Csr::HPMCOUNTERH6, { "hpmcounterh6", true, ANY } },
-    { Csr::HPMCOUNTERH7, { "hpmcounterh7", true, ANY } },
-    { Csr::HPMCOUNTERH8, { "hpmcounterh8", true, ANY } },
-    { Csr::HPMCOUNTERH9, { "hpmcounterh9", true, ANY } },
-    { Csr::HPMCOUNTERH10, { "hpmcounterh10", true, ANY } },
-    { Csr::HPMCOUNTERH11, { "hpmcounterh11", true, ANY } },
-    { Csr::HPMCOUNTERH12, { "hpmcounterh12", true, ANY } },
-    { Csr::HPMCOUNTERH13, { "hpmcounterh13", true, ANY } },
-    { Csr::HPMCOUNTERH14, { "hpmcounterh14", true, ANY } },
-    { Csr::HPMCOUNTERH15, { "hpmcounterh15", true, ANY } },
-    { Csr::HPMCOUNTERH16, { "hpmcounterh16", true, ANY } },
-    { Csr::HPMCOUNTERH17, { "hpmcounterh17", true, ANY } },
-    { Csr::HPMCOUNTERH18, { "hpmcounterh18", true, ANY } },
-    { Csr::HPMCOUNTERH19, { "hpmcounterh19", true, ANY } },
-    { Csr::HPMCOUNTERH20, { "hpmcounterh20", true, ANY } },
-    { Csr::HPMCOUNTERH21, { "hpmcounterh21", true, ANY } },
-    { Csr::HPMCOUNTERH22, { "hpmcounterh22", true, ANY } },
-    { Csr::HPMCOUNTERH23, { "hpmcounterh23", true, ANY } },
-    { Csr::HPMCOUNTERH24, { "hpmcounterh24", true, ANY } },
-    { Csr::HPMCOUNTERH25, { "hpmcounterh25", true, ANY } },
-    { Csr::HPMCOUNTERH26, { "hpmcounterh26", true, ANY } },
-    { Csr::HPMCOUNTERH27, { "hpmcounterh27", true, ANY } },
-    { Csr::HPMCOUNTERH28, { "hpmcounterh28", true, ANY } },
-    { Csr::HPMCOUNTERH29, { "hpmcounterh29", true, ANY } },
-    { Csr::HPMCOUNTERH30, { "hpmcounterh30", true, ANY } },
-    { Csr::HPMCOUNTERH31, { "hpmcounterh31", true, ANY } },
-    // Custom user CSRs
-    { Csr::LPSTART0, { "lpstart0", false, HWLP } },
-    { Csr::LPEND0, { "lpend0", false, HWLP } },
-    { Csr::LPCOUNT0, { "lpcount0", false, HWLP } },
-    { Csr::LPSTART1, { "lpstart1", false, HWLP } },
-    { Csr::LPEND1, { "lpend1", false, HWLP } },
-    { Csr::LPCOUNT1, { "lpcount1", false, HWLP } },
-    { Csr::UHARTID, { "uhartid", true, ANY } },
-    { Csr::PRIVLV, { "privlv", true, ANY } },
-    // Standard machine CSRs
-    { Csr::MSTATUS, { "mstatus", false, ANY } },
-    { Csr::MISA, { "misa", false, ANY } },
-    { Csr::MIE, { "mie", false, ANY } },
-    { Csr::MTVEC, { "mtvec", false, ANY } },
-    { Csr::MCOUNTINHIBIT, { "mcountinhibit", false, ANY } },
-    { Csr::MHPMEVENT3, { "mhpmevent3", false, ANY } },
-    { Csr::MHPMEVENT4, { "mhpmevent4", false, ANY } },
-    { Csr::MHPMEVENT5, { "mhpmevent5", false, ANY } },
-    { Csr::MHPMEVENT6, { "mhpmevent6", false, ANY } },
-    { Csr::MHPMEVENT7, { "mhpmevent7", false, ANY } },
-    { Csr::MHPMEVENT8, { "mhpmevent8", false, ANY } },
-    { Csr::MHPMEVENT9, { "mhpmevent9", false, ANY } },
-    { Csr::MHPMEVENT10, { "mhpmevent10", false, ANY } },
-    { Csr::MHPMEVENT11, { "mhpmevent11", false, ANY } },
-    { Csr::MHPMEVENT12, { "mhpmevent12", false, ANY } },
-    { Csr::MHPMEVENT13, { "mhpmevent13", false, ANY } },
-    { Csr::MHPMEVENT14, { "mhpmevent14", false, ANY } },
-    { Csr::MHPMEVENT15, { "mhpmevent15", false, ANY } },
-    { Csr::MHPMEVENT16, { "mhpmevent16", false, ANY } },
-    { Csr::MHPMEVENT17, { "mhpmevent17", false, ANY } },
-    { Csr::MHPMEVENT18, { "mhpmevent18", false, ANY } },
-    { Csr::MHPMEVENT19, { "mhpmevent19", false, ANY } },
-    { Csr::MHPMEVENT20, { "mhpmevent20", false, ANY } },
-    { Csr::MHPMEVENT21, { "mhpmevent21", false, ANY } },
-    { Csr::MHPMEVENT22, { "mhpmevent22", false, ANY } },
-    { Csr::MHPMEVENT23, { "mhpmevent23", false, ANY } },
-    { Csr::MHPMEVENT24, { "mhpmevent24", false, ANY } },
-    { Csr::MHPMEVENT25, { "mhpmevent25", false, ANY } },
-    { Csr::MHPMEVENT26, { "mhpmevent26", false, ANY } },
-    { Csr::MHPMEVENT27, { "mhpmevent27", false, ANY } },
-    { Csr::MHPMEVENT28, { "mhpmevent28", false, ANY } },
-    { Csr::MHPMEVENT29, { "mhpmevent29", false, ANY } },
-    { Csr::MHPMEVENT30, { "mhpmevent30", false, ANY } },
-    { Csr::MHPMEVENT31, { "mhpmevent31", false, ANY } },
-    { Csr::MSCRATCH, { "mscratch", false, ANY } },
-    { Csr::MEPC, { "mepc", false, ANY } },
-    { Csr::MCAUSE, { "mcause", false, ANY } },
-    { Csr::MTVAL, { "mtval", false, ANY } },
-    { Csr::MIP, { "mip", false, ANY } },
-    { Csr::TSELECT, { "tselect", false, ANY } },
-    { Csr::TDATA1, { "tdata1", false, ANY } },
-    { Csr::TDATA2, { "tdata2", false, ANY } },
-    { Csr::TDATA3, { "tdata3", false, ANY } },
-    { Csr::TINFO, { "tinfo", true, ANY } },
-    { Csr::MCONTEXT, { "mcontext", false, ANY } },
-    { Csr::SCONTEXT, { "scontext", false, ANY } },
-    { Csr::DCSR, { "dcsr", false, ANY } },
-    { Csr::DPC, { "dpc", false, ANY } },
-    { Csr::DSCRATCH0, { "dscratch0", false, ANY } },
-    { Csr::DSCRATCH1, { "dscratch1", false, ANY } },
-    { Csr::MCYCLE, { "mcycle", false, ANY } },
-    { Csr::MINSTRET, { "minstret", false, ANY } },
-    { Csr::MHPMCOUNTER3, { "mhpmcounter3", false, ANY } },
-    { Csr::MHPMCOUNTER4, { "mhpmcounter4", false, ANY } },
-    { Csr::MHPMCOUNTER5, { "mhpmcounter5", false, ANY } },
-    { Csr::MHPMCOUNTER6, { "mhpmcounter6", false, ANY } },
-    { Csr::MHPMCOUNTER7, { "mhpmcounter7", false, ANY } },
-    { Csr::MHPMCOUNTER8, { "mhpmcounter8", false, ANY } },
-    { Csr::MHPMCOUNTER9, { "mhpmcounter9", false, ANY } },
-    { Csr::MHPMCOUNTER10, { "mhpmcounter10", false, ANY } },
-    { Csr::MHPMCOUNTER11, { "mhpmcounter11", false, ANY } },
-    { Csr::MHPMCOUNTER12, { "mhpmcounter12", false, ANY } },
-    { Csr::MHPMCOUNTER13, { "mhpmcounter13", false, ANY } },
-    { Csr::MHPMCOUNTER14, { "mhpmcounter14", false, ANY } },
-    { Csr::MHPMCOUNTER15, { "mhpmcounter15", false, ANY } },
-    { Csr::MHPMCOUNTER16, { "mhpmcounter16", false, ANY } },
-    { Csr::MHPMCOUNTER17, { "mhpmcounter17", false, ANY } },
-    { Csr::MHPMCOUNTER18, { "mhpmcounter18", false, ANY } },
-    { Csr::MHPMCOUNTER19, { "mhpmcounter19", false, ANY } },
-    { Csr::MHPMCOUNTER20, { "mhpmcounter20", false, ANY } },
-    { Csr::MHPMCOUNTER21, { "mhpmcounter21", false, ANY } },
-    { Csr::MHPMCOUNTER22, { "mhpmcounter22", false, ANY } },
-    { Csr::MHPMCOUNTER23, { "mhpmcounter23", false, ANY } },
-    { Csr::MHPMCOUNTER24, { "mhpmcounter24", false, ANY } },
-    { Csr::MHPMCOUNTER25, { "mhpmcounter25", false, ANY } },
-    { Csr::MHPMCOUNTER26, { "mhpmcounter26", false, ANY } },
-    { Csr::MHPMCOUNTER27, { "mhpmcounter27", false, ANY } },
-    { Csr::MHPMCOUNTER28, { "mhpmcounter28", false, ANY } },
-    { Csr::MHPMCOUNTER29, { "mhpmcounter29", false, ANY } },
-    { Csr::MHPMCOUNTER30, { "mhpmcounter30", false, ANY } },
-    { Csr::MHPMCOUNTER31, { "mhpmcounter31", false, ANY } },
-    { Csr::MCYCLEH, { "mcycleh", false, ANY } },
-    { Csr::MINSTRETH, { "minstreth", false, ANY } },
-    { Csr::MHPMCOUNTERH3, { "mhpmcounterh3", false, ANY } },
-    { Csr::MHPMCOUNTERH4, { "mhpmcounterh4", false, ANY } },
-    { Csr::MHPMCOUNTERH5, { "mhpmcounterh5", false, ANY } },
-    { Csr::MHPMCOUNTERH6, { "mhpmcounterh6", false, ANY } },
-    { Csr::MHPMCOUNTERH7, { "mhpmcounterh7", false, ANY } },
-    { Csr::MHPMCOUNTERH8, { "mhpmcounterh8", false, ANY } },
-    { Csr::MHPMCOUNTERH9, { "mhpmcounterh9", false, ANY } },
-    { Csr::MHPMCOUNTERH10, { "mhpmcounterh10", false, ANY } },
-    { Csr::MHPMCOUNTERH11, { "mhpmcounterh11", false, ANY } },
-    { Csr::MHPMCOUNTERH12, { "mhpmcounterh12", false, ANY } },
-    { Csr::MHPMCOUNTERH13, { "mhpmcounterh13", false, ANY } },
-    { Csr::MHPMCOUNTERH14, { "mhpmcounterh14", false, ANY } },
-    { Csr::MHPMCOUNTERH15, { "mhpmcounterh15", false, ANY } },
-    { Csr::MHPMCOUNTERH16, { "mhpmcounterh16", false, ANY } },
-    { Csr::MHPMCOUNTERH17, { "mhpmcounterh17", false, ANY } },
-    { Csr::MHPMCOUNTERH18, { "mhpmcounterh18", false, ANY } },
-    { Csr::MHPMCOUNTERH19, { "mhpmcounterh19", false, ANY } },
-    { Csr::MHPMCOUNTERH20, { "mhpmcounterh20", false, ANY } },
-    { Csr::MHPMCOUNTERH21, { "mhpmcounterh21", false, ANY } },
-    { Csr::MHPMCOUNTERH22, { "mhpmcounterh22", false, ANY } },
-    { Csr::MHPMCOUNTERH23, { "mhpmcounterh23", false, ANY } },
-    { Csr::MHPMCOUNTERH24, { "mhpmcounterh24", false, ANY } },
-    { Csr::MHPMCOUNTERH25, { "mhpmcounterh25", false, ANY } },
-    { Csr::MHPMCOUNTERH26, { "mhpmcounterh26", false, ANY } },
-    { Csr::MHPMCOUNTERH27, { "mhpmcounterh27", false, ANY } },
-    { Csr::MHPMCOUNTERH28, { "mhpmcounterh28", false, ANY } },
-    { Csr::MHPMCOUNTERH29, { "mhpmcounterh29", false, ANY } },
-    { Csr::MHPMCOUNTERH30, { "mhpmcounterh30", false, ANY } },
-    { Csr::MHPMCOUNTERH31, { "mhpmcounterh31", false, ANY } },
-    { Csr::MVENDORID, { "mvendorid", true, ANY } },
-    { Csr::MARCHID, { "marchid", true, ANY } },
-    { Csr::MIMPID, { "mimpid", true, ANY } },
-    { Csr::MHARTID, { "mhartid", true, ANY } }
-  };
+  /// \brief GPR holding the address for program buffer memory access (s0)
+  static const std::size_t PROGBUF_ADDR_REG = 8;
+
+  /// \brief GPR holding the data for program buffer memory access (s1)
+  static const std::size_t PROGBUF_DATA_REG = 9;
+
+  /// \brief Program buffer entries used for memory access
+  static const std::size_t PROGBUF_MEM_LEN = 3;
+
+  /// \brief Initial clock cycles to idle between System Bus burst accesses
+  static const uint32_t SB_BURST_IDLE_DEFAULT = 8;
+
+  /// \brief Maximum clock cycles to idle between System Bus burst accesses
+  static const uint32_t SB_BURST_IDLE_MAX = 1024;
+
+  /// \brief Default number of times to reissue a busy abstract command
+  static const unsigned CMD_RETRIES_DEFAULT = 8;
+
+  /// \brief Initial clock cycles to wait before reissuing a busy command
+  static const uint32_t CMD_IDLE_MIN = 8;
+
+  /// \brief Default maximum clock cycles to wait before reissuing a command
+  static const uint32_t CMD_IDLE_MAX_DEFAULT = 4096;
+
+  /// \brief Number of fields in a saved capabilities file
+  static const std::size_t CAPS_FIELDS = 14;
+
+  /// \brief Table of CSR address, name, readability and instruction group
+  static const CsrInfo CSR_INFO[];
+
+  /// \brief Number of entries in \c CSR_INFO
+  static const std::size_t NUM_CSRS;
 
   /// \brief The Debug Transport Module we use.
-  std::unique_ptr<IDtm> mDtm;
+  std::unique_ptr<DtmT> mDtm;
+
+  /// \brief Initial clock cycles to run between polls of hart status
+  uint64_t mPollMinCycles;
+
+  /// \brief Maximum clock cycles to run between polls of hart status
+  uint64_t mPollMaxCycles;
+
+  /// \brief Simulated time after which to give up polling (0 = never)
+  uint64_t mPollTimeoutNs;
+
+  /// \brief Total polls of hart status
+  uint64_t mPollCount;
+
+  /// \brief Times to reissue a busy abstract command before resetting
+  unsigned mCmdRetries;
+
+  /// \brief Maximum clock cycles to wait before reissuing a busy command
+  uint32_t mCmdMaxCycles;
+
+  /// \brief Number of abstract commands reissued after a busy error
+  uint64_t mCmdBusyRetries;
+
+  /// \brief Number of times the retry budget ran out and we reset
+  uint64_t mCmdResets;
+
+  /// \brief Route taken by memory accesses
+  MemPath mMemPath;
+
+  /// \brief Load or store instruction currently in the program buffer
+  ///
+  /// Zero if the program buffer does not hold a memory access sequence.
+  uint32_t mProgbufInsn;
+
+  /// \brief Whether to use burst mode for System Bus blocks
+  bool mSbBurst;
+
+  /// \brief Clock cycles to idle between System Bus burst accesses
+  uint32_t mSbBurstIdle;
+
+  /// \brief Number of System Bus bursts attempted
+  uint64_t mSbBursts;
+
+  /// \brief Number of System Bus bursts repeated in polled mode
+  uint64_t mSbBurstRetries;
+
+  /// \brief Whether \c mCaps has been filled in
+  bool mCapsValid;
+
+  /// \brief Fixed properties of the debug module
+  Caps mCaps;
+
+  /// \brief DMI batch reused by memory transfers, to avoid allocation
+  std::vector<IDtm::DmiOp> mMemBatch;
+
+  /// \brief Words reused by memory transfers, to avoid allocation
+  std::vector<uint32_t> mMemWords;
 
   /// \brief The \c data register set.
   std::unique_ptr<Data> mData;
@@ -1695,38 +1787,487 @@ private:
   std::unique_ptr<Sbdata> mSbdata;
 };
 
-// Stream output operators for DMI register classes
-std::ostream &operator<< (std::ostream &s, const std::unique_ptr<Dmi::Data> &p);
-std::ostream &operator<< (std::ostream &s,
-                          const std::unique_ptr<Dmi::Dmcontrol> &p);
-std::ostream &operator<< (std::ostream &s,
-                          const std::unique_ptr<Dmi::Dmstatus> &p);
-std::ostream &operator<< (std::ostream &s,
-                          const std::unique_ptr<Dmi::Hartinfo> &p);
-std::ostream &operator<< (std::ostream &s,
-                          const std::unique_ptr<Dmi::Haltsum> &p);
-std::ostream &operator<< (std::ostream &s,
-                          const std::unique_ptr<Dmi::Hawindowsel> &p);
-std::ostream &operator<< (std::ostream &s,
-                          const std::unique_ptr<Dmi::Hawindow> &p);
-std::ostream &operator<< (std::ostream &s,
-                          const std::unique_ptr<Dmi::Abstractcs> &p);
-std::ostream &operator<< (std::ostream &s,
-                          const std::unique_ptr<Dmi::Command> &p);
-std::ostream &operator<< (std::ostream &s,
-                          const std::unique_ptr<Dmi::Abstractauto> &p);
-std::ostream &operator<< (std::ostream &s,
-                          const std::unique_ptr<Dmi::Confstrptr> &p);
-std::ostream &operator<< (std::ostream &s,
-                          const std::unique_ptr<Dmi::Nextdm> &p);
-std::ostream &operator<< (std::ostream &s,
-                          const std::unique_ptr<Dmi::Progbuf> &p);
-std::ostream &operator<< (std::ostream &s,
-                          const std::unique_ptr<Dmi::Authdata> &p);
-std::ostream &operator<< (std::ostream &s,
-                          const std::unique_ptr<Dmi::Sbaddress> &p);
-std::ostream &operator<< (std::ostream &s, const std::unique_ptr<Dmi::Sbcs> &p);
-std::ostream &operator<< (std::ostream &s,
-                          const std::unique_ptr<Dmi::Sbdata> &p);
+/// Get the \c impebreak field of the \c dmstatus register.
+///
+/// \return \c true if the \c impebreak field of \c dmstatus is set, \c false
+///         otherwise.
+template <class DtmT>
+inline bool
+DmiT<DtmT>::Dmstatus::impebreak () const
+{
+  return Impebreak::get (mDmstatusReg) != 0;
+}
+
+/// Get the \c havereset fields of the \c dmstatus register.
+///
+/// \note we do not distinguish between "all" or "any" versions of the flag.
+///
+/// \return \c true if either of the \c allhavereset of \c anyhavereset
+///         fields of \c dmstatus is set, \c false otherwise.
+template <class DtmT>
+inline bool
+DmiT<DtmT>::Dmstatus::havereset () const
+{
+  return (mDmstatusReg & (Allhavereset::MASK | Anyhavereset::MASK)) != 0;
+}
+
+/// Get the \c resumeack fields of the \c dmstatus register.
+///
+/// \note we do not distinguish between "all" or "any" versions of the flag.
+///
+/// \return \c true if either of the \c allresumeack of \c anyresumeack
+///         fields of \c dmstatus is set, \c false otherwise.
+template <class DtmT>
+inline bool
+DmiT<DtmT>::Dmstatus::resumeack () const
+{
+  return (mDmstatusReg & (Allresumeack::MASK | Anyresumeack::MASK)) != 0;
+}
+
+/// Get the \c nonexistent fields of the \c dmstatus register.
+///
+/// \note we do not distinguish between "all" or "any" versions of the flag.
+///
+/// \return \c true if either of the \c allnonexistent of \c anynonexistent
+///         fields of \c dmstatus is set, \c false otherwise.
+template <class DtmT>
+inline bool
+DmiT<DtmT>::Dmstatus::nonexistent () const
+{
+  return (mDmstatusReg & (Allnonexistent::MASK | Anynonexistent::MASK)) != 0;
+}
+
+/// Get the \c unavail fields of the \c dmstatus register.
+///
+/// \note we do not distinguish between "all" or "any" versions of the flag.
+///
+/// \return \c true if either of the \c allunavail of \c anyunavail
+///         fields of \c dmstatus is set, \c false otherwise.
+template <class DtmT>
+inline bool
+DmiT<DtmT>::Dmstatus::unavail () const
+{
+  return (mDmstatusReg & (Allunavail::MASK | Anyunavail::MASK)) != 0;
+}
+
+/// Get the \c running fields of the \c dmstatus register.
+///
+/// \note we do not distinguish between "all" or "any" versions of the flag.
+///
+/// \return \c true if either of the \c allrunning of \c anyrunning
+///         fields of \c dmstatus is set, \c false otherwise.
+template <class DtmT>
+inline bool
+DmiT<DtmT>::Dmstatus::running () const
+{
+  return (mDmstatusReg & (Allrunning::MASK | Anyrunning::MASK)) != 0;
+}
+
+/// Get the \c halted fields of the \c dmstatus register.
+///
+/// \note we do not distinguish between "all" or "any" versions of the flag.
+///
+/// \return \c true if either of the \c allhalted of \c anyhalted
+///         fields of \c dmstatus is set, \c false otherwise.
+template <class DtmT>
+inline bool
+DmiT<DtmT>::Dmstatus::halted () const
+{
+  return (mDmstatusReg & (Allhalted::MASK | Anyhalted::MASK)) != 0;
+}
+
+/// Get the \c authenticated field of the \c dmstatus register.
+///
+/// \return \c true if the \c authenticated field of \c dmstatus is set,
+///         \c false otherwise.
+template <class DtmT>
+inline bool
+DmiT<DtmT>::Dmstatus::authenticated () const
+{
+  return Authenticated::get (mDmstatusReg) != 0;
+}
+
+/// Get the \c authbusy field of the \c dmstatus register.
+///
+/// \return \c true if the \c authbusy field of \c dmstatus is set, \c false
+///         otherwise.
+template <class DtmT>
+inline bool
+DmiT<DtmT>::Dmstatus::authbusy () const
+{
+  return Authbusy::get (mDmstatusReg) != 0;
+}
+
+/// Get the \c hasresethaltreq field of the \c dmstatus register.
+///
+/// \return \c true if the \c hasresethaltreq field of \c dmstatus is set,
+///         \c false otherwise.
+template <class DtmT>
+inline bool
+DmiT<DtmT>::Dmstatus::hasresethaltreq () const
+{
+  return Hasresethaltreq::get (mDmstatusReg) != 0;
+}
+
+/// Get the \c confstrptrvalid field of the \c dmstatus register.
+///
+/// \return \c true if the \c confstrptrvalid field of \c dmstatus is set,
+///         \c false otherwise.
+template <class DtmT>
+inline bool
+DmiT<DtmT>::Dmstatus::confstrptrvalid () const
+{
+  return Confstrptrvalid::get (mDmstatusReg) != 0;
+}
+
+/// Get the \c version field of the \c dmstatus register.
+///
+/// \return the value in the \c version field of \c dmstatus.
+template <class DtmT>
+inline uint8_t
+DmiT<DtmT>::Dmstatus::version () const
+{
+  return static_cast<uint8_t> (Version::get (mDmstatusReg));
+}
+
+/// \brief Get the \c progbufsize bits of \c abstractcs
+///
+/// \return The value of \c progbufsize
+template <class DtmT>
+inline uint8_t
+DmiT<DtmT>::Abstractcs::progbufsize () const
+{
+  return static_cast<uint8_t> (Progbufsize::get (mAbstractcsReg));
+}
+
+/// \brief Get the \c busy bit of \c abstractcs
+///
+/// \return \c true if the \c busy bit is set, \c false otherwise.
+template <class DtmT>
+inline bool
+DmiT<DtmT>::Abstractcs::busy () const
+{
+  return Busy::get (mAbstractcsReg) != 0;
+}
+
+/// \brief Get the \c cmderr bits of \c abstractcs
+///
+/// \return The value of \c cmderr
+template <class DtmT>
+inline typename DmiT<DtmT>::Abstractcs::CmderrVal
+DmiT<DtmT>::Abstractcs::cmderr () const
+{
+  switch (static_cast<int> (Cmderr::get (mAbstractcsReg)))
+    {
+    case CMDERR_NONE:
+      return CMDERR_NONE;
+    case CMDERR_BUSY:
+      return CMDERR_BUSY;
+    case CMDERR_UNSUPPORTED:
+      return CMDERR_UNSUPPORTED;
+    case CMDERR_EXCEPT:
+      return CMDERR_EXCEPT;
+    case CMDERR_HALT_RESUME:
+      return CMDERR_HALT_RESUME;
+    case CMDERR_BUS:
+      return CMDERR_BUS;
+    case CMDERR_OTHER:
+      return CMDERR_OTHER;
+
+    default:
+      return CMDERR_UNKNOWN;
+    }
+}
+
+/// \brief Clear the \c cmderr bits of \c abstractcs
+///
+/// This means setting all the bits to 1, prior to a write.
+template <class DtmT>
+inline void
+DmiT<DtmT>::Abstractcs::cmderrClear ()
+{
+  mAbstractcsReg |= Cmderr::MASK;
+}
+
+/// \brief Get the \c datacount bits of \c abstractcs
+///
+/// \return The value of \c datacount
+template <class DtmT>
+inline uint8_t
+DmiT<DtmT>::Abstractcs::datacount () const
+{
+  return static_cast<uint8_t> (Datacount::get (mAbstractcsReg));
+}
+
+/// \brief Set the whole of the \c command register.
+///
+/// Usually with a word computed by Dmi::Command::accessReg32.
+///
+/// \param[in] commandVal  The value of \c command to set.
+template <class DtmT>
+inline void
+DmiT<DtmT>::Command::command (const uint32_t commandVal)
+{
+  mCommandReg = commandVal;
+}
+
+/// \brief Set the \c aamvirtual bit for the \c command \c control field.
+///
+/// \param[in] flag  \c true if the bit is to be set, false otherwise.
+template <class DtmT>
+inline void
+DmiT<DtmT>::Command::aamvirtual (bool flag)
+{
+  mCommandReg = Aamvirtual::set (mCommandReg, flag ? 1 : 0);
+}
+
+/// \brief Set the \c postincrement bit for the \c command \c control field.
+///
+/// \param[in] flag  \c true if the bit is to be set, false otherwise.
+template <class DtmT>
+inline void
+DmiT<DtmT>::Command::aapostincrement (const bool flag)
+{
+  mCommandReg = Aapostincrement::set (mCommandReg, flag ? 1 : 0);
+}
+
+/// \brief Set the \c postexec bit for the \c command \c control field.
+///
+/// \param[in] flag  \c true if the bit is to be set, false otherwise.
+template <class DtmT>
+inline void
+DmiT<DtmT>::Command::aapostexec (const bool flag)
+{
+  mCommandReg = Aapostexec::set (mCommandReg, flag ? 1 : 0);
+}
+
+/// \brief Set the \c transfer bit for the \c command \c control field.
+///
+/// \param[in] flag  \c true if the bit is to be set, false otherwise.
+template <class DtmT>
+inline void
+DmiT<DtmT>::Command::aatransfer (const bool flag)
+{
+  mCommandReg = Aatransfer::set (mCommandReg, flag ? 1 : 0);
+}
+
+/// \brief Set the \c write bit for the \c command \c control field.
+///
+/// \param[in] flag  \c true if the bit is to be set, false otherwise.
+template <class DtmT>
+inline void
+DmiT<DtmT>::Command::aawrite (const bool flag)
+{
+  mCommandReg = Aawrite::set (mCommandReg, flag ? 1 : 0);
+}
+
+/// \brief Set the \c regno bits for the \c command \c control field.
+///
+/// \param[in] value  The value to be set.
+template <class DtmT>
+inline void
+DmiT<DtmT>::Command::aaregno (uint16_t val)
+{
+  mCommandReg = Aaregno::set (mCommandReg, val);
+}
+
+/// \brief Set the whole of the \c sbcs register.
+///
+/// Usually with a word computed by Dmi::Sbcs::config.
+///
+/// \param[in] sbcsVal  The value of \c sbcs to set.
+template <class DtmT>
+inline void
+DmiT<DtmT>::Sbcs::sbcs (const uint32_t sbcsVal)
+{
+  mSbcsReg = sbcsVal;
+}
+
+/// \brief Get the \c sbversion bits in \c sbcs.
+///
+/// \return  The value in the \c sbversion bits of \c sbcs.
+template <class DtmT>
+inline uint8_t
+DmiT<DtmT>::Sbcs::sbversion () const
+{
+  return static_cast<uint8_t> (Sbversion::get (mSbcsReg));
+}
+
+/// \brief Get the \c sbbusyerror bit in \c sbcs.
+///
+/// \return  \c true if the \c sbbusyerror bit of \c sbcs is set, \c false
+///          otherwise.
+template <class DtmT>
+inline bool
+DmiT<DtmT>::Sbcs::sbbusyerror () const
+{
+  return Sbbusyerror::get (mSbcsReg) != 0;
+}
+
+/// \brief Clear the \c sbbusyerror bit in \c sbcs.
+///
+/// Writing 1 to this bit clears it.
+template <class DtmT>
+inline void
+DmiT<DtmT>::Sbcs::sbbusyerrorClear ()
+{
+  mSbcsReg |= Sbbusyerror::MASK;
+}
+
+/// \brief Get the \c sbbusy bit in \c sbcs.
+///
+/// \return  \c true if the \c sbbusy bit of \c sbcs is set, \c false
+///          otherwise.
+template <class DtmT>
+inline bool
+DmiT<DtmT>::Sbcs::sbbusy () const
+{
+  return Sbbusy::get (mSbcsReg) != 0;
+}
+
+/// \brief Get the \c sbreadonaddr bit in \c sbcs.
+///
+/// \return  \c true if the \c sbreadonaddr bit of \c sbcs is set, \c false
+///          otherwise.
+template <class DtmT>
+inline bool
+DmiT<DtmT>::Sbcs::sbreadonaddr () const
+{
+  return Sbreadonaddr::get (mSbcsReg) != 0;
+}
+
+/// \brief Set the \c sbreadonaddr bit in \c sbcs.
+///
+/// \param[in] flag  If \c true sets \c sbreadonaddr bit in \c sbcs, otherwise
+///                  clears it.
+template <class DtmT>
+inline void
+DmiT<DtmT>::Sbcs::sbreadonaddr (const bool flag)
+{
+  mSbcsReg = Sbreadonaddr::set (mSbcsReg, flag ? 1 : 0);
+}
+
+/// \brief Get the \c sbautoincrement bit in \c sbcs.
+///
+/// \return  \c true if the \c sbautoincrement bit of \c sbcs is set, \c false
+///          otherwise.
+template <class DtmT>
+inline bool
+DmiT<DtmT>::Sbcs::sbautoincrement () const
+{
+  return Sbautoincrement::get (mSbcsReg) != 0;
+}
+
+/// \brief Set the \c sbautoincrement bit in \c sbcs.
+///
+/// \param[in] flag  If \c true sets \c sbautoincrement bit in \c sbcs,
+///                  otherwise clears it.
+template <class DtmT>
+inline void
+DmiT<DtmT>::Sbcs::sbautoincrement (const bool flag)
+{
+  mSbcsReg = Sbautoincrement::set (mSbcsReg, flag ? 1 : 0);
+}
+
+/// \brief Get the \c sbreadondata bit in \c sbcs.
+///
+/// \return  \c true if the \c sbreadondata bit of \c sbcs is set, \c false
+///          otherwise.
+template <class DtmT>
+inline bool
+DmiT<DtmT>::Sbcs::sbreadondata () const
+{
+  return Sbreadondata::get (mSbcsReg) != 0;
+}
+
+/// \brief Set the \c sbreadondata bit in \c sbcs.
+///
+/// \param[in] flag  If \c true sets \c sbreadondata bit in \c sbcs, otherwise
+///                  clears it.
+template <class DtmT>
+inline void
+DmiT<DtmT>::Sbcs::sbreadondata (const bool flag)
+{
+  mSbcsReg = Sbreadondata::set (mSbcsReg, flag ? 1 : 0);
+}
+
+/// \brief Clear the \c sberror bits in \c sbcs.
+///
+/// Writing 1 to these bits clears the error.
+template <class DtmT>
+inline void
+DmiT<DtmT>::Sbcs::sberrorClear ()
+{
+  mSbcsReg |= Sberror::MASK;
+}
+
+/// \brief Get the \c sbasize bits in \c sbcs.
+///
+/// \return  The value of the \c sbasize bits in \c sbcs.
+template <class DtmT>
+inline uint8_t
+DmiT<DtmT>::Sbcs::sbasize () const
+{
+  return static_cast<uint8_t> (Sbasize::get (mSbcsReg));
+}
+
+/// \brief Get the \c sbaccess128 bit in \c sbcs.
+///
+/// \return  \c true if the \c sbaccess128 bit of \c sbcs is set, \c false
+///          otherwise.
+template <class DtmT>
+inline bool
+DmiT<DtmT>::Sbcs::sbaccess128 () const
+{
+  return Sbaccess128::get (mSbcsReg) != 0;
+}
+
+/// \brief Get the \c sbaccess64 bit in \c sbcs.
+///
+/// \return  \c true if the \c sbaccess64 bit of \c sbcs is set, \c false
+///          otherwise.
+template <class DtmT>
+inline bool
+DmiT<DtmT>::Sbcs::sbaccess64 () const
+{
+  return Sbaccess64::get (mSbcsReg) != 0;
+}
+
+/// \brief Get the \c sbaccess32 bit in \c sbcs.
+///
+/// \return  \c true if the \c sbaccess32 bit of \c sbcs is set, \c false
+///          otherwise.
+template <class DtmT>
+inline bool
+DmiT<DtmT>::Sbcs::sbaccess32 () const
+{
+  return Sbaccess32::get (mSbcsReg) != 0;
+}
+
+/// \brief Get the \c sbaccess16 bit in \c sbcs.
+///
+/// \return  \c true if the \c sbaccess16 bit of \c sbcs is set, \c false
+///          otherwise.
+template <class DtmT>
+inline bool
+DmiT<DtmT>::Sbcs::sbaccess16 () const
+{
+  return Sbaccess16::get (mSbcsReg) != 0;
+}
+
+/// \brief Get the \c sbaccess8 bit in \c sbcs.
+///
+/// \return  \c true if the \c sbaccess8 bit of \c sbcs is set, \c false
+///          otherwise.
+template <class DtmT>
+inline bool
+DmiT<DtmT>::Sbcs::sbaccess8 () const
+{
+  return Sbaccess8::get (mSbcsReg) != 0;
+}
+
+
+/// \brief The Debug Module Interface over a DTM chosen at run time
+typedef DmiT<IDtm> Dmi;
 
 #endif // DMI_H
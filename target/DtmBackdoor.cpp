@@ -0,0 +1,219 @@
+// Definition of a class to represent a backdoor Debug Transport Module
+//
+// This file is part of the Embecosm Debug Server target for CORE-V MCU
+//
+// Copyright (C) 2021 Embecosm Limited
+// SPDX-License-Identifier: Apache-2.0
+
+#include <iostream>
+
+#include "DtmBackdoor.h"
+
+using std::cerr;
+using std::endl;
+
+/// \brief Constructor for the backdoor DTM.
+///
+/// \param[in] mcu  The Verilator model of the MCU, which may be shared with
+///                 a JTAG DTM.
+DtmBackdoor::DtmBackdoor (std::shared_ptr<VSim> mcu)
+    : mMcu (mcu), mDmiOps (0)
+{
+}
+
+/// \brief Destructor for the backdoor DTM.
+///
+/// We do not own the model, but release our share of it explicitly as good
+/// practice.
+DtmBackdoor::~DtmBackdoor ()
+{
+  mMcu.reset ();
+}
+
+/// \brief Take the system through reset.
+///
+/// If the model is still in reset (because this DTM was used from the start),
+/// we clock it out of reset.  Otherwise we just idle the DMI ports.
+///
+/// \return \c true if we completed reset, \c false if the simulation
+///         terminated during reset or the backdoor is not available in this
+///         model.
+bool
+DtmBackdoor::reset ()
+{
+  if (!VSim::haveDmiBackdoor ())
+    {
+      cerr << "Warning: DMI backdoor not available in this model" << endl;
+      return false;
+    }
+
+  while (mMcu->inReset ())
+    {
+      if (mMcu->allDone ())
+        return false;
+
+      mMcu->tms (0U); // Keep the JTAG TAP out of the way
+      mMcu->eval ();
+      mMcu->advanceHalfPeriod ();
+    }
+
+  mMcu->dmiReqValid (false);
+  mMcu->dmiRespReady (false);
+  mMcu->eval ();
+  return true;
+}
+
+/// \brief Read a DMI register.
+///
+/// \param[in] address  DMI address from which to read.
+/// \return Data read.
+uint32_t
+DtmBackdoor::dmiRead (uint64_t address)
+{
+  mDmiOps++;
+  uint64_t resp = transact (OP_READ, address, 0);
+  return static_cast<uint32_t> ((resp >> 2) & 0xffffffffULL);
+}
+
+/// \brief Write a DMI register.
+///
+/// \param[in] address  DMI address to which to write.
+/// \param[in] wdata    Data to write.
+void
+DtmBackdoor::dmiWrite (uint64_t address, uint32_t wdata)
+{
+  mDmiOps++;
+  transact (OP_WRITE, address, wdata);
+}
+
+/// \brief Provide access to simulation time
+///
+/// \return The current simulation time in nanoseconds.
+uint64_t
+DtmBackdoor::simTimeNs () const
+{
+  return mMcu->simTimeNs ();
+}
+
+/// \brief Let the MCU run with no DMI traffic.
+///
+/// \param[in] cycles  The number of main clock cycles to run.
+/// \return \c true if we ran all the cycles, \c false if the simulation
+///         finished first.
+bool
+DtmBackdoor::idle (uint64_t cycles)
+{
+  return mMcu->runCycles (cycles) == cycles;
+}
+
+/// \brief Has the simulation finished?
+///
+/// \return \c true if the simulation has finished, \c false otherwise.
+bool
+DtmBackdoor::simDone () const
+{
+  return mMcu->allDone ();
+}
+
+/// \brief Report transport statistics.
+///
+/// \param[in] stream  The stream on which to report.
+void
+DtmBackdoor::printStats (std::ostream &stream) const
+{
+  stream << "Backdoor DTM: " << mDmiOps << " DMI ops" << endl;
+}
+
+/// \brief Clear transport statistics.
+void
+DtmBackdoor::clearStats ()
+{
+  mDmiOps = 0;
+}
+
+/// \brief Number of DMI transactions since statistics were cleared.
+///
+/// \return The number of DMI transactions.
+uint64_t
+DtmBackdoor::dmiOpCount () const
+{
+  return mDmiOps;
+}
+
+/// \brief Carry out a single DMI transaction via the backdoor.
+///
+/// Present the request with valid high until the debug module signals ready,
+/// then wait with response ready high until the response is valid.  The
+/// debug module's DMI ports cannot report a busy status, but we treat it as
+/// the JTAG DTM does, by retrying.
+///
+/// \param[in] op       The operation to perform.
+/// \param[in] address  DMI address to access.
+/// \param[in] wdata    Data to write (ignored for reads).
+/// \return The response, with data in bits [33:2] and status in bits [1:0].
+uint64_t
+DtmBackdoor::transact (const Op op, const uint64_t address,
+                       const uint32_t wdata)
+{
+  uint64_t resp;
+
+  do
+    {
+      // Request phase
+      mMcu->dmiReq (static_cast<uint8_t> (op), address, wdata);
+      mMcu->dmiReqValid (true);
+      mMcu->eval ();
+
+      for (uint32_t i = 0; !mMcu->dmiReqReady (); i++)
+        if ((i >= MAX_WAIT_CYCLES) || mMcu->allDone ())
+          {
+            cerr << "Warning: DMI backdoor request not accepted" << endl;
+            mMcu->dmiReqValid (false);
+            return 0;
+          }
+        else
+          clockCycle ();
+
+      clockCycle (); // Request accepted on this edge
+      mMcu->dmiReqValid (false);
+
+      // Response phase
+      mMcu->dmiRespReady (true);
+      mMcu->eval ();
+
+      for (uint32_t i = 0; !mMcu->dmiRespValid (); i++)
+        if ((i >= MAX_WAIT_CYCLES) || mMcu->allDone ())
+          {
+            cerr << "Warning: DMI backdoor response not received" << endl;
+            mMcu->dmiRespReady (false);
+            return 0;
+          }
+        else
+          clockCycle ();
+
+      resp = mMcu->dmiResp ();
+      clockCycle (); // Response consumed on this edge
+      mMcu->dmiRespReady (false);
+      mMcu->eval ();
+
+      if ((resp & 0x3ULL) == static_cast<uint64_t> (RES_BUSY))
+        cerr << "Warning DMI backdoor retry requested" << endl;
+    }
+  while ((resp & 0x3ULL) == static_cast<uint64_t> (RES_BUSY));
+
+  if ((resp & 0x3ULL) != static_cast<uint64_t> (RES_OK))
+    cerr << "Warning: unknown DMI backdoor result " << (resp & 0x3ULL)
+         << ": ignored" << endl;
+
+  return resp;
+}
+
+/// \brief Advance the model by one main clock cycle.
+void
+DtmBackdoor::clockCycle ()
+{
+  mMcu->eval ();
+  mMcu->advanceHalfPeriod ();
+  mMcu->eval ();
+  mMcu->advanceHalfPeriod ();
+}
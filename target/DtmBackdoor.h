@@ -0,0 +1,76 @@
+// Declaration of a class to represent a backdoor Debug Transport Module
+//
+// This file is part of the Embecosm Debug Server target for CORE-V MCU
+//
+// Copyright (C) 2021 Embecosm Limited
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef DTM_BACKDOOR_H
+#define DTM_BACKDOOR_H
+
+#include <memory>
+
+#include "IDtm.h"
+#include "VSim.h"
+
+/// \brief A Debug Transport Module which bypasses the JTAG TAP
+///
+/// DMI requests are driven directly onto the debug module's DMI
+/// request/response ports inside the Verilator model, so an access costs a
+/// few main clock cycles, rather than a full JTAG scan.  This sacrifices
+/// JTAG fidelity for speed.
+class DtmBackdoor final : public IDtm
+{
+public:
+  // Constructor and destructor
+  explicit DtmBackdoor (std::shared_ptr<VSim> mcu);
+  DtmBackdoor (const DtmBackdoor &) = delete;
+  ~DtmBackdoor ();
+
+  // API
+  bool reset () override;
+  virtual uint32_t dmiRead (uint64_t address) override;
+  virtual void dmiWrite (uint64_t address, uint32_t wdata) override;
+  virtual uint64_t simTimeNs () const override;
+  virtual bool idle (uint64_t cycles) override;
+  virtual bool simDone () const override;
+  virtual void printStats (std::ostream &stream) const override;
+  virtual void clearStats () override;
+  virtual uint64_t dmiOpCount () const override;
+
+  // Delete the copy assignment operator
+  DtmBackdoor &operator= (const DtmBackdoor &) = delete;
+
+private:
+  /// \brief Enumeration of DMI request op field
+  enum Op
+  {
+    OP_NOP = 0,
+    OP_READ = 1,
+    OP_WRITE = 2,
+  };
+
+  /// \brief Enumeration of DMI response op field
+  enum Res
+  {
+    RES_OK = 0,
+    RES_ERROR = 2,
+    RES_BUSY = 3,
+  };
+
+  /// \brief Maximum main clock cycles to wait for a handshake
+  static const uint32_t MAX_WAIT_CYCLES = 1000;
+
+  /// \brief The Verilator simulation of the MCU, shared with other DTMs
+  std::shared_ptr<VSim> mMcu;
+
+  /// \brief Number of DMI transactions since statistics were cleared
+  uint64_t mDmiOps;
+
+  // Helper methods
+  uint64_t transact (const Op op, const uint64_t address,
+                     const uint32_t wdata);
+  void clockCycle ();
+};
+
+#endif // DTM_BACKDOOR_H
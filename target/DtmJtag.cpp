@@ -31,11 +31,30 @@ using std::setw;
 /// \param[in] vcdFile        \see VSim::VSim
 DtmJtag::DtmJtag (const vluint64_t clkPeriodNs, const vluint64_t simTimeNs,
                   const char *vcdFile)
-    : mDmiWidth (42U)
+    : mDmiWidth (42U), mDmiOps (0), mIdcode (0), mDtmcs (0),
+      mPostedWrites (false), mPostedFailed (false), mPostedFail (0),
+      mPostedCount (0), mPostedReplays (0), mLastClass (CLASS_REG),
+      mOpPending (false), mDmiBusy (false)
 {
+  rtiReset (1);
   mTap.reset (new Tap (clkPeriodNs, simTimeNs, vcdFile));
 }
 
+/// \brief Constructor for the JTAG DTM using an existing MCU model.
+///
+/// Used when the Verilator model is shared with another DTM.
+///
+/// \param[in] mcu  The Verilator model of the MCU.
+DtmJtag::DtmJtag (std::shared_ptr<VSim> mcu)
+    : mDmiWidth (42U), mDmiOps (0), mIdcode (0), mDtmcs (0),
+      mPostedWrites (false), mPostedFailed (false), mPostedFail (0),
+      mPostedCount (0), mPostedReplays (0), mLastClass (CLASS_REG),
+      mOpPending (false), mDmiBusy (false)
+{
+  rtiReset (1);
+  mTap.reset (new Tap (mcu));
+}
+
 /// \brief Destructor for the JTAG DTM.
 ///
 /// While the JTAG TAP should be cleaned up automatically, we do this
@@ -49,7 +68,8 @@ DtmJtag::~DtmJtag ()
 ///
 /// We need to reset the TAP and underlying processor model.  We then read
 /// DTMCS in order to find out the count of cycles to spend in Run-Test/Idle
-/// when accessing the same register more than once.
+/// when accessing the same register more than once.  This is the starting
+/// point for the count learned for each class of operation.
 ///
 /// \todo Do we need to explicitly hard reset the DM interface?
 ///
@@ -58,15 +78,20 @@ DtmJtag::~DtmJtag ()
 bool
 DtmJtag::reset ()
 {
+  mPosted.clear ();
+  mPostedFailed = false;
+
   if (!mTap->reset ())
     return false; // Didn't complete reset
 
   // Read the DTM JTAG registers
   uint32_t idcode = readIdcode ();
   uint32_t dtmcs = readDtmcs ();
+  mIdcode = idcode;
+  mDtmcs = dtmcs;
 
   // Update features of JTAG interface
-  mTap->rtiCount (static_cast<uint8_t> ((dtmcs >> 12) & 0x7));
+  rtiReset (static_cast<uint8_t> ((dtmcs >> 12) & 0x7));
   uint8_t addrSize = static_cast<uint8_t> ((dtmcs >> 4) & 0x3f);
   mDmiWidth = 34U + addrSize;
   mDmiAddrMask = ~((~0ULL) << addrSize);
@@ -89,35 +114,40 @@ DtmJtag::reset ()
   cout << ", addr mask = " << Utils::hexStr (mDmiAddrMask, 8) << "]" << endl;
 
   // Reset the DMI
-  writeDtmcs (0x10000); // dmireset
-  return true;          // Reset completed.
+  dmiReset ();
+  return true; // Reset completed.
 }
 
 /// \brief Read a DMI register.
 ///
+/// If there are posted writes, the scan issuing the read collects the status
+/// of the last of them, so they are confirmed at no extra cost.  If any
+/// failed, the DMI will also have ignored the read, so it is reissued once
+/// the failed writes have been.
+///
 /// \param[in] address  DMI address from which to read.
 /// \return Data read.
 uint32_t
 DtmJtag::dmiRead (uint64_t address)
 {
   uint64_t reg = static_cast<uint64_t> (OP_READ);
+  mDmiOps++;
 
   reg |= (address & mDmiAddrMask) << 34;
-  mTap->writeReg (static_cast<uint8_t> (DMIACCESS), reg, mDmiWidth);
+  reg = dmiAccess (reg);
 
-  while (true)
+  if (!mPosted.empty ())
     {
-      reg = mTap->readReg (static_cast<uint8_t> (DMIACCESS), mDmiWidth);
-      if ((reg & 0x3ULL) == static_cast<uint64_t> (RES_RETRY))
-        {
-          cerr << "Warning dmiRead retry requested" << endl;
-          writeDtmcs (0x10000); // dmireset
-        }
-      else
-        break;
+      postedStatus (reg);
+      if (!postedConfirm ())
+        return dmiRead (address);
     }
-  while ((reg & 0x3ULL) == static_cast<uint64_t> (RES_RETRY))
-    ;
+
+  // If the read was still running it still completes, so just collect its
+  // result again.  Its class now idles for longer.
+  reg = dmiAccess (static_cast<uint64_t> (OP_NOP));
+  if ((reg & 0x3ULL) == static_cast<uint64_t> (RES_RETRY))
+    reg = dmiRecover ();
 
   if ((reg & 0x3ULL) != static_cast<uint64_t> (RES_OK))
     cerr << "Warning: unknown JTAG read result " << (reg & 0x3ULL)
@@ -128,34 +158,123 @@ DtmJtag::dmiRead (uint64_t address)
 
 /// \brief Write a DMI register.
 ///
+/// If writes are posted, the write is just issued.  Its status is shifted
+/// out by the next scan, and is checked at the next read or sync.  Otherwise
+/// a further scan confirms the write at once.
+///
 /// \param[in] address  DMI address from which to read.
 /// \param[in] wdata    Data to write.
 void
 DtmJtag::dmiWrite (uint64_t address, uint32_t wdata)
 {
   uint64_t reg = static_cast<uint64_t> (OP_WRITE);
+  mDmiOps++;
 
   reg |= static_cast<uint64_t> (wdata) << 2;
   reg |= (address & mDmiAddrMask) << 34;
-  mTap->writeReg (static_cast<uint8_t> (DMIACCESS), reg, mDmiWidth);
+  reg = dmiAccess (reg);
 
-  while (true)
+  if (!mPosted.empty ())
+    postedStatus (reg);
+
+  if (mPostedWrites)
     {
-      reg = mTap->readReg (static_cast<uint8_t> (DMIACCESS), mDmiWidth);
-      if ((reg & 0x3ULL) == static_cast<uint64_t> (RES_RETRY))
-        {
-          cerr << "Warning dmiWrite retry requested" << endl;
-          writeDtmcs (0x10000); // dmireset
-        }
-      else
-        break;
+      mPosted.push_back ({ DmiOp::WRITE, address, wdata, nullptr });
+      mPostedCount++;
+
+      // Once a write has been ignored, so will everything after it be.
+      if (mPostedFailed || (mPosted.size () >= POSTED_MAX))
+        sync ();
+      return;
     }
 
+  // If the write was still running it still completes, so just collect its
+  // status again.  Its class now idles for longer.
+  reg = dmiAccess (static_cast<uint64_t> (OP_NOP));
+  if ((reg & 0x3ULL) == static_cast<uint64_t> (RES_RETRY))
+    reg = dmiRecover ();
+
   if ((reg & 0x3ULL) != static_cast<uint64_t> (RES_OK))
     cerr << "Warning: unknown JTAG write result " << (reg & 0x3ULL)
          << ": ignored" << endl;
 }
 
+/// \brief Carry out a sequence of DMI transactions, pipelining the scans.
+///
+/// Each DMIACCESS scan shifts in a new operation and simultaneously shifts
+/// out the result of the previous one.  So rather than following every
+/// operation with a separate scan just to collect its status, the scan
+/// issuing operation N+1 collects the result of operation N.  A final NOP
+/// scan collects the result of the last operation.  A batch of N operations
+/// thus costs N + 1 scans rather than 2N.
+///
+/// If a scan reports RES_RETRY, the operation whose result it was collecting
+/// was still running.  That operation still completes, but the one shifted
+/// in by the scan was ignored, as is everything after it until the DMI is
+/// reset.  So we reset the DMI, collect the result of the running operation
+/// and carry on from the operation which was ignored.  Reissuing the running
+/// operation instead would repeat its side effects, such as an abstract
+/// command executed by \c data0 or a System Bus read started by \c sbdata0.
+///
+/// Idles are carried out between scans, with the TAP left where it is.  The
+/// result of the operation before an idle is collected by the scan after it.
+///
+/// \param[in,out] ops  The transactions to carry out.  Read results are
+///                     stored via each transaction's \c rdata pointer.
+void
+DtmJtag::dmiBatch (std::vector<DmiOp> &ops)
+{
+  sync ();
+
+  std::size_t next = 0; // Next operation to issue
+  std::size_t prev = 0; // Operation whose result is still to collect
+  bool pending = false; // Whether there is such an operation
+
+  while ((next < ops.size ()) || pending)
+    {
+      if ((next < ops.size ()) && (ops[next].type == DmiOp::IDLE))
+        {
+          static_cast<void> (mTap->idle (ops[next].wdata));
+          next++;
+          continue;
+        }
+
+      uint64_t wreg = (next < ops.size ()) ? dmiReg (ops[next])
+                                           : static_cast<uint64_t> (OP_NOP);
+      uint64_t reg = dmiAccess (wreg);
+
+      if (pending)
+        {
+          // If the previous operation was still running, the one just
+          // shifted in was ignored, so must be issued again.
+          bool ignored = (reg & 0x3ULL) == static_cast<uint64_t> (RES_RETRY);
+          if (ignored)
+            reg = dmiRecover ();
+
+          if ((reg & 0x3ULL) != static_cast<uint64_t> (RES_OK))
+            cerr << "Warning: unknown JTAG batch result " << (reg & 0x3ULL)
+                 << ": ignored" << endl;
+
+          if (ops[prev].type == DmiOp::READ)
+            *ops[prev].rdata
+                = static_cast<uint32_t> ((reg >> 2) & 0xffffffffULL);
+
+          if (ignored)
+            {
+              pending = false;
+              continue;
+            }
+        }
+
+      pending = next < ops.size ();
+      if (pending)
+        {
+          mDmiOps++;
+          prev = next++;
+        }
+    }
+}
+
 /// \brief Provide access to simulation time
 ///
 /// \return The current simulation time in nanoseconds.
@@ -165,6 +284,350 @@ DtmJtag::simTimeNs () const
   return mTap->simTimeNs ();
 }
 
+/// \brief Let the MCU run with no DMI traffic.
+///
+/// \param[in] cycles  The number of main clock cycles to run.
+/// \return \c true if we ran all the cycles, \c false if the simulation
+///         finished first.
+bool
+DtmJtag::idle (uint64_t cycles)
+{
+  return mTap->idle (cycles);
+}
+
+/// \brief Has the simulation finished?
+///
+/// \return \c true if the simulation has finished, \c false otherwise.
+bool
+DtmJtag::simDone () const
+{
+  return mTap->simDone ();
+}
+
+/// \brief Report transport statistics.
+///
+/// In particular the TCK cycles saved per DMI operation by tracking the IR
+/// and only idling in Run-Test/Idle when the DTM requires it.
+///
+/// \param[in] stream  The stream on which to report.
+void
+DtmJtag::printStats (std::ostream &stream) const
+{
+  double ops = (mDmiOps == 0) ? 1.0 : static_cast<double> (mDmiOps);
+
+  stream << "JTAG DTM: " << mDmiOps << " DMI ops, " << mTap->scanCount ()
+         << " scans, " << mTap->tckCycles () << " TCK cycles" << endl;
+  stream << "  TCK cycles per DMI op: "
+         << static_cast<double> (mTap->tckCycles ()) / ops << endl;
+  stream << "  TCK cycles saved per DMI op: "
+         << static_cast<double> (mTap->tckCyclesSaved ()) / ops << endl;
+  stream << "  Posted writes: " << mPostedCount << ", replayed "
+         << mPostedReplays << endl;
+
+  static const char *className[NUM_CLASSES]
+      = { "register", "abstract", "sysbus" };
+  for (std::size_t c = 0; c < NUM_CLASSES; c++)
+    {
+      const RtiState &r = mRti[c];
+      double rOps = (r.ops == 0) ? 1.0 : static_cast<double> (r.ops);
+
+      stream << "  Idle " << setw (8) << std::left << className[c]
+             << std::right << ": " << static_cast<uint32_t> (r.count)
+             << " cycles, " << r.retries << " retries in " << r.ops
+             << " ops (" << (100.0 * static_cast<double> (r.retries) / rOps)
+             << "%)" << endl;
+    }
+}
+
+/// \brief Clear transport statistics.
+void
+DtmJtag::clearStats ()
+{
+  mDmiOps = 0;
+  mPostedCount = 0;
+  mPostedReplays = 0;
+  for (auto &r : mRti)
+    {
+      r.ops = 0;
+      r.retries = 0;
+    }
+  mTap->clearStats ();
+}
+
+/// \brief Number of DMI transactions since statistics were cleared.
+///
+/// \return The number of DMI transactions.
+uint64_t
+DtmJtag::dmiOpCount () const
+{
+  return mDmiOps;
+}
+
+/// \brief The JTAG IDCODE found when the DTM was last reset.
+///
+/// \return The IDCODE.
+uint32_t
+DtmJtag::idcode () const
+{
+  return mIdcode;
+}
+
+/// \brief The \c dtmcs register found when the DTM was last reset.
+///
+/// \return The value of \c dtmcs.
+uint32_t
+DtmJtag::dtmcs () const
+{
+  return mDtmcs;
+}
+
+/// \brief Control whether DMI writes are posted.
+///
+/// Any writes already posted are confirmed first.
+///
+/// \param[in] enable  If \c true post writes, otherwise confirm each one.
+void
+DtmJtag::postedWrites (const bool enable)
+{
+  sync ();
+  mPostedWrites = enable;
+}
+
+/// \brief Whether DMI writes are posted.
+///
+/// \return \c true if writes are posted, \c false otherwise.
+bool
+DtmJtag::postedWrites () const
+{
+  return mPostedWrites;
+}
+
+/// \brief Confirm any posted writes, reissuing any which failed.
+///
+/// A NOP scan collects the status of the last posted write.
+void
+DtmJtag::sync ()
+{
+  while (!mPosted.empty ())
+    {
+      postedStatus (dmiAccess (static_cast<uint64_t> (OP_NOP)));
+      static_cast<void> (postedConfirm ());
+    }
+}
+
+/// \brief Note the status of the last posted write.
+///
+/// A failure means the operation shifted in by the same scan was ignored, as
+/// will be everything after it until the DMI is reset.  That operation is
+/// the next to be added to \c mPosted, if it is a posted write.
+///
+/// \param[in] reg  The value shifted out by the scan after the write.
+void
+DtmJtag::postedStatus (const uint64_t reg)
+{
+  if (mPostedFailed || ((reg & 0x3ULL) == static_cast<uint64_t> (RES_OK)))
+    return;
+
+  if ((reg & 0x3ULL) != static_cast<uint64_t> (RES_RETRY))
+    cerr << "Warning: unknown JTAG posted write result " << (reg & 0x3ULL)
+         << ": ignored" << endl;
+
+  mPostedFailed = true;
+  mPostedFail = mPosted.size ();
+}
+
+/// \brief Finish with the posted writes whose status has been collected.
+///
+/// A failure is sticky in \c dtmcs.dmistat, and the DMI ignores everything
+/// after it until reset.  So on failure we reset the DMI, collect the result
+/// of the write which was still running, and reissue the writes from the
+/// first which was ignored, confirming each.
+///
+/// \return \c true if no operation was ignored, \c false if the DMI
+///         ignored an operation, which the caller must reissue if it was not
+///         a posted write.
+bool
+DtmJtag::postedConfirm ()
+{
+  if (!mPostedFailed)
+    {
+      mPosted.clear ();
+      return true;
+    }
+
+  static_cast<void> (dmiRecover ());
+
+  std::vector<DmiOp> replay (mPosted.begin () + mPostedFail, mPosted.end ());
+  mPosted.clear ();
+  mPostedFailed = false;
+  mPostedReplays += replay.size ();
+
+  bool posted = mPostedWrites;
+  mPostedWrites = false;
+  for (auto &op : replay)
+    dmiWrite (op.address, op.wdata);
+  mPostedWrites = posted;
+  return false;
+}
+
+/// \brief Build the DMIACCESS register value for a transaction.
+///
+/// \param[in] op  The transaction.
+/// \return The value to shift into DMIACCESS to issue \p op.
+uint64_t
+DtmJtag::dmiReg (const DmiOp &op) const
+{
+  uint64_t reg = (op.address & mDmiAddrMask) << 34;
+
+  if (op.type == DmiOp::WRITE)
+    reg |= (static_cast<uint64_t> (op.wdata) << 2)
+           | static_cast<uint64_t> (OP_WRITE);
+  else
+    reg |= static_cast<uint64_t> (OP_READ);
+
+  return reg;
+}
+
+/// \brief Scan the DMIACCESS register.
+///
+/// The usual DMI width of 42 bits (7 address bits) uses a scan specialized
+/// for that length.
+///
+/// The time spent in Run-Test/Idle before the scan is that learned for the
+/// class of the operation whose result the scan collects, and the result
+/// is used to adjust it.
+///
+/// \param[in] wreg  The value to shift in.
+/// \return The value shifted out.
+uint64_t
+DtmJtag::dmiAccess (const uint64_t wreg)
+{
+  const OpClass collect = mLastClass;
+  const bool pending = mOpPending;
+  uint64_t reg;
+
+  mTap->rtiCount (mRti[collect].count);
+  if (mDmiWidth == 42U)
+    reg = mTap->accessReg<42> (static_cast<uint8_t> (DMIACCESS), wreg);
+  else
+    reg = mTap->accessReg (static_cast<uint8_t> (DMIACCESS), wreg, mDmiWidth);
+
+  if (pending)
+    rtiResult (collect, reg);
+
+  mOpPending = (wreg & 0x3ULL) != static_cast<uint64_t> (OP_NOP);
+  if (mOpPending)
+    mLastClass = opClass ((wreg >> 34) & mDmiAddrMask);
+
+  return reg;
+}
+
+/// \brief The class of a DMI operation
+///
+/// Abstract commands and System Bus accesses may keep the debug module busy
+/// for longer than plain register accesses, so need more time in
+/// Run-Test/Idle before their results are collected.
+///
+/// \param[in] address  The DMI address of the operation.
+/// \return The class of the operation.
+DtmJtag::OpClass
+DtmJtag::opClass (const uint64_t address) const
+{
+  if (((address >= 0x04) && (address <= 0x0f))     // data0-11
+      || ((address >= 0x16) && (address <= 0x18))  // abstractcs, command,
+                                                   // abstractauto
+      || ((address >= 0x20) && (address <= 0x2f))) // progbuf0-15
+    return CLASS_ABSTRACT;
+  else if ((address >= 0x37) && (address <= 0x3f)) // sbaddress3, sbcs,
+                                                    // sbaddress0-2, sbdata0-3
+    return CLASS_SYSBUS;
+  else
+    return CLASS_REG;
+}
+
+/// \brief Start learning Run-Test/Idle counts afresh.
+///
+/// \param[in] count  The initial count for every class.
+void
+DtmJtag::rtiReset (const uint8_t count)
+{
+  for (auto &r : mRti)
+    {
+      r.count = count;
+      if (r.count > RTI_MAX)
+        r.count = RTI_MAX;
+      r.okRun = 0;
+      r.ops = 0;
+      r.retries = 0;
+    }
+}
+
+/// \brief Adjust the Run-Test/Idle count for a class given a result.
+///
+/// A retry means the result was collected before the operation completed,
+/// so the count is raised at once.  After a run of results with no retry,
+/// we probe one cycle lower.
+///
+/// \param[in] c    The class of the operation whose result was collected.
+/// \param[in] reg  The value shifted out, holding the result.
+void
+DtmJtag::rtiResult (const OpClass c, const uint64_t reg)
+{
+  RtiState &r = mRti[c];
+  bool retry = (reg & 0x3ULL) == static_cast<uint64_t> (RES_RETRY);
+
+  if (retry && mDmiBusy)
+    return; // Sticky from an earlier retry
+
+  r.ops++;
+  if (retry)
+    {
+      mDmiBusy = true;
+      r.retries++;
+      r.okRun = 0;
+      if (r.count < RTI_MAX)
+        r.count++;
+    }
+  else if ((r.count > 0) && (++r.okRun >= RTI_PROBE_OPS))
+    {
+      r.count--;
+      r.okRun = 0;
+    }
+}
+
+/// \brief Reset the DMI, clearing any sticky error.
+void
+DtmJtag::dmiReset ()
+{
+  writeDtmcs (0x10000); // dmireset
+  mOpPending = false;
+  mDmiBusy = false;
+}
+
+/// \brief Collect the result of an operation which was still running.
+///
+/// Used when a scan reports RES_RETRY.  The operation it was collecting the
+/// result of still completes, so we reset the DMI and collect the result
+/// with a NOP scan, repeating this while the operation is still running.
+///
+/// \return The value shifted out by the NOP scan which collected the
+///         result.
+uint64_t
+DtmJtag::dmiRecover ()
+{
+  uint64_t reg;
+
+  do
+    {
+      dmiReset ();
+      mOpPending = true; // The result is still to collect
+      reg = dmiAccess (static_cast<uint64_t> (OP_NOP));
+    }
+  while ((reg & 0x3ULL) == static_cast<uint64_t> (RES_RETRY));
+
+  return reg;
+}
+
 /// \brief Read the IDCODE register.
 ///
 /// This identifies the target, and is a simple read of a 32-bit register.
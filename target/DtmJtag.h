@@ -14,12 +14,13 @@
 /// \brief Abstract class for a Debug Transport Module
 ///
 /// This must be subclassed by an actual implementation such as JTAG or USB.
-class DtmJtag : public IDtm
+class DtmJtag final : public IDtm
 {
 public:
   // Constructor and destructor
   DtmJtag (const uint64_t clkPeriodNs, const uint64_t simTimeNs,
            const char *vcdFile);
+  explicit DtmJtag (std::shared_ptr<VSim> mcu);
   DtmJtag (const DtmJtag &) = delete;
   ~DtmJtag ();
 
@@ -27,7 +28,18 @@ public:
   bool reset () override;
   virtual uint32_t dmiRead (uint64_t address) override;
   virtual void dmiWrite (uint64_t address, uint32_t wdata) override;
+  virtual void dmiBatch (std::vector<DmiOp> &ops) override;
   virtual uint64_t simTimeNs () const override;
+  virtual bool idle (uint64_t cycles) override;
+  virtual bool simDone () const override;
+  virtual void printStats (std::ostream &stream) const override;
+  virtual void clearStats () override;
+  virtual uint64_t dmiOpCount () const override;
+  virtual uint32_t idcode () const override;
+  virtual uint32_t dtmcs () const override;
+  virtual void postedWrites (const bool enable) override;
+  virtual bool postedWrites () const override;
+  virtual void sync () override;
 
   // Delete the copy assignment operator
   DtmJtag &operator= (const DtmJtag &) = delete;
@@ -63,6 +75,33 @@ private:
     RES_RETRY = 3,
   };
 
+  /// \brief Classes of DMI operation, each with its own Run-Test/Idle count
+  enum OpClass
+  {
+    CLASS_REG = 0,      ///< Plain debug module registers
+    CLASS_ABSTRACT = 1, ///< Abstract command and program buffer registers
+    CLASS_SYSBUS = 2,   ///< System Bus registers
+    NUM_CLASSES = 3,
+  };
+
+  /// \brief Learned Run-Test/Idle count and retry history for a class
+  struct RtiState
+  {
+    uint8_t count;    ///< Cycles in Run-Test/Idle before collecting a result
+    uint32_t okRun;   ///< Results since the count last changed
+    uint64_t ops;     ///< Results since statistics were cleared
+    uint64_t retries; ///< Retries since statistics were cleared
+  };
+
+  /// \brief Largest Run-Test/Idle count we will learn
+  static const uint8_t RTI_MAX = 32;
+
+  /// \brief Results without a retry before probing a lower count
+  static const uint32_t RTI_PROBE_OPS = 256;
+
+  /// \brief Most writes to post before confirming them with a sync
+  static const std::size_t POSTED_MAX = 64;
+
   /// \brief the JTAG Tap associated with this DTM
   std::unique_ptr<Tap> mTap;
 
@@ -78,10 +117,63 @@ private:
   /// smaller.
   uint64_t mDmiAddrMask;
 
+  /// \brief Number of DMI operations carried out
+  uint64_t mDmiOps;
+
+  /// \brief The IDCODE read at the last reset
+  uint32_t mIdcode;
+
+  /// \brief The \c dtmcs register read at the last reset
+  uint32_t mDtmcs;
+
+  /// \brief Whether to post DMI writes
+  bool mPostedWrites;
+
+  /// \brief Posted writes whose status is not yet known, in order
+  std::vector<DmiOp> mPosted;
+
+  /// \brief Whether the DMI has ignored any posted write
+  bool mPostedFailed;
+
+  /// \brief Index in \c mPosted of the first write the DMI ignored
+  ///
+  /// Only meaningful if \c mPostedFailed is set.  Equal to the size of
+  /// \c mPosted if only the operation after the posted writes was ignored.
+  std::size_t mPostedFail;
+
+  /// \brief Number of DMI writes posted
+  uint64_t mPostedCount;
+
+  /// \brief Number of posted writes reissued after a failure
+  uint64_t mPostedReplays;
+
+  /// \brief Run-Test/Idle state for each class of operation
+  RtiState mRti[NUM_CLASSES];
+
+  /// \brief Class of the last operation issued
+  OpClass mLastClass;
+
+  /// \brief Whether the next scan collects the result of an operation
+  bool mOpPending;
+
+  /// \brief Whether a retry has been seen since the last \c dmireset
+  ///
+  /// The retry status is sticky, so only the first is counted.
+  bool mDmiBusy;
+
   // Helper methods
+  uint64_t dmiReg (const DmiOp &op) const;
+  uint64_t dmiAccess (const uint64_t wreg);
   uint32_t readIdcode ();
   uint32_t readDtmcs ();
   void writeDtmcs (const uint32_t val);
+  void postedStatus (const uint64_t reg);
+  OpClass opClass (const uint64_t address) const;
+  void rtiReset (const uint8_t count);
+  void rtiResult (const OpClass c, const uint64_t reg);
+  void dmiReset ();
+  uint64_t dmiRecover ();
+  bool postedConfirm ();
 };
 
 #endif // DTM_JTAG_H
@@ -0,0 +1,98 @@
+// Declaration of a class to represent a mock Debug Transport Module
+//
+// This file is part of the Embecosm Debug Server target for CORE-V MCU
+//
+// Copyright (C) 2021 Embecosm Limited
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef DTM_MOCK_H
+#define DTM_MOCK_H
+
+#include "IDtm.h"
+
+/// \brief A Debug Transport Module with no debug module behind it
+///
+/// Each DMI register simply holds the last value written.  There is no
+/// simulation, so timing accesses through this measures just the cost of
+/// the software path down to the DTM.  Everything is defined here, so when
+/// used as its concrete type every access can be inlined.
+class DtmMock final : public IDtm
+{
+public:
+  // Constructor and destructor
+  DtmMock () : mDmiOps (0)
+  {
+    for (std::size_t i = 0; i < NUM_REGS; i++)
+      mRegs[i] = 0;
+  }
+
+  DtmMock (const DtmMock &) = delete;
+  ~DtmMock () = default;
+
+  // API
+  bool
+  reset () override
+  {
+    return true;
+  }
+
+  uint32_t
+  dmiRead (uint64_t address) override
+  {
+    mDmiOps++;
+    return mRegs[address & (NUM_REGS - 1)];
+  }
+
+  void
+  dmiWrite (uint64_t address, uint32_t wdata) override
+  {
+    mDmiOps++;
+    mRegs[address & (NUM_REGS - 1)] = wdata;
+  }
+
+  uint64_t
+  simTimeNs () const override
+  {
+    return 0;
+  }
+
+  bool
+  idle (uint64_t cycles) override
+  {
+    static_cast<void> (cycles);
+    return true;
+  }
+
+  bool
+  simDone () const override
+  {
+    return false;
+  }
+
+  void
+  clearStats () override
+  {
+    mDmiOps = 0;
+  }
+
+  uint64_t
+  dmiOpCount () const override
+  {
+    return mDmiOps;
+  }
+
+  // Delete the copy assignment operator
+  DtmMock &operator= (const DtmMock &) = delete;
+
+private:
+  /// \brief Number of DMI registers modeled, a power of 2
+  static const std::size_t NUM_REGS = 128;
+
+  /// \brief The DMI registers
+  uint32_t mRegs[NUM_REGS];
+
+  /// \brief Number of DMI transactions since statistics were cleared
+  uint64_t mDmiOps;
+};
+
+#endif // DTM_MOCK_H
@@ -10,6 +10,8 @@
 
 #include <cstdint>
 #include <memory>
+#include <ostream>
+#include <vector>
 
 /// \brief Abstract class for a Debug Transport Module
 ///
@@ -17,6 +19,28 @@
 class IDtm
 {
 public:
+  /// \brief A single DMI transaction within a batch.
+  ///
+  /// For a read, the data read is stored via \c rdata, which must remain
+  /// valid until the batch completes.  For a write \c wdata is written and
+  /// \c rdata is ignored.  An idle is not a DMI transaction at all, but lets
+  /// the MCU run for \c wdata clock cycles before the next transaction.
+  struct DmiOp
+  {
+    /// \brief The type of DMI transaction
+    enum Type
+    {
+      READ,
+      WRITE,
+      IDLE,
+    };
+
+    Type type;        ///< Read, write or idle
+    uint64_t address; ///< DMI address to access
+    uint32_t wdata;   ///< Data to write, or cycles to idle
+    uint32_t *rdata;  ///< Where to store the data read (reads only)
+  };
+
   // Constructor and destructor
   IDtm () = default;
   IDtm (const IDtm &) = delete;
@@ -27,6 +51,109 @@ public:
   virtual uint32_t dmiRead (uint64_t address) = 0;
   virtual void dmiWrite (uint64_t address, uint32_t wdata) = 0;
   virtual uint64_t simTimeNs () const = 0;
+  virtual bool idle (uint64_t cycles) = 0;
+  virtual bool simDone () const = 0;
+
+  /// \brief Carry out a sequence of DMI transactions in order.
+  ///
+  /// The default implementation just issues each transaction in turn.
+  /// Transports which can overlap transactions should override this.
+  ///
+  /// \param[in,out] ops  The transactions to carry out.  Read results are
+  ///                     stored via each transaction's \c rdata pointer.
+  virtual void
+  dmiBatch (std::vector<DmiOp> &ops)
+  {
+    for (auto &op : ops)
+      if (op.type == DmiOp::READ)
+        *op.rdata = dmiRead (op.address);
+      else if (op.type == DmiOp::WRITE)
+        dmiWrite (op.address, op.wdata);
+      else
+        idle (op.wdata);
+  }
+
+  /// \brief Control whether DMI writes are posted.
+  ///
+  /// A posted write is issued without waiting to confirm it succeeded.  Its
+  /// status is checked at the next read or Dmi::sync.  The default
+  /// implementation always confirms each write.
+  ///
+  /// \param[in] enable  If \c true post writes, otherwise confirm each one.
+  virtual void
+  postedWrites (const bool enable)
+  {
+    static_cast<void> (enable);
+  }
+
+  /// \brief Whether DMI writes are posted.
+  ///
+  /// \return \c true if writes are posted, \c false otherwise.
+  virtual bool
+  postedWrites () const
+  {
+    return false;
+  }
+
+  /// \brief Confirm any posted writes, reissuing any which failed.
+  ///
+  /// The default implementation has no posted writes, so nothing to do.
+  virtual void
+  sync ()
+  {
+  }
+
+  /// \brief Report transport statistics.
+  ///
+  /// The default implementation has nothing to report.
+  ///
+  /// \param[in] stream  The stream on which to report.
+  virtual void
+  printStats (std::ostream &stream) const
+  {
+    static_cast<void> (stream);
+  }
+
+  /// \brief Clear transport statistics.
+  ///
+  /// The default implementation has nothing to clear.
+  virtual void
+  clearStats ()
+  {
+  }
+
+  /// \brief The JTAG IDCODE found when the DTM was last reset.
+  ///
+  /// The default implementation has no IDCODE.
+  ///
+  /// \return The IDCODE, or zero if there is none.
+  virtual uint32_t
+  idcode () const
+  {
+    return 0;
+  }
+
+  /// \brief The \c dtmcs register found when the DTM was last reset.
+  ///
+  /// The default implementation has no \c dtmcs.
+  ///
+  /// \return The value of \c dtmcs, or zero if there is none.
+  virtual uint32_t
+  dtmcs () const
+  {
+    return 0;
+  }
+
+  /// \brief Number of DMI transactions since statistics were cleared.
+  ///
+  /// The default implementation does not count them.
+  ///
+  /// \return The number of DMI transactions.
+  virtual uint64_t
+  dmiOpCount () const
+  {
+    return 0;
+  }
 
   // Delete the copy assignment operator
   IDtm &operator= (const IDtm &) = delete;
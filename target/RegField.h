@@ -0,0 +1,73 @@
+// Declaration of a template describing a field of a 32-bit register.
+//
+// This file is part of the Embecosm Debug Server target for CORE-V MCU
+//
+// Copyright (C) 2021 Embecosm Limited
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef REG_FIELD_H
+#define REG_FIELD_H
+
+#include <cstdint>
+
+/// \brief A field of a 32-bit register.
+///
+/// The field is described entirely by its position, so all its operations
+/// are \c constexpr, and whole register values built from fields can be
+/// computed at compile time.
+///
+/// \tparam OFFSET  Bit number of the LS bit of the field.
+/// \tparam SIZE    Number of bits in the field.
+template <unsigned OFFSET, unsigned SIZE> struct RegField
+{
+  static_assert ((SIZE > 0) && ((OFFSET + SIZE) <= 32),
+                 "Field does not fit in a 32-bit register");
+
+  /// \brief The bits of the register occupied by the field
+  static constexpr uint32_t MASK
+      = ((SIZE == 32) ? ~0U : ((1U << SIZE) - 1U)) << OFFSET;
+
+  /// \brief The largest value the field can hold
+  static constexpr uint32_t MAX = MASK >> OFFSET;
+
+  /// \brief Extract the field from a register value.
+  ///
+  /// \param[in] reg  The register value.
+  /// \return The value of the field.
+  static constexpr uint32_t
+  get (const uint32_t reg)
+  {
+    return (reg & MASK) >> OFFSET;
+  }
+
+  /// \brief Position a value in the field, ignoring any excess high bits.
+  ///
+  /// \param[in] val  The value of the field.
+  /// \return A register value with just the field set.
+  static constexpr uint32_t
+  encode (const uint32_t val)
+  {
+    return (val << OFFSET) & MASK;
+  }
+
+  /// \brief Replace the field in a register value.
+  ///
+  /// \param[in] reg  The register value.
+  /// \param[in] val  The new value of the field.
+  /// \return The register value with the field replaced.
+  static constexpr uint32_t
+  set (const uint32_t reg, const uint32_t val)
+  {
+    return (reg & ~MASK) | encode (val);
+  }
+};
+
+/// \brief Must define as well as declare our constexpr members before using.
+template <unsigned OFFSET, unsigned SIZE>
+constexpr uint32_t RegField<OFFSET, SIZE>::MASK;
+
+/// \brief Must define as well as declare our constexpr members before using.
+template <unsigned OFFSET, unsigned SIZE>
+constexpr uint32_t RegField<OFFSET, SIZE>::MAX;
+
+#endif // REG_FIELD_H
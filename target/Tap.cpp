@@ -36,33 +36,49 @@ using std::unique_ptr;
 /// \param[in] vcdFile        \see VSim::VSim
 Tap::Tap (const uint64_t clkPeriodNs, const uint64_t simTimeNs,
           const char *vcdFile)
-    : mLastIr (0), mRtiCount (1)
+    : mLastIr (0), mRtiCount (1), mScanCount (0), mTckCycles (0),
+      mTckCyclesSaved (0)
 {
   mMcu.reset (new VSim (static_cast<const vluint64_t> (clkPeriodNs),
                         static_cast<const vluint64_t> (simTimeNs), vcdFile));
 }
 
+/// \brief Constructor for the JTAG TAP model using an existing MCU model
+///
+/// Used when the Verilator model is shared with other means of accessing the
+/// MCU.  Defaults are as for the main constructor.
+///
+/// \param[in] mcu  The Verilator model of the MCU.
+Tap::Tap (std::shared_ptr<VSim> mcu)
+    : mMcu (mcu), mLastIr (0), mRtiCount (1), mScanCount (0), mTckCycles (0),
+      mTckCyclesSaved (0)
+{
+}
+
 /// \brief Destructor for the JTAG TAP model
 ///
 /// While the MCU should be cleaned up automatically, we do this explicitly as
 /// good practice.
 Tap::~Tap ()
 {
-  mMcu.reset (nullptr);
+  mMcu.reset ();
 }
 
 /// \brief Setter for the Run-Test/Idle count
 ///
 /// When we access the same register multiple times, we need not set the IR
 /// again, but we may need to spend one or more cycles in Run-Test/Idle.  This
-/// is not known at instantiation, so we provide a mechanism to set this
-/// value.
+/// is not known at instantiation, and may vary from scan to scan, so we
+/// provide a mechanism to set this value.  It is part of the key for
+/// compiled scans, so changing it is cheap.
 ///
 /// \param[in] rtiCount_  The value to save as the Run-Test/Idle count.
 void
 Tap::rtiCount (const uint8_t rtiCount_)
 {
   mRtiCount = rtiCount_;
+  if (mRtiCount > RTI_MAX)
+    mRtiCount = RTI_MAX;
 }
 
 /// \brief Take the simulator through reset
@@ -100,6 +116,7 @@ Tap::reset ()
     }
 
   mCurrState = RUN_TEST_IDLE; // Should be Test-Logic-Reset
+  mLastIr = 0;                // Force the next IR to be shifted
   return true;
 }
 
@@ -116,25 +133,14 @@ uint64_t
 Tap::accessReg (const uint8_t ir, uint64_t wdata, const uint8_t len)
 {
   // Sanity check
-  if (len > 64)
+  if ((len < 2) || (len > 64))
     {
       cerr << "ERROR: Attempt to access JTAG register of size "
            << static_cast<unsigned int> (len) << endl;
       exit (EXIT_FAILURE);
     }
 
-  // If the IR has not changed we do don't need to save it, but we might need
-  // to stay in Run-Test/Idle for some cycles
-  if (mLastIr == ir)
-    for (uint8_t i = 0; i < mRtiCount; i++)
-      gotoState (RUN_TEST_IDLE);
-  else
-    shiftIr (ir);
-
-  uint64_t reg = shiftDr (wdata, len);
-  gotoState (UPDATE_DR);
-
-  return reg;
+  return runScan (ir, wdata, len);
 }
 
 /// \brief Generic write to a JTAG register.
@@ -163,80 +169,208 @@ Tap::readReg (const uint8_t ir, const uint8_t len)
   return accessReg (ir, 0ULL, len);
 }
 
-/// \brief Helper to shift in an instruction register
-///
-/// @note The length of an instruction register is hard coded
+/// \brief Provide access to simulation time
 ///
-/// \param[in] ireg  The instruction register to shift in.
-void
-Tap::shiftIr (const uint8_t ireg)
+/// \return The current simulation time in nanoseconds.
+uint64_t
+Tap::simTimeNs () const
 {
-  static_cast<void> (gotoState (SHIFT_IR));
+  return static_cast<uint64_t> (mMcu->simTimeNs ());
+}
 
-  // Shift in LS bit first, staying in SHIFT_IR for all but the last bit
-  for (int i = 0; i < (IR_LEN - 1); i++)
-    static_cast<void> (advanceState (/* tms = */ false,
-                                     /* tdi = */ (ireg & (1 << i)) != 0));
+/// \brief Let the MCU run with the TAP idle
+///
+/// The JTAG clock is parked, so the TAP stays where the last scan left it.
+/// This gives the core time to make progress between accesses without any
+/// JTAG traffic.
+///
+/// \param[in] cycles  The number of main clock cycles to run.
+/// \return \c true if we ran all the cycles, \c false if the simulation
+///         finished first.
+bool
+Tap::idle (const uint64_t cycles)
+{
+  return mMcu->runCycles (cycles) == cycles;
+}
 
-  static_cast<void> (advanceState (/* tms = */ true,
-                                   /* tdi = */
-                                   (ireg & (1 << (IR_LEN - 1))) != 0));
+/// \brief Has the simulation finished?
+///
+/// \return \c true if the simulation has finished, \c false otherwise.
+bool
+Tap::simDone () const
+{
+  return mMcu->allDone ();
+}
 
-  static_cast<void> (gotoState (UPDATE_IR));
+/// \brief Getter for the number of scans carried out
+///
+/// \return The number of scans since the statistics were last cleared.
+uint64_t
+Tap::scanCount () const
+{
+  return mScanCount;
 }
 
-/// \brief Provide access to simulation time
+/// \brief Getter for the number of TCK cycles used by scans
 ///
-/// \return The current simulation time in nanoseconds.
+/// \return The number of TCK cycles since the statistics were last cleared.
 uint64_t
-Tap::simTimeNs () const
+Tap::tckCycles () const
 {
-  return static_cast<uint64_t> (mMcu->simTimeNs ());
+  return mTckCycles;
 }
 
-/// \brief Helper to shift a data register in and out
+/// \brief Getter for the number of TCK cycles saved
+///
+/// Savings are relative to shifting the IR on every access, which is what
+/// happened before the IR was tracked.
 ///
-/// \param[in] dreg  The data register to shift in
-/// \param[in] len   The length of the register in bits
-/// \return  The register shifted out.
+/// \return The number of TCK cycles saved since the statistics were last
+///         cleared.
 uint64_t
-Tap::shiftDr (const uint64_t dreg, size_t len)
+Tap::tckCyclesSaved () const
 {
-  static_cast<void> (gotoState (SHIFT_DR));
+  return mTckCyclesSaved;
+}
 
-  // Shift in the first LS bit
-  static_cast<void> (advanceState (/* tms = */ false,
-                                   /* tdi = */ (dreg & 1) != 0));
+/// \brief Clear the statistics
+void
+Tap::clearStats ()
+{
+  mScanCount = 0;
+  mTckCycles = 0;
+  mTckCyclesSaved = 0;
+}
 
-  // Start shifting out bits
-  uint64_t regOut = 0;
-  for (int i = 1; i < (len - 1); i++)
-    if (advanceState (/* tms = */ false,
-                      /* tdi = */ (dreg & (1ULL << i)) != 0))
-      regOut |= 1ULL << (i - 1);
+/// \brief Get the compiled scan for an access from the current state.
+///
+/// Scans are compiled on first use and cached.  The scan depends on the
+/// current TAP state, whether the IR must be shifted, the IR, the
+/// Run-Test/Idle count and the register length.
+///
+/// \param[in] ir   The instruction register to set.
+/// \param[in] len  Length of the data register.
+/// \return The compiled scan.
+const Tap::ScanVector &
+Tap::scanFor (const uint8_t ir, const uint8_t len)
+{
+  uint32_t key = (static_cast<uint32_t> (mCurrState) << 24)
+                 | (static_cast<uint32_t> (ir) << 16)
+                 | (static_cast<uint32_t> (mRtiCount) << 9)
+                 | ((mLastIr == ir) ? 0x100U : 0U)
+                 | static_cast<uint32_t> (len);
+  auto it = mScanCache.find (key);
+
+  if (it == mScanCache.end ())
+    {
+      ScanVector sv;
+      compileScan (ir, len, mLastIr == ir, sv);
+
+      // Compare with the cost of always shifting the IR
+      if (mLastIr == ir)
+        {
+          ScanVector full;
+          compileScan (ir, len, false, full);
+          sv.nSaved = full.nBits - sv.nBits;
+        }
+      else
+        sv.nSaved = 0;
+
+      it = mScanCache.insert (std::make_pair (key, sv)).first;
+    }
 
-  // Shift in the last bit and out the penultimate bit
-  if (advanceState (/* tms = */ true,
-                    /* tdi = */ (dreg & (1ULL << (len - 1))) != 0))
-    regOut |= 1ULL << (len - 2);
+  return it->second;
+}
 
-  // Shift out the last bit
-  if (advanceState (/* tms = */ false,
-                    /* tdi = */ (dreg & (1ULL << (len - 1))) != 0))
-    regOut |= 1ULL << (len - 1);
+/// \brief Compile the complete scan for a register access.
+///
+/// If the IR has not changed we do don't need to shift it, but we might need
+/// to go via Run-Test/Idle.  We only do so if the DTM asks for idle cycles,
+/// otherwise we go straight from Update-DR to Select-DR-Scan.  We finish in
+/// Update-DR to commit any write.
+///
+/// \param[in]  ir      The instruction register to set.
+/// \param[in]  len     Length of the data register.
+/// \param[in]  sameIr  \c true if the IR need not be shifted.
+/// \param[out] sv      The compiled scan.
+void
+Tap::compileScan (const uint8_t ir, const uint8_t len, const bool sameIr,
+                  ScanVector &sv) const
+{
+  State s = mCurrState;
+
+  sv.nBits = 0;
+  for (std::size_t w = 0; w < ScanVector::WORDS; w++)
+    {
+      sv.tms[w] = 0;
+      sv.tdi[w] = 0;
+      sv.hold[w] = 0;
+    }
+
+  if (!sameIr)
+    compileShiftIr (sv, s, ir);
+  else if (mRtiCount > 0)
+    {
+      // Enter Run-Test/Idle, then stay for any further idle cycles
+      compileGoto (sv, s, RUN_TEST_IDLE);
+      for (uint8_t i = 1; i < mRtiCount; i++)
+        compileStep (sv, s, /* tms = */ false, /* tdi = */ false);
+    }
 
-  static_cast<void> (gotoState (UPDATE_DR));
-  return regOut;
+  compileShiftDr (sv, s, len);
+  compileGoto (sv, s, UPDATE_DR);
+  sv.endState = s;
 }
 
-/// \brief Helper to get to a desired state.
+/// \brief Compile the shifting in of an instruction register
 ///
-/// Drives TMS and discards all but the last TDO output.
+/// @note The length of an instruction register is hard coded
 ///
-/// \param[in] s    The state we are trying to reach.
-/// \return \c true if the final TDO is high, \c false otherwise or on error.
-bool
-Tap::gotoState (const Tap::State s)
+/// \param[in,out] sv    The scan being compiled.
+/// \param[in,out] s     The TAP state at this point in the scan.
+/// \param[in]     ireg  The instruction register to shift in.
+void
+Tap::compileShiftIr (ScanVector &sv, State &s, const uint8_t ireg) const
+{
+  compileGoto (sv, s, SHIFT_IR);
+
+  // Shift in LS bit first, staying in SHIFT_IR for all but the last bit
+  for (std::size_t i = 0; i < IR_LEN; i++)
+    compileStep (sv, s, /* tms = */ i == (IR_LEN - 1),
+                 /* tdi = */ (ireg & (1 << i)) != 0);
+
+  compileGoto (sv, s, UPDATE_IR);
+}
+
+/// \brief Compile the shifting of a data register in and out
+///
+/// Only TMS is compiled.  The data bits themselves are inserted into the TDI
+/// template when the scan is run.  There is one more cycle than bits, since
+/// TDO lags TDI by one cycle.
+///
+/// \param[in,out] sv   The scan being compiled.
+/// \param[in,out] s    The TAP state at this point in the scan.
+/// \param[in]     len  The length of the register in bits
+void
+Tap::compileShiftDr (ScanVector &sv, State &s, const uint8_t len) const
+{
+  compileGoto (sv, s, SHIFT_DR);
+  sv.drStart = sv.nBits;
+
+  for (uint8_t i = 0; i < len; i++)
+    compileStep (sv, s, /* tms = */ i == (len - 1), /* tdi = */ false);
+
+  // Shift out the last bit
+  compileStep (sv, s, /* tms = */ false, /* tdi = */ false);
+}
+
+/// \brief Compile the steps to get to a desired state.
+///
+/// \param[in,out] sv      The scan being compiled.
+/// \param[in,out] s       The TAP state at this point in the scan.
+/// \param[in]     target  The state we are trying to reach.
+void
+Tap::compileGoto (ScanVector &sv, State &s, const State target) const
 {
   // A table showing the TMS value for the first step for getting for the
   // state of the first argument, to the state of the second argument.
@@ -262,69 +396,49 @@ Tap::gotoState (const Tap::State s)
         { 1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 }, // Update-IR ->
       };
 
-  // Safety check
-  if (static_cast<unsigned> (s) >= NUM_STATES)
-    {
-      cerr << "ERROR: Attempt to go to non-existent state: " << s << endl;
-      return false;
-    }
-
-  bool tdo_reg = mMcu->tdo ();
-
-  while (mCurrState != s)
-    {
-      bool tms = (1U == nextStateTab[mCurrState][s]);
-      // Drive TMS into TAP state machine, which will leave as at JTAG TAP
-      // negative edge. We ignore the TDO output.
-      tdo_reg = advanceState (tms, /* tdi = */ false);
-    }
-
-  return tdo_reg;
+  while (s != target)
+    compileStep (sv, s, /* tms = */ 1U == nextStateTab[s][target],
+                 /* tdi = */ false);
 }
 
-/// \brief Advance the JTAG TAP state machine
-///
-/// Clock the processor to a JTAG TAP positive edge, set TMS/TDI, then clock
-/// the processor to a JTAG TAP negative edge, and read TDO as the result.
-/// Update the model of the JTAG TAP state accordingly.
+/// \brief Compile a single TCK cycle, tracking the resulting state
 ///
-/// \note  The JTAG TAP is left at a negative edge.
-///
-/// \param[in] tms  The value to drive as the TMS input.
-/// \param[in] tdi  The value to drive as the TDI input.
-/// \return The resulting value of TDO.
-bool
-Tap::advanceState (const bool tms, const bool tdi)
+/// \param[in,out] sv   The scan being compiled.
+/// \param[in,out] s    The TAP state at this point in the scan.
+/// \param[in]     tms  The value to drive as the TMS input.
+/// \param[in]     tdi  The value to drive as the TDI input.
+void
+Tap::compileStep (ScanVector &sv, State &s, const bool tms,
+                  const bool tdi) const
 {
-  // Get to the JTAG TAP positive edge if we are not already there
-  while (!mMcu->tapPosedge ())
+  if (sv.nBits >= ScanVector::MAX_BITS)
     {
-      mMcu->eval ();
-      mMcu->advanceHalfPeriod ();
+      cerr << "ERROR: JTAG scan exceeds " << ScanVector::MAX_BITS << " bits"
+           << endl;
+      exit (EXIT_FAILURE);
     }
 
-  // Set TMS and drive to the next JTAG TAP negedge.
-  mMcu->tms (tms);
-  mMcu->tdi (tdi);
+  std::size_t w = sv.nBits / 64;
+  uint64_t bit = 1ULL << (sv.nBits % 64);
 
-  while (!mMcu->tapNegedge ())
-    {
-      mMcu->eval ();
-      mMcu->advanceHalfPeriod ();
-    }
+  if (tms)
+    sv.tms[w] |= bit;
+  if (tdi)
+    sv.tdi[w] |= bit;
+  if ((s == SHIFT_DR) || (s == SHIFT_IR))
+    sv.hold[w] |= bit;
 
-  // Update the record of the state we are in and then return the TDO
-  nextState (mMcu->tms ());
-  return mMcu->tdo ();
+  sv.nBits++;
+  s = nextState (s, tms);
 }
 
 /// \brief Helper to get the next state.
 ///
-/// Updates Tap::mCurrState with the next state, based on the TMS input
-///
+/// \param[in] s    The current state
 /// \param[in] tms  The TMS signal driving the state transition
-void
-Tap::nextState (const bool tms)
+/// \return The state after one TCK cycle
+Tap::State
+Tap::nextState (const State s, const bool tms)
 {
   static const State trans[NUM_STATES][2] = {
     { RUN_TEST_IDLE, TEST_LOGIC_RESET }, // Test-Logic-Reset ->
@@ -345,7 +459,7 @@ Tap::nextState (const bool tms)
     { RUN_TEST_IDLE, SELECT_DR_SCAN },   // Update-DR ->
   };
 
-  mCurrState = tms ? trans[mCurrState][1] : trans[mCurrState][0];
+  return tms ? trans[s][1] : trans[s][0];
 }
 
 /// \brief Helper to get the name of a state safely
@@ -8,6 +8,8 @@
 #ifndef TAP_H
 #define TAP_H
 
+#include <map>
+#include <memory>
 #include <sstream>
 
 #include "VSim.h"
@@ -19,6 +21,7 @@ public:
   // Constructor and destructor
   Tap (const uint64_t clkPeriodNs, const uint64_t simTimeNs,
        const char *vcdFile);
+  explicit Tap (std::shared_ptr<VSim> mcu);
   Tap (const Tap &) = delete;
   ~Tap ();
 
@@ -26,9 +29,18 @@ public:
   void rtiCount (const uint8_t rtiCount_);
   bool reset ();
   uint64_t accessReg (const uint8_t ir, uint64_t wdata, const uint8_t len);
+  template <uint8_t LEN> uint64_t accessReg (const uint8_t ir, uint64_t wdata);
   void writeReg (const uint8_t ir, uint64_t wdata, const uint8_t len);
   uint64_t readReg (const uint8_t ir, const uint8_t len);
   uint64_t simTimeNs () const;
+  bool idle (const uint64_t cycles);
+  bool simDone () const;
+
+  // Statistics
+  uint64_t scanCount () const;
+  uint64_t tckCycles () const;
+  uint64_t tckCyclesSaved () const;
+  void clearStats ();
 
   // Delete the copy assignment operator
   Tap &operator= (const Tap &) = delete;
@@ -63,13 +75,42 @@ private:
   /// \todo Should this be hard-coded like this?
   static const std::size_t IR_LEN = 5;
 
+  /// \brief Largest Run-Test/Idle count, which must fit in 7 bits
+  static const uint8_t RTI_MAX = 127;
+
   /// \brief Length of the IDCODE
   ///
   /// \todo Should this be hard-coded like this?
   static const std::size_t IDCODE_LEN = 32;
 
+  /// \brief A compiled JTAG scan
+  ///
+  /// The complete sequence of TMS/TDI bits for one register access, from the
+  /// current state, via the IR shift if needed, through the DR shift to
+  /// Update-DR.  TMS and TDI bits are packed LS bit first, one per TCK cycle.
+  /// The TDI bits are a template, with zeros where the DR bits go.  Cycles
+  /// spent shifting, which need no core progress, are marked in \c hold.
+  struct ScanVector
+  {
+    /// \brief Maximum number of TCK cycles in a scan
+    static const std::size_t MAX_BITS = 128;
+
+    /// \brief Number of words to hold MAX_BITS
+    static const std::size_t WORDS = MAX_BITS / 64;
+
+    std::size_t nBits;    ///< Number of TCK cycles in the scan
+    uint64_t tms[WORDS];  ///< TMS for each cycle
+    uint64_t tdi[WORDS];  ///< TDI template for each cycle
+    uint64_t hold[WORDS]; ///< Whether the core clock may be held
+    std::size_t drStart;  ///< Cycle at which the DR shift starts
+    State endState;       ///< State at the end of the scan
+    std::size_t nSaved;   ///< Cycles saved over always shifting the IR
+  };
+
   /// \brief The Verilator simulation of the MCU associated with the JTAG TAP
-  std::unique_ptr<VSim> mMcu;
+  ///
+  /// This may be shared with other means of accessing the MCU.
+  std::shared_ptr<VSim> mMcu;
 
   /// \brief The current state of the TAP
   State mCurrState;
@@ -81,16 +122,102 @@ private:
   ///
   /// When we access the same register multiple times, we do not need to shift
   /// the IR again, but may be required to go via Run-Test/Idle state and stay
-  /// their for 1 or more cycles.  This records the count.
+  /// their for 1 or more cycles.  This records the count, with the meaning of
+  /// the \c idle field of \c dtmcs, so zero means we need not enter
+  /// Run-Test/Idle at all.
   uint8_t mRtiCount;
 
+  /// \brief Number of scans carried out
+  uint64_t mScanCount;
+
+  /// \brief Number of TCK cycles used by scans
+  uint64_t mTckCycles;
+
+  /// \brief Number of TCK cycles saved by not always shifting the IR
+  uint64_t mTckCyclesSaved;
+
+  /// \brief Compiled scans, keyed by start state, IR, IR change,
+  ///        Run-Test/Idle count and length
+  std::map<uint32_t, ScanVector> mScanCache;
+
   // Helper functions/operators
-  void shiftIr (const uint8_t ireg);
-  uint64_t shiftDr (const uint64_t dreg, size_t len);
-  bool gotoState (const State s);
-  bool advanceState (const bool tms, const bool tdi);
-  void nextState (const bool tms);
+  const ScanVector &scanFor (const uint8_t ir, const uint8_t len);
+  void compileScan (const uint8_t ir, const uint8_t len, const bool sameIr,
+                    ScanVector &sv) const;
+  void compileShiftIr (ScanVector &sv, State &s, const uint8_t ireg) const;
+  void compileShiftDr (ScanVector &sv, State &s, const uint8_t len) const;
+  void compileGoto (ScanVector &sv, State &s, const State target) const;
+  void compileStep (ScanVector &sv, State &s, const bool tms,
+                    const bool tdi) const;
+  static State nextState (const State s, const bool tms);
+  inline uint64_t runScan (const uint8_t ir, uint64_t wdata,
+                           const uint8_t len);
   const char *nameState (const State s) const;
 };
 
+/// \brief Run a compiled scan, inserting and extracting the DR bits
+///
+/// The DR bits shifted out lag those shifted in by one TCK cycle, and the
+/// compiled scan includes the extra cycle needed to collect the last bit.
+///
+/// \param[in] ir     The instruction register to set.
+/// \param[in] wdata  The data register to write.
+/// \param[in] len    Length of data to write/read.
+/// \return the value read.
+inline uint64_t
+Tap::runScan (const uint8_t ir, uint64_t wdata, const uint8_t len)
+{
+  const ScanVector &sv = scanFor (ir, len);
+  const uint64_t mask = (len < 64) ? ((1ULL << len) - 1ULL) : ~0ULL;
+  uint64_t tdi[ScanVector::WORDS];
+  uint64_t tdo[ScanVector::WORDS];
+
+  for (std::size_t w = 0; w < ScanVector::WORDS; w++)
+    tdi[w] = sv.tdi[w];
+
+  // Insert the DR, plus a copy of its last bit in the extra cycle
+  wdata &= mask;
+  std::size_t word = sv.drStart / 64;
+  std::size_t off = sv.drStart % 64;
+  tdi[word] |= wdata << off;
+  if ((off != 0) && ((off + len) > 64))
+    tdi[word + 1] |= wdata >> (64 - off);
+
+  std::size_t last = sv.drStart + len;
+  tdi[last / 64] |= ((wdata >> (len - 1)) & 1ULL) << (last % 64);
+
+  mMcu->replayScan (sv.tms, tdi, sv.hold, tdo, sv.nBits);
+  mCurrState = sv.endState;
+  mLastIr = ir;
+  mScanCount++;
+  mTckCycles += sv.nBits;
+  mTckCyclesSaved += sv.nSaved;
+
+  // Extract the DR, one cycle later
+  word = (sv.drStart + 1) / 64;
+  off = (sv.drStart + 1) % 64;
+  uint64_t regOut = tdo[word] >> off;
+  if ((off != 0) && ((off + len) > 64))
+    regOut |= tdo[word + 1] << (64 - off);
+
+  return regOut & mask;
+}
+
+/// \brief Access to a JTAG register of fixed length
+///
+/// As Tap::accessReg, but with the length known at compile time, so the
+/// insertion and extraction of the data register reduce to constant shifts
+/// and masks.
+///
+/// \param[in] ir     The instruction register to set.
+/// \param[in] wdata  The data register to write.
+/// \return the value read.
+template <uint8_t LEN>
+uint64_t
+Tap::accessReg (const uint8_t ir, uint64_t wdata)
+{
+  static_assert ((LEN > 1) && (LEN <= 64), "Invalid JTAG register length");
+  return runScan (ir, wdata, LEN);
+}
+
 #endif // TAP_H
@@ -36,9 +36,57 @@ public:
   // Generate a random number
   static uint32_t rand (uint32_t n);
 
+  // Pack and unpack little endian target words
+  static uint32_t loadLe (const uint8_t *p, std::size_t n = 4);
+  static void storeLe (uint8_t *p, uint32_t val, std::size_t n = 4);
+
 private:
   static std::ostringstream sOss;
   static std::string sPadding;
 };
 
+/// \brief Pack bytes into a little endian target word
+///
+/// Inline, since it is used for every word of a memory transfer.  For a whole
+/// word the compiler reduces this to a single load on a little endian host.
+///
+/// \param[in] p  The bytes to pack.
+/// \param[in] n  The number of bytes (at most 4).
+/// \return The packed word.
+inline uint32_t
+Utils::loadLe (const uint8_t *p, std::size_t n)
+{
+  if (n == 4)
+    return static_cast<uint32_t> (p[0]) | (static_cast<uint32_t> (p[1]) << 8)
+           | (static_cast<uint32_t> (p[2]) << 16)
+           | (static_cast<uint32_t> (p[3]) << 24);
+
+  uint32_t val = 0;
+  for (std::size_t i = 0; i < n; i++)
+    val |= static_cast<uint32_t> (p[i]) << (8 * i);
+
+  return val;
+}
+
+/// \brief Unpack a little endian target word into bytes
+///
+/// \param[out] p    Where to put the bytes.
+/// \param[in]  val  The word to unpack.
+/// \param[in]  n    The number of bytes (at most 4).
+inline void
+Utils::storeLe (uint8_t *p, uint32_t val, std::size_t n)
+{
+  if (n == 4)
+    {
+      p[0] = static_cast<uint8_t> (val);
+      p[1] = static_cast<uint8_t> (val >> 8);
+      p[2] = static_cast<uint8_t> (val >> 16);
+      p[3] = static_cast<uint8_t> (val >> 24);
+      return;
+    }
+
+  for (std::size_t i = 0; i < n; i++)
+    p[i] = static_cast<uint8_t> (val >> (8 * i));
+}
+
 #endif // UTILS_H
@@ -9,22 +9,54 @@
 
 #include "VSim.h"
 
+#ifdef CV32E40_DMI_BACKDOOR
+#include "Vcore_v_mcu___024root.h"
+
+// The DMI request/response signals between the JTAG DTM and the debug module.
+// These must be made public and writable in the Verilator model (for example
+// with /*verilator public_flat_rw*/), and the JTAG DTM must not drive them
+// while the backdoor is in use.  The names may be overridden when building
+// against a model with a different hierarchy.
+#ifndef CV32E40_DMI_SCOPE
+#define CV32E40_DMI_SCOPE(sig)                                                \
+  rootp->core_v_mcu__DOT__i_soc_domain__DOT__i_pulp_soc__DOT__##sig
+#endif
+#define DMI_REQ_VALID CV32E40_DMI_SCOPE (jtag_req_valid)
+#define DMI_REQ_READY CV32E40_DMI_SCOPE (debug_req_ready)
+#define DMI_REQ CV32E40_DMI_SCOPE (jtag_dmi_req)
+#define DMI_RESP_VALID CV32E40_DMI_SCOPE (jtag_resp_valid)
+#define DMI_RESP_READY CV32E40_DMI_SCOPE (jtag_resp_ready)
+#define DMI_RESP CV32E40_DMI_SCOPE (debug_resp)
+#endif
+
+#ifdef CV32E40_HALT_SIGNAL
+#include "Vcore_v_mcu___024root.h"
+
+// The core's debug mode signal, which must be made public in the Verilator
+// model (for example with /*verilator public_flat*/).  The name may be
+// overridden when building against a model with a different hierarchy.
+#ifndef CV32E40_DEBUG_MODE
+#define CV32E40_DEBUG_MODE                                                    \
+  rootp->core_v_mcu__DOT__i_soc_domain__DOT__i_pulp_soc__DOT__fc_subsystem_i__DOT__lFC_CORE__DOT__debug_mode
+#endif
+#endif
+
 using std::cerr;
 using std::cout;
 using std::endl;
 
 /// \brief Constructor for the Verilator simulator
 ///
-/// \note We hard code some of the timing parameters.  The JTAG clock period
-///       is 10x the main clock period.  The reset time is 5 JTAG clock
-///       periods.
+/// \note We hard code some of the timing parameters.  The reset time is 10
+///       main clock periods.
 ///
 /// \param[in] clkPeriodNs    Main clock period in nanoseconds
 /// \param[in] simTimeNs      Time to simulate for in nanoseconds.  Zero means
 ///                           simulate forever.
 /// \param[in] vcdFile        VCD file name for tracing, if any
+/// \param[in] tckRatio       \see VSim::tckRatio
 VSim::VSim (const vluint64_t clkPeriodNs, const vluint64_t simTimeNs,
-            const char *vcdFile)
+            const char *vcdFile, const unsigned int tckRatio)
 {
   mContextp.reset (new VerilatedContext);
   mCpu.reset (new Vcore_v_mcu);
@@ -48,13 +80,15 @@ VSim::VSim (const vluint64_t clkPeriodNs, const vluint64_t simTimeNs,
       mTfp->open (vcdFile);
     }
 
-  // Set up clock timings reset and simulation time.  JTAG and reset times are
-  // hard-coded multiples of the clock period.  Easy because we have also hard
+  // Set up clock timings reset and simulation time.  Reset time is a
+  // hard-coded multiple of the clock period.  Easy because we have also hard
   // coded 1 tick = 1ns.
   mClkHalfPeriodTicks = clkPeriodNs / 2;
-  mTckHalfPeriodTicks = mClkHalfPeriodTicks * 2;
-  mResetPeriodTicks = mTckHalfPeriodTicks * 10;
+  mResetPeriodTicks = mClkHalfPeriodTicks * 20;
   mSimTimeTicks = simTimeNs;
+  mTckRatio = tckRatio;
+  mTckPhase = 0;
+  mHoldClk = false;
 
   // Initial clock/reset signal values
   mTickCount = 0;
@@ -87,6 +121,42 @@ VSim::~VSim ()
   mContextp.reset (nullptr);
 }
 
+/// \brief Setter for the JTAG clock ratio
+///
+/// The JTAG clock half period is this many main clock half periods.  The
+/// special value VSim::TCK_ONLY means the JTAG clock runs at the main clock
+/// rate, but the main clock is held while no core progress is needed (see
+/// VSim::holdClk).
+///
+/// \param[in] ratio  The new JTAG clock ratio.
+void
+VSim::tckRatio (const unsigned int ratio)
+{
+  mTckRatio = ratio;
+  mTckPhase = 0;
+  mHoldClk = false;
+}
+
+/// \brief Getter for the JTAG clock ratio
+///
+/// \return The JTAG clock ratio.
+unsigned int
+VSim::tckRatio () const
+{
+  return mTckRatio;
+}
+
+/// \brief Setter for whether the main clock is held
+///
+/// Only has any effect in VSim::TCK_ONLY mode.
+///
+/// \param[in] hold  \c true if the main clock should be held.
+void
+VSim::holdClk (const bool hold)
+{
+  mHoldClk = hold && (mTckRatio == TCK_ONLY);
+}
+
 /// \brief Getter for the current time in nanoseconds
 ///
 /// Since 1 tick = 1ns, this is easy
@@ -115,23 +185,113 @@ VSim::allDone () const
 /// \brief Advance one half main clock period
 ///
 /// Updates the time simulated, the clock and reset inputs and whether we are
-/// on the posedge or negedge of the JTAG TAP clock.
+/// on the posedge or negedge of the JTAG TAP clock.  The clocks are toggled
+/// by counting, to avoid divisions on every call.
 void
 VSim::advanceHalfPeriod ()
 {
   mTickCount += mClkHalfPeriodTicks;
   mContextp->time (mTickCount);
-  vluint8_t old_tck = mCpu->jtag_tck_i;
   vluint8_t nResetBit = mTickCount < mResetPeriodTicks ? 0 : 1;
 
-  mCpu->ref_clk_i = 1U - (mTickCount / mClkHalfPeriodTicks) % 2;
-  mCpu->rstn_i = nResetBit;
+  if (!mHoldClk)
+    mCpu->ref_clk_i = 1U - mCpu->ref_clk_i;
 
-  mCpu->jtag_tck_i = 1U - (mTickCount / mTckHalfPeriodTicks) % 2;
+  mCpu->rstn_i = nResetBit;
   mCpu->jtag_trst_i = nResetBit;
 
-  mTckPosedge = (old_tck == 0U) && (mCpu->jtag_tck_i == 1U);
-  mTckNegedge = (old_tck == 1U) && (mCpu->jtag_tck_i == 0U);
+  if (++mTckPhase >= mTckRatio)
+    {
+      mTckPhase = 0;
+      mCpu->jtag_tck_i = 1U - mCpu->jtag_tck_i;
+      mTckPosedge = mCpu->jtag_tck_i == 1U;
+      mTckNegedge = !mTckPosedge;
+    }
+  else
+    {
+      mTckPosedge = false;
+      mTckNegedge = false;
+    }
+}
+
+/// \brief Free-run the main clock
+///
+/// Only the main clock is toggled, in a tight loop.  The JTAG clock is
+/// parked, so the TAP stays in whatever state it was left in and needs no
+/// bookkeeping.  Use when no JTAG traffic is needed, such as while the hart
+/// runs.
+///
+/// \param[in] n  The number of main clock cycles to run.
+/// \return The number of cycles run, fewer than \p n if the simulation
+///         finished first.
+vluint64_t
+VSim::runCycles (const vluint64_t n)
+{
+  if (mHaveVcd)
+    return freeRun<true, false> (n);
+  else
+    return freeRun<false, false> (n);
+}
+
+/// \brief The free-running loop
+///
+/// Specialized on whether we are tracing and whether we stop on entering
+/// debug mode, so the loop itself has no such tests.  The simulation time
+/// limit is turned into a cycle limit before we start.
+///
+/// As with VSim::eval followed by VSim::advanceHalfPeriod on the JTAG path,
+/// each half period evaluates the level left by the one before and then
+/// toggles the clock.  So the model is always left with the last edge driven
+/// but not yet evaluated, and a free run straight after VSim::replayScan, or
+/// the other way round, neither drops nor repeats a main clock edge.
+///
+/// \note Must not be used during reset.
+///
+/// \tparam VCD          \c true if we are dumping a VCD.
+/// \tparam UNTIL_DEBUG  \c true if we stop when the core enters debug mode.
+/// \param[in] n  The maximum number of main clock cycles to run.
+/// \return The number of cycles run.
+template <bool VCD, bool UNTIL_DEBUG>
+vluint64_t
+VSim::freeRun (const vluint64_t n)
+{
+  const vluint64_t half = mClkHalfPeriodTicks;
+  vluint64_t limit = n;
+  vluint64_t tick = mTickCount;
+  Vcore_v_mcu *cpu = mCpu.get ();
+  VerilatedContext *ctx = mContextp.get ();
+
+  if (mSimTimeTicks != 0)
+    {
+      vluint64_t left
+          = (tick >= mSimTimeTicks) ? 0 : (mSimTimeTicks - tick) / (2 * half);
+      if (left < limit)
+        limit = left;
+    }
+
+  vluint64_t i;
+  for (i = 0; i < limit; i++)
+    {
+      if (ctx->gotFinish () || (UNTIL_DEBUG && debugMode ()))
+        break;
+
+      cpu->eval ();
+      if (VCD)
+        mTfp->dump (tick);
+      tick += half;
+      ctx->time (tick);
+      cpu->ref_clk_i = 1U - cpu->ref_clk_i;
+
+      cpu->eval ();
+      if (VCD)
+        mTfp->dump (tick);
+      tick += half;
+      ctx->time (tick);
+      cpu->ref_clk_i = 1U - cpu->ref_clk_i;
+    }
+
+  mTickCount = tick;
+  return i;
 }
 
 /// \brief Determine if the model is in reset
@@ -182,6 +342,59 @@ VSim::eval ()
     mTfp->dump (mContextp->time ());
 }
 
+/// \brief Replay a precompiled JTAG scan
+///
+/// For each TCK cycle, clock to a JTAG TAP positive edge, drive TMS and TDI,
+/// then clock to the negative edge and capture TDO.  All bits are packed LS
+/// bit first.  There is no TAP state bookkeeping: that was all done when the
+/// scan was compiled.
+///
+/// In VSim::TCK_ONLY mode, the main clock is held for each cycle marked in
+/// \p hold, which should be those needing no core progress.
+///
+/// \note  The JTAG TAP is left at a negative edge.
+///
+/// \param[in]  tms    The TMS value for each cycle.
+/// \param[in]  tdi    The TDI value for each cycle.
+/// \param[in]  hold   Whether the main clock may be held for each cycle.
+/// \param[out] tdo    The TDO value captured for each cycle.
+/// \param[in]  nBits  The number of TCK cycles.
+void
+VSim::replayScan (const uint64_t *tms, const uint64_t *tdi,
+                  const uint64_t *hold, uint64_t *tdo, const std::size_t nBits)
+{
+  const bool tckOnly = mTckRatio == TCK_ONLY;
+
+  for (std::size_t w = 0; (w * 64) < nBits; w++)
+    tdo[w] = 0;
+
+  for (std::size_t i = 0; i < nBits; i++)
+    {
+      std::size_t w = i / 64;
+      std::size_t b = i % 64;
+
+      while (!mTckPosedge)
+        {
+          eval ();
+          advanceHalfPeriod ();
+        }
+
+      mCpu->jtag_tms_i = static_cast<vluint8_t> ((tms[w] >> b) & 1U);
+      mCpu->jtag_tdi_i = static_cast<vluint8_t> ((tdi[w] >> b) & 1U);
+      mHoldClk = tckOnly && (((hold[w] >> b) & 1U) != 0);
+
+      while (!mTckNegedge)
+        {
+          eval ();
+          advanceHalfPeriod ();
+        }
+
+      tdo[w] |= static_cast<uint64_t> (mCpu->jtag_tdo_o & 1U) << b;
+    }
+
+  mHoldClk = false;
+}
+
 /// \brief Setter for the TDI input port
 ///
 /// We take the input as a bool, the signal value is a \c vluint8_t, hence the
@@ -242,3 +455,161 @@ VSim::tms () const
 {
   return mCpu->jtag_tms_i != 0U;
 }
+
+/// \brief Is the core's debug mode signal visible?
+///
+/// This needs a Verilator model with the signal made public, so is only
+/// available if the target was built with \c CV32E40_HALT_SIGNAL defined.
+///
+/// \return \c true if VSim::debugMode is available, \c false otherwise.
+bool
+VSim::haveDebugModeSignal ()
+{
+#ifdef CV32E40_HALT_SIGNAL
+  return true;
+#else
+  return false;
+#endif
+}
+
+/// \brief Getter for the core's debug mode signal
+///
+/// \return \c true if the core is in debug mode (i.e. halted), \c false
+///         otherwise, or if the signal is not available.
+bool
+VSim::debugMode () const
+{
+#ifdef CV32E40_HALT_SIGNAL
+  return mCpu->CV32E40_DEBUG_MODE != 0U;
+#else
+  return false;
+#endif
+}
+
+/// \brief Run the core until it enters debug mode
+///
+/// \see VSim::runCycles.
+///
+/// \param[in] maxCycles  The maximum number of main clock cycles to run.
+/// \return \c true if the core is in debug mode, \c false if it is not
+///         after \p maxCycles, or the simulation finished.
+bool
+VSim::runUntilDebugMode (const vluint64_t maxCycles)
+{
+  if (mHaveVcd)
+    static_cast<void> (freeRun<true, true> (maxCycles));
+  else
+    static_cast<void> (freeRun<false, true> (maxCycles));
+
+  return debugMode ();
+}
+
+/// \brief Is backdoor access to the DMI ports compiled in?
+///
+/// The backdoor needs a Verilator model with the DMI signals made public, so
+/// is only available if the target was built with \c CV32E40_DMI_BACKDOOR
+/// defined.
+///
+/// \return \c true if the DMI backdoor is available, \c false otherwise.
+bool
+VSim::haveDmiBackdoor ()
+{
+#ifdef CV32E40_DMI_BACKDOOR
+  return true;
+#else
+  return false;
+#endif
+}
+
+/// \brief Set the DMI request payload
+///
+/// The request is a packed structure of 7 bits of address, 2 bits of
+/// operation and 32 bits of data, most significant first.
+///
+/// \param[in] op       The operation (as for the JTAG DMIACCESS op field).
+/// \param[in] address  The DMI address.
+/// \param[in] data     The data to write (ignored for reads).
+void
+VSim::dmiReq (const uint8_t op, const uint64_t address, const uint32_t data)
+{
+#ifdef CV32E40_DMI_BACKDOOR
+  mCpu->DMI_REQ = ((address & 0x7fULL) << 34)
+                  | (static_cast<vluint64_t> (op & 0x3) << 32)
+                  | static_cast<vluint64_t> (data);
+#else
+  static_cast<void> (op);
+  static_cast<void> (address);
+  static_cast<void> (data);
+#endif
+}
+
+/// \brief Setter for the DMI request valid signal
+///
+/// \param[in] valid  The value to drive on the request valid signal.
+void
+VSim::dmiReqValid (const bool valid)
+{
+#ifdef CV32E40_DMI_BACKDOOR
+  mCpu->DMI_REQ_VALID = valid ? 1U : 0U;
+#else
+  static_cast<void> (valid);
+#endif
+}
+
+/// \brief Getter for the DMI request ready signal
+///
+/// \return \c true if the debug module can accept a request, \c false
+///         otherwise, or if the backdoor is not available.
+bool
+VSim::dmiReqReady () const
+{
+#ifdef CV32E40_DMI_BACKDOOR
+  return mCpu->DMI_REQ_READY != 0U;
+#else
+  return false;
+#endif
+}
+
+/// \brief Setter for the DMI response ready signal
+///
+/// \param[in] ready  The value to drive on the response ready signal.
+void
+VSim::dmiRespReady (const bool ready)
+{
+#ifdef CV32E40_DMI_BACKDOOR
+  mCpu->DMI_RESP_READY = ready ? 1U : 0U;
+#else
+  static_cast<void> (ready);
+#endif
+}
+
+/// \brief Getter for the DMI response valid signal
+///
+/// \return \c true if the debug module has a response, \c false
+///         otherwise, or if the backdoor is not available.
+bool
+VSim::dmiRespValid () const
+{
+#ifdef CV32E40_DMI_BACKDOOR
+  return mCpu->DMI_RESP_VALID != 0U;
+#else
+  return false;
+#endif
+}
+
+/// \brief Getter for the DMI response payload
+///
+/// The response is a packed structure of 32 bits of data followed by 2 bits
+/// of response code, the same layout as the JTAG DMIACCESS register, less
+/// its address.
+///
+/// \return The response, zero if the backdoor is not available.
+uint64_t
+VSim::dmiResp () const
+{
+#ifdef CV32E40_DMI_BACKDOOR
+  return static_cast<uint64_t> (mCpu->DMI_RESP);
+#else
+  return 0;
+#endif
+}
@@ -21,7 +21,7 @@ class VSim
 public:
   // Constructors and destructors
   VSim (const vluint64_t clkPeriodNs, const vluint64_t simTimeNs,
-        const char *vcdFile);
+        const char *vcdFile, const unsigned int tckRatio = 2);
   VSim (const VSim &) = delete;
   ~VSim ();
 
@@ -30,14 +30,25 @@ public:
   double sc_time_stamp ();
 #endif
 
+  /// \brief TCK ratio meaning TCK runs at the core clock rate, with the core
+  ///        clock held whenever no core progress is needed.
+  static const unsigned int TCK_ONLY = 0;
+
   // API
+  void tckRatio (const unsigned int ratio);
+  unsigned int tckRatio () const;
+  void holdClk (const bool hold);
   vluint64_t simTimeNs () const;
   bool allDone () const;
   void advanceHalfPeriod ();
+  vluint64_t runCycles (const vluint64_t n);
   bool inReset () const;
   bool tapPosedge () const;
   bool tapNegedge () const;
   void eval ();
+  void replayScan (const uint64_t *tms, const uint64_t *tdi,
+                   const uint64_t *hold, uint64_t *tdo,
+                   const std::size_t nBits);
 
   // Port accessors
   void tdi (const bool tdi_);
@@ -46,6 +57,20 @@ public:
   void tms (const bool tms_);
   bool tms () const;
 
+  // Direct observation of the core's halted state
+  static bool haveDebugModeSignal ();
+  bool debugMode () const;
+  bool runUntilDebugMode (const vluint64_t maxCycles);
+
+  // Backdoor access to the debug module's DMI ports
+  static bool haveDmiBackdoor ();
+  void dmiReq (const uint8_t op, const uint64_t address, const uint32_t data);
+  void dmiReqValid (const bool valid);
+  bool dmiReqReady () const;
+  void dmiRespReady (const bool ready);
+  bool dmiRespValid () const;
+  uint64_t dmiResp () const;
+
   // Delete the copy assignment operator
   VSim &operator= (const VSim &) = delete;
 
@@ -65,8 +90,17 @@ private:
   /// \brief Half period of the main clock in ticks
   vluint64_t mClkHalfPeriodTicks;
 
-  /// \brief Half period of the JTAG clock in ticks
-  vluint64_t mTckHalfPeriodTicks;
+  /// \brief Main clock half periods per JTAG clock half period
+  ///
+  /// Zero (VSim::TCK_ONLY) means one, but with the main clock held while
+  /// mHoldClk is set.
+  unsigned int mTckRatio;
+
+  /// \brief Main clock half periods since the JTAG clock last changed
+  unsigned int mTckPhase;
+
+  /// \brief Is the main clock held (TCK only mode)
+  bool mHoldClk;
 
   /// \brief Reset period in ticks
   vluint64_t mResetPeriodTicks;
@@ -82,6 +116,10 @@ private:
 
   /// \brief Are we at a TAP clock negedge
   bool mTckNegedge;
+
+  // Helper methods
+  template <bool VCD, bool UNTIL_DEBUG>
+  vluint64_t freeRun (const vluint64_t n);
 };
 
 #endif // VSIM_H